@@ -6,19 +6,267 @@
 #include <iomanip>
 #include <psapi.h>
 #include <thread>
+#include <chrono>
 #include <conio.h>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <map>
+#include <algorithm>
 
 // Global variables
 std::vector<DWORD> processIds;
 HANDLE currentProcessHandle = NULL;
 bool autoRefreshRunning = false;
 
+// Launch pool: keeps suspended, pre-created instances of one registered executable
+struct LaunchPool {
+    std::string commandLine;
+    size_t targetSize = 0;
+    std::deque<PROCESS_INFORMATION> ready;  // Suspended instances waiting to be handed out
+    std::mutex mutex;
+    std::condition_variable refillNeeded;
+    std::thread refillThread;
+    bool running = false;
+    DWORD lastSpawnError = 0;
+};
+LaunchPool launchPool;
+
+// Placement policy applied to every process whose executable name matches the filter
+struct ProcessPolicy {
+    std::string nameFilter;      // Case-insensitive substring of the executable name ("*" = all)
+    DWORD_PTR affinityMask = 0;  // 0 = leave unchanged
+    DWORD priorityClass = 0;     // 0 = leave unchanged
+    int ioPriority = -1;         // 0 = very low, 1 = low, 2 = normal, -1 = leave unchanged
+};
+std::vector<ProcessPolicy> governorPolicies;
+bool governorEnabled = false;
+std::map<DWORD, std::string> governedProcesses; // PID -> executable name already placed by the governor
+
+// Resource limits for launched processes (0 = unlimited)
+struct LaunchLimits {
+    DWORD cpuRatePercent = 0;   // Hard cap on CPU usage of the whole group
+    SIZE_T memoryLimitMb = 0;   // Committed memory of the whole group
+    DWORD maxProcesses = 0;     // Active processes in the group
+};
+
+// Job object grouping every process launched with one set of limits
+struct ResourceGroup {
+    std::string name;
+    HANDLE hJob;
+    LaunchLimits limits;
+};
+std::vector<ResourceGroup> resourceGroups;
+
+// Launched child whose exit is waited on by the thread pool
+struct TrackedChild {
+    DWORD processId;
+    std::string commandLine;
+    HANDLE hProcess;
+    HANDLE hWait;
+};
+
+// Exit code and runtime of a finished child
+struct ChildExitRecord {
+    DWORD processId;
+    std::string commandLine;
+    DWORD exitCode;
+    double runtimeMs;
+};
+
+// Exit-wait multiplexer: one thread-pool wait per child instead of a 64-handle WaitForMultipleObjects
+struct ExitWaitMultiplexer {
+    std::mutex mutex;
+    std::map<DWORD, TrackedChild*> running;
+    std::deque<ChildExitRecord> finished;   // Most recent exits, bounded by maxHistory
+    std::vector<ChildExitRecord> unreported; // Exits not yet announced by the menu loop
+    std::vector<TrackedChild*> retired;      // Exited children whose wait still has to be unregistered
+    size_t totalExited = 0;
+    static const size_t maxHistory = 1000;
+};
+ExitWaitMultiplexer exitWaiter;
+
+// Fixed-memory log-linear latency histogram (HDR-style, buckets within ~6% of their value)
+struct LatencyHistogram {
+    static const int subBucketBits = 5;
+    static const int subBucketCount = 1 << subBucketBits;
+    static const int halfSubBucketCount = subBucketCount / 2;
+    static const int bucketCount = subBucketCount + (64 - subBucketBits) * halfSubBucketCount;
+
+    unsigned long long counts[bucketCount] = {};
+    unsigned long long totalCount = 0;
+    unsigned long long maxValue = 0;
+};
+
+// Startup phases recorded for each profiled launch
+enum StartupPhase {
+    PhaseCreated,
+    PhaseFirstScheduled,
+    PhaseModulesLoaded,
+    PhaseFirstWindow,
+    PhaseFirstOutput,
+    PhaseExited,
+    StartupPhaseCount
+};
+
+const char* startupPhaseNames[StartupPhaseCount] = {
+    "Created", "First scheduled", "Modules loaded", "First window", "First output", "Exited"
+};
+
+// Aggregated startup latencies of one command line over repeated runs
+struct StartupProfile {
+    LatencyHistogram phases[StartupPhaseCount];
+    int runs = 0;
+    int timedOut = 0;
+};
+std::map<std::string, StartupProfile> startupProfiles;
+
 // Function to display WinAPI error
 void DisplayError(const std::string& message) {
     DWORD error = GetLastError();
     std::cout << message << " (Error code: " << error << ")" << std::endl;
 }
 
+// Thread-pool callback fired once when a tracked child exits
+VOID CALLBACK ChildExitCallback(PVOID context, BOOLEAN timedOut) {
+    // Waits are registered with INFINITE, so this cannot happen; should it, the child simply
+    // stays in the running list and is released by ShutdownExitWaiter
+    if (timedOut) return;
+
+    TrackedChild* child = (TrackedChild*)context;
+
+    ChildExitRecord record;
+    record.processId = child->processId;
+    record.commandLine = child->commandLine;
+    record.exitCode = 0;
+    record.runtimeMs = 0;
+    GetExitCodeProcess(child->hProcess, &record.exitCode);
+
+    FILETIME creationTime, exitTime, kernelTime, userTime;
+    if (GetProcessTimes(child->hProcess, &creationTime, &exitTime, &kernelTime, &userTime)) {
+        ULARGE_INTEGER created, exited;
+        created.LowPart = creationTime.dwLowDateTime;
+        created.HighPart = creationTime.dwHighDateTime;
+        exited.LowPart = exitTime.dwLowDateTime;
+        exited.HighPart = exitTime.dwHighDateTime;
+        record.runtimeMs = (exited.QuadPart - created.QuadPart) / 10000.0;
+    }
+
+    std::lock_guard<std::mutex> lock(exitWaiter.mutex);
+    exitWaiter.running.erase(child->processId);
+    exitWaiter.retired.push_back(child);
+    exitWaiter.totalExited++;
+
+    // Printed by the menu loop, so it never interleaves with the prompt or input
+    exitWaiter.unreported.push_back(record);
+    exitWaiter.finished.push_back(record);
+    if (exitWaiter.finished.size() > ExitWaitMultiplexer::maxHistory) {
+        exitWaiter.finished.pop_front();
+    }
+}
+
+// Announce children that exited since the last call (menu thread only)
+void ReportChildExits() {
+    std::vector<ChildExitRecord> exited;
+    {
+        std::lock_guard<std::mutex> lock(exitWaiter.mutex);
+        exited.swap(exitWaiter.unreported);
+    }
+
+    for (const ChildExitRecord& record : exited) {
+        std::cout << "[exit] PID " << record.processId << " (" << record.commandLine << ") exited with code "
+                  << record.exitCode << " after " << record.runtimeMs << " ms" << std::endl;
+    }
+}
+
+// Release waits and handles of children that have already exited
+void ReleaseRetiredChildren() {
+    std::vector<TrackedChild*> retired;
+    {
+        std::lock_guard<std::mutex> lock(exitWaiter.mutex);
+        retired.swap(exitWaiter.retired);
+    }
+
+    for (TrackedChild* child : retired) {
+        // Blocks only until the (already finishing) callback has returned
+        UnregisterWaitEx(child->hWait, INVALID_HANDLE_VALUE);
+        CloseHandle(child->hProcess);
+        delete child;
+    }
+}
+
+// Keep the process handle of a launched child and get notified when it exits
+void TrackChildProcess(HANDLE hProcess, DWORD processId, const std::string& commandLine) {
+    ReleaseRetiredChildren();
+
+    TrackedChild* child = new TrackedChild{processId, commandLine, hProcess, NULL};
+
+    std::lock_guard<std::mutex> lock(exitWaiter.mutex);
+    exitWaiter.running[processId] = child;
+
+    if (!RegisterWaitForSingleObject(&child->hWait, hProcess, ChildExitCallback, child,
+            INFINITE, WT_EXECUTEONLYONCE)) {
+        DisplayError("Failed to register exit wait");
+        exitWaiter.running.erase(processId);
+        CloseHandle(hProcess);
+        delete child;
+    }
+}
+
+// Cancel all exit waits (used on shutdown; children keep running)
+void ShutdownExitWaiter() {
+    ReleaseRetiredChildren();
+
+    std::vector<TrackedChild*> running;
+    {
+        std::lock_guard<std::mutex> lock(exitWaiter.mutex);
+        for (auto& entry : exitWaiter.running) {
+            running.push_back(entry.second);
+        }
+    }
+
+    for (TrackedChild* child : running) {
+        UnregisterWaitEx(child->hWait, INVALID_HANDLE_VALUE);
+    }
+
+    // Every wait is unregistered now; children that exited meanwhile sit in the retired list
+    std::lock_guard<std::mutex> lock(exitWaiter.mutex);
+    for (TrackedChild* child : exitWaiter.retired) {
+        CloseHandle(child->hProcess);
+        delete child;
+    }
+    for (auto& entry : exitWaiter.running) {
+        CloseHandle(entry.second->hProcess);
+        delete entry.second;
+    }
+    exitWaiter.retired.clear();
+    exitWaiter.running.clear();
+}
+
+// 15. Function to show launched children and their exit codes
+void ShowChildExits() {
+    ReleaseRetiredChildren();
+
+    std::lock_guard<std::mutex> lock(exitWaiter.mutex);
+    exitWaiter.unreported.clear(); // Listed below anyway
+
+    std::cout << "Running children: " << exitWaiter.running.size()
+              << ", exited: " << exitWaiter.totalExited << std::endl;
+
+    std::cout << std::left << std::setw(10) << "PID"
+              << std::setw(12) << "Exit Code"
+              << std::setw(14) << "Runtime (ms)"
+              << "Command Line" << std::endl;
+    std::cout << std::string(70, '-') << std::endl;
+
+    for (const ChildExitRecord& record : exitWaiter.finished) {
+        std::cout << std::left << std::setw(10) << record.processId
+                  << std::setw(12) << record.exitCode
+                  << std::setw(14) << record.runtimeMs
+                  << record.commandLine << std::endl;
+    }
+}
+
 // 1. Function to create a new process
 void CreateNewProcess(const std::string& processPath) {
     STARTUPINFO si;
@@ -56,12 +304,183 @@ void CreateNewProcess(const std::string& processPath) {
     std::cout << "Process ID: " << pi.dwProcessId << std::endl;
     std::cout << "Primary thread ID: " << pi.dwThreadId << std::endl;
 
-    // Close handles
-    CloseHandle(pi.hProcess);
+    // Keep the process handle to report the exit code, close the thread handle
+    TrackChildProcess(pi.hProcess, pi.dwProcessId, processPath);
     CloseHandle(pi.hThread);
     delete[] processPathCopy;
 }
 
+// Create a suspended instance of the given command line (main thread not yet running)
+bool SpawnSuspendedInstance(const std::string& commandLine, PROCESS_INFORMATION& pi) {
+    STARTUPINFO si;
+    ZeroMemory(&si, sizeof(si));
+    si.cb = sizeof(si);
+    ZeroMemory(&pi, sizeof(pi));
+
+    char* commandLineCopy = new char[commandLine.length() + 1];
+    strcpy_s(commandLineCopy, commandLine.length() + 1, commandLine.c_str());
+
+    BOOL created = CreateProcess(
+        NULL,
+        commandLineCopy,
+        NULL,
+        NULL,
+        FALSE,
+        CREATE_SUSPENDED, // Only process and image creation is paid now; loader and DLL init still run on ResumeThread
+        NULL,
+        NULL,
+        &si,
+        &pi
+    );
+
+    delete[] commandLineCopy;
+    return created != FALSE;
+}
+
+// Background thread that keeps the launch pool filled up to its target size
+void LaunchPoolRefillLoop() {
+    std::unique_lock<std::mutex> lock(launchPool.mutex);
+
+    while (launchPool.running) {
+        if (launchPool.ready.size() >= launchPool.targetSize) {
+            launchPool.refillNeeded.wait(lock);
+            continue;
+        }
+
+        // Create the process without holding the lock so hand-outs are never blocked
+        std::string commandLine = launchPool.commandLine;
+        lock.unlock();
+        PROCESS_INFORMATION pi;
+        bool created = SpawnSuspendedInstance(commandLine, pi);
+        DWORD error = created ? 0 : GetLastError();
+        lock.lock();
+
+        if (!created) {
+            // Back off instead of spinning on a broken path
+            launchPool.lastSpawnError = error;
+            launchPool.refillNeeded.wait_for(lock, std::chrono::seconds(1));
+            continue;
+        }
+
+        if (!launchPool.running || launchPool.commandLine != commandLine) {
+            TerminateProcess(pi.hProcess, 0);
+            CloseHandle(pi.hProcess);
+            CloseHandle(pi.hThread);
+            continue;
+        }
+
+        launchPool.lastSpawnError = 0;
+        launchPool.ready.push_back(pi);
+    }
+}
+
+// Stop the refill thread and discard all instances that were never handed out
+void ShutdownLaunchPool() {
+    {
+        std::lock_guard<std::mutex> lock(launchPool.mutex);
+        launchPool.running = false;
+    }
+    launchPool.refillNeeded.notify_all();
+
+    if (launchPool.refillThread.joinable()) {
+        launchPool.refillThread.join();
+    }
+
+    for (PROCESS_INFORMATION& pi : launchPool.ready) {
+        TerminateProcess(pi.hProcess, 0);
+        CloseHandle(pi.hProcess);
+        CloseHandle(pi.hThread);
+    }
+    launchPool.ready.clear();
+}
+
+// 9. Function to register an executable in the launch pool
+void RegisterLaunchPool(const std::string& commandLine, size_t poolSize) {
+    if (commandLine.empty() || poolSize == 0) {
+        std::cout << "Invalid executable path or pool size." << std::endl;
+        return;
+    }
+
+    ShutdownLaunchPool();
+
+    launchPool.commandLine = commandLine;
+    launchPool.targetSize = poolSize;
+    launchPool.lastSpawnError = 0;
+    launchPool.running = true;
+    launchPool.refillThread = std::thread(LaunchPoolRefillLoop);
+
+    std::cout << "Launch pool registered for: " << commandLine << std::endl;
+    std::cout << "Keeping " << poolSize << " suspended instance(s) ready." << std::endl;
+}
+
+// 10. Function to launch the registered executable from the pool
+void LaunchFromPool() {
+    PROCESS_INFORMATION pi;
+    bool fromPool = false;
+    std::string commandLine;
+    size_t remaining = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(launchPool.mutex);
+        if (!launchPool.running) {
+            std::cout << "No executable registered in the launch pool." << std::endl;
+            return;
+        }
+
+        commandLine = launchPool.commandLine;
+        if (!launchPool.ready.empty()) {
+            pi = launchPool.ready.front();
+            launchPool.ready.pop_front();
+            fromPool = true;
+        }
+        remaining = launchPool.ready.size();
+
+        if (launchPool.lastSpawnError != 0) {
+            std::cout << "Warning: pool refill is failing (Error code: " << launchPool.lastSpawnError << ")" << std::endl;
+        }
+    }
+    launchPool.refillNeeded.notify_one();
+
+    // Pool exhausted: pay the full creation cost once, and count it in the latency
+    LARGE_INTEGER frequency, start, created, end;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&start);
+    if (!fromPool && !SpawnSuspendedInstance(commandLine, pi)) {
+        DisplayError("Error creating process");
+        return;
+    }
+
+    QueryPerformanceCounter(&created);
+    DWORD resumeResult = ResumeThread(pi.hThread);
+    QueryPerformanceCounter(&end);
+
+    if (resumeResult == (DWORD)-1) {
+        DisplayError("Failed to resume pooled process");
+        TerminateProcess(pi.hProcess, 0);
+        CloseHandle(pi.hProcess);
+        CloseHandle(pi.hThread);
+        return;
+    }
+
+    double createMicroseconds = (created.QuadPart - start.QuadPart) * 1000000.0 / frequency.QuadPart;
+    double resumeMicroseconds = (end.QuadPart - created.QuadPart) * 1000000.0 / frequency.QuadPart;
+
+    std::cout << (fromPool ? "Process handed out from pool." : "Pool empty, process created on demand.") << std::endl;
+    std::cout << "Process ID: " << pi.dwProcessId << std::endl;
+    std::cout << std::fixed << std::setprecision(1);
+    if (fromPool) {
+        std::cout << "Launch latency: " << resumeMicroseconds << " us" << std::endl;
+    } else {
+        std::cout << "Launch latency: " << createMicroseconds + resumeMicroseconds << " us (creation " <<
+            createMicroseconds << " us, resume " << resumeMicroseconds << " us)" << std::endl;
+    }
+    std::cout.unsetf(std::ios::fixed);
+    std::cout << "Instances left in pool: " << remaining << std::endl;
+
+    TrackChildProcess(pi.hProcess, pi.dwProcessId, commandLine);
+    CloseHandle(pi.hThread);
+}
+
 // 2. Function to list all processes
 void ListAllProcesses() {
     HANDLE hSnapshot = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
@@ -104,6 +523,559 @@ void ListAllProcesses() {
     CloseHandle(hSnapshot);
 }
 
+// Check whether an executable name matches a policy filter
+bool MatchesProcessFilter(const std::string& exeName, const std::string& filter) {
+    if (filter.empty() || filter == "*") return true;
+
+    auto it = std::search(exeName.begin(), exeName.end(), filter.begin(), filter.end(),
+        [](char a, char b) { return tolower((unsigned char)a) == tolower((unsigned char)b); });
+    return it != exeName.end();
+}
+
+// Set I/O priority through ntdll (there is no documented Win32 call for other processes).
+// Returns a Win32 error code; the NTSTATUS is translated, since it never sets the last error.
+DWORD SetProcessIoPriority(HANDLE hProcess, int ioPriority) {
+    typedef LONG (NTAPI *NtSetInformationProcessFn)(HANDLE, ULONG, PVOID, ULONG);
+    typedef ULONG (NTAPI *RtlNtStatusToDosErrorFn)(LONG);
+    const ULONG ProcessIoPriority = 33;
+
+    HMODULE ntdll = GetModuleHandleA("ntdll.dll");
+    static NtSetInformationProcessFn ntSetInformationProcess =
+        (NtSetInformationProcessFn)GetProcAddress(ntdll, "NtSetInformationProcess");
+    static RtlNtStatusToDosErrorFn rtlNtStatusToDosError =
+        (RtlNtStatusToDosErrorFn)GetProcAddress(ntdll, "RtlNtStatusToDosError");
+    if (ntSetInformationProcess == NULL || rtlNtStatusToDosError == NULL) return ERROR_PROC_NOT_FOUND;
+
+    ULONG value = (ULONG)ioPriority;
+    LONG status = ntSetInformationProcess(hProcess, ProcessIoPriority, &value, sizeof(value));
+    return status >= 0 ? ERROR_SUCCESS : rtlNtStatusToDosError(status);
+}
+
+// Apply affinity, priority class and I/O priority of a policy to one process.
+// Returns ERROR_SUCCESS or the error of the first step that failed.
+DWORD ApplyPolicyToProcess(DWORD processId, const ProcessPolicy& policy) {
+    HANDLE hProcess = OpenProcess(PROCESS_SET_INFORMATION | PROCESS_QUERY_LIMITED_INFORMATION, FALSE, processId);
+    if (hProcess == NULL) {
+        return GetLastError();
+    }
+
+    DWORD error = ERROR_SUCCESS;
+    if (policy.affinityMask != 0 && !SetProcessAffinityMask(hProcess, policy.affinityMask)) {
+        error = GetLastError();
+    }
+    if (policy.priorityClass != 0 && !SetPriorityClass(hProcess, policy.priorityClass) && error == ERROR_SUCCESS) {
+        error = GetLastError();
+    }
+    if (policy.ioPriority >= 0) {
+        DWORD ioError = SetProcessIoPriority(hProcess, policy.ioPriority);
+        if (error == ERROR_SUCCESS) error = ioError;
+    }
+
+    CloseHandle(hProcess);
+    return error;
+}
+
+// Apply a policy to every running process that matches its filter
+void ApplyProcessPolicy(const ProcessPolicy& policy) {
+    HANDLE hSnapshot = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
+    if (hSnapshot == INVALID_HANDLE_VALUE) {
+        DisplayError("Failed to create process snapshot");
+        return;
+    }
+
+    PROCESSENTRY32 pe32;
+    pe32.dwSize = sizeof(PROCESSENTRY32);
+
+    int matched = 0;
+    int applied = 0;
+    if (Process32First(hSnapshot, &pe32)) {
+        do {
+            if (pe32.th32ProcessID == 0 || !MatchesProcessFilter(pe32.szExeFile, policy.nameFilter)) {
+                continue;
+            }
+            matched++;
+            DWORD error = ApplyPolicyToProcess(pe32.th32ProcessID, policy);
+            if (error == ERROR_SUCCESS) {
+                applied++;
+            } else {
+                std::cout << "Failed to place " << pe32.szExeFile << " (PID " << pe32.th32ProcessID
+                          << ", Error code: " << error << ")" << std::endl;
+            }
+        } while (Process32Next(hSnapshot, &pe32));
+    }
+
+    CloseHandle(hSnapshot);
+    std::cout << "Policy applied to " << applied << " of " << matched << " matching process(es)." << std::endl;
+}
+
+// Governor pass: place processes that appeared since the previous refresh
+void ApplyGovernorPolicies() {
+    if (!governorEnabled || governorPolicies.empty()) return;
+
+    HANDLE hSnapshot = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
+    if (hSnapshot == INVALID_HANDLE_VALUE) return;
+
+    PROCESSENTRY32 pe32;
+    pe32.dwSize = sizeof(PROCESSENTRY32);
+
+    std::map<DWORD, std::string> seen;
+    int placed = 0;
+    if (Process32First(hSnapshot, &pe32)) {
+        do {
+            DWORD processId = pe32.th32ProcessID;
+
+            // Skip processes already placed (a reused PID shows up with a different name)
+            auto known = governedProcesses.find(processId);
+            if (known != governedProcesses.end() && known->second == pe32.szExeFile) {
+                seen[processId] = pe32.szExeFile;
+                continue;
+            }
+
+            bool failed = false;
+            for (const ProcessPolicy& policy : governorPolicies) {
+                if (processId == 0 || !MatchesProcessFilter(pe32.szExeFile, policy.nameFilter)) continue;
+                if (ApplyPolicyToProcess(processId, policy) == ERROR_SUCCESS) {
+                    placed++;
+                } else {
+                    failed = true;
+                }
+            }
+
+            // A process still starting up, or denied this time, is tried again on the next refresh
+            if (!failed) seen[processId] = pe32.szExeFile;
+        } while (Process32Next(hSnapshot, &pe32));
+    }
+
+    CloseHandle(hSnapshot);
+
+    // Forget exited processes so the table does not grow forever
+    governedProcesses.swap(seen);
+
+    if (placed > 0) {
+        std::cout << "Governor placed " << placed << " new process(es)." << std::endl;
+    }
+}
+
+// 11. Function to set affinity and priority for all processes matching a filter
+void SetPolicyForMatchingProcesses() {
+    static const DWORD priorityClasses[] = {
+        0, IDLE_PRIORITY_CLASS, BELOW_NORMAL_PRIORITY_CLASS, NORMAL_PRIORITY_CLASS,
+        ABOVE_NORMAL_PRIORITY_CLASS, HIGH_PRIORITY_CLASS
+    };
+
+    ProcessPolicy policy;
+    std::string affinityText;
+    int priorityChoice;
+    char addToGovernor;
+
+    std::cout << "Enter process name filter (* for all): ";
+    std::getline(std::cin, policy.nameFilter);
+    std::cout << "Enter CPU affinity mask in hex (0 to keep): ";
+    std::getline(std::cin, affinityText);
+    policy.affinityMask = (DWORD_PTR)strtoull(affinityText.c_str(), NULL, 16);
+    std::cout << "Priority (0 keep, 1 idle, 2 below normal, 3 normal, 4 above normal, 5 high): ";
+    std::cin >> priorityChoice;
+    std::cout << "I/O priority (-1 keep, 0 very low, 1 low, 2 normal): ";
+    std::cin >> policy.ioPriority;
+    std::cout << "Keep applying to new processes (governor)? (y/n): ";
+    std::cin >> addToGovernor;
+
+    if (priorityChoice > 0 && priorityChoice < (int)(sizeof(priorityClasses) / sizeof(priorityClasses[0]))) {
+        policy.priorityClass = priorityClasses[priorityChoice];
+    }
+    if (policy.ioPriority > 2) {
+        policy.ioPriority = 2;
+    }
+
+    ApplyProcessPolicy(policy);
+
+    if (addToGovernor == 'y' || addToGovernor == 'Y') {
+        governorPolicies.push_back(policy);
+        governorEnabled = true;
+        std::cout << "Policy added to governor (" << governorPolicies.size() << " active)." << std::endl;
+    }
+}
+
+// 12. Function to toggle governor mode
+void ToggleGovernor() {
+    governorEnabled = !governorEnabled;
+    std::cout << "Governor mode " << (governorEnabled ? "enabled" : "disabled") << "." << std::endl;
+
+    for (size_t i = 0; i < governorPolicies.size(); i++) {
+        const ProcessPolicy& policy = governorPolicies[i];
+        std::cout << "  Policy " << i << ": filter \"" << policy.nameFilter << "\""
+                  << ", affinity " << std::hex << std::showbase << policy.affinityMask << std::dec << std::noshowbase
+                  << ", priority class " << policy.priorityClass
+                  << ", I/O priority " << policy.ioPriority << std::endl;
+    }
+
+    if (governorEnabled) {
+        governedProcesses.clear(); // Re-place everything on the next refresh
+        ApplyGovernorPolicies();
+    }
+}
+
+// Create a job object enforcing the given limits
+HANDLE CreateLimitedJob(const LaunchLimits& limits) {
+    HANDLE hJob = CreateJobObject(NULL, NULL);
+    if (hJob == NULL) {
+        DisplayError("Failed to create job object");
+        return NULL;
+    }
+
+    JOBOBJECT_EXTENDED_LIMIT_INFORMATION extendedLimits;
+    ZeroMemory(&extendedLimits, sizeof(extendedLimits));
+    if (limits.memoryLimitMb != 0) {
+        extendedLimits.BasicLimitInformation.LimitFlags |= JOB_OBJECT_LIMIT_JOB_MEMORY;
+        extendedLimits.JobMemoryLimit = limits.memoryLimitMb * 1024 * 1024;
+    }
+    if (limits.maxProcesses != 0) {
+        extendedLimits.BasicLimitInformation.LimitFlags |= JOB_OBJECT_LIMIT_ACTIVE_PROCESS;
+        extendedLimits.BasicLimitInformation.ActiveProcessLimit = limits.maxProcesses;
+    }
+
+    if (extendedLimits.BasicLimitInformation.LimitFlags != 0 &&
+        !SetInformationJobObject(hJob, JobObjectExtendedLimitInformation, &extendedLimits, sizeof(extendedLimits))) {
+        DisplayError("Failed to set job memory/process limits");
+        CloseHandle(hJob);
+        return NULL;
+    }
+
+    if (limits.cpuRatePercent != 0) {
+        JOBOBJECT_CPU_RATE_CONTROL_INFORMATION cpuRate;
+        ZeroMemory(&cpuRate, sizeof(cpuRate));
+        cpuRate.ControlFlags = JOB_OBJECT_CPU_RATE_CONTROL_ENABLE | JOB_OBJECT_CPU_RATE_CONTROL_HARD_CAP;
+        cpuRate.CpuRate = limits.cpuRatePercent * 100; // In 1/100 of a percent
+
+        if (!SetInformationJobObject(hJob, JobObjectCpuRateControlInformation, &cpuRate, sizeof(cpuRate))) {
+            DisplayError("Failed to set job CPU rate limit");
+            CloseHandle(hJob);
+            return NULL;
+        }
+    }
+
+    return hJob;
+}
+
+// 13. Function to launch a process inside a resource-limited group
+void CreateProcessWithLimits(const std::string& commandLine, const std::string& groupName, const LaunchLimits& limits) {
+    ResourceGroup* group = NULL;
+    for (ResourceGroup& existing : resourceGroups) {
+        if (existing.name == groupName) {
+            group = &existing;
+            break;
+        }
+    }
+
+    if (group == NULL) {
+        HANDLE hJob = CreateLimitedJob(limits);
+        if (hJob == NULL) return;
+
+        resourceGroups.push_back({groupName, hJob, limits});
+        group = &resourceGroups.back();
+        std::cout << "Resource group \"" << groupName << "\" created." << std::endl;
+    }
+
+    // Start suspended so the process cannot run (or spawn children) outside the job
+    PROCESS_INFORMATION pi;
+    if (!SpawnSuspendedInstance(commandLine, pi)) {
+        DisplayError("Error creating process");
+        return;
+    }
+
+    if (!AssignProcessToJobObject(group->hJob, pi.hProcess)) {
+        DisplayError("Failed to assign process to resource group");
+        TerminateProcess(pi.hProcess, 0);
+        CloseHandle(pi.hProcess);
+        CloseHandle(pi.hThread);
+        return;
+    }
+
+    ResumeThread(pi.hThread);
+
+    std::cout << "Process created successfully in group \"" << group->name << "\"!" << std::endl;
+    std::cout << "Process ID: " << pi.dwProcessId << std::endl;
+
+    TrackChildProcess(pi.hProcess, pi.dwProcessId, commandLine);
+    CloseHandle(pi.hThread);
+}
+
+// 14. Function to show aggregate accounting of every resource group
+void ShowResourceGroupAccounting() {
+    if (resourceGroups.empty()) {
+        std::cout << "No resource groups created yet." << std::endl;
+        return;
+    }
+
+    std::cout << std::left << std::setw(20) << "Group"
+              << std::setw(10) << "Active"
+              << std::setw(10) << "Total"
+              << std::setw(14) << "CPU (ms)"
+              << std::setw(14) << "Read (KB)"
+              << std::setw(14) << "Write (KB)"
+              << std::setw(16) << "Peak Mem (MB)" << std::endl;
+    std::cout << std::string(98, '-') << std::endl;
+
+    for (const ResourceGroup& group : resourceGroups) {
+        // Group-wide totals, not summed per process: one query for CPU, process and I/O counts,
+        // and one for peak memory, which only the extended limit information reports
+        JOBOBJECT_BASIC_AND_IO_ACCOUNTING_INFORMATION accounting;
+        JOBOBJECT_EXTENDED_LIMIT_INFORMATION extendedLimits;
+
+        if (!QueryInformationJobObject(group.hJob, JobObjectBasicAndIoAccountingInformation,
+                &accounting, sizeof(accounting), NULL) ||
+            !QueryInformationJobObject(group.hJob, JobObjectExtendedLimitInformation,
+                &extendedLimits, sizeof(extendedLimits), NULL)) {
+            DisplayError("Failed to query resource group " + group.name);
+            continue;
+        }
+
+        ULONGLONG cpuTime = accounting.BasicInfo.TotalUserTime.QuadPart + accounting.BasicInfo.TotalKernelTime.QuadPart;
+
+        std::cout << std::left << std::setw(20) << group.name
+                  << std::setw(10) << accounting.BasicInfo.ActiveProcesses
+                  << std::setw(10) << accounting.BasicInfo.TotalProcesses
+                  << std::setw(14) << cpuTime / 10000
+                  << std::setw(14) << accounting.IoInfo.ReadTransferCount / 1024
+                  << std::setw(14) << accounting.IoInfo.WriteTransferCount / 1024
+                  << std::setw(16) << extendedLimits.PeakJobMemoryUsed / (1024 * 1024) << std::endl;
+    }
+}
+
+// Histogram bucket holding a value (exact below subBucketCount, log-linear above)
+int HistogramBucketIndex(unsigned long long value) {
+    if (value < LatencyHistogram::subBucketCount) return (int)value;
+
+    int highestBit = 63;
+    while (!(value >> highestBit)) highestBit--;
+
+    int shift = highestBit - LatencyHistogram::subBucketBits + 1;
+    int top = (int)(value >> shift); // In [halfSubBucketCount, subBucketCount)
+    return LatencyHistogram::subBucketCount + (shift - 1) * LatencyHistogram::halfSubBucketCount
+        + (top - LatencyHistogram::halfSubBucketCount);
+}
+
+// Largest value that falls into a histogram bucket
+unsigned long long HistogramBucketUpperBound(int index) {
+    if (index < LatencyHistogram::subBucketCount) return index;
+
+    int offset = index - LatencyHistogram::subBucketCount;
+    int shift = offset / LatencyHistogram::halfSubBucketCount + 1;
+    unsigned long long top = offset % LatencyHistogram::halfSubBucketCount + LatencyHistogram::halfSubBucketCount;
+    return ((top + 1) << shift) - 1;
+}
+
+void RecordLatency(LatencyHistogram& histogram, unsigned long long microseconds) {
+    histogram.counts[HistogramBucketIndex(microseconds)]++;
+    histogram.totalCount++;
+    if (microseconds > histogram.maxValue) {
+        histogram.maxValue = microseconds;
+    }
+}
+
+unsigned long long LatencyAtPercentile(const LatencyHistogram& histogram, double percentile) {
+    if (histogram.totalCount == 0) return 0;
+
+    unsigned long long target = (unsigned long long)(percentile / 100.0 * histogram.totalCount + 0.5);
+    if (target < 1) target = 1;
+
+    unsigned long long seen = 0;
+    for (int i = 0; i < LatencyHistogram::bucketCount; i++) {
+        seen += histogram.counts[i];
+        if (seen >= target) {
+            return std::min(HistogramBucketUpperBound(i), histogram.maxValue);
+        }
+    }
+    return histogram.maxValue;
+}
+
+// Window enumeration state used to detect the first visible window of a process
+struct ProcessWindowSearch {
+    DWORD processId;
+    bool found;
+};
+
+BOOL CALLBACK FindVisibleProcessWindow(HWND hwnd, LPARAM lParam) {
+    ProcessWindowSearch* search = (ProcessWindowSearch*)lParam;
+    DWORD windowProcessId = 0;
+    GetWindowThreadProcessId(hwnd, &windowProcessId);
+    if (windowProcessId == search->processId && IsWindowVisible(hwnd)) {
+        search->found = true;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// Launch once and record when each startup phase was first observed (microseconds since create).
+// A run ends when the child is ready (first window or first output) or exits; a program that
+// never exits, such as a service or GUI, is then terminated. False if neither happened in time.
+bool ProfileSingleLaunch(const std::string& commandLine, unsigned long long phaseTimes[StartupPhaseCount], DWORD timeoutMs) {
+    for (int i = 0; i < StartupPhaseCount; i++) {
+        phaseTimes[i] = (unsigned long long)-1;
+    }
+
+    // Capture stdout/stderr through a pipe so the first output byte can be observed
+    SECURITY_ATTRIBUTES sa = {sizeof(SECURITY_ATTRIBUTES), NULL, TRUE};
+    HANDLE hReadPipe, hWritePipe;
+    if (!CreatePipe(&hReadPipe, &hWritePipe, &sa, 0)) {
+        DisplayError("Failed to create output pipe");
+        return false;
+    }
+    SetHandleInformation(hReadPipe, HANDLE_FLAG_INHERIT, 0);
+
+    STARTUPINFO si;
+    PROCESS_INFORMATION pi;
+    ZeroMemory(&si, sizeof(si));
+    si.cb = sizeof(si);
+    si.dwFlags = STARTF_USESTDHANDLES;
+    si.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+    si.hStdOutput = hWritePipe;
+    si.hStdError = hWritePipe;
+    ZeroMemory(&pi, sizeof(pi));
+
+    char* commandLineCopy = new char[commandLine.length() + 1];
+    strcpy_s(commandLineCopy, commandLine.length() + 1, commandLine.c_str());
+
+    LARGE_INTEGER frequency, start, now;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&start);
+
+    BOOL created = CreateProcess(NULL, commandLineCopy, NULL, NULL, TRUE, CREATE_SUSPENDED,
+        NULL, NULL, &si, &pi);
+    delete[] commandLineCopy;
+    CloseHandle(hWritePipe); // The child holds the only write end now
+
+    if (!created) {
+        DisplayError("Error creating process");
+        CloseHandle(hReadPipe);
+        return false;
+    }
+
+    auto elapsedMicroseconds = [&]() {
+        QueryPerformanceCounter(&now);
+        return (unsigned long long)((now.QuadPart - start.QuadPart) * 1000000 / frequency.QuadPart);
+    };
+
+    phaseTimes[PhaseCreated] = elapsedMicroseconds();
+    ResumeThread(pi.hThread);
+
+    bool finished = false;
+    unsigned long long lastWindowCheck = 0;
+    char drain[4096];
+
+    while (!finished) {
+        unsigned long long elapsed = elapsedMicroseconds();
+        if (elapsed > (unsigned long long)timeoutMs * 1000) break;
+
+        if (phaseTimes[PhaseFirstScheduled] == (unsigned long long)-1) {
+            ULONG64 cycles = 0;
+            if (QueryThreadCycleTime(pi.hThread, &cycles) && cycles > 0) {
+                phaseTimes[PhaseFirstScheduled] = elapsed;
+            }
+        }
+
+        if (phaseTimes[PhaseModulesLoaded] == (unsigned long long)-1) {
+            HMODULE mainModule;
+            DWORD cbNeeded;
+            // Fails until the loader has published the module list
+            if (EnumProcessModules(pi.hProcess, &mainModule, sizeof(mainModule), &cbNeeded)) {
+                phaseTimes[PhaseModulesLoaded] = elapsed;
+            }
+        }
+
+        // Window enumeration is expensive, check it every 5 ms
+        if (phaseTimes[PhaseFirstWindow] == (unsigned long long)-1 && elapsed - lastWindowCheck >= 5000) {
+            ProcessWindowSearch search = {pi.dwProcessId, false};
+            EnumWindows(FindVisibleProcessWindow, (LPARAM)&search);
+            if (search.found) {
+                phaseTimes[PhaseFirstWindow] = elapsed;
+            }
+            lastWindowCheck = elapsed;
+        }
+
+        // Drain output so the child never blocks on a full pipe
+        DWORD available = 0;
+        if (PeekNamedPipe(hReadPipe, NULL, 0, NULL, &available, NULL) && available > 0) {
+            if (phaseTimes[PhaseFirstOutput] == (unsigned long long)-1) {
+                phaseTimes[PhaseFirstOutput] = elapsed;
+            }
+            DWORD bytesRead;
+            ReadFile(hReadPipe, drain, std::min<DWORD>(available, sizeof(drain)), &bytesRead, NULL);
+        }
+
+        if (phaseTimes[PhaseFirstWindow] != (unsigned long long)-1 ||
+            phaseTimes[PhaseFirstOutput] != (unsigned long long)-1) {
+            finished = true;
+            break;
+        }
+
+        // Short wait between polls; returns at once when the child exits
+        if (WaitForSingleObject(pi.hProcess, 1) == WAIT_OBJECT_0) {
+            phaseTimes[PhaseExited] = elapsedMicroseconds();
+            finished = true;
+        }
+    }
+
+    if (phaseTimes[PhaseExited] == (unsigned long long)-1) {
+        TerminateProcess(pi.hProcess, 1);
+        WaitForSingleObject(pi.hProcess, 5000); // So the next run does not overlap this one
+    }
+
+    CloseHandle(hReadPipe);
+    CloseHandle(pi.hProcess);
+    CloseHandle(pi.hThread);
+    return finished;
+}
+
+// 16. Function to profile process startup over repeated runs
+void ProfileProcessStartup(const std::string& commandLine, int runs, DWORD timeoutMs) {
+    if (commandLine.empty() || runs <= 0) {
+        std::cout << "Invalid executable path or run count." << std::endl;
+        return;
+    }
+
+    StartupProfile& profile = startupProfiles[commandLine];
+    std::cout << "Profiling " << runs << " launch(es) of: " << commandLine << std::endl;
+
+    for (int run = 0; run < runs; run++) {
+        unsigned long long phaseTimes[StartupPhaseCount];
+        bool finished = ProfileSingleLaunch(commandLine, phaseTimes, timeoutMs);
+
+        if (!finished) {
+            profile.timedOut++;
+            if (phaseTimes[PhaseCreated] == (unsigned long long)-1) break; // Could not launch at all
+        }
+
+        for (int phase = 0; phase < StartupPhaseCount; phase++) {
+            if (phaseTimes[phase] != (unsigned long long)-1) {
+                RecordLatency(profile.phases[phase], phaseTimes[phase]);
+            }
+        }
+        profile.runs++;
+    }
+
+    // Percentiles over every run of this command line so far
+    std::cout << "Startup latency in microseconds over " << profile.runs << " run(s)"
+              << " (" << profile.timedOut << " timed out):" << std::endl;
+    std::cout << std::left << std::setw(18) << "Phase"
+              << std::setw(10) << "Samples"
+              << std::setw(12) << "p50"
+              << std::setw(12) << "p90"
+              << std::setw(12) << "p99"
+              << std::setw(12) << "Max" << std::endl;
+    std::cout << std::string(76, '-') << std::endl;
+
+    for (int phase = 0; phase < StartupPhaseCount; phase++) {
+        const LatencyHistogram& histogram = profile.phases[phase];
+        std::cout << std::left << std::setw(18) << startupPhaseNames[phase]
+                  << std::setw(10) << histogram.totalCount
+                  << std::setw(12) << LatencyAtPercentile(histogram, 50)
+                  << std::setw(12) << LatencyAtPercentile(histogram, 90)
+                  << std::setw(12) << LatencyAtPercentile(histogram, 99)
+                  << std::setw(12) << histogram.maxValue << std::endl;
+    }
+}
+
 // Function to automatically refresh the process list at regular intervals
 void AutoRefreshProcesses() {
     std::cout << "Starting automatic refresh of process list. Press any key to stop." << std::endl;
@@ -126,6 +1098,7 @@ void AutoRefreshProcesses() {
         system("cls"); // Clear screen
         std::cout << "Automatic process list refresh (press any key to stop)" << std::endl;
         ListAllProcesses(); // List all processes
+        ApplyGovernorPolicies(); // Place processes that appeared since the last refresh
         Sleep(2000); // Wait 2 seconds before next refresh
     }
 
@@ -308,8 +1281,8 @@ void StartProcessWithParameters(const std::string& processPath, const std::strin
     std::cout << "Process created successfully!" << std::endl;
     std::cout << "Process ID: " << pi.dwProcessId << std::endl;
 
-    // Close handles
-    CloseHandle(pi.hProcess);
+    // Keep the process handle to report the exit code, close the thread handle
+    TrackChildProcess(pi.hProcess, pi.dwProcessId, commandLine);
     CloseHandle(pi.hThread);
     delete[] commandLineCopy;
 }
@@ -380,6 +1353,14 @@ void ShowMenu() {
     std::cout << "6. Show process modules\n";
     std::cout << "7. Launch process with parameters\n";
     std::cout << "8. Create a new thread in selected process (Group 1 additional task)\n";
+    std::cout << "9. Register executable in launch pool\n";
+    std::cout << "10. Launch process from pool\n";
+    std::cout << "11. Set affinity/priority for matching processes\n";
+    std::cout << "12. Toggle affinity/priority governor\n";
+    std::cout << "13. Launch process with resource limits\n";
+    std::cout << "14. Show resource group accounting\n";
+    std::cout << "15. Show launched children and exit codes\n";
+    std::cout << "16. Profile process startup latency\n";
     std::cout << "0. Exit\n";
     std::cout << "Enter your choice: ";
 }
@@ -389,6 +1370,7 @@ int main() {
     bool running = true;
 
     while (running) {
+        ReportChildExits();
         ShowMenu();
         std::cin >> choice;
         std::cin.ignore(); // Clear input buffer
@@ -403,6 +1385,7 @@ int main() {
             }
             case 2:
                 ListAllProcesses();
+                ApplyGovernorPolicies();
                 break;
             case 3:
                 AutoRefreshProcesses();
@@ -440,6 +1423,64 @@ int main() {
             case 8:
                 CreateThreadInProcess();
                 break;
+            case 9: {
+                std::string processPath;
+                int poolSize;
+                std::cout << "Enter path to executable file: ";
+                std::getline(std::cin, processPath);
+                std::cout << "Enter number of instances to keep ready: ";
+                std::cin >> poolSize;
+                RegisterLaunchPool(processPath, poolSize > 0 ? poolSize : 0);
+                break;
+            }
+            case 10:
+                LaunchFromPool();
+                break;
+            case 11:
+                SetPolicyForMatchingProcesses();
+                break;
+            case 12:
+                ToggleGovernor();
+                break;
+            case 13: {
+                std::string processPath, groupName;
+                LaunchLimits limits;
+                std::cout << "Enter path to executable file: ";
+                std::getline(std::cin, processPath);
+                std::cout << "Enter resource group name: ";
+                std::getline(std::cin, groupName);
+                std::cout << "Limits apply only when the group is new.\n";
+                std::cout << "CPU rate limit in percent (0 = unlimited): ";
+                std::cin >> limits.cpuRatePercent;
+                std::cout << "Memory limit in MB (0 = unlimited): ";
+                std::cin >> limits.memoryLimitMb;
+                std::cout << "Maximum active processes (0 = unlimited): ";
+                std::cin >> limits.maxProcesses;
+                if (limits.cpuRatePercent > 100) {
+                    limits.cpuRatePercent = 100;
+                }
+                CreateProcessWithLimits(processPath, groupName, limits);
+                break;
+            }
+            case 14:
+                ShowResourceGroupAccounting();
+                break;
+            case 15:
+                ShowChildExits();
+                break;
+            case 16: {
+                std::string processPath;
+                int runs;
+                DWORD timeoutSeconds;
+                std::cout << "Enter path to executable file: ";
+                std::getline(std::cin, processPath);
+                std::cout << "Enter number of runs: ";
+                std::cin >> runs;
+                std::cout << "Enter timeout per run in seconds: ";
+                std::cin >> timeoutSeconds;
+                ProfileProcessStartup(processPath, runs, timeoutSeconds * 1000);
+                break;
+            }
             case 0:
                 running = false;
                 break;
@@ -462,5 +1503,16 @@ int main() {
     // Ensure auto-refresh is stopped if running
     autoRefreshRunning = false;
 
+    // Discard pre-created instances that were never used
+    ShutdownLaunchPool();
+
+    // Stop waiting for launched children
+    ShutdownExitWaiter();
+
+    // Release resource groups (processes keep running under their limits)
+    for (ResourceGroup& group : resourceGroups) {
+        CloseHandle(group.hJob);
+    }
+
     return 0;
 }
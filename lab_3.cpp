@@ -1,14 +1,47 @@
 #include <windows.h>
 #include <commctrl.h>
 #include <commdlg.h>
+#include <psapi.h>
+#include <ktmw32.h>
 #include <string>
 #include <vector>
 #include <fstream>
 #include <sstream>
+#include <iostream>
 #include <map>
+#include <deque>
+#include <list>
+#include <memory>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
+#include <shared_mutex>
+#include <string_view>
+#include <cstdint>
+#include <cstdio>
+#include <cerrno>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <regex>
+#include <cctype>
+#include <cmath>
+#include <chrono>
+#include <new>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define REG_SCAN_SSE2 1
+#else
+#define REG_SCAN_SSE2 0
+#endif
 
 #pragma comment(lib, "comctl32.lib")
 #pragma comment(lib, "comdlg32.lib")
+#pragma comment(lib, "ktmw32.lib")
+#pragma comment(lib, "psapi.lib")
 
 // Resource IDs
 #define IDC_TREE_REGISTRY      1001
@@ -26,6 +59,31 @@
 #define IDC_STATUS_BAR         1013
 #define IDC_COMBO_ROOT_KEY     1014
 #define IDC_BUTTON_CHECK_KEY   1015
+#define IDC_BUTTON_OPEN_HIVE   1016
+#define IDC_BUTTON_LIVE_REGISTRY 1017
+#define IDC_EDIT_FIND          1018
+#define IDC_CHECK_REGEX        1019
+#define IDC_BUTTON_FIND        1020
+#define IDC_BUTTON_BUILD_INDEX 1021
+#define IDC_BUTTON_DIFF        1022
+#define IDC_BUTTON_CANCEL      1023
+#define IDC_CHECK_SIZES        1024
+#define IDC_EDIT_REPLACE       1025
+#define IDC_BUTTON_REPLACE     1026
+
+// Posted by the view cache when the backend reports changed keys
+#define WM_REGISTRY_CHANGED    (WM_APP + 1)
+// Posted by the background key deletion when it has finished
+#define WM_KEY_TREE_DELETED    (WM_APP + 2)
+// Posted by the registry I/O worker when it has results for the window
+#define WM_REGISTRY_LOADED     (WM_APP + 3)
+
+// Timer that refreshes the progress of a background key deletion
+#define IDT_KEY_DELETE_PROGRESS 1
+// Timer that refreshes the progress of a find-and-replace on the I/O worker
+#define IDT_REPLACE_PROGRESS 2
+// Timer that refreshes the progress of a save, import, comparison or hive load on the I/O worker
+#define IDT_FILE_PROGRESS 3
 
 // Global variables
 HWND hMainWindow;
@@ -36,725 +94,9411 @@ HWND hEditValueName;
 HWND hEditValueData;
 HWND hStatusBar;
 HWND hComboRootKey;
+HWND hEditFind;
+HWND hCheckRegex;
+HWND hEditReplace;
+HWND hButtonCancel;
+HWND hCheckSizes;
 
 // Registry root keys structure
 struct RegistryRoot {
     HKEY hKey;
     const char* name;
     const char* displayName;
+    const char* shortName; // Abbreviation accepted on the command line
 };
 
 RegistryRoot rootKeys[] = {
-    {HKEY_CURRENT_USER, "HKEY_CURRENT_USER", "HKEY_CURRENT_USER"},
-    {HKEY_LOCAL_MACHINE, "HKEY_LOCAL_MACHINE", "HKEY_LOCAL_MACHINE"},
-    {HKEY_CLASSES_ROOT, "HKEY_CLASSES_ROOT", "HKEY_CLASSES_ROOT"},
-    {HKEY_USERS, "HKEY_USERS", "HKEY_USERS"},
-    {HKEY_CURRENT_CONFIG, "HKEY_CURRENT_CONFIG", "HKEY_CURRENT_CONFIG"}
+    {HKEY_CURRENT_USER, "HKEY_CURRENT_USER", "HKEY_CURRENT_USER", "HKCU"},
+    {HKEY_LOCAL_MACHINE, "HKEY_LOCAL_MACHINE", "HKEY_LOCAL_MACHINE", "HKLM"},
+    {HKEY_CLASSES_ROOT, "HKEY_CLASSES_ROOT", "HKEY_CLASSES_ROOT", "HKCR"},
+    {HKEY_USERS, "HKEY_USERS", "HKEY_USERS", "HKU"},
+    {HKEY_CURRENT_CONFIG, "HKEY_CURRENT_CONFIG", "HKEY_CURRENT_CONFIG", "HKCC"}
 };
 
 const int ROOT_KEYS_COUNT = sizeof(rootKeys) / sizeof(rootKeys[0]);
 
-// Function prototypes
-LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
-void InitializeControls(HWND hwnd);
-void PopulateTreeView();
-void PopulateRootKey(HTREEITEM hParent, HKEY hKey, const std::string& keyPath, int depth = 0);
-void OnTreeSelectionChanged();
-void PopulateValuesList(HKEY hKey, const std::string& keyPath);
-void CreateRegistryKey();
-void DeleteRegistryKey();
-void SetRegistryValue();
-void DeleteRegistryValue();
-void SaveRegistryToFile();
-void LoadRegistryFromFile();
-void UpdateStatusBar(const std::string& message);
-HKEY GetSelectedRootKey();
-std::string GetSelectedKeyPath();
-std::string GetWindowText(HWND hwnd);
-void SetWindowText(HWND hwnd, const std::string& text);
-void CheckKeyExists();
-bool KeyExists(HKEY rootKey, const std::string& keyPath);
-
-// Entry point
-int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow) {
-    // Initialize common controls
-    INITCOMMONCONTROLSEX icex;
-    icex.dwSize = sizeof(INITCOMMONCONTROLSEX);
-    icex.dwICC = ICC_TREEVIEW_CLASSES | ICC_LISTVIEW_CLASSES | ICC_BAR_CLASSES;
-    InitCommonControlsEx(&icex);
-
-    // Register window class
-    const char* className = "RegistryManagerWindow";
-    WNDCLASS wc = {};
-    wc.lpfnWndProc = WindowProc;
-    wc.hInstance = hInstance;
-    wc.lpszClassName = className;
-    wc.hbrBackground = (HBRUSH)(COLOR_WINDOW + 1);
-    wc.hCursor = LoadCursor(nullptr, IDC_ARROW);
-    wc.hIcon = LoadIcon(nullptr, IDI_APPLICATION);
-
-    RegisterClass(&wc);
+// Index of the lowest set bit of a non-zero mask
+inline unsigned CountTrailingZeros(unsigned mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (unsigned)index;
+#else
+    return (unsigned)__builtin_ctz(mask);
+#endif
+}
 
-    // Create main window
-    hMainWindow = CreateWindowEx(
-        0,
-        className,
-        "Windows Registry Manager - Lab 3 (Group 3)",
-        WS_OVERLAPPEDWINDOW,
-        CW_USEDEFAULT, CW_USEDEFAULT,
-        1200, 800,
-        nullptr, nullptr, hInstance, nullptr
-    );
+// Names and string data are kept as UTF-8 and converted to UTF-16 only at the Win32 boundary.
+// Runs of ASCII are converted 16 units per step with SSE2; everything else one code point at a
+// time. Unpaired surrogates are encoded like any other code unit (WTF-8), so every name read
+// from the registry converts back to exactly the same UTF-16.
 
-    if (!hMainWindow) {
-        MessageBox(nullptr, "Failed to create window!", "Error", MB_OK | MB_ICONERROR);
-        return -1;
+// Convert UTF-16 to UTF-8; dst must have room for 3 bytes per unit. Returns the bytes written.
+size_t Utf16ToUtf8(const wchar_t* src, size_t length, char* dst) {
+    const wchar_t* p = src;
+    const wchar_t* end = src + length;
+    char* out = dst;
+    while (p < end) {
+#if REG_SCAN_SSE2
+        // Both halves are packed and stored whole; only the leading ASCII units are kept
+        const __m128i highBits = _mm_set1_epi16((short)0xFF80);
+        const __m128i zero = _mm_setzero_si128();
+        while (end - p >= 16) {
+            __m128i a = _mm_loadu_si128((const __m128i*)p);
+            __m128i b = _mm_loadu_si128((const __m128i*)(p + 8));
+            __m128i asciiA = _mm_cmpeq_epi16(_mm_and_si128(a, highBits), zero);
+            __m128i asciiB = _mm_cmpeq_epi16(_mm_and_si128(b, highBits), zero);
+            unsigned nonAscii = ~(unsigned)_mm_movemask_epi8(_mm_packs_epi16(asciiA, asciiB)) & 0xFFFF;
+            _mm_storeu_si128((__m128i*)out, _mm_packus_epi16(a, b));
+            if (nonAscii) {
+                unsigned ascii = CountTrailingZeros(nonAscii);
+                p += ascii;
+                out += ascii;
+                break;
+            }
+            p += 16;
+            out += 16;
+        }
+        if (p == end) break;
+#endif
+        // Up to the next ASCII unit, where the vector loop can take over again
+        do {
+            unsigned c = (unsigned)(uint16_t)*p++;
+            if (c < 0x80) {
+                *out++ = (char)c;
+            } else if (c < 0x800) {
+                out[0] = (char)(0xC0 | (c >> 6));
+                out[1] = (char)(0x80 | (c & 0x3F));
+                out += 2;
+            } else if (c >= 0xD800 && c < 0xDC00 && p < end && (uint16_t)*p >= 0xDC00 && (uint16_t)*p < 0xE000) {
+                c = 0x10000 + ((c - 0xD800) << 10) + ((unsigned)(uint16_t)*p++ - 0xDC00);
+                out[0] = (char)(0xF0 | (c >> 18));
+                out[1] = (char)(0x80 | ((c >> 12) & 0x3F));
+                out[2] = (char)(0x80 | ((c >> 6) & 0x3F));
+                out[3] = (char)(0x80 | (c & 0x3F));
+                out += 4;
+            } else {
+                out[0] = (char)(0xE0 | (c >> 12));
+                out[1] = (char)(0x80 | ((c >> 6) & 0x3F));
+                out[2] = (char)(0x80 | (c & 0x3F));
+                out += 3;
+            }
+        } while (p < end && (uint16_t)*p >= 0x80);
     }
+    return (size_t)(out - dst);
+}
 
-    ShowWindow(hMainWindow, nCmdShow);
-    UpdateWindow(hMainWindow);
-
-    // Message loop
-    MSG msg = {};
-    while (GetMessage(&msg, nullptr, 0, 0)) {
-        TranslateMessage(&msg);
-        DispatchMessage(&msg);
+// Convert UTF-8 to UTF-16; dst must have room for one unit per byte. Returns the units written.
+// Each byte that does not start a valid sequence becomes U+FFFD.
+size_t Utf8ToUtf16(const char* src, size_t length, wchar_t* dst) {
+    const char* p = src;
+    const char* end = src + length;
+    wchar_t* out = dst;
+    while (p < end) {
+#if REG_SCAN_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        while (end - p >= 16) {
+            __m128i chunk = _mm_loadu_si128((const __m128i*)p);
+            unsigned nonAscii = (unsigned)_mm_movemask_epi8(chunk);
+            _mm_storeu_si128((__m128i*)out, _mm_unpacklo_epi8(chunk, zero));
+            _mm_storeu_si128((__m128i*)(out + 8), _mm_unpackhi_epi8(chunk, zero));
+            if (nonAscii) {
+                unsigned ascii = CountTrailingZeros(nonAscii);
+                p += ascii;
+                out += ascii;
+                break;
+            }
+            p += 16;
+            out += 16;
+        }
+        if (p == end) break;
+#endif
+        do {
+            unsigned c = (BYTE)p[0];
+            size_t left = (size_t)(end - p);
+            if (c < 0x80) {
+                *out++ = (wchar_t)c;
+                p++;
+                continue;
+            }
+            if (c >= 0xC2 && c <= 0xDF && left >= 2 && ((BYTE)p[1] & 0xC0) == 0x80) {
+                *out++ = (wchar_t)(((c & 0x1F) << 6) | ((BYTE)p[1] & 0x3F));
+                p += 2;
+                continue;
+            }
+            if ((c & 0xF0) == 0xE0 && left >= 3 && ((BYTE)p[1] & 0xC0) == 0x80 && ((BYTE)p[2] & 0xC0) == 0x80) {
+                c = ((c & 0x0F) << 12) | (((BYTE)p[1] & 0x3F) << 6) | ((BYTE)p[2] & 0x3F);
+                if (c >= 0x800) { // Not overlong; surrogates are let through (WTF-8)
+                    *out++ = (wchar_t)c;
+                    p += 3;
+                    continue;
+                }
+            } else if (c >= 0xF0 && c <= 0xF4 && left >= 4 && ((BYTE)p[1] & 0xC0) == 0x80 &&
+                       ((BYTE)p[2] & 0xC0) == 0x80 && ((BYTE)p[3] & 0xC0) == 0x80) {
+                c = ((c & 0x07) << 18) | (((BYTE)p[1] & 0x3F) << 12) | (((BYTE)p[2] & 0x3F) << 6) | ((BYTE)p[3] & 0x3F);
+                if (c >= 0x10000 && c <= 0x10FFFF) {
+                    c -= 0x10000;
+                    out[0] = (wchar_t)(0xD800 + (c >> 10));
+                    out[1] = (wchar_t)(0xDC00 + (c & 0x3FF));
+                    out += 2;
+                    p += 4;
+                    continue;
+                }
+            }
+            *out++ = (wchar_t)0xFFFD;
+            p++;
+        } while (p < end && ((BYTE)*p & 0x80));
     }
+    return (size_t)(out - dst);
+}
 
-    return 0;
+// Assign UTF-16 text to a string as UTF-8, reusing the string's buffer
+void AssignUtf8(std::string& result, const wchar_t* text, size_t length) {
+    result.resize(length * 3);
+    result.resize(Utf16ToUtf8(text, length, &result[0]));
 }
 
-// Window procedure
-LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
-    switch (uMsg) {
-    case WM_CREATE:
-        InitializeControls(hwnd);
-        PopulateTreeView();
-        UpdateStatusBar("Registry Manager initialized successfully");
-        break;
+std::string WideToUtf8(const wchar_t* text, size_t length) {
+    std::string result;
+    AssignUtf8(result, text, length);
+    return result;
+}
 
-    case WM_SIZE: {
-        RECT rect;
-        GetClientRect(hwnd, &rect);
-        int width = rect.right - rect.left;
-        int height = rect.bottom - rect.top;
+std::wstring Utf8ToWide(const std::string& text) {
+    std::wstring result(text.size(), L'\0');
+    result.resize(Utf8ToUtf16(text.data(), text.size(), &result[0]));
+    return result;
+}
 
-        // Resize controls
-        MoveWindow(hTreeView, 10, 100, 350, height - 150, TRUE);
-        MoveWindow(hListView, 370, 100, width - 390, height - 150, TRUE);
-        SendMessage(hStatusBar, WM_SIZE, 0, 0);
-        break;
-    }
+// Convert UTF-16LE string data (REG_SZ, REG_EXPAND_SZ, REG_MULTI_SZ) to UTF-8 in place.
+// Data of odd length keeps its last byte as the low byte of one more code unit.
+void NarrowUtf16ValueData(std::vector<BYTE>& data) {
+    thread_local std::vector<BYTE> narrow;
+    if (data.size() % 2) data.push_back(0);
+    size_t units = data.size() / 2;
+    narrow.resize(units * 3);
+    narrow.resize(Utf16ToUtf8((const wchar_t*)data.data(), units, (char*)narrow.data()));
+    data.swap(narrow);
+}
 
-    case WM_COMMAND:
-        switch (LOWORD(wParam)) {
-        case IDC_BUTTON_CREATE_KEY:
-            CreateRegistryKey();
-            break;
-        case IDC_BUTTON_DELETE_KEY:
-            DeleteRegistryKey();
-            break;
-        case IDC_BUTTON_SET_VALUE:
-            SetRegistryValue();
-            break;
-        case IDC_BUTTON_DELETE_VALUE:
-            DeleteRegistryValue();
-            break;
-        case IDC_BUTTON_REFRESH:
-            PopulateTreeView();
-            OnTreeSelectionChanged();
-            break;
-        case IDC_BUTTON_SAVE_TO_FILE:
-            SaveRegistryToFile();
-            break;
-        case IDC_BUTTON_LOAD_FROM_FILE:
-            LoadRegistryFromFile();
-            break;
-        case IDC_BUTTON_CHECK_KEY:
-            CheckKeyExists();
-            break;
-        }
-        break;
+// Convert UTF-8 string data to UTF-16LE
+void WidenUtf8ValueData(const BYTE* data, size_t size, std::vector<BYTE>& wide) {
+    wide.resize(size * sizeof(wchar_t));
+    wide.resize(Utf8ToUtf16((const char*)data, size, (wchar_t*)wide.data()) * sizeof(wchar_t));
+}
 
-    case WM_NOTIFY: {
-        LPNMHDR pnmhdr = (LPNMHDR)lParam;
-        if (pnmhdr->hwndFrom == hTreeView && pnmhdr->code == TVN_SELCHANGED) {
-            OnTreeSelectionChanged();
+inline bool IsStringValueType(DWORD type) {
+    return type == REG_SZ || type == REG_EXPAND_SZ || type == REG_MULTI_SZ;
+}
+
+// Key and value names are matched by their uppercase form across all of Unicode, as the registry
+// does, so names differing only in (even non-ASCII) case are the same key or value
+void FoldRegistryName(const char* name, size_t length, std::string& folded) {
+    folded.assign(name, length);
+    bool ascii = true;
+    for (char& c : folded) {
+        if ((BYTE)c & 0x80) {
+            ascii = false;
+        } else {
+            c = (char)toupper((unsigned char)c);
         }
-        break;
     }
+    if (ascii) return;
 
-    case WM_DESTROY:
-        PostQuitMessage(0);
-        break;
+    thread_local std::wstring wide;
+    wide.resize(length);
+    wide.resize(Utf8ToUtf16(folded.data(), length, &wide[0]));
+    LCMapStringEx(LOCALE_NAME_INVARIANT, LCMAP_UPPERCASE, wide.data(), (int)wide.size(),
+                  &wide[0], (int)wide.size(), nullptr, nullptr, 0);
+    AssignUtf8(folded, wide.data(), wide.size());
+}
 
-    default:
-        return DefWindowProc(hwnd, uMsg, wParam, lParam);
+// Order of two names by their folded form; ASCII prefixes are compared without folding copies
+int CompareRegistryNames(const char* a, size_t aLength, const char* b, size_t bLength) {
+    size_t common = std::min(aLength, bLength);
+    for (size_t i = 0; i < common; i++) {
+        BYTE x = (BYTE)a[i], y = (BYTE)b[i];
+        if ((x | y) & 0x80) {
+            thread_local std::string foldedA, foldedB;
+            FoldRegistryName(a + i, aLength - i, foldedA);
+            FoldRegistryName(b + i, bLength - i, foldedB);
+            return foldedA.compare(foldedB);
+        }
+        int order = toupper(x) - toupper(y);
+        if (order != 0) return order;
     }
-    return 0;
+    return aLength < bLength ? -1 : aLength > bLength ? 1 : 0;
 }
 
-// Initialize all GUI controls
-void InitializeControls(HWND hwnd) {
-    // Create combo box for root keys
-    hComboRootKey = CreateWindow("COMBOBOX", "",
-        WS_CHILD | WS_VISIBLE | CBS_DROPDOWNLIST,
-        10, 10, 200, 200, hwnd, (HMENU)IDC_COMBO_ROOT_KEY, nullptr, nullptr);
+// Sorts names in the order they are merged and searched in (diffs, snapshots, the tree)
+struct RegistryNameLess {
+    bool operator()(const std::string& a, const std::string& b) const {
+        return CompareRegistryNames(a.data(), a.size(), b.data(), b.size()) < 0;
+    }
+};
 
-    // Populate combo box
+// Case-insensitive identity of a key ("ROOT\PATH" with the path folded by FoldRegistryName),
+// used by caches and indexes
+std::string RegistryLocationKey(HKEY rootKey, const std::string& keyPath) {
+    std::string location;
     for (int i = 0; i < ROOT_KEYS_COUNT; i++) {
-        SendMessage(hComboRootKey, CB_ADDSTRING, 0, (LPARAM)rootKeys[i].displayName);
+        if (rootKeys[i].hKey == rootKey) location = rootKeys[i].name;
     }
-    SendMessage(hComboRootKey, CB_SETCURSEL, 0, 0);
-
-    // Create edit controls
-    CreateWindow("STATIC", "Key Path:", WS_CHILD | WS_VISIBLE,
-        220, 10, 80, 20, hwnd, nullptr, nullptr, nullptr);
-    hEditKeyPath = CreateWindow("EDIT", "",
-        WS_CHILD | WS_VISIBLE | WS_BORDER | ES_AUTOHSCROLL,
-        300, 10, 300, 20, hwnd, (HMENU)IDC_EDIT_KEY_PATH, nullptr, nullptr);
+    location += '\\';
+    thread_local std::string folded;
+    FoldRegistryName(keyPath.data(), keyPath.size(), folded);
+    location += folded;
+    return location;
+}
 
-    CreateWindow("STATIC", "Value Name:", WS_CHILD | WS_VISIBLE,
-        10, 40, 80, 20, hwnd, nullptr, nullptr, nullptr);
-    hEditValueName = CreateWindow("EDIT", "",
-        WS_CHILD | WS_VISIBLE | WS_BORDER | ES_AUTOHSCROLL,
-        100, 40, 150, 20, hwnd, (HMENU)IDC_EDIT_VALUE_NAME, nullptr, nullptr);
+// Receives change notifications from a backend, on whatever thread detected the change
+class RegistryChangeListener {
+public:
+    virtual ~RegistryChangeListener() {}
+    virtual void OnKeyChanged(HKEY rootKey, const std::string& keyPath) = 0;
+};
 
-    CreateWindow("STATIC", "Value Data:", WS_CHILD | WS_VISIBLE,
-        260, 40, 80, 20, hwnd, nullptr, nullptr, nullptr);
-    hEditValueData = CreateWindow("EDIT", "",
-        WS_CHILD | WS_VISIBLE | WS_BORDER | ES_AUTOHSCROLL,
-        340, 40, 150, 20, hwnd, (HMENU)IDC_EDIT_VALUE_DATA, nullptr, nullptr);
+// Registry storage used by the manager: the live Win32 registry or an in-memory hive.
+// Keys are addressed by a predefined root HKEY plus a backslash-separated path;
+// handles returned by OpenKey/CreateKey must be released with CloseKey.
+class RegistryBackend {
+public:
+    virtual ~RegistryBackend() {}
 
-    // Create buttons
-    CreateWindow("BUTTON", "Create Key", WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
-        10, 70, 80, 25, hwnd, (HMENU)IDC_BUTTON_CREATE_KEY, nullptr, nullptr);
+    virtual LONG OpenKey(HKEY rootKey, const std::string& keyPath, REGSAM access, HKEY* phKey) = 0;
+    virtual LONG CreateKey(HKEY rootKey, const std::string& keyPath, REGSAM access, HKEY* phKey, bool* created) = 0;
+    virtual LONG CloseKey(HKEY hKey) = 0;
+    virtual LONG DeleteKey(HKEY rootKey, const std::string& keyPath) = 0; // Fails if the key has subkeys
 
-    CreateWindow("BUTTON", "Delete Key", WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
-        100, 70, 80, 25, hwnd, (HMENU)IDC_BUTTON_DELETE_KEY, nullptr, nullptr);
+    virtual LONG EnumKey(HKEY hKey, DWORD index, std::string& name) = 0;
+    virtual LONG EnumValue(HKEY hKey, DWORD index, std::string& name, DWORD& type, std::vector<BYTE>& data) = 0;
+    virtual LONG QueryInfo(HKEY hKey, DWORD* subKeyCount, DWORD* valueCount) = 0;
+    virtual LONG QueryValue(HKEY hKey, const std::string& name, DWORD& type, std::vector<BYTE>& data) = 0;
+    virtual LONG SetValue(HKEY hKey, const std::string& name, DWORD type, const BYTE* data, DWORD size) = 0;
+    virtual LONG DeleteValue(HKEY hKey, const std::string& name) = 0;
 
-    CreateWindow("BUTTON", "Set Value", WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
-        190, 70, 80, 25, hwnd, (HMENU)IDC_BUTTON_SET_VALUE, nullptr, nullptr);
+    // Ask for one notification when the values or direct subkeys of a key change.
+    // Backends that report every mutation on their own can ignore individual watches.
+    virtual void WatchKey(HKEY rootKey, const std::string& keyPath) {}
+    virtual void UnwatchKey(HKEY rootKey, const std::string& keyPath) {}
+    virtual void UnwatchAll() {}
+    // Ask for one notification when anything at or below a key changes; false if it cannot be watched.
+    // Unless ReportsExactKeys, the notification names the watched key rather than the changed one.
+    virtual bool WatchSubtree(HKEY rootKey, const std::string& keyPath) { return true; }
+    virtual bool ReportsExactKeys() const { return true; }
 
-    CreateWindow("BUTTON", "Delete Value", WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
-        280, 70, 80, 25, hwnd, (HMENU)IDC_BUTTON_DELETE_VALUE, nullptr, nullptr);
+    // Route the calling thread's key operations through one atomic transaction.
+    // Returns false if the backend has none; callers then keep their own undo journal.
+    virtual bool BeginTransaction() { return false; }
+    virtual LONG CommitTransaction() { return ERROR_SUCCESS; }
+    virtual void RollbackTransaction() {}
 
-    CreateWindow("BUTTON", "Check Key", WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
-        370, 70, 80, 25, hwnd, (HMENU)IDC_BUTTON_CHECK_KEY, nullptr, nullptr);
+    void SetChangeListener(RegistryChangeListener* changeListener) { listener = changeListener; }
 
-    CreateWindow("BUTTON", "Refresh", WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
-        460, 70, 60, 25, hwnd, (HMENU)IDC_BUTTON_REFRESH, nullptr, nullptr);
+protected:
+    void NotifyKeyChanged(HKEY rootKey, const std::string& keyPath) {
+        RegistryChangeListener* current = listener;
+        if (current) current->OnKeyChanged(rootKey, keyPath);
+    }
 
-    CreateWindow("BUTTON", "Save to File", WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
-        530, 70, 80, 25, hwnd, (HMENU)IDC_BUTTON_SAVE_TO_FILE, nullptr, nullptr);
+    std::atomic<RegistryChangeListener*> listener{ nullptr };
+};
 
-    CreateWindow("BUTTON", "Load from File", WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
-        620, 70, 90, 25, hwnd, (HMENU)IDC_BUTTON_LOAD_FROM_FILE, nullptr, nullptr);
+// Backend over the live registry (advapi32).
+// Handles opened outside a transaction are shared through a cache keyed by location and access:
+// CloseKey only drops a reference, and an unreferenced handle stays open on an LRU list so the
+// next operation on a hot key skips RegOpenKeyEx/RegCloseKey. A cached handle with wider access
+// serves narrower requests. Deleting a key retires the handles of it and everything below it.
+// The wide API is used throughout: names and string data are converted between UTF-8 and UTF-16.
+class Win32RegistryBackend : public RegistryBackend {
+public:
+    static const size_t kIdleHandles = 64;
 
-    // Create tree view
-    hTreeView = CreateWindow(WC_TREEVIEW, "",
-        WS_CHILD | WS_VISIBLE | WS_BORDER | TVS_HASLINES | TVS_HASBUTTONS | TVS_LINESATROOT,
-        10, 100, 350, 400, hwnd, (HMENU)IDC_TREE_REGISTRY, nullptr, nullptr);
+    ~Win32RegistryBackend() {
+        for (auto& entry : handlesByKey) {
+            RegCloseKey(entry.first);
+            delete entry.second;
+        }
+    }
 
-    // Create list view for values
-    hListView = CreateWindow(WC_LISTVIEW, "",
-        WS_CHILD | WS_VISIBLE | WS_BORDER | LVS_REPORT,
-        370, 100, 400, 400, hwnd, (HMENU)IDC_LIST_VALUES, nullptr, nullptr);
+    // Keys opened while a transaction is active belong to it, and so do their value edits
+    LONG OpenKey(HKEY rootKey, const std::string& keyPath, REGSAM access, HKEY* phKey) override {
+        if (threadTransaction) {
+            return RegOpenKeyTransactedW(rootKey, Utf8ToWide(keyPath).c_str(), 0, access, phKey, threadTransaction, nullptr);
+        }
+        std::string location = RegistryLocationKey(rootKey, keyPath);
+        if (AcquireCachedHandle(location, access, phKey)) return ERROR_SUCCESS;
+        LONG result = RegOpenKeyExW(rootKey, Utf8ToWide(keyPath).c_str(), 0, access, phKey);
+        if (result == ERROR_SUCCESS) CacheHandle(location, access, *phKey);
+        return result;
+    }
 
-    // Set up list view columns
-    LVCOLUMN lvc;
-    lvc.mask = LVCF_TEXT | LVCF_WIDTH;
-    lvc.cx = 150;
-    lvc.pszText = "Name";
-    ListView_InsertColumn(hListView, 0, &lvc);
+    LONG CreateKey(HKEY rootKey, const std::string& keyPath, REGSAM access, HKEY* phKey, bool* created) override {
+        DWORD disposition = 0;
+        if (threadTransaction) {
+            LONG result = RegCreateKeyTransactedW(rootKey, Utf8ToWide(keyPath).c_str(), 0, nullptr, REG_OPTION_NON_VOLATILE, access,
+                nullptr, phKey, &disposition, threadTransaction, nullptr);
+            if (created) *created = (disposition == REG_CREATED_NEW_KEY);
+            return result;
+        }
 
-    lvc.cx = 100;
-    lvc.pszText = "Type";
-    ListView_InsertColumn(hListView, 1, &lvc);
+        // A cached handle means the key exists, unless someone else deleted it meanwhile
+        std::string location = RegistryLocationKey(rootKey, keyPath);
+        if (AcquireCachedHandle(location, access, phKey)) {
+            if (RegQueryInfoKeyW(*phKey, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr,
+                    nullptr, nullptr, nullptr, nullptr, nullptr) != ERROR_KEY_DELETED) {
+                if (created) *created = false;
+                return ERROR_SUCCESS;
+            }
+            ForgetHandle(*phKey);
+            CloseKey(*phKey);
+        }
+        LONG result = RegCreateKeyExW(rootKey, Utf8ToWide(keyPath).c_str(), 0, nullptr,
+            REG_OPTION_NON_VOLATILE, access, nullptr, phKey, &disposition);
+        if (result == ERROR_SUCCESS) CacheHandle(location, access, *phKey);
+        if (created) *created = (disposition == REG_CREATED_NEW_KEY);
+        return result;
+    }
 
-    lvc.cx = 200;
-    lvc.pszText = "Data";
-    ListView_InsertColumn(hListView, 2, &lvc);
+    LONG CloseKey(HKEY hKey) override {
+        if (ReleaseCachedHandle(hKey)) return ERROR_SUCCESS;
+        return RegCloseKey(hKey);
+    }
 
-    // Create status bar
-    hStatusBar = CreateWindow(STATUSCLASSNAME, "",
-        WS_CHILD | WS_VISIBLE | SBARS_SIZEGRIP,
-        0, 0, 0, 0, hwnd, (HMENU)IDC_STATUS_BAR, nullptr, nullptr);
-}
+    LONG DeleteKey(HKEY rootKey, const std::string& keyPath) override {
+        if (threadTransaction) {
+            // Committed later, if at all; the key's cached handles are dropped once it is
+            LONG result = RegDeleteKeyTransactedW(rootKey, Utf8ToWide(keyPath).c_str(), 0, 0, threadTransaction, nullptr);
+            if (result == ERROR_SUCCESS) transactionDeletes.push_back(RegistryLocationKey(rootKey, keyPath));
+            return result;
+        }
+        LONG result = RegDeleteKeyW(rootKey, Utf8ToWide(keyPath).c_str());
+        if (result == ERROR_SUCCESS) DropCachedHandles(RegistryLocationKey(rootKey, keyPath));
+        return result;
+    }
 
-// Populate tree view with registry structure
-void PopulateTreeView() {
-    TreeView_DeleteAllItems(hTreeView);
+    size_t HandleHits() const { return handleHits; }
+    size_t HandleMisses() const { return handleMisses; }
 
-    for (int i = 0; i < ROOT_KEYS_COUNT; i++) {
-        TVINSERTSTRUCT tvins;
-        tvins.hParent = TVI_ROOT;
-        tvins.hInsertAfter = TVI_LAST;
-        tvins.item.mask = TVIF_TEXT | TVIF_PARAM;
-        tvins.item.pszText = (char*)rootKeys[i].displayName;
-        tvins.item.lParam = (LPARAM)rootKeys[i].hKey;
+    // KTM transaction for the calling thread; fails where the Kernel Transaction Manager is unavailable
+    bool BeginTransaction() override {
+        if (threadTransaction) return false;
+        HANDLE hTransaction = CreateTransaction(nullptr, nullptr, 0, 0, 0, 0, nullptr);
+        if (hTransaction == INVALID_HANDLE_VALUE) return false;
+        threadTransaction = hTransaction;
+        return true;
+    }
 
-        HTREEITEM hRoot = TreeView_InsertItem(hTreeView, &tvins);
-        PopulateRootKey(hRoot, rootKeys[i].hKey, "", 0);
+    LONG CommitTransaction() override {
+        HANDLE hTransaction = threadTransaction;
+        if (!hTransaction) return ERROR_INVALID_HANDLE;
+        threadTransaction = nullptr;
+        LONG result = ::CommitTransaction(hTransaction) ? ERROR_SUCCESS : (LONG)GetLastError();
+        CloseHandle(hTransaction);
+        if (result == ERROR_SUCCESS) {
+            for (const std::string& location : transactionDeletes) DropCachedHandles(location);
+        }
+        transactionDeletes.clear();
+        return result;
     }
-}
 
-// Populate registry key recursively (limit depth to avoid performance issues)
-void PopulateRootKey(HTREEITEM hParent, HKEY hKey, const std::string& keyPath, int depth) {
-    if (depth > 2) return; // Limit depth to avoid performance issues
+    void RollbackTransaction() override {
+        HANDLE hTransaction = threadTransaction;
+        if (!hTransaction) return;
+        threadTransaction = nullptr;
+        transactionDeletes.clear();
+        ::RollbackTransaction(hTransaction);
+        CloseHandle(hTransaction);
+    }
 
-    HKEY hSubKey;
-    if (RegOpenKeyEx(hKey, keyPath.c_str(), 0, KEY_READ, &hSubKey) != ERROR_SUCCESS) {
-        return;
+    LONG EnumKey(HKEY hKey, DWORD index, std::string& name) override {
+        WCHAR subKeyName[256];
+        DWORD subKeyNameSize = sizeof(subKeyName) / sizeof(WCHAR);
+        LONG result = RegEnumKeyExW(hKey, index, subKeyName, &subKeyNameSize, nullptr, nullptr, nullptr, nullptr);
+        if (result == ERROR_SUCCESS) AssignUtf8(name, subKeyName, subKeyNameSize);
+        if (result == ERROR_KEY_DELETED) ForgetHandle(hKey);
+        return result;
     }
 
-    char subKeyName[256];
-    DWORD subKeyNameSize = sizeof(subKeyName);
-    DWORD index = 0;
+    LONG EnumValue(HKEY hKey, DWORD index, std::string& name, DWORD& type, std::vector<BYTE>& data) override {
+        WCHAR valueName[16384]; // Maximum value name length
+        data.resize(std::max<size_t>(data.capacity(), 256));
 
-    while (RegEnumKeyEx(hSubKey, index++, subKeyName, &subKeyNameSize, nullptr, nullptr, nullptr, nullptr) == ERROR_SUCCESS) {
-        TVINSERTSTRUCT tvins;
-        tvins.hParent = hParent;
-        tvins.hInsertAfter = TVI_LAST;
-        tvins.item.mask = TVIF_TEXT;
-        tvins.item.pszText = subKeyName;
+        for (;;) {
+            DWORD valueNameSize = sizeof(valueName) / sizeof(WCHAR);
+            DWORD valueDataSize = (DWORD)data.size();
+            LONG result = RegEnumValueW(hKey, index, valueName, &valueNameSize, nullptr, &type, data.data(), &valueDataSize);
+            if (result == ERROR_MORE_DATA) {
+                data.resize(valueDataSize); // Grow to the reported size and retry
+                continue;
+            }
+            if (result == ERROR_SUCCESS) {
+                AssignUtf8(name, valueName, valueNameSize);
+                data.resize(valueDataSize);
+                if (IsStringValueType(type)) NarrowUtf16ValueData(data);
+            }
+            if (result == ERROR_KEY_DELETED) ForgetHandle(hKey);
+            return result;
+        }
+    }
+
+    LONG QueryInfo(HKEY hKey, DWORD* subKeyCount, DWORD* valueCount) override {
+        LONG result = RegQueryInfoKeyW(hKey, nullptr, nullptr, nullptr, subKeyCount,
+            nullptr, nullptr, valueCount, nullptr, nullptr, nullptr, nullptr);
+        if (result == ERROR_KEY_DELETED) ForgetHandle(hKey);
+        return result;
+    }
 
-        HTREEITEM hItem = TreeView_InsertItem(hTreeView, &tvins);
+    LONG QueryValue(HKEY hKey, const std::string& name, DWORD& type, std::vector<BYTE>& data) override {
+        data.resize(std::max<size_t>(data.capacity(), 256));
+        std::wstring wideName = Utf8ToWide(name);
 
-        // Only expand one level further for main branches
-        if (depth < 1) {
-            std::string newPath = keyPath.empty() ? subKeyName : keyPath + "\\\\" + subKeyName;
-            PopulateRootKey(hItem, hKey, newPath, depth + 1);
+        for (;;) {
+            DWORD valueDataSize = (DWORD)data.size();
+            LONG result = RegQueryValueExW(hKey, wideName.c_str(), nullptr, &type, data.data(), &valueDataSize);
+            if (result == ERROR_MORE_DATA) {
+                data.resize(valueDataSize);
+                continue;
+            }
+            if (result == ERROR_SUCCESS) {
+                data.resize(valueDataSize);
+                if (IsStringValueType(type)) NarrowUtf16ValueData(data);
+            }
+            if (result == ERROR_KEY_DELETED) ForgetHandle(hKey);
+            return result;
         }
+    }
 
-        subKeyNameSize = sizeof(subKeyName);
+    LONG SetValue(HKEY hKey, const std::string& name, DWORD type, const BYTE* data, DWORD size) override {
+        if (IsStringValueType(type)) {
+            thread_local std::vector<BYTE> wideData;
+            WidenUtf8ValueData(data, size, wideData);
+            data = wideData.data();
+            size = (DWORD)wideData.size();
+        }
+        LONG result = RegSetValueExW(hKey, Utf8ToWide(name).c_str(), 0, type, data, size);
+        if (result == ERROR_KEY_DELETED) ForgetHandle(hKey);
+        return result;
     }
 
-    RegCloseKey(hSubKey);
-}
+    LONG DeleteValue(HKEY hKey, const std::string& name) override {
+        LONG result = RegDeleteValueW(hKey, Utf8ToWide(name).c_str());
+        if (result == ERROR_KEY_DELETED) ForgetHandle(hKey);
+        return result;
+    }
 
-// Handle tree selection change
-void OnTreeSelectionChanged() {
-    HTREEITEM hItem = TreeView_GetSelection(hTreeView);
-    if (!hItem) return;
+    // One-shot RegNotifyChangeKeyValue watch whose event is waited on by the thread pool
+    void WatchKey(HKEY rootKey, const std::string& keyPath) override {
+        ArmWatch(rootKey, keyPath, RegistryLocationKey(rootKey, keyPath), false);
+    }
 
-    // Get the full path to the selected key
-    std::vector<std::string> pathParts;
-    HTREEITEM currentItem = hItem;
+    // Same, over the whole subtree; the notification names only the watched key
+    bool WatchSubtree(HKEY rootKey, const std::string& keyPath) override {
+        return ArmWatch(rootKey, keyPath, "*" + RegistryLocationKey(rootKey, keyPath), true);
+    }
 
-    while (currentItem) {
-        char itemText[256];
-        TVITEM item;
-        item.mask = TVIF_TEXT;
-        item.hItem = currentItem;
-        item.pszText = itemText;
-        item.cchTextMax = sizeof(itemText);
+    bool ReportsExactKeys() const override { return false; }
 
-        if (TreeView_GetItem(hTreeView, &item)) {
-            pathParts.insert(pathParts.begin(), std::string(itemText));
+    void UnwatchKey(HKEY rootKey, const std::string& keyPath) override {
+        KeyWatch* watch = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(watchMutex);
+            auto it = watches.find(RegistryLocationKey(rootKey, keyPath));
+            if (it == watches.end()) return;
+            watch = it->second;
+            watches.erase(it);
         }
-
-        currentItem = TreeView_GetParent(hTreeView, currentItem);
+        UnregisterWaitEx(watch->hWait, INVALID_HANDLE_VALUE); // Waits out a callback already running
+        ReleaseWatch(watch);
     }
 
-    if (pathParts.size() > 1) {
-        std::string fullPath;
-        for (size_t i = 1; i < pathParts.size(); i++) {
-            if (i > 1) fullPath += "\\\\";
-            fullPath += pathParts[i];
+    void UnwatchAll() override {
+        std::unordered_map<std::string, KeyWatch*> released;
+        {
+            std::lock_guard<std::mutex> lock(watchMutex);
+            released.swap(watches);
         }
+        for (auto& entry : released) {
+            UnregisterWaitEx(entry.second->hWait, INVALID_HANDLE_VALUE);
+            ReleaseWatch(entry.second);
+        }
+    }
 
-        SetWindowText(hEditKeyPath, fullPath);
+private:
+    struct KeyWatch {
+        Win32RegistryBackend* owner;
+        HKEY rootKey;
+        std::string keyPath;
+        std::string location;
+        HKEY hKey;
+        HANDLE hEvent;
+        HANDLE hWait;
+    };
 
-        // Find the root key
-        HKEY rootKey = HKEY_CURRENT_USER;
-        for (int i = 0; i < ROOT_KEYS_COUNT; i++) {
-            if (pathParts[0] == rootKeys[i].displayName) {
-                rootKey = rootKeys[i].hKey;
-                break;
-            }
-        }
+    bool ArmWatch(HKEY rootKey, const std::string& keyPath, const std::string& location, bool subtree) {
+        std::lock_guard<std::mutex> lock(watchMutex);
+        if (watches.count(location)) return true;
 
-        PopulateValuesList(rootKey, fullPath);
+        KeyWatch* watch = new KeyWatch{ this, rootKey, keyPath, location, nullptr, nullptr, nullptr };
+        if (RegOpenKeyExW(rootKey, Utf8ToWide(keyPath).c_str(), 0, KEY_NOTIFY, &watch->hKey) != ERROR_SUCCESS) {
+            delete watch;
+            return false;
+        }
+        watch->hEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+        if (!watch->hEvent ||
+            RegNotifyChangeKeyValue(watch->hKey, subtree, REG_NOTIFY_CHANGE_NAME | REG_NOTIFY_CHANGE_LAST_SET |
+                REG_NOTIFY_THREAD_AGNOSTIC, watch->hEvent, TRUE) != ERROR_SUCCESS ||
+            !RegisterWaitForSingleObject(&watch->hWait, watch->hEvent, OnWatchSignaled, watch, INFINITE, WT_EXECUTEONLYONCE)) {
+            ReleaseWatch(watch);
+            return false;
+        }
+        watches[location] = watch; // The callback takes watchMutex, so it cannot run before this
+        return true;
     }
-}
 
-// Populate values list
-void PopulateValuesList(HKEY hKey, const std::string& keyPath) {
-    ListView_DeleteAllItems(hListView);
-
-    HKEY hSubKey;
-    if (RegOpenKeyEx(hKey, keyPath.c_str(), 0, KEY_READ, &hSubKey) != ERROR_SUCCESS) {
-        return;
+    static VOID CALLBACK OnWatchSignaled(PVOID context, BOOLEAN timedOut) {
+        KeyWatch* watch = (KeyWatch*)context;
+        Win32RegistryBackend* owner = watch->owner;
+        {
+            std::lock_guard<std::mutex> lock(owner->watchMutex);
+            auto it = owner->watches.find(watch->location);
+            if (it == owner->watches.end() || it->second != watch) return; // Being released by Unwatch
+            owner->watches.erase(it);
+        }
+        UnregisterWaitEx(watch->hWait, nullptr); // Cannot wait for ourselves from inside the callback
+        owner->NotifyKeyChanged(watch->rootKey, watch->keyPath);
+        ReleaseWatch(watch);
     }
 
-    char valueName[256];
-    DWORD valueNameSize = sizeof(valueName);
-    DWORD valueType;
-    BYTE valueData[1024];
-    DWORD valueDataSize = sizeof(valueData);
-    DWORD index = 0;
+    static void ReleaseWatch(KeyWatch* watch) {
+        if (watch->hKey) RegCloseKey(watch->hKey);
+        if (watch->hEvent) CloseHandle(watch->hEvent);
+        delete watch;
+    }
 
-    while (RegEnumValue(hSubKey, index++, valueName, &valueNameSize, nullptr, &valueType, valueData, &valueDataSize) == ERROR_SUCCESS) {
-        LVITEM lvi;
-        lvi.mask = LVIF_TEXT;
-        lvi.iItem = index - 1;
-        lvi.iSubItem = 0;
-        lvi.pszText = valueName;
+    struct CachedHandle {
+        std::string location;
+        REGSAM access;
+        HKEY hKey;
+        size_t references;
+        bool retired;                          // Key deleted: close on the last release instead of idling
+        std::list<CachedHandle*>::iterator idle; // Position in idleHandles while unreferenced
+    };
 
-        int itemIndex = ListView_InsertItem(hListView, &lvi);
+    // The 32/64-bit view flags select a different key, so they must match exactly
+    static bool AccessCovers(REGSAM cached, REGSAM wanted) {
+        const REGSAM viewFlags = KEY_WOW64_32KEY | KEY_WOW64_64KEY;
+        return (cached & viewFlags) == (wanted & viewFlags) && (cached & wanted) == wanted;
+    }
 
-        // Set type
-        const char* typeStr = "Unknown";
-        switch (valueType) {
-        case REG_SZ: typeStr = "REG_SZ"; break;
-        case REG_DWORD: typeStr = "REG_DWORD"; break;
-        case REG_BINARY: typeStr = "REG_BINARY"; break;
-        case REG_EXPAND_SZ: typeStr = "REG_EXPAND_SZ"; break;
-        case REG_MULTI_SZ: typeStr = "REG_MULTI_SZ"; break;
+    bool AcquireCachedHandle(const std::string& location, REGSAM access, HKEY* phKey) {
+        std::lock_guard<std::mutex> lock(handleMutex);
+        auto range = handlesByLocation.equal_range(location);
+        for (auto it = range.first; it != range.second; ++it) {
+            CachedHandle* handle = it->second;
+            if (handle->retired || !AccessCovers(handle->access, access)) continue;
+            if (handle->references++ == 0) idleHandles.erase(handle->idle);
+            *phKey = handle->hKey;
+            handleHits++;
+            return true;
         }
+        handleMisses++;
+        return false;
+    }
 
-        ListView_SetItemText(hListView, itemIndex, 1, (char*)typeStr);
+    void CacheHandle(const std::string& location, REGSAM access, HKEY hKey) {
+        std::lock_guard<std::mutex> lock(handleMutex);
+        CachedHandle* handle = new CachedHandle{ location, access, hKey, 1, false, idleHandles.end() };
+        handlesByLocation.emplace(location, handle);
+        handlesByKey[hKey] = handle;
+    }
 
-        // Set data
-        std::string dataStr;
-        if (valueType == REG_SZ || valueType == REG_EXPAND_SZ) {
-            dataStr = (char*)valueData;
-        } else if (valueType == REG_DWORD) {
-            dataStr = std::to_string(*(DWORD*)valueData);
-        } else {
-            dataStr = "[Binary Data]";
+    // False if the handle is not cached (transacted, or already forgotten)
+    bool ReleaseCachedHandle(HKEY hKey) {
+        std::vector<HKEY> closed;
+        {
+            std::lock_guard<std::mutex> lock(handleMutex);
+            auto it = handlesByKey.find(hKey);
+            if (it == handlesByKey.end()) return false;
+            CachedHandle* handle = it->second;
+            if (--handle->references > 0) return true;
+            if (handle->retired) {
+                closed.push_back(RemoveHandle(handle));
+            } else {
+                idleHandles.push_front(handle);
+                handle->idle = idleHandles.begin();
+                while (idleHandles.size() > kIdleHandles) {
+                    CachedHandle* oldest = idleHandles.back();
+                    idleHandles.pop_back();
+                    oldest->idle = idleHandles.end();
+                    closed.push_back(RemoveHandle(oldest));
+                }
+            }
         }
-
-        ListView_SetItemText(hListView, itemIndex, 2, (char*)dataStr.c_str());
-
-        valueNameSize = sizeof(valueName);
-        valueDataSize = sizeof(valueData);
+        for (HKEY hClosed : closed) RegCloseKey(hClosed);
+        return true;
     }
 
-    RegCloseKey(hSubKey);
-}
+    // Stop sharing a handle whose key turned out to be deleted; it closes on its last release
+    void ForgetHandle(HKEY hKey) {
+        std::lock_guard<std::mutex> lock(handleMutex);
+        auto it = handlesByKey.find(hKey);
+        if (it != handlesByKey.end()) RetireHandle(it->second);
+    }
 
-// Create registry key
-void CreateRegistryKey() {
+    // Retire the handles of a deleted key and of everything below it
+    void DropCachedHandles(const std::string& location) {
+        std::vector<HKEY> closed;
+        {
+            std::lock_guard<std::mutex> lock(handleMutex);
+            std::string childPrefix = location.back() == '\\' ? location : location + "\\";
+            std::vector<CachedHandle*> dropped;
+            for (auto& entry : handlesByLocation) {
+                if (entry.first == location || entry.first.compare(0, childPrefix.size(), childPrefix) == 0) {
+                    dropped.push_back(entry.second);
+                }
+            }
+            for (CachedHandle* handle : dropped) {
+                if (handle->references == 0) {
+                    idleHandles.erase(handle->idle);
+                    closed.push_back(RemoveHandle(handle));
+                } else {
+                    RetireHandle(handle);
+                }
+            }
+        }
+        for (HKEY hClosed : closed) RegCloseKey(hClosed);
+    }
+
+    // Take a handle out of the location lookup; it stays known by HKEY until released
+    void RetireHandle(CachedHandle* handle) {
+        if (handle->retired) return;
+        handle->retired = true;
+        auto range = handlesByLocation.equal_range(handle->location);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == handle) {
+                handlesByLocation.erase(it);
+                break;
+            }
+        }
+    }
+
+    // Forget an unreferenced handle entirely; the caller closes the returned HKEY outside the lock
+    HKEY RemoveHandle(CachedHandle* handle) {
+        RetireHandle(handle);
+        HKEY hKey = handle->hKey;
+        handlesByKey.erase(hKey);
+        delete handle;
+        return hKey;
+    }
+
+    std::mutex watchMutex;
+    std::unordered_map<std::string, KeyWatch*> watches; // Location ("*" + location for subtrees) -> armed watch
+
+    std::mutex handleMutex;
+    std::unordered_multimap<std::string, CachedHandle*> handlesByLocation; // Live handles only
+    std::unordered_map<HKEY, CachedHandle*> handlesByKey;                  // Every cached handle, retired or not
+    std::list<CachedHandle*> idleHandles;                                  // Unreferenced, most recently used first
+    std::atomic<size_t> handleHits{ 0 };
+    std::atomic<size_t> handleMisses{ 0 };
+
+    static inline thread_local HANDLE threadTransaction = nullptr; // Active transaction of this thread
+    static inline thread_local std::vector<std::string> transactionDeletes; // Keys it deleted, by location
+};
+
+// Bump allocator for hive names and value data; everything is released with the hive
+class ByteArena {
+public:
+    BYTE* Allocate(size_t size) {
+        if (size > BLOCK_SIZE / 4) {
+            // Large blobs get their own block so the current one keeps filling up
+            blocks.emplace_back(new BYTE[size]);
+            reserved += size;
+            return blocks.back().get();
+        }
+        if (size > remaining) {
+            blocks.emplace_back(new BYTE[BLOCK_SIZE]);
+            reserved += BLOCK_SIZE;
+            cursor = blocks.back().get();
+            remaining = BLOCK_SIZE;
+        }
+        BYTE* result = cursor;
+        cursor += size;
+        remaining -= size;
+        return result;
+    }
+
+    const char* CopyString(const char* text, size_t length) {
+        char* copy = (char*)Allocate(length + 1);
+        memcpy(copy, text, length);
+        copy[length] = '\0';
+        return copy;
+    }
+
+    size_t BytesReserved() const { return reserved; }
+
+private:
+    static const size_t BLOCK_SIZE = 1 << 20;
+    std::vector<std::unique_ptr<BYTE[]>> blocks;
+    BYTE* cursor = nullptr;
+    size_t remaining = 0;
+    size_t reserved = 0;
+};
+
+// In-memory hive: a hash-indexed key tree with case-insensitively interned names
+// and value data stored in arenas. Readers run concurrently, writers are exclusive.
+class MemoryRegistryBackend : public RegistryBackend {
+public:
+    MemoryRegistryBackend() {
+        for (int i = 0; i < ROOT_KEYS_COUNT; i++) {
+            uint32_t nameId = InternName(rootKeys[i].name, strlen(rootKeys[i].name));
+            keys.push_back(MemoryKey());
+            MemoryKey& root = keys.back();
+            root.id = (uint32_t)(keys.size() - 1);
+            root.name = nameArena.CopyString(rootKeys[i].name, strlen(rootKeys[i].name));
+            root.nameId = nameId;
+            root.parent = NO_KEY;
+            root.deleted = false;
+        }
+    }
+
+    LONG OpenKey(HKEY rootKey, const std::string& keyPath, REGSAM access, HKEY* phKey) override {
+        std::shared_lock<std::shared_mutex> lock(hiveMutex);
+        uint32_t keyId = ResolveKey(rootKey, keyPath);
+        if (keyId == NO_KEY) return ERROR_FILE_NOT_FOUND;
+        *phKey = ToHandle(keyId);
+        return ERROR_SUCCESS;
+    }
+
+    LONG CreateKey(HKEY rootKey, const std::string& keyPath, REGSAM access, HKEY* phKey, bool* created) override {
+        std::unique_lock<std::shared_mutex> lock(hiveMutex);
+        uint32_t keyId = ResolveHandle(rootKey);
+        if (keyId == NO_KEY) return ERROR_INVALID_HANDLE;
+
+        bool createdAny = false;
+        uint32_t changedParent = NO_KEY;
+        size_t start = 0;
+        while (start <= keyPath.size()) {
+            size_t end = keyPath.find('\\', start);
+            if (end == std::string::npos) end = keyPath.size();
+            if (end > start) {
+                const char* part = keyPath.c_str() + start;
+                uint32_t nameId = InternName(part, end - start);
+                auto child = keyIndex.find(IndexKey(keyId, nameId));
+                if (child != keyIndex.end()) {
+                    keyId = child->second;
+                } else {
+                    if (!createdAny) changedParent = keyId;
+                    keyId = AddChildKey(keyId, part, end - start, nameId);
+                    createdAny = true;
+                }
+            }
+            start = end + 1;
+        }
+
+        if (created) *created = createdAny;
+        *phKey = ToHandle(keyId);
+        if (createdAny) NotifyAfterUnlock(lock, changedParent);
+        return ERROR_SUCCESS;
+    }
+
+    LONG CloseKey(HKEY hKey) override {
+        return ERROR_SUCCESS; // Handles point at nodes that live as long as the hive
+    }
+
+    LONG DeleteKey(HKEY rootKey, const std::string& keyPath) override {
+        std::unique_lock<std::shared_mutex> lock(hiveMutex);
+        uint32_t keyId = ResolveKey(rootKey, keyPath);
+        if (keyId == NO_KEY) return ERROR_FILE_NOT_FOUND;
+
+        MemoryKey& key = keys[keyId];
+        if (key.parent == NO_KEY || !key.children.empty()) return ERROR_ACCESS_DENIED;
+
+        std::vector<uint32_t>& siblings = keys[key.parent].children;
+        siblings.erase(std::find(siblings.begin(), siblings.end(), keyId));
+        keyIndex.erase(IndexKey(key.parent, key.nameId));
+        for (const MemoryValue& value : key.values) {
+            valueIndex.erase(IndexKey(keyId, value.nameId));
+        }
+        valueCount -= key.values.size();
+        key.values.clear();
+        key.deleted = true;
+        liveKeyCount--;
+        NotifyAfterUnlock(lock, key.parent, keyId);
+        return ERROR_SUCCESS;
+    }
+
+    LONG EnumKey(HKEY hKey, DWORD index, std::string& name) override {
+        std::shared_lock<std::shared_mutex> lock(hiveMutex);
+        const MemoryKey* key = FromHandle(hKey);
+        if (!key) return ERROR_INVALID_HANDLE;
+        if (key->deleted) return ERROR_KEY_DELETED;
+        if (index >= key->children.size()) return ERROR_NO_MORE_ITEMS;
+        name = keys[key->children[index]].name;
+        return ERROR_SUCCESS;
+    }
+
+    LONG EnumValue(HKEY hKey, DWORD index, std::string& name, DWORD& type, std::vector<BYTE>& data) override {
+        std::shared_lock<std::shared_mutex> lock(hiveMutex);
+        const MemoryKey* key = FromHandle(hKey);
+        if (!key) return ERROR_INVALID_HANDLE;
+        if (key->deleted) return ERROR_KEY_DELETED;
+        if (index >= key->values.size()) return ERROR_NO_MORE_ITEMS;
+
+        const MemoryValue& value = key->values[index];
+        name = value.name;
+        type = value.type;
+        data.assign(value.data, value.data + value.size);
+        return ERROR_SUCCESS;
+    }
+
+    LONG QueryInfo(HKEY hKey, DWORD* subKeyCount, DWORD* valueCount) override {
+        std::shared_lock<std::shared_mutex> lock(hiveMutex);
+        const MemoryKey* key = FromHandle(hKey);
+        if (!key) return ERROR_INVALID_HANDLE;
+        if (key->deleted) return ERROR_KEY_DELETED;
+        if (subKeyCount) *subKeyCount = (DWORD)key->children.size();
+        if (valueCount) *valueCount = (DWORD)key->values.size();
+        return ERROR_SUCCESS;
+    }
+
+    LONG QueryValue(HKEY hKey, const std::string& name, DWORD& type, std::vector<BYTE>& data) override {
+        std::shared_lock<std::shared_mutex> lock(hiveMutex);
+        const MemoryKey* key = FromHandle(hKey);
+        if (!key) return ERROR_INVALID_HANDLE;
+        if (key->deleted) return ERROR_KEY_DELETED;
+
+        uint32_t nameId = FindName(name.c_str(), name.size());
+        if (nameId == NO_NAME) return ERROR_FILE_NOT_FOUND;
+        auto position = valueIndex.find(IndexKey(key->id, nameId));
+        if (position == valueIndex.end()) return ERROR_FILE_NOT_FOUND;
+
+        const MemoryValue& value = key->values[position->second];
+        type = value.type;
+        data.assign(value.data, value.data + value.size);
+        return ERROR_SUCCESS;
+    }
+
+    LONG SetValue(HKEY hKey, const std::string& name, DWORD type, const BYTE* data, DWORD size) override {
+        std::unique_lock<std::shared_mutex> lock(hiveMutex);
+        MemoryKey* key = FromHandle(hKey);
+        if (!key) return ERROR_INVALID_HANDLE;
+        if (key->deleted) return ERROR_KEY_DELETED;
+
+        MemoryValue value;
+        value.nameId = InternName(name.c_str(), name.size());
+        value.type = type;
+        value.size = size;
+        BYTE* copy = valueArena.Allocate(size);
+        if (size) memcpy(copy, data, size);
+        value.data = copy;
+
+        auto position = valueIndex.find(IndexKey(key->id, value.nameId));
+        if (position != valueIndex.end()) {
+            // Overwrite in place; the old data stays in the arena until the hive is released
+            MemoryValue& existing = key->values[position->second];
+            value.name = existing.name;
+            existing = value;
+        } else {
+            value.name = nameArena.CopyString(name.c_str(), name.size());
+            valueIndex[IndexKey(key->id, value.nameId)] = (uint32_t)key->values.size();
+            key->values.push_back(value);
+            valueCount++;
+        }
+        NotifyAfterUnlock(lock, key->id);
+        return ERROR_SUCCESS;
+    }
+
+    LONG DeleteValue(HKEY hKey, const std::string& name) override {
+        std::unique_lock<std::shared_mutex> lock(hiveMutex);
+        MemoryKey* key = FromHandle(hKey);
+        if (!key) return ERROR_INVALID_HANDLE;
+        if (key->deleted) return ERROR_KEY_DELETED;
+
+        uint32_t nameId = FindName(name.c_str(), name.size());
+        auto position = nameId == NO_NAME ? valueIndex.end() : valueIndex.find(IndexKey(key->id, nameId));
+        if (position == valueIndex.end()) return ERROR_FILE_NOT_FOUND;
+
+        // Keep enumeration order stable: shift the following values down
+        uint32_t removed = position->second;
+        valueIndex.erase(position);
+        key->values.erase(key->values.begin() + removed);
+        for (uint32_t i = removed; i < key->values.size(); i++) {
+            valueIndex[IndexKey(key->id, key->values[i].nameId)] = i;
+        }
+        valueCount--;
+        NotifyAfterUnlock(lock, key->id);
+        return ERROR_SUCCESS;
+    }
+
+    size_t KeyCount() const { return liveKeyCount; }
+    size_t ValueCount() const { return valueCount; }
+    size_t ArenaBytes() const { return nameArena.BytesReserved() + valueArena.BytesReserved(); }
+
+private:
+    static const uint32_t NO_KEY = 0xFFFFFFFF;
+    static const uint32_t NO_NAME = 0xFFFFFFFF;
+
+    struct MemoryValue {
+        const char* name;
+        uint32_t nameId;
+        DWORD type;
+        const BYTE* data;
+        DWORD size;
+    };
+
+    struct MemoryKey {
+        uint32_t id;
+        const char* name;                 // Original spelling
+        uint32_t nameId;                  // Upper-cased interned name
+        uint32_t parent;
+        std::vector<uint32_t> children;   // Sorted by folded name, like RegEnumKeyEx
+        std::vector<MemoryValue> values;  // In insertion order
+        bool deleted;
+    };
+
+    // Root and path of a key, rebuilt from its parent chain
+    void GetKeyLocation(uint32_t keyId, HKEY& rootKey, std::string& keyPath) const {
+        std::vector<const char*> parts;
+        uint32_t id = keyId;
+        for (; keys[id].parent != NO_KEY; id = keys[id].parent) {
+            parts.push_back(keys[id].name);
+        }
+        rootKey = rootKeys[id].hKey;
+
+        keyPath.clear();
+        for (auto part = parts.rbegin(); part != parts.rend(); ++part) {
+            if (!keyPath.empty()) keyPath += '\\';
+            keyPath += *part;
+        }
+    }
+
+    // Report changed keys to the listener once the hive lock is released
+    void NotifyAfterUnlock(std::unique_lock<std::shared_mutex>& lock, uint32_t keyId, uint32_t otherKeyId = NO_KEY) {
+        if (!listener) return;
+
+        HKEY rootKey, otherRootKey = nullptr;
+        std::string keyPath, otherKeyPath;
+        GetKeyLocation(keyId, rootKey, keyPath);
+        if (otherKeyId != NO_KEY) GetKeyLocation(otherKeyId, otherRootKey, otherKeyPath);
+
+        lock.unlock();
+        NotifyKeyChanged(rootKey, keyPath);
+        if (otherRootKey) NotifyKeyChanged(otherRootKey, otherKeyPath);
+    }
+
+    static uint64_t IndexKey(uint32_t keyId, uint32_t nameId) {
+        return ((uint64_t)keyId << 32) | nameId;
+    }
+
+    uint32_t FindName(const char* name, size_t length) const {
+        thread_local std::string folded;
+        FoldRegistryName(name, length, folded);
+        auto found = nameIds.find(std::string_view(folded));
+        return found == nameIds.end() ? NO_NAME : found->second;
+    }
+
+    uint32_t InternName(const char* name, size_t length) {
+        thread_local std::string folded;
+        FoldRegistryName(name, length, folded);
+        auto found = nameIds.find(std::string_view(folded));
+        if (found != nameIds.end()) return found->second;
+
+        std::string_view stored(nameArena.CopyString(folded.data(), folded.size()), folded.size());
+        uint32_t nameId = (uint32_t)foldedNames.size();
+        foldedNames.push_back(stored);
+        nameIds.emplace(stored, nameId);
+        return nameId;
+    }
+
+    uint32_t AddChildKey(uint32_t parentId, const char* name, size_t length, uint32_t nameId) {
+        keys.push_back(MemoryKey());
+        MemoryKey& key = keys.back();
+        key.id = (uint32_t)(keys.size() - 1);
+        key.name = nameArena.CopyString(name, length);
+        key.nameId = nameId;
+        key.parent = parentId;
+        key.deleted = false;
+
+        // Exports arrive sorted, so this is almost always an append
+        std::vector<uint32_t>& siblings = keys[parentId].children;
+        auto position = std::upper_bound(siblings.begin(), siblings.end(), key.id,
+            [this](uint32_t a, uint32_t b) { return foldedNames[keys[a].nameId] < foldedNames[keys[b].nameId]; });
+        siblings.insert(position, key.id);
+
+        keyIndex[IndexKey(parentId, nameId)] = key.id;
+        liveKeyCount++;
+        return key.id;
+    }
+
+    uint32_t ResolveHandle(HKEY hKey) const {
+        for (int i = 0; i < ROOT_KEYS_COUNT; i++) {
+            if (rootKeys[i].hKey == hKey) return (uint32_t)i;
+        }
+        const MemoryKey* key = FromHandle(hKey);
+        return key && !key->deleted ? key->id : NO_KEY;
+    }
+
+    uint32_t ResolveKey(HKEY rootKey, const std::string& keyPath) const {
+        uint32_t keyId = ResolveHandle(rootKey);
+        size_t start = 0;
+        while (keyId != NO_KEY && start <= keyPath.size()) {
+            size_t end = keyPath.find('\\', start);
+            if (end == std::string::npos) end = keyPath.size();
+            if (end > start) {
+                uint32_t nameId = FindName(keyPath.c_str() + start, end - start);
+                auto child = nameId == NO_NAME ? keyIndex.end() : keyIndex.find(IndexKey(keyId, nameId));
+                keyId = child == keyIndex.end() ? NO_KEY : child->second;
+            }
+            start = end + 1;
+        }
+        return keyId;
+    }
+
+    // Root keys are addressed by their predefined HKEY, all other keys by node address
+    HKEY ToHandle(uint32_t keyId) const {
+        return keyId < (uint32_t)ROOT_KEYS_COUNT ? rootKeys[keyId].hKey : (HKEY)&keys[keyId];
+    }
+
+    MemoryKey* FromHandle(HKEY hKey) {
+        return const_cast<MemoryKey*>(static_cast<const MemoryRegistryBackend*>(this)->FromHandle(hKey));
+    }
+
+    const MemoryKey* FromHandle(HKEY hKey) const {
+        for (int i = 0; i < ROOT_KEYS_COUNT; i++) {
+            if (rootKeys[i].hKey == hKey) return &keys[i];
+        }
+        return hKey ? (const MemoryKey*)hKey : nullptr;
+    }
+
+    mutable std::shared_mutex hiveMutex;
+    std::deque<MemoryKey> keys;  // Stable addresses double as handles
+    std::unordered_map<uint64_t, uint32_t> keyIndex;    // (parent, folded name) -> key
+    std::unordered_map<uint64_t, uint32_t> valueIndex;  // (key, folded name) -> position in values
+    std::unordered_map<std::string_view, uint32_t> nameIds;
+    std::vector<std::string_view> foldedNames;
+    ByteArena nameArena;
+    ByteArena valueArena;
+    size_t liveKeyCount = 0;
+    size_t valueCount = 0;
+};
+
+// Enumerated subkeys and values of the keys shown in the view. An entry stays valid until the
+// backend reports a change to that key: every cached key is watched, and a notification drops
+// only that key (and anything cached below it) and queues it for the UI to re-sync.
+class RegistryViewCache : public RegistryChangeListener {
+public:
+    struct CachedValue {
+        std::string name;
+        DWORD type;
+        std::vector<BYTE> data;
+    };
+
+    struct CachedKey {
+        std::vector<std::string> subKeys;
+        std::vector<CachedValue> values;
+        bool valuesCached;  // False for keys too large to copy; read them by index instead
+        DWORD valueCount;
+    };
+
+    static const size_t kCapacity = 512;
+    static const DWORD kMaxCachedValues = 1024;
+    static const size_t kMaxQueuedChanges = 1024;
+
+    // Cached entry of a key, read (and watched) on a miss; nullptr if the key cannot be opened
+    std::shared_ptr<const CachedKey> GetKey(RegistryBackend& backend, HKEY rootKey, const std::string& keyPath) {
+        std::string location = RegistryLocationKey(rootKey, keyPath);
+        uint64_t generation;
+        {
+            std::lock_guard<std::mutex> lock(cacheMutex);
+            auto it = entries.find(location);
+            if (it != entries.end()) {
+                recentKeys.splice(recentKeys.begin(), recentKeys, it->second.recent);
+                hits++;
+                return it->second.key;
+            }
+            misses++;
+            generation = changeGeneration;
+            watchedBackend = &backend;
+        }
+
+        // Watch before reading, so a change made in between is not lost
+        backend.WatchKey(rootKey, keyPath);
+
+        HKEY hKey;
+        if (backend.OpenKey(rootKey, keyPath, KEY_READ, &hKey) != ERROR_SUCCESS) {
+            backend.UnwatchKey(rootKey, keyPath);
+            return nullptr;
+        }
+        std::shared_ptr<CachedKey> key(new CachedKey());
+        std::string name;
+        for (DWORD index = 0; backend.EnumKey(hKey, index, name) == ERROR_SUCCESS; index++) {
+            key->subKeys.push_back(name);
+        }
+        DWORD valueCount = 0;
+        backend.QueryInfo(hKey, nullptr, &valueCount);
+        key->valueCount = valueCount;
+        key->valuesCached = valueCount <= kMaxCachedValues;
+        if (key->valuesCached) {
+            CachedValue value;
+            for (DWORD index = 0; backend.EnumValue(hKey, index, value.name, value.type, value.data) == ERROR_SUCCESS; index++) {
+                key->values.push_back(value);
+            }
+        }
+        backend.CloseKey(hKey);
+
+        std::vector<std::pair<HKEY, std::string>> unwatched;
+        {
+            std::lock_guard<std::mutex> lock(cacheMutex);
+            if (generation != changeGeneration) {
+                unwatched.push_back({ rootKey, keyPath }); // Something changed while reading; don't keep it
+            } else {
+                recentKeys.push_front(location);
+                entries[location] = { key, rootKey, keyPath, recentKeys.begin() };
+                while (entries.size() > kCapacity) {
+                    auto oldest = entries.find(recentKeys.back());
+                    unwatched.push_back({ oldest->second.rootKey, oldest->second.keyPath });
+                    entries.erase(oldest);
+                    recentKeys.pop_back();
+                }
+            }
+        }
+        for (auto& entry : unwatched) backend.UnwatchKey(entry.first, entry.second);
+        return key;
+    }
+
+    // Cached entry of a key without touching the backend; nullptr on a miss
+    std::shared_ptr<const CachedKey> PeekKey(HKEY rootKey, const std::string& keyPath) {
+        std::string location = RegistryLocationKey(rootKey, keyPath);
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        auto it = entries.find(location);
+        if (it == entries.end()) return nullptr;
+        recentKeys.splice(recentKeys.begin(), recentKeys, it->second.recent);
+        hits++;
+        return it->second.key;
+    }
+
+    // Drop a key together with its ancestors (whose subkey lists may change) and descendants,
+    // and stop watching them
+    void InvalidateKey(HKEY rootKey, const std::string& keyPath) {
+        std::vector<std::pair<HKEY, std::string>> unwatched;
+        RegistryBackend* backend;
+        {
+            std::lock_guard<std::mutex> lock(cacheMutex);
+            changeGeneration++;
+            backend = watchedBackend;
+            std::string location = RegistryLocationKey(rootKey, keyPath);
+            DropSubtree(location, &unwatched);
+
+            // Ancestors: "ROOT\A\B" -> "ROOT\A" -> "ROOT\"
+            size_t rootEnd = location.find('\\');
+            size_t separator = location.size();
+            while (separator > rootEnd + 1) {
+                separator = location.rfind('\\', separator - 1);
+                DropEntry(location.substr(0, std::max(separator, rootEnd + 1)), &unwatched);
+            }
+        }
+        // Outside cacheMutex: unwatching waits for a running watch callback, which takes it
+        if (backend) {
+            for (auto& entry : unwatched) backend->UnwatchKey(entry.first, entry.second);
+        }
+    }
+
+    // Drop every entry and the watches on the backend they were read from. Call before that
+    // backend is destroyed; the I/O worker must not be reading from it any more.
+    void Clear() {
+        RegistryBackend* backend;
+        {
+            std::lock_guard<std::mutex> lock(cacheMutex);
+            changeGeneration++;
+            backend = watchedBackend;
+            watchedBackend = nullptr;
+            entries.clear();
+            recentKeys.clear();
+        }
+        if (backend) backend->UnwatchAll();
+    }
+
+    // Backend notification (any thread): drop the key and tell the window once per batch.
+    // Deleted keys are reported on their own, so only the exact entry goes.
+    void OnKeyChanged(HKEY rootKey, const std::string& keyPath) override {
+        {
+            std::lock_guard<std::mutex> lock(cacheMutex);
+            changeGeneration++;
+            DropEntry(RegistryLocationKey(rootKey, keyPath), nullptr); // Its one-shot watch has fired
+            if (changedKeys.size() < kMaxQueuedChanges) {
+                changedKeys.push_back({ rootKey, keyPath });
+            } else {
+                changesOverflowed = true; // Too many to re-sync one by one (e.g. a bulk import)
+            }
+        }
+        if (!notifyPending.exchange(true)) {
+            PostMessage(hMainWindow, WM_REGISTRY_CHANGED, 0, 0);
+        }
+    }
+
+    // Keys reported as changed since the last call (UI thread); overflowed means re-sync everything
+    std::vector<std::pair<HKEY, std::string>> TakeChangedKeys(bool& overflowed) {
+        notifyPending = false;
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        std::vector<std::pair<HKEY, std::string>> changed;
+        changed.swap(changedKeys);
+        overflowed = changesOverflowed;
+        changesOverflowed = false;
+        return changed;
+    }
+
+    size_t Hits() const { return hits; }
+    size_t Misses() const { return misses; }
+
+private:
+    struct Entry {
+        std::shared_ptr<const CachedKey> key;
+        HKEY rootKey;
+        std::string keyPath;
+        std::list<std::string>::iterator recent;
+    };
+
+    // Dropped keys are added to unwatched, if given
+    void DropEntry(const std::string& location, std::vector<std::pair<HKEY, std::string>>* unwatched) {
+        auto it = entries.find(location);
+        if (it == entries.end()) return;
+        if (unwatched) unwatched->push_back({ it->second.rootKey, it->second.keyPath });
+        recentKeys.erase(it->second.recent);
+        entries.erase(it);
+    }
+
+    void DropSubtree(const std::string& location, std::vector<std::pair<HKEY, std::string>>* unwatched) {
+        DropEntry(location, unwatched);
+        std::string childPrefix = location.back() == '\\' ? location : location + "\\";
+        for (auto it = entries.begin(); it != entries.end();) {
+            if (it->first.compare(0, childPrefix.size(), childPrefix) == 0) {
+                if (unwatched) unwatched->push_back({ it->second.rootKey, it->second.keyPath });
+                recentKeys.erase(it->second.recent);
+                it = entries.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    std::mutex cacheMutex;
+    std::unordered_map<std::string, Entry> entries;
+    std::list<std::string> recentKeys; // Most recently used first
+    std::vector<std::pair<HKEY, std::string>> changedKeys;
+    uint64_t changeGeneration = 0;
+    RegistryBackend* watchedBackend = nullptr; // Backend the cached keys are watched on
+    bool changesOverflowed = false;
+    std::atomic<bool> notifyPending{ false };
+    std::atomic<size_t> hits{ 0 };
+    std::atomic<size_t> misses{ 0 };
+};
+
+// Nodes behind the tree items: each item's lParam is a node id, and the node holds the parent
+// id, the interned key name and the root HKEY. Paths are rebuilt from the node chain into a
+// caller-owned buffer, so resolving an item never queries the control or allocates.
+class TreeNodeTable {
+public:
+    static const uint32_t NO_NODE = 0xFFFFFFFF;
+
+    struct Node {
+        uint32_t parent;
+        uint32_t nameId;
+        HKEY rootKey;
+    };
+
+    uint32_t AddRoot(HKEY rootKey) {
+        return AddNode({ NO_NODE, NO_NODE, rootKey });
+    }
+
+    uint32_t AddChild(uint32_t parent, const std::string& name) {
+        return AddNode({ parent, InternName(name), nodes[parent].rootKey });
+    }
+
+    // Called when the tree item goes away; the id is reused by the next insert
+    void Release(uint32_t nodeId) {
+        if (nodeId < nodes.size()) freeNodes.push_back(nodeId);
+    }
+
+    void Clear() {
+        nodes.clear();
+        freeNodes.clear();
+        names.clear();
+        nameIds.clear();
+        nameArena = ByteArena();
+    }
+
+    const Node& Get(uint32_t nodeId) const { return nodes[nodeId]; }
+
+    // Key name of a node (empty for root nodes)
+    std::string_view Name(uint32_t nodeId) const {
+        uint32_t nameId = nodes[nodeId].nameId;
+        return nameId == NO_NODE ? std::string_view() : names[nameId];
+    }
+
+    // Backslash-joined path below the root, O(depth); reuses the buffers once they have grown
+    void BuildPath(uint32_t nodeId, std::string& keyPath) {
+        chain.clear();
+        size_t length = 0;
+        for (uint32_t id = nodeId; nodes[id].parent != NO_NODE; id = nodes[id].parent) {
+            chain.push_back(id);
+            length += names[nodes[id].nameId].size() + 1;
+        }
+
+        keyPath.clear();
+        keyPath.reserve(length);
+        for (auto id = chain.rbegin(); id != chain.rend(); ++id) {
+            if (!keyPath.empty()) keyPath += '\\';
+            keyPath.append(names[nodes[*id].nameId]);
+        }
+    }
+
+private:
+    uint32_t AddNode(const Node& node) {
+        if (!freeNodes.empty()) {
+            uint32_t nodeId = freeNodes.back();
+            freeNodes.pop_back();
+            nodes[nodeId] = node;
+            return nodeId;
+        }
+        nodes.push_back(node);
+        return (uint32_t)(nodes.size() - 1);
+    }
+
+    uint32_t InternName(const std::string& name) {
+        auto found = nameIds.find(std::string_view(name));
+        if (found != nameIds.end()) return found->second;
+
+        std::string_view stored(nameArena.CopyString(name.c_str(), name.size()), name.size());
+        names.push_back(stored);
+        nameIds[stored] = (uint32_t)(names.size() - 1);
+        return (uint32_t)(names.size() - 1);
+    }
+
+    std::vector<Node> nodes;
+    std::vector<uint32_t> freeNodes;
+    std::vector<std::string_view> names;
+    std::unordered_map<std::string_view, uint32_t> nameIds;
+    ByteArena nameArena;
+    std::vector<uint32_t> chain;
+};
+
+Win32RegistryBackend win32Registry;
+std::unique_ptr<RegistryBackend> offlineHive; // Imported .reg file or mapped snapshot
+RegistryBackend* registry = &win32Registry; // Backend used by every registry operation
+RegistryViewCache viewCache;
+TreeNodeTable treeNodes;
+
+// Counters reported by the .reg importer
+struct RegImportStats {
+    size_t keys = 0;
+    size_t values = 0;
+    size_t deletions = 0;
+    size_t bytes = 0;
+};
+
+// Counters reported by the .reg exporter
+struct RegExportStats {
+    size_t keys = 0;
+    size_t values = 0;
+    size_t skipped = 0; // Keys that could not be opened
+    size_t bytes = 0;
+};
+
+// One side of a diff: a key and everything below it, in any backend
+struct RegDiffSource {
+    RegistryBackend* backend;
+    HKEY rootKey;
+    std::string keyPath;
+};
+
+// Counters of a diff
+struct RegDiffStats {
+    size_t keysCompared = 0;
+    size_t keysAdded = 0;
+    size_t keysRemoved = 0;
+    size_t valuesAdded = 0;
+    size_t valuesRemoved = 0;
+    size_t valuesChanged = 0;
+    size_t skipped = 0;
+    size_t bytes = 0;
+};
+
+// Keys read or written so far by a file operation on another thread, and a flag that stops it
+struct RegFileProgress {
+    std::atomic<size_t> keys{ 0 };
+    std::atomic<bool> cancel{ false };
+};
+
+// Progress of a recursive key deletion, shared with the thread that shows it
+struct RegDeleteProgress {
+    std::atomic<size_t> keysDeleted{ 0 };
+    std::atomic<size_t> keysFailed{ 0 };
+    std::atomic<bool> cancel{ false };
+};
+
+// Counters reported by a registry batch
+struct RegBatchStats {
+    size_t keysOpened = 0;
+    size_t keysCreated = 0;
+    size_t keysDeleted = 0;
+    size_t valuesSet = 0;
+    size_t valuesDeleted = 0;
+    bool transacted = false; // Applied in a backend transaction rather than with the undo journal
+};
+
+// Progress of a batch applied on another thread; cancelling undoes what was written so far
+struct RegBatchProgress {
+    std::atomic<size_t> keysApplied{ 0 };
+    std::atomic<bool> cancel{ false };
+};
+
+// Queued registry edits applied as one atomic operation. Edits are grouped by key so every
+// key is opened once; a key deletion is a barrier that keeps the order of the edits around it.
+// The batch runs inside a backend transaction (KTM) where there is one; otherwise the prior
+// state of everything it touches is journaled and restored if any edit fails.
+class RegistryBatch {
+public:
+    explicit RegistryBatch(RegistryBackend& backend) : backend(backend) {}
+
+    void CreateKey(HKEY rootKey, const std::string& keyPath);
+    void DeleteKey(HKEY rootKey, const std::string& keyPath); // With all of its subkeys
+    void SetValue(HKEY rootKey, const std::string& keyPath, const std::string& name, DWORD type,
+                  const BYTE* data, DWORD size);
+    void DeleteValue(HKEY rootKey, const std::string& keyPath, const std::string& name);
+
+    size_t EditCount() const { return edits.size(); }
+    size_t DataSize() const { return editData.size(); } // Bytes of queued value data
+    // Keys written or deleted by the batch, for views and indexes to refresh
+    std::vector<std::pair<HKEY, std::string>> TouchedKeys() const;
+    void Clear();
+
+    // Apply every queued edit or none of them
+    bool Apply(std::string& error, RegBatchStats* stats = nullptr, RegBatchProgress* progress = nullptr);
+
+private:
+    enum EditKind { CreateEdit, DeleteKeyEdit, SetValueEdit, DeleteValueEdit };
+
+    struct Edit {
+        EditKind kind;
+        uint32_t keyIndex;
+        std::string name;
+        DWORD type;
+        size_t dataOffset;
+        DWORD dataSize;
+    };
+
+    struct BatchKey {
+        HKEY rootKey;
+        std::string keyPath;
+        uint32_t phase; // Number of key deletions queued before the key was first used
+    };
+
+    enum UndoKind { UndoDeleteTree, UndoRestoreValue, UndoDeleteValue, UndoRestoreTree };
+
+    struct UndoEntry {
+        UndoKind kind;
+        HKEY rootKey;
+        std::string keyPath;
+        std::string name;
+        DWORD type;
+        size_t dataOffset; // In journalData
+        DWORD dataSize;
+        size_t firstSaved; // UndoRestoreTree: range in savedKeys
+        size_t savedCount;
+    };
+
+    struct SavedKey {
+        std::string keyPath;
+        size_t firstValue; // Range in savedValues
+        size_t valueCount;
+    };
+
+    struct SavedValue {
+        std::string name;
+        DWORD type;
+        size_t dataOffset; // In journalData
+        DWORD dataSize;
+    };
+
+    uint32_t FindKey(HKEY rootKey, const std::string& keyPath);
+    void AddEdit(EditKind kind, uint32_t keyIndex, const std::string& name, DWORD type, const BYTE* data, DWORD size);
+    LONG ApplyKeyEdits(uint32_t keyIndex, const std::vector<uint32_t>& keyEdits, bool journaled, RegBatchStats& counters);
+    LONG OpenForEdit(const BatchKey& key, bool create, bool journaled, HKEY* phKey, bool& created);
+    void JournalValue(HKEY hKey, const BatchKey& key, const std::string& name);
+    void JournalTree(HKEY rootKey, const std::string& keyPath);
+    void SaveTree(HKEY rootKey, std::string& keyPath);
+    void RollBack();
+
+    RegistryBackend& backend;
+    std::vector<BatchKey> keys;
+    std::unordered_map<std::string, uint32_t> keyIndex; // Location and phase -> key
+    std::vector<Edit> edits;
+    std::vector<BYTE> editData;
+    uint32_t phase = 0;
+    uint32_t lastKey = UINT32_MAX;
+
+    std::vector<UndoEntry> journal;
+    std::vector<BYTE> journalData;
+    std::vector<SavedKey> savedKeys;
+    std::vector<SavedValue> savedValues;
+};
+
+// Trigram search index over key paths, value names and string value data.
+// Every crawled subtree becomes a shard with its own key table and posting lists; a posting
+// list holds the ids of the keys that contain a trigram, delta-encoded as varints. A changed
+// key is appended to the update shard under a fresh id and its old entry is marked dead, so
+// posting lists only ever grow at the end. Queries intersect the lists of the pattern's
+// trigrams and then verify the surviving keys against the backend. A root may be crawled on the
+// I/O worker while the window edits it; those edits are recorded and replayed over the crawl.
+class RegistrySearchIndex {
+public:
+    struct Hit {
+        HKEY rootKey;
+        std::string keyPath;
+        std::string valueName;
+        DWORD valueType;
+        bool keyMatch; // The key path itself matched, not a value
+    };
+
+    // Crawl a root in parallel and replace whatever was indexed for it before
+    size_t IndexRoot(RegistryBackend& backend, HKEY rootKey);
+    // Re-read one key (dropping it if it no longer exists)
+    void UpdateKey(RegistryBackend& backend, HKEY rootKey, const std::string& keyPath);
+    // Forget a key and all of its subkeys
+    void RemoveSubtree(HKEY rootKey, const std::string& keyPath);
+    // Substring (case-insensitive) or ECMAScript regex query over indexed roots, or only over
+    // onlyRoot; maxHits counts hits in the searched roots only
+    bool Search(RegistryBackend& backend, const std::string& pattern, bool isRegex, size_t maxHits,
+                std::vector<Hit>& hits, std::string& error, HKEY onlyRoot = nullptr) const;
+
+    bool IsRootIndexed(HKEY rootKey) const;
+    void Clear();
+    size_t KeyCount() const;
+    size_t PostingBytes() const;
+
+private:
+    struct PostingList {
+        std::vector<BYTE> bytes;
+        uint32_t lastId = 0;
+        uint32_t count = 0;
+    };
+
+    struct IndexedKey {
+        HKEY rootKey;
+        std::string keyPath;
+        bool live;
+    };
+
+    struct Shard {
+        HKEY rootKey = nullptr; // nullptr for the update shard, which mixes roots
+        std::vector<IndexedKey> keys;
+        std::unordered_map<uint32_t, PostingList> postings;
+        size_t deadKeys = 0;
+    };
+
+    struct CrawlScratch {
+        std::string text;
+        std::string valueName;
+        std::vector<BYTE> valueData;
+        std::vector<uint32_t> trigrams;
+    };
+
+    static void AppendPosting(PostingList& list, uint32_t id);
+    static void DecodePostings(const PostingList& list, std::vector<uint32_t>& ids);
+    static void IntersectPostings(const PostingList& list, std::vector<uint32_t>& candidates);
+    static bool AddKey(RegistryBackend& backend, HKEY rootKey, const std::string& keyPath,
+                       Shard& shard, CrawlScratch& scratch, std::vector<std::string>* subKeys);
+    static void CrawlSubtree(RegistryBackend& backend, HKEY rootKey, std::string& keyPath,
+                             Shard& shard, CrawlScratch& scratch);
+    void RegisterShardKeys(uint32_t shardIndex);
+    void MarkDead(const std::string& location);
+    void CompactShard(uint32_t shardIndex);
+    void RecordCrawlChange(HKEY rootKey, const std::string& keyPath, bool removed);
+
+    struct CrawlChange {
+        HKEY rootKey;
+        std::string keyPath;
+        bool removed; // RemoveSubtree rather than UpdateKey
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::unordered_map<std::string, std::pair<uint32_t, uint32_t>> keyLocations; // "ROOT\PATH" -> (shard, key)
+    std::vector<HKEY> indexedRoots;
+    std::vector<HKEY> crawlingRoots;
+    std::vector<CrawlChange> crawlChanges; // Edits of crawling roots, replayed when the crawl is merged
+    mutable std::shared_mutex indexMutex;
+};
+
+RegistrySearchIndex searchIndex;
+HKEY findAfterIndexing = nullptr; // Root whose crawl a Find is waiting for
+
+// Literal (SSE2-scanned) or ECMAScript regex pattern matched against value names and strings.
+// Without matchCase, ASCII letters match either case.
+class RegTextMatcher {
+public:
+    bool Compile(const std::string& pattern, bool isRegex, bool matchCase, std::string& error);
+    bool Matches(const char* text, size_t length) const;
+    // Append the text to out with every match replaced (regex replacements may use $1, $& ...);
+    // returns the number of matches
+    size_t Replace(const char* text, size_t length, const std::string& replacement, std::string& out) const;
+
+private:
+    std::string needle; // Folded unless matchCase
+    bool isRegex = false;
+    bool foldCase = true;
+    std::regex expression;
+};
+
+struct RegReplaceOptions {
+    std::string pattern;     // Matched in the data of string values
+    std::string replacement;
+    std::string namePattern; // Only values whose name matches as well (empty: every value)
+    bool isRegex = false;    // Both patterns are regexes
+    bool matchCase = false;
+    std::vector<DWORD> types = { REG_SZ, REG_EXPAND_SZ, REG_MULTI_SZ };
+};
+
+struct RegReplaceChange {
+    HKEY rootKey;
+    std::string keyPath;
+    std::string name;
+    DWORD type;
+    std::vector<BYTE> oldData;
+    std::vector<BYTE> newData;
+};
+
+// Keys scanned so far by a find-and-replace on another thread, and a flag that stops the scan
+struct RegReplaceProgress {
+    std::atomic<size_t> keysScanned{ 0 };
+    std::atomic<bool> cancel{ false };
+};
+
+struct RegReplaceStats {
+    size_t keysScanned = 0;
+    size_t valuesScanned = 0;
+    size_t valuesChanged = 0;
+    size_t replacements = 0;
+};
+
+// Bulk find-and-replace over the string values of a subtree. Scan walks the subtree once and
+// collects every change without writing anything, which is all a dry run does; the changes are
+// then queued into a RegistryBatch so they are applied together or not at all. Each string of
+// a REG_MULTI_SZ is matched on its own, and terminating NULs are kept as they are.
+class RegistryReplacer {
+public:
+    explicit RegistryReplacer(RegistryBackend& backend) : backend(backend) {}
+
+    bool Prepare(const RegReplaceOptions& options, std::string& error);
+    bool Scan(HKEY rootKey, const std::string& keyPath, std::string& error, RegReplaceProgress* progress = nullptr);
+    void QueueChanges(RegistryBatch& batch) const;
+
+    const std::vector<RegReplaceChange>& Changes() const { return changes; }
+    const RegReplaceStats& Stats() const { return stats; }
+
+private:
+    void ScanKey(HKEY rootKey, std::string& keyPath);
+    bool ReplaceData(const std::vector<BYTE>& data, std::vector<BYTE>& replaced);
+
+    RegistryBackend& backend;
+    RegReplaceOptions options;
+    RegTextMatcher dataMatcher;
+    RegTextMatcher nameMatcher;
+    std::vector<RegReplaceChange> changes;
+    RegReplaceStats stats;
+    RegReplaceProgress* progress = nullptr; // Of the scan running now, if anyone watches it
+    std::string text; // Scratch for ReplaceData
+};
+
+enum AuditRecordKind : BYTE { AuditValueChange, AuditKeyCreated, AuditKeyDeleted };
+
+// One observed change. A value hash of 0 means the value did not exist on that side.
+struct AuditRecord {
+    uint64_t time; // FILETIME (100 ns units since 1601, UTC)
+    uint32_t keyId;
+    AuditRecordKind kind;
+    std::string valueName;
+    uint64_t oldHash;
+    uint64_t newHash;
+};
+
+// Append-only audit log of registry changes. Records are buffered and written in blocks; a block
+// stores timestamps as deltas, key ids as varints, value names through a block-local dictionary
+// and hashes only when present. Each block header lists the distinct key ids it holds and the
+// key paths it introduces, so opening the log reads only headers and builds the per-key index
+// (key id -> blocks). A query resolves a key prefix to ids, keeps the blocks that hold one of
+// them within the time range, and decodes just those. A torn block at the end is dropped.
+class RegistryAuditLog {
+public:
+    static const size_t kBlockRecords = 4096;
+
+    ~RegistryAuditLog() { Close(); }
+
+    bool Open(const std::string& fileName, bool readOnly, std::string& error);
+    void Close();
+
+    uint32_t KeyId(HKEY rootKey, const std::string& keyPath);
+    void KeyLocation(uint32_t keyId, HKEY& rootKey, std::string& keyPath) const;
+    bool Append(const AuditRecord& record); // True once a block's worth of records is buffered
+    bool Flush(std::string& error); // Write buffered records as a block
+    uint64_t OldestBuffered() const; // Time of the first buffered record, 0 if none
+
+    // Records of the key and its subkeys (every key if keyPath is null) with from <= time <= to
+    bool Query(HKEY rootKey, const std::string* keyPath, uint64_t from, uint64_t to, size_t maxRecords,
+               std::vector<AuditRecord>& records, std::string& error);
+
+    size_t BlockCount() const { return blocks.size(); }
+    size_t BlocksRead() const { return blocksRead; } // By the last query
+
+private:
+    struct BlockHeader {
+        char magic[4];
+        uint32_t indexSize;   // Key id list and key definitions following this header
+        uint32_t payloadSize; // Encoded records following the index
+        uint32_t recordCount;
+        uint32_t checksum;    // Of the payload
+        uint32_t keyCount;
+        uint32_t newKeyCount;
+        uint32_t reserved;
+        uint64_t firstTime;
+        uint64_t lastTime;
+    };
+
+    struct Block {
+        uint64_t payloadOffset;
+        uint32_t payloadSize;
+        uint32_t recordCount;
+        uint32_t checksum;
+        uint64_t firstTime;
+        uint64_t lastTime;
+    };
+
+    struct AuditKey {
+        HKEY rootKey;
+        std::string keyPath;
+    };
+
+    static void AppendVarint(std::vector<BYTE>& out, uint64_t value);
+    static bool ReadVarint(const BYTE*& p, const BYTE* end, uint64_t& value);
+    static uint32_t Checksum(const BYTE* data, size_t size);
+    bool ReadIndex();
+    uint32_t AddKey(HKEY rootKey, const std::string& keyPath);
+    bool DecodeBlock(const Block& block, const std::unordered_set<uint32_t>* keyIds, uint64_t from, uint64_t to,
+                     size_t maxRecords, std::vector<AuditRecord>& records, std::string& error);
+
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+    bool readOnly = true;
+    std::vector<Block> blocks;
+    std::vector<AuditKey> keys;
+    std::map<std::string, uint32_t> keyIds;                       // Location -> id, ordered for prefix ranges
+    std::unordered_map<uint32_t, std::vector<uint32_t>> keyBlocks; // Key id -> blocks holding it, ascending
+    uint32_t writtenKeys = 0;                                     // Keys defined by blocks on disk
+    std::vector<AuditRecord> buffered;
+    uint64_t lastTime = 0; // Of the newest record; later records never go back in time
+    size_t blocksRead = 0;
+    mutable std::mutex logMutex;
+};
+
+// Records changes under a set of subtrees into an audit log. The watcher keeps the value hashes
+// and subkey names of every key it tracks; a change notification makes it re-read the key named
+// (or, when the backend only names the watched root, the whole subtree), compare, and log the
+// differences. Keys that appear or vanish are logged with all of their values.
+class RegistryAuditWatcher : public RegistryChangeListener {
+public:
+    RegistryAuditWatcher(RegistryBackend& backend, RegistryAuditLog& log) : backend(backend), log(log) {}
+    ~RegistryAuditWatcher() { Stop(); }
+
+    bool Start(const std::vector<std::pair<HKEY, std::string>>& subtrees, std::string& error);
+    void Stop();
+    // Wait up to timeoutMs for records logged since the last call
+    std::vector<AuditRecord> TakeRecords(DWORD timeoutMs);
+
+    void OnKeyChanged(HKEY rootKey, const std::string& keyPath) override;
+
+    static uint64_t HashValue(DWORD type, const std::vector<BYTE>& data);
+
+private:
+    struct KeyState {
+        std::unordered_map<std::string, uint64_t> values; // Name -> hash
+        std::vector<std::string> subKeys;
+    };
+
+    void Run();
+    void Rescan(HKEY rootKey, std::string& keyPath, bool deep, uint64_t now);
+    void ScanNew(HKEY rootKey, std::string& keyPath, uint64_t now, bool record);
+    void ForgetKey(HKEY rootKey, std::string& keyPath, uint64_t now);
+    bool ReadKey(HKEY rootKey, const std::string& keyPath, KeyState& state);
+    const std::pair<HKEY, std::string>* FindSubtree(HKEY rootKey, const std::string& keyPath) const;
+    void Record(HKEY rootKey, const std::string& keyPath, AuditRecordKind kind, const std::string& valueName,
+                uint64_t oldHash, uint64_t newHash, uint64_t now);
+
+    RegistryBackend& backend;
+    RegistryAuditLog& log;
+    std::vector<std::pair<HKEY, std::string>> subtrees;
+    std::unordered_map<std::string, KeyState> states; // Location -> last seen contents (worker thread only)
+
+    std::thread worker;
+    std::mutex queueMutex;
+    std::condition_variable queueReady;
+    std::condition_variable recordsReady;
+    std::deque<std::pair<HKEY, std::string>> changedKeys;
+    std::unordered_set<std::string> queuedKeys;
+    std::vector<AuditRecord> newRecords;
+    bool stopping = false;
+};
+
+// Rows of the values list, formatted only when the list view asks for them (LVS_OWNERDATA).
+// A key is read from its cached entry when the view cache holds its values; the rows of a key
+// too large for the cache are fetched by the I/O worker a visible range at a time (and read by
+// index through an open handle when there is no cache entry at all). Only the row count is
+// known up front, and formatted rows are kept in a small LRU. Fixed rows (search results) can
+// be shown the same way.
+class ValueListModel {
+public:
+    struct Row {
+        std::string name;
+        std::string type;
+        std::string data;
+    };
+
+    static const size_t kCachedRows = 256;
+
+    ~ValueListModel() { Reset(); }
+
+    bool Open(RegistryBackend& backend, HKEY rootKey, const std::string& keyPath,
+              std::shared_ptr<const RegistryViewCache::CachedKey> cached);
+    void ShowRows(std::vector<Row>&& rows);
+    void Reset();
+
+    size_t RowCount() const { return rowCount; }
+    const Row* GetRow(size_t index);
+    void Prefetch(size_t first, size_t last);
+    void StoreRows(size_t first, std::vector<Row>&& rows); // Fetched by the I/O worker
+    size_t RowsFormatted() const { return rowsFormatted; }
+
+    static void FormatValue(const std::string& name, DWORD type, const std::vector<BYTE>& data, Row& row);
+
+private:
+    bool FormatRow(size_t index, Row& row);
+    void AddRecentRow(size_t index, Row&& row);
+
+    RegistryBackend* backend = nullptr;
+    HKEY hKey = nullptr;
+    std::shared_ptr<const RegistryViewCache::CachedKey> cached;
+    std::vector<Row> fixedRows;
+    size_t rowCount = 0;
+    size_t rowsFormatted = 0;
+    bool rowsFromWorker = false;
+    size_t requestedFirst = 1; // Range last asked of the worker (empty when first > last)
+    size_t requestedLast = 0;
+
+    std::list<std::pair<size_t, Row>> recentRows; // Most recently used first
+    std::unordered_map<size_t, std::list<std::pair<size_t, Row>>::iterator> rowIndex;
+    std::string valueName;
+    std::vector<BYTE> valueData;
+};
+
+ValueListModel valueListModel;
+
+// Recursive key deletion running on a background thread
+struct KeyDeleteJob {
+    std::thread thread;
+    RegDeleteProgress progress;
+    HKEY rootKey = nullptr;
+    std::string keyPath;
+    DWORD startTime = 0;
+    std::atomic<LONG> result{ ERROR_SUCCESS };
+};
+
+KeyDeleteJob keyDeleteJob;
+
+// Find-and-replace of the window, scanned and then written on the I/O worker. The worker fills
+// in the outcome before it posts each result; the window owns everything else.
+struct ReplaceJob {
+    std::unique_ptr<RegistryReplacer> replacer;
+    RegReplaceProgress scanProgress;
+    RegBatchProgress applyProgress;
+    HKEY rootKey = nullptr;
+    std::string keyPath;
+    DWORD startTime = 0;
+    bool running = false; // From the scan until the changes are written or dropped
+    bool busy = false;    // A step is queued on or running on the worker
+    bool succeeded = false;
+    std::string error;
+    std::string summary; // Of the preview; empty while scanning
+    std::vector<std::pair<HKEY, std::string>> touchedKeys;
+};
+
+ReplaceJob replaceJob;
+
+// Save, import, comparison or offline hive load of the window, run on the I/O worker. The worker
+// fills in the outcome before it posts the result; the window owns everything else.
+struct FileJob {
+    const char* action = ""; // "Saving", "Importing", ..., for the progress shown
+    std::string fileName;
+    std::string patchFileName; // Comparison: where the patch is saved
+    HKEY rootKey = nullptr;
+    std::string keyPath;
+    bool snapshot = false; // Save: a .regsnap rather than .reg text
+    bool opensHive = false; // The backend is switched to the loaded hive when it arrives
+    DWORD startTime = 0;
+    bool busy = false; // Queued on or running on the worker
+    RegFileProgress progress;
+    bool succeeded = false;
+    std::string error;
+    RegExportStats exportStats;
+    RegImportStats importStats;
+    RegDiffStats diffStats;
+    std::unique_ptr<RegistryBackend> hive; // Hive load: nullptr if it failed or was cancelled
+    size_t hiveKeys = 0;
+    size_t hiveValues = 0;
+};
+
+FileJob fileJob;
+
+// Key lookup, key creation or value edit of the window, run on the I/O worker: a lookup first
+// where the edit depends on whether the key exists, then the write. The worker fills in the
+// outcome before it posts each result; the window owns everything else.
+struct EditJob {
+    enum Action { CheckKey, CreateKey, SetValue, DeleteValue };
+    Action action = CheckKey;
+    HKEY rootKey = nullptr;
+    std::string keyPath;
+    std::string valueName;
+    std::string valueData;
+    bool busy = false;      // A step is queued on or running on the worker
+    bool keyExists = false; // Of the lookup
+    bool succeeded = false;
+    std::string error;
+    RegBatchStats stats;
+};
+
+EditJob editJob;
+
+// Find of the window, searched on the I/O worker. The worker fills in the outcome before it posts
+// the result; the window owns everything else.
+struct FindJob {
+    std::string pattern;
+    bool isRegex = false;
+    bool busy = false; // Queued on or running on the worker
+    bool succeeded = false;
+    std::string error;
+    std::vector<RegistrySearchIndex::Hit> hits;
+    DWORD searchTime = 0;
+};
+
+FindJob findJob;
+
+// Recursive size of a subtree: the key itself and every key below it
+struct SubtreeStats {
+    uint64_t keys = 0;
+    uint64_t values = 0;
+    uint64_t valueBytes = 0;
+};
+
+// Subtree stats of every key a stats pass has visited. A pass splits the requested subtree into
+// units that worker threads walk in parallel, then adds the keys above the units up from their
+// children. Entries are reused by later passes, so after a change only the changed key and its
+// ancestors are walked again (everything below them is still cached). A key changed while a pass
+// runs may have been read half-way, so the pass caches nothing for that key, its ancestors or the
+// keys below it, and is run again; after a few tries its totals are returned uncached.
+class RegistryStatsCache {
+public:
+    typedef std::function<bool()> CancelCheck;
+
+    // Stats of a subtree, computing whatever is not cached; false if the key cannot be opened or
+    // the pass was cancelled (complete subtrees walked so far are kept)
+    bool Compute(RegistryBackend& backend, HKEY rootKey, const std::string& keyPath, SubtreeStats& stats,
+                 const CancelCheck& cancelled);
+    // Compute, then the stats of each direct subkey
+    bool ComputeChildren(RegistryBackend& backend, HKEY rootKey, const std::string& keyPath, SubtreeStats& total,
+                         std::vector<std::pair<std::string, SubtreeStats>>& children, const CancelCheck& cancelled);
+
+    // A key's values or subkey list changed: drop it and its ancestors
+    void InvalidateKey(HKEY rootKey, const std::string& keyPath);
+    // A key was deleted: drop it, everything below it and its ancestors
+    void RemoveSubtree(HKEY rootKey, const std::string& keyPath);
+    void Clear();
+    size_t EntryCount() const;
+
+private:
+    typedef std::vector<std::pair<std::string, SubtreeStats>> Found;
+
+    bool Lookup(const std::string& location, SubtreeStats& stats) const;
+    bool ReadKey(RegistryBackend& backend, HKEY rootKey, const std::string& keyPath, SubtreeStats& own,
+                 std::vector<std::string>* subKeys) const;
+    bool WalkSubtree(RegistryBackend& backend, HKEY rootKey, std::string& keyPath, SubtreeStats& stats,
+                     Found& found, const CancelCheck& cancelled) const;
+    // Locations invalidated while a pass runs
+    struct PassChanges {
+        std::vector<std::string> locations;
+        bool everything = false; // Cleared, or more changes than are worth tracking
+    };
+    static const int kMaxPasses = 3;
+    static const size_t kMaxPassChanges = 256;
+
+    static bool Overlaps(const std::string& first, const std::string& second);
+    bool ComputePass(RegistryBackend& backend, HKEY rootKey, const std::string& keyPath, SubtreeStats& stats,
+                     const CancelCheck& cancelled, bool& stale);
+    bool Store(const Found& found, const PassChanges& changes);
+    void NoteChange(const std::string& location);
+    void DropWithAncestors(std::string location);
+
+    std::unordered_map<std::string, SubtreeStats> entries; // "ROOT\PATH" -> stats
+    std::vector<PassChanges*> runningPasses; // Passes that have not finished yet
+    mutable std::shared_mutex statsMutex;
+};
+
+RegistryStatsCache subtreeStats;
+
+// Subkeys listed by the sizes view, and the column they are sorted by
+std::vector<std::pair<std::string, SubtreeStats>> shownSubtreeSizes;
+int subtreeSortColumn = 2;
+bool sizesColumnsShown = false;
+
+// Registry reads for the window on a background thread, so a slow key (network hive, huge
+// value list) never blocks the UI. Keys are read into the view cache and the UI re-runs its
+// cache-only path when WM_REGISTRY_LOADED arrives. Only the latest selection counts: a new one
+// replaces the pending one, rows of a superseded selection stop being read, and results that
+// belong to an older selection are dropped.
+class RegistryIoWorker {
+public:
+    enum RequestKind { LoadSelection, LoadSubtreeSizes, LoadExpansion, LoadChildCount, LoadRefresh, LoadValueRows, IndexSearchRoot,
+                       ReplaceScan, ReplaceApply, SaveFile, ImportFile, DiffFile, LoadHive, EditLookup, EditApply,
+                       FindText };
+
+    struct Result {
+        RequestKind kind;
+        uint64_t generation; // Selection current when the request was taken
+        HKEY rootKey;
+        std::string keyPath;
+        std::shared_ptr<const RegistryViewCache::CachedKey> key; // nullptr if the key cannot be opened
+        size_t firstRow;
+        std::vector<ValueListModel::Row> rows;
+        bool sizesComputed; // LoadSubtreeSizes: the subtree and its direct subkeys
+        SubtreeStats subtreeTotal;
+        std::vector<std::pair<std::string, SubtreeStats>> subtreeSizes;
+        size_t indexedKeys; // IndexSearchRoot: keys crawled, and how long it took
+        DWORD indexTime;
+    };
+
+    void Start(HWND notifyWindow, RegistryBackend& backend);
+    void Stop();
+    // Switch backends: waits for the read in flight and drops every other request and result
+    void SetBackend(RegistryBackend& backend);
+
+    // Key shown in the values list; load is false when the UI found it in the cache.
+    // With sizes the subtree stats of the key's subkeys are computed instead.
+    void SelectKey(HKEY rootKey, const std::string& keyPath, bool load, bool sizes = false);
+    // Subkeys of a tree item being expanded or refreshed, or whether it has any; IndexSearchRoot
+    // crawls a whole root into the search index, ReplaceScan and ReplaceApply run the steps of
+    // replaceJob, SaveFile, ImportFile, DiffFile and LoadHive run fileJob, EditLookup and EditApply
+    // the steps of editJob, and FindText searches for findJob
+    void LoadKey(RequestKind kind, HKEY rootKey, const std::string& keyPath);
+    // Formatted rows of the selected key (too large for the cache); replaces a pending range
+    void LoadRows(size_t first, size_t last);
+
+    std::vector<Result> TakeResults();
+    uint64_t SelectionGeneration() const { return selectionGeneration; }
+
+private:
+    struct KeyRequest {
+        RequestKind kind;
+        HKEY rootKey;
+        std::string keyPath;
+    };
+
+    void Run();
+    void ReadRows(Result& result, size_t last);
+
+    HWND notifyWindow = nullptr;
+    RegistryBackend* backend = nullptr;
+    std::thread thread;
+    std::mutex queueMutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    bool stopping = false;
+    bool busy = false;
+
+    HKEY selectedRoot = nullptr;
+    std::string selectedPath;
+    bool selectionPending = false;
+    bool selectionSizes = false;
+    std::atomic<uint64_t> selectionGeneration{ 0 };
+    size_t rowsFirst = 0;
+    size_t rowsLast = 0;
+    bool rowsPending = false;
+    std::deque<KeyRequest> keyRequests; // Tree items, first come first served
+    std::unordered_set<std::string> queuedKeys;
+
+    std::vector<Result> results;
+    std::atomic<bool> notifyPending{ false };
+};
+
+RegistryIoWorker ioWorker;
+
+// Headless command mode: registry commands from the command line or a batch file, run on the
+// same backend as the window. Results stream to stdout as text or NDJSON (one object per line);
+// in text mode errors go to stderr.
+class RegistryCli {
+public:
+    int Run(const std::vector<std::string>& arguments);
+
+private:
+    typedef std::vector<std::string> Arguments;
+
+    bool RunCommand(const Arguments& arguments, size_t line);
+    bool Query(const Arguments& arguments);
+    bool QueryKey(HKEY rootKey, std::string& keyPath, const std::string* valueName, bool recursive);
+    bool Set(const Arguments& arguments);
+    bool Delete(const Arguments& arguments);
+    bool Export(const Arguments& arguments);
+    bool Import(const Arguments& arguments);
+    bool Find(const Arguments& arguments);
+    bool Replace(const Arguments& arguments);
+    bool Watch(const Arguments& arguments);
+    bool Audit(const Arguments& arguments);
+    bool Diff(const Arguments& arguments);
+    bool Stats(const Arguments& arguments);
+    bool Batch(const Arguments& arguments);
+    bool ApplyEdits(RegistryBatch& batch);
+
+    void WriteKey(HKEY rootKey, const std::string& keyPath);
+    void WriteValue(HKEY rootKey, const std::string& keyPath, const std::string& name, DWORD type,
+                    const std::vector<BYTE>& data);
+    void WriteAuditRecord(const RegistryAuditLog& log, const AuditRecord& record);
+    void WriteResult(const std::string& command, bool ok, size_t line);
+    void Flush();
+
+    bool json = false;
+    std::string output; // Written to stdout in large blocks
+    std::string error; // Of the current command
+    std::string details; // Extra fields of the current command's NDJSON result
+    RegistryBatch* atomicBatch = nullptr; // batch -atomic: edits are queued here and applied at the end
+    bool inBatch = false;
+};
+
+// Function prototypes
+LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
+void InitializeControls(HWND hwnd);
+void PopulateTreeView();
+void PopulateTreeChildren(HTREEITEM hParent, const std::vector<std::string>& subKeys);
+void RefreshTreeItem(HTREEITEM hItem);
+void RefreshTreeBranch(HKEY rootKey, const std::string& keyPath);
+HTREEITEM FindLoadedTreeItem(HKEY rootKey, const std::string& keyPath, bool* exact);
+void OnRegistryChanged();
+void RefreshTreeView();
+BOOL OnTreeItemExpanding(LPNMTREEVIEW pnmtv);
+void OnTreeGetDispInfo(LPNMTVDISPINFO pnmtvdi);
+bool GetTreeItemKeyPath(HTREEITEM hItem, HKEY& rootKey, std::string& keyPath);
+uint32_t GetTreeItemNode(HTREEITEM hItem);
+void OnTreeDeleteItem(LPNMTREEVIEW pnmtv);
+void SyncTreeChildren(HTREEITEM hItem, const std::vector<std::string>& subKeys);
+void OnTreeSelectionChanged();
+void PopulateValuesList(HKEY hKey, const std::string& keyPath);
+void ShowValuesList(HKEY hKey, const std::string& keyPath, std::shared_ptr<const RegistryViewCache::CachedKey> key);
+void OnRegistryLoaded();
+void SetValuesListColumns(bool sizes);
+void ShowSubtreeSizes();
+std::string FormatByteSize(uint64_t bytes);
+void ClearValuesList();
+void OnValuesGetDispInfo(NMLVDISPINFOW* pnmdi);
+void CreateRegistryKey();
+void DeleteRegistryKey();
+void SetRegistryValue();
+void DeleteRegistryValue();
+void SaveRegistryToFile();
+void LoadRegistryFromFile();
+void OpenOfflineHive();
+void UseLiveRegistry();
+void BuildSearchIndex();
+void OnSearchIndexBuilt(HKEY rootKey, size_t keyCount, DWORD elapsed);
+void FindInRegistry();
+void OnRegistrySearched();
+void ReplaceInRegistry();
+void ShowReplaceProgress();
+void OnReplaceScanned();
+void OnReplaceApplied();
+void EndReplaceStep();
+void EndReplaceJob();
+void UpdateCancelButton();
+void StartFileJob(const char* action, RegistryIoWorker::RequestKind kind);
+void ShowFileProgress();
+void EndFileJob();
+void OnRegistrySaved();
+void OnRegistryImported();
+void OnRegistryCompared();
+void OnHiveLoaded();
+bool MustWaitForHive();
+void StartEditStep(RegistryIoWorker::RequestKind kind);
+void OnEditLookedUp();
+void OnEditApplied();
+void DiffWithRegFile();
+bool ImportRegFile(RegistryBackend& backend, const std::string& fileName, std::string& error, RegImportStats* stats = nullptr,
+                   bool atomic = false, RegFileProgress* progress = nullptr);
+bool ExportRegFile(RegistryBackend& backend, HKEY rootKey, const std::string& keyPath,
+                   const std::string& fileName, std::string& error, RegExportStats* stats = nullptr,
+                   RegFileProgress* progress = nullptr);
+bool WriteRegSnapshot(RegistryBackend& backend, HKEY rootKey, const std::string& keyPath,
+                      const std::string& fileName, std::string& error, RegExportStats* stats = nullptr,
+                      RegFileProgress* progress = nullptr);
+bool DiffRegistry(const RegDiffSource& from, const RegDiffSource& to, const std::string& patchFileName,
+                  std::string& error, RegDiffStats* stats, RegFileProgress* progress = nullptr);
+std::unique_ptr<RegistryBackend> LoadHiveFile(const std::string& fileName, std::string& error,
+                                              size_t* keyCount, size_t* valueCount, RegFileProgress* progress = nullptr);
+LONG DeleteKeyTree(RegistryBackend& backend, HKEY rootKey, const std::string& keyPath);
+LONG DeleteKeyTreeParallel(RegistryBackend& backend, HKEY rootKey, const std::string& keyPath, RegDeleteProgress& progress);
+void OnKeyTreeDeleted();
+void ShowKeyDeleteProgress();
+bool IsKeyDeleteRunning();
+HKEY FindRootKeyByName(const std::string& name);
+const char* GetRootKeyName(HKEY rootKey);
+void UpdateStatusBar(const std::string& message);
+HKEY GetSelectedRootKey();
+std::string GetSelectedKeyPath();
+std::string GetWindowText(HWND hwnd);
+void SetWindowText(HWND hwnd, const std::string& text);
+int MessageBox(HWND hwnd, const std::string& text, const char* caption, UINT type);
+void CheckKeyExists();
+int RunBenchmarks(const std::string& arguments);
+std::string GetCommandLineArguments();
+std::vector<std::string> SplitCommandLine(const std::string& line);
+bool IsCliCommand(const std::string& argument);
+void AttachCliConsole();
+std::string FormatCliValueData(DWORD type, const std::vector<BYTE>& data);
+uint64_t GetAuditTime();
+std::string FormatAuditTime(uint64_t time);
+bool ParseAuditTime(const std::string& text, uint64_t& time);
+const char* GetAuditChangeName(const AuditRecord& record);
+
+// Entry point
+int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow) {
+    // Benchmarks and registry commands print to the console instead of opening the window
+    std::string commandLine = GetCommandLineArguments();
+    if (commandLine.compare(0, 7, "--bench") == 0) {
+        AttachCliConsole();
+        return RunBenchmarks(commandLine.substr(7));
+    }
+    std::vector<std::string> arguments = SplitCommandLine(commandLine);
+    if (!arguments.empty() && IsCliCommand(arguments[0])) {
+        AttachCliConsole();
+        RegistryCli cli;
+        return cli.Run(arguments);
+    }
+
+    // Initialize common controls
+    INITCOMMONCONTROLSEX icex;
+    icex.dwSize = sizeof(INITCOMMONCONTROLSEX);
+    icex.dwICC = ICC_TREEVIEW_CLASSES | ICC_LISTVIEW_CLASSES | ICC_BAR_CLASSES;
+    InitCommonControlsEx(&icex);
+
+    // Register window class; the window and its controls are Unicode, so names and data in
+    // any script show and edit as they are
+    const WCHAR* className = L"RegistryManagerWindow";
+    WNDCLASSW wc = {};
+    wc.lpfnWndProc = WindowProc;
+    wc.hInstance = hInstance;
+    wc.lpszClassName = className;
+    wc.hbrBackground = (HBRUSH)(COLOR_WINDOW + 1);
+    wc.hCursor = LoadCursor(nullptr, IDC_ARROW);
+    wc.hIcon = LoadIcon(nullptr, IDI_APPLICATION);
+
+    RegisterClassW(&wc);
+
+    // Create main window
+    hMainWindow = CreateWindowExW(
+        0,
+        className,
+        L"Windows Registry Manager - Lab 3 (Group 3)",
+        WS_OVERLAPPEDWINDOW,
+        CW_USEDEFAULT, CW_USEDEFAULT,
+        1200, 800,
+        nullptr, nullptr, hInstance, nullptr
+    );
+
+    if (!hMainWindow) {
+        MessageBox(nullptr, "Failed to create window!", "Error", MB_OK | MB_ICONERROR);
+        return -1;
+    }
+
+    ShowWindow(hMainWindow, nCmdShow);
+    UpdateWindow(hMainWindow);
+
+    // Message loop
+    MSG msg = {};
+    while (GetMessageW(&msg, nullptr, 0, 0)) {
+        TranslateMessage(&msg);
+        DispatchMessageW(&msg);
+    }
+
+    return 0;
+}
+
+// Window procedure
+LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
+    switch (uMsg) {
+    case WM_CREATE:
+        win32Registry.SetChangeListener(&viewCache);
+        ioWorker.Start(hwnd, *registry);
+        InitializeControls(hwnd);
+        PopulateTreeView();
+        UpdateStatusBar("Registry Manager initialized successfully");
+        break;
+
+    case WM_SIZE: {
+        RECT rect;
+        GetClientRect(hwnd, &rect);
+        int width = rect.right - rect.left;
+        int height = rect.bottom - rect.top;
+
+        // Resize controls
+        MoveWindow(hTreeView, 10, 100, 350, height - 150, TRUE);
+        MoveWindow(hListView, 370, 100, width - 390, height - 150, TRUE);
+        SendMessage(hStatusBar, WM_SIZE, 0, 0);
+        break;
+    }
+
+    case WM_COMMAND:
+        switch (LOWORD(wParam)) {
+        case IDC_BUTTON_CREATE_KEY:
+            CreateRegistryKey();
+            break;
+        case IDC_BUTTON_DELETE_KEY:
+            DeleteRegistryKey();
+            break;
+        case IDC_BUTTON_SET_VALUE:
+            SetRegistryValue();
+            break;
+        case IDC_BUTTON_DELETE_VALUE:
+            DeleteRegistryValue();
+            break;
+        case IDC_BUTTON_REFRESH:
+            viewCache.Clear();
+            subtreeStats.Clear();
+            RefreshTreeView();
+            OnTreeSelectionChanged();
+            break;
+        case IDC_BUTTON_SAVE_TO_FILE:
+            SaveRegistryToFile();
+            break;
+        case IDC_BUTTON_LOAD_FROM_FILE:
+            LoadRegistryFromFile();
+            break;
+        case IDC_BUTTON_CHECK_KEY:
+            CheckKeyExists();
+            break;
+        case IDC_BUTTON_OPEN_HIVE:
+            OpenOfflineHive();
+            break;
+        case IDC_BUTTON_LIVE_REGISTRY:
+            UseLiveRegistry();
+            break;
+        case IDC_BUTTON_FIND:
+            FindInRegistry();
+            break;
+        case IDC_BUTTON_REPLACE:
+            ReplaceInRegistry();
+            break;
+        case IDC_BUTTON_BUILD_INDEX:
+            BuildSearchIndex();
+            break;
+        case IDC_BUTTON_DIFF:
+            DiffWithRegFile();
+            break;
+        case IDC_BUTTON_CANCEL:
+            keyDeleteJob.progress.cancel = true;
+            replaceJob.scanProgress.cancel = true;
+            replaceJob.applyProgress.cancel = true;
+            fileJob.progress.cancel = true;
+            break;
+        case IDC_CHECK_SIZES:
+            OnTreeSelectionChanged();
+            break;
+        }
+        break;
+
+    case WM_NOTIFYFORMAT:
+        // The tree and list views send Unicode notifications, so key names and data display as they are
+        return NFR_UNICODE;
+
+    case WM_NOTIFY: {
+        LPNMHDR pnmhdr = (LPNMHDR)lParam;
+        if (pnmhdr->hwndFrom == hTreeView) {
+            // Only the item handles, states and lParam are used, which the ANSI structures lay out the same way
+            if (pnmhdr->code == TVN_SELCHANGEDW) {
+                OnTreeSelectionChanged();
+            } else if (pnmhdr->code == TVN_ITEMEXPANDINGW) {
+                return OnTreeItemExpanding((LPNMTREEVIEW)lParam);
+            } else if (pnmhdr->code == TVN_GETDISPINFOW) {
+                OnTreeGetDispInfo((LPNMTVDISPINFO)lParam);
+            } else if (pnmhdr->code == TVN_DELETEITEMW) {
+                OnTreeDeleteItem((LPNMTREEVIEW)lParam);
+            }
+        } else if (pnmhdr->hwndFrom == hListView) {
+            if (pnmhdr->code == LVN_GETDISPINFOW) {
+                OnValuesGetDispInfo((NMLVDISPINFOW*)lParam);
+            } else if (pnmhdr->code == LVN_ODCACHEHINT) {
+                LPNMLVCACHEHINT pnmch = (LPNMLVCACHEHINT)lParam;
+                valueListModel.Prefetch(pnmch->iFrom, pnmch->iTo);
+            } else if (pnmhdr->code == LVN_COLUMNCLICK && sizesColumnsShown) {
+                subtreeSortColumn = ((LPNMLISTVIEW)lParam)->iSubItem;
+                ShowSubtreeSizes();
+            }
+        }
+        break;
+    }
+
+    case WM_REGISTRY_CHANGED:
+        OnRegistryChanged();
+        break;
+
+    case WM_KEY_TREE_DELETED:
+        OnKeyTreeDeleted();
+        break;
+
+    case WM_REGISTRY_LOADED:
+        OnRegistryLoaded();
+        break;
+
+    case WM_TIMER:
+        if (wParam == IDT_KEY_DELETE_PROGRESS) ShowKeyDeleteProgress();
+        if (wParam == IDT_REPLACE_PROGRESS) ShowReplaceProgress();
+        if (wParam == IDT_FILE_PROGRESS) ShowFileProgress();
+        break;
+
+    case WM_DESTROY:
+        if (IsKeyDeleteRunning()) {
+            keyDeleteJob.progress.cancel = true;
+            keyDeleteJob.thread.join();
+        }
+        replaceJob.scanProgress.cancel = true;
+        replaceJob.applyProgress.cancel = true;
+        fileJob.progress.cancel = true;
+        ioWorker.Stop();
+        win32Registry.UnwatchAll();
+        PostQuitMessage(0);
+        break;
+
+    default:
+        return DefWindowProcW(hwnd, uMsg, wParam, lParam);
+    }
+    return 0;
+}
+
+// Initialize all GUI controls
+void InitializeControls(HWND hwnd) {
+    // Create combo box for root keys
+    hComboRootKey = CreateWindowW(L"COMBOBOX", L"",
+        WS_CHILD | WS_VISIBLE | CBS_DROPDOWNLIST,
+        10, 10, 200, 200, hwnd, (HMENU)IDC_COMBO_ROOT_KEY, nullptr, nullptr);
+
+    // Populate combo box
+    for (int i = 0; i < ROOT_KEYS_COUNT; i++) {
+        SendMessageW(hComboRootKey, CB_ADDSTRING, 0, (LPARAM)Utf8ToWide(rootKeys[i].displayName).c_str());
+    }
+    SendMessage(hComboRootKey, CB_SETCURSEL, 0, 0);
+
+    // Create edit controls
+    CreateWindowW(L"STATIC", L"Key Path:", WS_CHILD | WS_VISIBLE,
+        220, 10, 80, 20, hwnd, nullptr, nullptr, nullptr);
+    hEditKeyPath = CreateWindowW(L"EDIT", L"",
+        WS_CHILD | WS_VISIBLE | WS_BORDER | ES_AUTOHSCROLL,
+        300, 10, 300, 20, hwnd, (HMENU)IDC_EDIT_KEY_PATH, nullptr, nullptr);
+
+    CreateWindowW(L"STATIC", L"Value Name:", WS_CHILD | WS_VISIBLE,
+        10, 40, 80, 20, hwnd, nullptr, nullptr, nullptr);
+    hEditValueName = CreateWindowW(L"EDIT", L"",
+        WS_CHILD | WS_VISIBLE | WS_BORDER | ES_AUTOHSCROLL,
+        100, 40, 150, 20, hwnd, (HMENU)IDC_EDIT_VALUE_NAME, nullptr, nullptr);
+
+    CreateWindowW(L"STATIC", L"Value Data:", WS_CHILD | WS_VISIBLE,
+        260, 40, 80, 20, hwnd, nullptr, nullptr, nullptr);
+    hEditValueData = CreateWindowW(L"EDIT", L"",
+        WS_CHILD | WS_VISIBLE | WS_BORDER | ES_AUTOHSCROLL,
+        340, 40, 150, 20, hwnd, (HMENU)IDC_EDIT_VALUE_DATA, nullptr, nullptr);
+
+    CreateWindowW(L"STATIC", L"Find:", WS_CHILD | WS_VISIBLE,
+        510, 40, 40, 20, hwnd, nullptr, nullptr, nullptr);
+    hEditFind = CreateWindowW(L"EDIT", L"",
+        WS_CHILD | WS_VISIBLE | WS_BORDER | ES_AUTOHSCROLL,
+        550, 40, 200, 20, hwnd, (HMENU)IDC_EDIT_FIND, nullptr, nullptr);
+    hCheckRegex = CreateWindowW(L"BUTTON", L"Regex", WS_CHILD | WS_VISIBLE | BS_AUTOCHECKBOX,
+        760, 40, 60, 20, hwnd, (HMENU)IDC_CHECK_REGEX, nullptr, nullptr);
+
+    // Enabled while a long operation runs in the background
+    hButtonCancel = CreateWindowW(L"BUTTON", L"Cancel", WS_CHILD | WS_VISIBLE | WS_DISABLED | BS_PUSHBUTTON,
+        830, 38, 70, 24, hwnd, (HMENU)IDC_BUTTON_CANCEL, nullptr, nullptr);
+
+    CreateWindowW(L"STATIC", L"Replace:", WS_CHILD | WS_VISIBLE,
+        910, 40, 60, 20, hwnd, nullptr, nullptr, nullptr);
+    hEditReplace = CreateWindowW(L"EDIT", L"",
+        WS_CHILD | WS_VISIBLE | WS_BORDER | ES_AUTOHSCROLL,
+        970, 40, 150, 20, hwnd, (HMENU)IDC_EDIT_REPLACE, nullptr, nullptr);
+    CreateWindowW(L"BUTTON", L"Replace...", WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
+        1130, 38, 80, 24, hwnd, (HMENU)IDC_BUTTON_REPLACE, nullptr, nullptr);
+
+    // Create buttons
+    CreateWindowW(L"BUTTON", L"Create Key", WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
+        10, 70, 80, 25, hwnd, (HMENU)IDC_BUTTON_CREATE_KEY, nullptr, nullptr);
+
+    CreateWindowW(L"BUTTON", L"Delete Key", WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
+        100, 70, 80, 25, hwnd, (HMENU)IDC_BUTTON_DELETE_KEY, nullptr, nullptr);
+
+    CreateWindowW(L"BUTTON", L"Set Value", WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
+        190, 70, 80, 25, hwnd, (HMENU)IDC_BUTTON_SET_VALUE, nullptr, nullptr);
+
+    CreateWindowW(L"BUTTON", L"Delete Value", WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
+        280, 70, 80, 25, hwnd, (HMENU)IDC_BUTTON_DELETE_VALUE, nullptr, nullptr);
+
+    CreateWindowW(L"BUTTON", L"Check Key", WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
+        370, 70, 80, 25, hwnd, (HMENU)IDC_BUTTON_CHECK_KEY, nullptr, nullptr);
+
+    CreateWindowW(L"BUTTON", L"Refresh", WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
+        460, 70, 60, 25, hwnd, (HMENU)IDC_BUTTON_REFRESH, nullptr, nullptr);
+
+    CreateWindowW(L"BUTTON", L"Save to File", WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
+        530, 70, 80, 25, hwnd, (HMENU)IDC_BUTTON_SAVE_TO_FILE, nullptr, nullptr);
+
+    CreateWindowW(L"BUTTON", L"Load from File", WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
+        620, 70, 90, 25, hwnd, (HMENU)IDC_BUTTON_LOAD_FROM_FILE, nullptr, nullptr);
+
+    CreateWindowW(L"BUTTON", L"Open Hive", WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
+        720, 70, 80, 25, hwnd, (HMENU)IDC_BUTTON_OPEN_HIVE, nullptr, nullptr);
+
+    CreateWindowW(L"BUTTON", L"Live Registry", WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
+        810, 70, 90, 25, hwnd, (HMENU)IDC_BUTTON_LIVE_REGISTRY, nullptr, nullptr);
+
+    CreateWindowW(L"BUTTON", L"Find", WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
+        910, 70, 60, 25, hwnd, (HMENU)IDC_BUTTON_FIND, nullptr, nullptr);
+
+    CreateWindowW(L"BUTTON", L"Build Index", WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
+        980, 70, 80, 25, hwnd, (HMENU)IDC_BUTTON_BUILD_INDEX, nullptr, nullptr);
+
+    CreateWindowW(L"BUTTON", L"Diff...", WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
+        1070, 70, 60, 25, hwnd, (HMENU)IDC_BUTTON_DIFF, nullptr, nullptr);
+
+    // While pressed, the values list shows the recursive sizes of the selected key's subkeys
+    hCheckSizes = CreateWindowW(L"BUTTON", L"Sizes", WS_CHILD | WS_VISIBLE | BS_AUTOCHECKBOX | BS_PUSHLIKE,
+        1140, 70, 60, 25, hwnd, (HMENU)IDC_CHECK_SIZES, nullptr, nullptr);
+
+    // Create tree view
+    hTreeView = CreateWindowW(WC_TREEVIEWW, L"",
+        WS_CHILD | WS_VISIBLE | WS_BORDER | TVS_HASLINES | TVS_HASBUTTONS | TVS_LINESATROOT,
+        10, 100, 350, 400, hwnd, (HMENU)IDC_TREE_REGISTRY, nullptr, nullptr);
+
+    // Create list view for values
+    hListView = CreateWindowW(WC_LISTVIEWW, L"",
+        WS_CHILD | WS_VISIBLE | WS_BORDER | LVS_REPORT | LVS_OWNERDATA,
+        370, 100, 400, 400, hwnd, (HMENU)IDC_LIST_VALUES, nullptr, nullptr);
+
+    // Set up list view columns
+    LVCOLUMNW lvc;
+    lvc.mask = LVCF_TEXT | LVCF_WIDTH;
+    lvc.cx = 150;
+    lvc.pszText = (LPWSTR)L"Name";
+    SendMessageW(hListView, LVM_INSERTCOLUMNW, 0, (LPARAM)&lvc);
+
+    lvc.cx = 100;
+    lvc.pszText = (LPWSTR)L"Type";
+    SendMessageW(hListView, LVM_INSERTCOLUMNW, 1, (LPARAM)&lvc);
+
+    lvc.cx = 200;
+    lvc.pszText = (LPWSTR)L"Data";
+    SendMessageW(hListView, LVM_INSERTCOLUMNW, 2, (LPARAM)&lvc);
+
+    // Create status bar
+    hStatusBar = CreateWindowW(STATUSCLASSNAMEW, L"",
+        WS_CHILD | WS_VISIBLE | SBARS_SIZEGRIP,
+        0, 0, 0, 0, hwnd, (HMENU)IDC_STATUS_BAR, nullptr, nullptr);
+}
+
+// Populate tree view with the root keys only; subkeys are loaded when a branch is expanded
+void PopulateTreeView() {
+    TreeView_DeleteAllItems(hTreeView);
+    treeNodes.Clear();
+
+    for (int i = 0; i < ROOT_KEYS_COUNT; i++) {
+        std::wstring text = Utf8ToWide(rootKeys[i].displayName);
+        TVINSERTSTRUCTW tvins;
+        tvins.hParent = TVI_ROOT;
+        tvins.hInsertAfter = TVI_LAST;
+        tvins.item.mask = TVIF_TEXT | TVIF_PARAM | TVIF_CHILDREN;
+        tvins.item.pszText = &text[0];
+        tvins.item.lParam = (LPARAM)treeNodes.AddRoot(rootKeys[i].hKey);
+        tvins.item.cChildren = 1; // Placeholder button until the root is expanded
+
+        SendMessageW(hTreeView, TVM_INSERTITEMW, 0, (LPARAM)&tvins);
+    }
+}
+
+// Node id stored in a tree item
+uint32_t GetTreeItemNode(HTREEITEM hItem) {
+    TVITEM item;
+    item.mask = TVIF_PARAM;
+    item.hItem = hItem;
+    if (!TreeView_GetItem(hTreeView, &item)) return TreeNodeTable::NO_NODE;
+    return (uint32_t)item.lParam;
+}
+
+// Get the key name of a tree item
+std::string GetTreeItemText(HTREEITEM hItem) {
+    uint32_t nodeId = GetTreeItemNode(hItem);
+    if (nodeId == TreeNodeTable::NO_NODE) return "";
+    return std::string(treeNodes.Name(nodeId));
+}
+
+// Set the "has children" state of a tree item (I_CHILDRENCALLBACK = ask again when visible)
+void SetTreeItemChildren(HTREEITEM hItem, int cChildren) {
+    TVITEM item;
+    item.mask = TVIF_CHILDREN;
+    item.hItem = hItem;
+    item.cChildren = cChildren;
+    TreeView_SetItem(hTreeView, &item);
+}
+
+// Insert a subkey item; whether it has children is resolved only once it becomes visible
+HTREEITEM InsertTreeChild(HTREEITEM hParent, HTREEITEM hInsertAfter, const std::string& name) {
+    uint32_t parentNode = GetTreeItemNode(hParent);
+    if (parentNode == TreeNodeTable::NO_NODE) return nullptr;
+
+    std::wstring text = Utf8ToWide(name);
+    TVINSERTSTRUCTW tvins;
+    tvins.hParent = hParent;
+    tvins.hInsertAfter = hInsertAfter;
+    tvins.item.mask = TVIF_TEXT | TVIF_PARAM | TVIF_CHILDREN;
+    tvins.item.pszText = &text[0];
+    tvins.item.lParam = (LPARAM)treeNodes.AddChild(parentNode, name);
+    tvins.item.cChildren = I_CHILDRENCALLBACK;
+
+    return (HTREEITEM)SendMessageW(hTreeView, TVM_INSERTITEMW, 0, (LPARAM)&tvins);
+}
+
+// Release the node of a tree item that is being deleted
+void OnTreeDeleteItem(LPNMTREEVIEW pnmtv) {
+    treeNodes.Release((uint32_t)pnmtv->itemOld.lParam);
+}
+
+// Root key and path of a tree item, built from its node chain into keyPath
+bool GetTreeItemKeyPath(HTREEITEM hItem, HKEY& rootKey, std::string& keyPath) {
+    uint32_t nodeId = GetTreeItemNode(hItem);
+    if (nodeId == TreeNodeTable::NO_NODE) return false;
+
+    rootKey = treeNodes.Get(nodeId).rootKey;
+    treeNodes.BuildPath(nodeId, keyPath);
+    return true;
+}
+
+// Insert the direct subkeys of a tree item
+void PopulateTreeChildren(HTREEITEM hParent, const std::vector<std::string>& subKeys) {
+    for (const std::string& name : subKeys) {
+        InsertTreeChild(hParent, TVI_LAST, name);
+    }
+
+    if (subKeys.empty()) {
+        SetTreeItemChildren(hParent, 0); // Drop the expand button
+    }
+}
+
+// Load subkeys the first time a branch is expanded. Unless the view cache has them, the
+// expansion is refused (TRUE) and done again once the I/O worker has read the key.
+BOOL OnTreeItemExpanding(LPNMTREEVIEW pnmtv) {
+    HTREEITEM hItem = pnmtv->itemNew.hItem;
+    if (!(pnmtv->action & TVE_EXPAND) || TreeView_GetChild(hTreeView, hItem)) return FALSE;
+
+    HKEY rootKey;
+    std::string keyPath;
+    if (!GetTreeItemKeyPath(hItem, rootKey, keyPath)) return FALSE;
+    std::shared_ptr<const RegistryViewCache::CachedKey> key = viewCache.PeekKey(rootKey, keyPath);
+    if (!key) {
+        ioWorker.LoadKey(RegistryIoWorker::LoadExpansion, rootKey, keyPath);
+        return TRUE;
+    }
+    PopulateTreeChildren(hItem, key->subKeys);
+    return FALSE;
+}
+
+// Answer "has children" for items that just became visible
+void OnTreeGetDispInfo(LPNMTVDISPINFO pnmtvdi) {
+    if (!(pnmtvdi->item.mask & TVIF_CHILDREN)) return;
+
+    pnmtvdi->item.cChildren = 0;
+
+    HKEY rootKey;
+    std::string keyPath;
+    if (!GetTreeItemKeyPath(pnmtvdi->item.hItem, rootKey, keyPath)) return;
+
+    // Not known yet: ask the I/O worker and keep asking the callback until it answers
+    std::shared_ptr<const RegistryViewCache::CachedKey> key = viewCache.PeekKey(rootKey, keyPath);
+    if (!key) {
+        ioWorker.LoadKey(RegistryIoWorker::LoadChildCount, rootKey, keyPath);
+        return;
+    }
+    pnmtvdi->item.cChildren = key->subKeys.empty() ? 0 : 1;
+    pnmtvdi->item.mask |= TVIF_DI_SETITEM; // Let the control remember the answer
+}
+
+// Re-sync a tree item with the registry: expanded branches are diffed in place (once the I/O
+// worker has read the key, unless the view cache has it), collapsed ones are reset and reloaded
+// on their next expansion
+void RefreshTreeItem(HTREEITEM hItem) {
+    if (!TreeView_GetChild(hTreeView, hItem)) {
+        SetTreeItemChildren(hItem, I_CHILDRENCALLBACK);
+        return;
+    }
+
+    if (!(TreeView_GetItemState(hTreeView, hItem, TVIS_EXPANDED) & TVIS_EXPANDED)) {
+        TreeView_Expand(hTreeView, hItem, TVE_COLLAPSE | TVE_COLLAPSERESET);
+        SetTreeItemChildren(hItem, I_CHILDRENCALLBACK);
+        return;
+    }
+
+    HKEY rootKey;
+    std::string keyPath;
+    if (!GetTreeItemKeyPath(hItem, rootKey, keyPath)) return;
+    std::shared_ptr<const RegistryViewCache::CachedKey> key = viewCache.PeekKey(rootKey, keyPath);
+    if (!key) {
+        ioWorker.LoadKey(RegistryIoWorker::LoadRefresh, rootKey, keyPath);
+        return;
+    }
+    SyncTreeChildren(hItem, key->subKeys);
+}
+
+// Diff the children of an expanded tree item against the key's current subkeys
+void SyncTreeChildren(HTREEITEM hItem, const std::vector<std::string>& subKeys) {
+    std::map<std::string, HTREEITEM, RegistryNameLess> existingItems;
+    for (HTREEITEM hChild = TreeView_GetChild(hTreeView, hItem); hChild; hChild = TreeView_GetNextSibling(hTreeView, hChild)) {
+        existingItems[GetTreeItemText(hChild)] = hChild;
+    }
+
+    // Keep items that still exist (with their expansion state), insert new ones in place
+    HTREEITEM hPrevious = TVI_FIRST;
+    for (const std::string& name : subKeys) {
+        auto existing = existingItems.find(name);
+        if (existing != existingItems.end()) {
+            hPrevious = existing->second;
+            existingItems.erase(existing);
+            RefreshTreeItem(hPrevious);
+        } else {
+            hPrevious = InsertTreeChild(hItem, hPrevious, name);
+        }
+    }
+
+    // Whatever is left was deleted from the registry
+    for (auto& removed : existingItems) {
+        TreeView_DeleteItem(hTreeView, removed.second);
+    }
+
+    if (subKeys.empty()) {
+        SetTreeItemChildren(hItem, 0);
+    }
+}
+
+// Deepest loaded tree item along a key path; exact tells whether the key's own item was reached
+HTREEITEM FindLoadedTreeItem(HKEY rootKey, const std::string& keyPath, bool* exact) {
+    HTREEITEM hItem = nullptr;
+    for (HTREEITEM hRoot = TreeView_GetRoot(hTreeView); hRoot; hRoot = TreeView_GetNextSibling(hTreeView, hRoot)) {
+        TVITEM item;
+        item.mask = TVIF_PARAM;
+        item.hItem = hRoot;
+        if (TreeView_GetItem(hTreeView, &item) && treeNodes.Get((uint32_t)item.lParam).rootKey == rootKey) {
+            hItem = hRoot;
+            break;
+        }
+    }
+    if (exact) *exact = false;
+    if (!hItem) return nullptr;
+
+    // Descend through loaded items along the path
+    std::stringstream pathStream(keyPath);
+    std::string part;
+    while (std::getline(pathStream, part, '\\')) {
+        if (part.empty()) continue;
+        HTREEITEM hChild = TreeView_GetChild(hTreeView, hItem);
+        for (; hChild; hChild = TreeView_GetNextSibling(hTreeView, hChild)) {
+            std::string text = GetTreeItemText(hChild);
+            if (CompareRegistryNames(text.data(), text.size(), part.data(), part.size()) == 0) break;
+        }
+        if (!hChild) return hItem;
+        hItem = hChild;
+    }
+
+    if (exact) *exact = true;
+    return hItem;
+}
+
+// Refresh only the loaded branch that contains a created or deleted key
+void RefreshTreeBranch(HKEY rootKey, const std::string& keyPath) {
+    size_t separator = keyPath.rfind('\\');
+    std::string parentPath = separator == std::string::npos ? std::string() : keyPath.substr(0, separator);
+
+    HTREEITEM hItem = FindLoadedTreeItem(rootKey, parentPath, nullptr);
+    if (hItem) RefreshTreeItem(hItem);
+}
+
+// Re-sync the loaded tree items and the values list of keys the backend reported as changed
+void OnRegistryChanged() {
+    bool overflowed;
+    std::vector<std::pair<HKEY, std::string>> changed = viewCache.TakeChangedKeys(overflowed);
+    if (overflowed) {
+        subtreeStats.Clear();
+        RefreshTreeView();
+        OnTreeSelectionChanged();
+        return;
+    }
+
+    std::string selectedLocation;
+    HKEY selectedRoot;
+    std::string selectedPath;
+    HTREEITEM hSelected = TreeView_GetSelection(hTreeView);
+    if (hSelected && GetTreeItemKeyPath(hSelected, selectedRoot, selectedPath)) {
+        selectedLocation = RegistryLocationKey(selectedRoot, selectedPath);
+    }
+
+    // The sizes view also depends on everything below the selected key
+    bool sizesView = SendMessage(hCheckSizes, BM_GETCHECK, 0, 0) == BST_CHECKED;
+    std::string selectedPrefix = selectedLocation.empty() || selectedLocation.back() == '\\' ? selectedLocation : selectedLocation + "\\";
+    bool selectionChanged = false;
+    for (const auto& key : changed) {
+        subtreeStats.InvalidateKey(key.first, key.second);
+        bool exact;
+        HTREEITEM hItem = FindLoadedTreeItem(key.first, key.second, &exact);
+        if (hItem && exact) RefreshTreeItem(hItem);
+        std::string location = RegistryLocationKey(key.first, key.second);
+        if (location == selectedLocation ||
+            (sizesView && !selectedPrefix.empty() && location.compare(0, selectedPrefix.size(), selectedPrefix) == 0)) {
+            selectionChanged = true;
+        }
+    }
+
+    if (selectionChanged) {
+        PopulateValuesList(selectedRoot, selectedPath);
+    }
+}
+
+// Refresh all loaded branches
+void RefreshTreeView() {
+    for (HTREEITEM hRoot = TreeView_GetRoot(hTreeView); hRoot; hRoot = TreeView_GetNextSibling(hTreeView, hRoot)) {
+        RefreshTreeItem(hRoot);
+    }
+}
+
+// Handle tree selection change: show the key's path and values and switch the root combo to
+// its root, so that key operations act on the selected key
+void OnTreeSelectionChanged() {
+    HTREEITEM hItem = TreeView_GetSelection(hTreeView);
+    if (!hItem) return;
+
+    static std::string selectedPath; // Reused between selections
+    HKEY rootKey;
+    if (!GetTreeItemKeyPath(hItem, rootKey, selectedPath)) return;
+
+    for (int i = 0; i < ROOT_KEYS_COUNT; i++) {
+        if (rootKeys[i].hKey == rootKey) {
+            SendMessage(hComboRootKey, CB_SETCURSEL, i, 0);
+            break;
+        }
+    }
+    SetWindowText(hEditKeyPath, selectedPath);
+    PopulateValuesList(rootKey, selectedPath);
+}
+
+// Display name of a registry value type
+const char* GetValueTypeName(DWORD valueType) {
+    switch (valueType) {
+    case REG_SZ: return "REG_SZ";
+    case REG_DWORD: return "REG_DWORD";
+    case REG_BINARY: return "REG_BINARY";
+    case REG_EXPAND_SZ: return "REG_EXPAND_SZ";
+    case REG_MULTI_SZ: return "REG_MULTI_SZ";
+    }
+    return "Unknown";
+}
+
+// Text shown in the values list for a value
+std::string FormatValueData(DWORD valueType, const std::vector<BYTE>& valueData) {
+    if (valueType == REG_SZ || valueType == REG_EXPAND_SZ) {
+        if (valueData.empty()) return "";
+        const char* text = (const char*)valueData.data();
+        return std::string(text, strnlen(text, valueData.size()));
+    } else if (valueType == REG_DWORD && valueData.size() >= sizeof(DWORD)) {
+        return std::to_string(*(const DWORD*)valueData.data());
+    }
+    return "[Binary Data]";
+}
+
+bool ValueListModel::Open(RegistryBackend& keyBackend, HKEY rootKey, const std::string& keyPath,
+                          std::shared_ptr<const RegistryViewCache::CachedKey> cachedKey) {
+    Reset();
+    if (cachedKey && cachedKey->valuesCached) {
+        cached = cachedKey;
+        rowCount = cached->values.size();
+        return true;
+    }
+    if (cachedKey) {
+        rowsFromWorker = true; // The key selected in the I/O worker
+        rowCount = cachedKey->valueCount;
+        return true;
+    }
+
+    if (keyBackend.OpenKey(rootKey, keyPath, KEY_READ, &hKey) != ERROR_SUCCESS) {
+        hKey = nullptr;
+        return false;
+    }
+    DWORD valueCount = 0;
+    keyBackend.QueryInfo(hKey, nullptr, &valueCount);
+    backend = &keyBackend;
+    rowCount = valueCount;
+    return true;
+}
+
+void ValueListModel::ShowRows(std::vector<Row>&& rows) {
+    Reset();
+    fixedRows = std::move(rows);
+    rowCount = fixedRows.size();
+}
+
+void ValueListModel::Reset() {
+    if (hKey) backend->CloseKey(hKey);
+    hKey = nullptr;
+    backend = nullptr;
+    cached.reset();
+    fixedRows.clear();
+    recentRows.clear();
+    rowIndex.clear();
+    rowCount = 0;
+    rowsFromWorker = false;
+    requestedFirst = 1;
+    requestedLast = 0;
+}
+
+bool ValueListModel::FormatRow(size_t index, Row& row) {
+    DWORD valueType;
+    const std::string* name = &valueName;
+    const std::vector<BYTE>* data = &valueData;
+
+    if (cached) {
+        const RegistryViewCache::CachedValue& value = cached->values[index];
+        name = &value.name;
+        valueType = value.type;
+        data = &value.data;
+    } else if (!hKey || backend->EnumValue(hKey, (DWORD)index, valueName, valueType, valueData) != ERROR_SUCCESS) {
+        return false;
+    }
+
+    FormatValue(*name, valueType, *data, row);
+    rowsFormatted++;
+    return true;
+}
+
+void ValueListModel::FormatValue(const std::string& name, DWORD type, const std::vector<BYTE>& data, Row& row) {
+    row.name = name.empty() ? "(Default)" : name;
+    row.type = GetValueTypeName(type);
+    row.data = FormatValueData(type, data);
+}
+
+// Formatted row, from the LRU or freshly formatted; nullptr past the end
+const ValueListModel::Row* ValueListModel::GetRow(size_t index) {
+    if (index >= rowCount) return nullptr;
+    if (!fixedRows.empty()) return &fixedRows[index];
+
+    auto found = rowIndex.find(index);
+    if (found != rowIndex.end()) {
+        recentRows.splice(recentRows.begin(), recentRows, found->second);
+        return &found->second->second;
+    }
+
+    // Rows the worker has not fetched yet are drawn empty and redrawn when they arrive
+    if (rowsFromWorker) {
+        if (index < requestedFirst || index > requestedLast) Prefetch(index, index + 63);
+        return nullptr;
+    }
+
+    Row row;
+    if (!FormatRow(index, row)) return nullptr;
+    AddRecentRow(index, std::move(row));
+    return &recentRows.front().second;
+}
+
+void ValueListModel::AddRecentRow(size_t index, Row&& row) {
+    auto found = rowIndex.find(index);
+    if (found != rowIndex.end()) {
+        recentRows.erase(found->second);
+        rowIndex.erase(found);
+    }
+    recentRows.emplace_front(index, std::move(row));
+    rowIndex[index] = recentRows.begin();
+    if (recentRows.size() > kCachedRows) {
+        rowIndex.erase(recentRows.back().first);
+        recentRows.pop_back();
+    }
+}
+
+// Format a range the list view is about to draw (LVN_ODCACHEHINT)
+void ValueListModel::Prefetch(size_t first, size_t last) {
+    if (!fixedRows.empty() || first >= rowCount) return;
+    last = std::min(last, std::min(rowCount, first + kCachedRows) - 1);
+    if (rowsFromWorker) {
+        size_t missing = first;
+        while (missing <= last && rowIndex.count(missing)) missing++;
+        if (missing > last) return;
+        requestedFirst = missing;
+        requestedLast = last;
+        ioWorker.LoadRows(missing, last);
+        return;
+    }
+    for (size_t index = first; index <= last; index++) {
+        GetRow(index);
+    }
+}
+
+void ValueListModel::StoreRows(size_t first, std::vector<Row>&& rows) {
+    if (!rowsFromWorker) return;
+    for (size_t i = 0; i < rows.size() && first + i < rowCount; i++) {
+        AddRecentRow(first + i, std::move(rows[i]));
+    }
+}
+
+// Headers of the values list: value columns, or subkey sizes
+void SetValuesListColumns(bool sizes) {
+    if (sizes == sizesColumnsShown) return;
+    static const WCHAR* valueHeaders[] = { L"Name", L"Type", L"Data" };
+    static const WCHAR* sizeHeaders[] = { L"Subkey", L"Keys / Values", L"Size" };
+    LVCOLUMNW lvc;
+    lvc.mask = LVCF_TEXT;
+    for (int column = 0; column < 3; column++) {
+        lvc.pszText = (LPWSTR)(sizes ? sizeHeaders : valueHeaders)[column];
+        SendMessageW(hListView, LVM_SETCOLUMNW, column, (LPARAM)&lvc);
+    }
+    sizesColumnsShown = sizes;
+}
+
+// List the subkeys of the sizes view, sorted by name or with the heaviest first
+void ShowSubtreeSizes() {
+    std::sort(shownSubtreeSizes.begin(), shownSubtreeSizes.end(),
+        [](const std::pair<std::string, SubtreeStats>& a, const std::pair<std::string, SubtreeStats>& b) {
+            if (subtreeSortColumn == 0) return RegistryNameLess()(a.first, b.first);
+            if (subtreeSortColumn == 1 && a.second.keys != b.second.keys) return a.second.keys > b.second.keys;
+            if (a.second.valueBytes != b.second.valueBytes) return a.second.valueBytes > b.second.valueBytes;
+            return a.second.values > b.second.values;
+        });
+
+    std::vector<ValueListModel::Row> rows;
+    rows.reserve(shownSubtreeSizes.size());
+    for (const auto& subKey : shownSubtreeSizes) {
+        ValueListModel::Row row;
+        row.name = subKey.first;
+        row.type = std::to_string(subKey.second.keys) + " / " + std::to_string(subKey.second.values);
+        row.data = FormatByteSize(subKey.second.valueBytes);
+        rows.push_back(std::move(row));
+    }
+    SetValuesListColumns(true);
+    valueListModel.ShowRows(std::move(rows));
+    ListView_SetItemCountEx(hListView, (int)shownSubtreeSizes.size(), 0);
+    InvalidateRect(hListView, nullptr, TRUE);
+}
+
+// Empty the values list
+void ClearValuesList() {
+    valueListModel.Reset();
+    ListView_SetItemCountEx(hListView, 0, 0);
+}
+
+// Populate values list: at once if the view cache has the key, otherwise once the I/O worker
+// has read it. Either way the selection supersedes any earlier one still being read.
+void PopulateValuesList(HKEY hKey, const std::string& keyPath) {
+    if (SendMessage(hCheckSizes, BM_GETCHECK, 0, 0) == BST_CHECKED) {
+        ioWorker.SelectKey(hKey, keyPath, true, true);
+        ClearValuesList();
+        UpdateStatusBar("Computing subtree sizes...");
+        return;
+    }
+
+    std::shared_ptr<const RegistryViewCache::CachedKey> key = viewCache.PeekKey(hKey, keyPath);
+    ioWorker.SelectKey(hKey, keyPath, !key);
+    if (key) {
+        ShowValuesList(hKey, keyPath, key);
+    } else {
+        ClearValuesList();
+    }
+}
+
+// Show a key read through the view cache: only the row count is set, rows are formatted when
+// they become visible
+void ShowValuesList(HKEY hKey, const std::string& keyPath, std::shared_ptr<const RegistryViewCache::CachedKey> key) {
+    if (!key) {
+        ClearValuesList();
+        UpdateStatusBar("Cannot open registry key: " + keyPath);
+        return;
+    }
+    SetValuesListColumns(false);
+    valueListModel.Open(*registry, hKey, keyPath, key);
+    ListView_SetItemCountEx(hListView, (int)valueListModel.RowCount(), 0);
+    InvalidateRect(hListView, nullptr, TRUE);
+}
+
+// Supply the text of a visible cell of the values list
+void OnValuesGetDispInfo(NMLVDISPINFOW* pnmdi) {
+    if (!(pnmdi->item.mask & LVIF_TEXT) || pnmdi->item.cchTextMax <= 0) return;
+
+    const ValueListModel::Row* row = valueListModel.GetRow(pnmdi->item.iItem);
+    const std::string* text = nullptr;
+    if (row) {
+        text = pnmdi->item.iSubItem == 0 ? &row->name : pnmdi->item.iSubItem == 1 ? &row->type : &row->data;
+    }
+
+    // Each byte converts to at most one unit; a cut text ends before a UTF-8 lead byte
+    size_t length = text ? std::min(text->size(), (size_t)pnmdi->item.cchTextMax - 1) : 0;
+    while (length > 0 && length < text->size() && ((BYTE)(*text)[length] & 0xC0) == 0x80) length--;
+    length = length ? Utf8ToUtf16(text->data(), length, pnmdi->item.pszText) : 0;
+    pnmdi->item.pszText[length] = L'\0';
+}
+
+void RegistryIoWorker::Start(HWND window, RegistryBackend& keyBackend) {
+    notifyWindow = window;
+    backend = &keyBackend;
+    thread = std::thread(&RegistryIoWorker::Run, this);
+}
+
+void RegistryIoWorker::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    if (thread.joinable()) thread.join();
+}
+
+void RegistryIoWorker::SetBackend(RegistryBackend& keyBackend) {
+    std::unique_lock<std::mutex> lock(queueMutex);
+    selectionGeneration++;
+    selectionPending = false;
+    rowsPending = false;
+    keyRequests.clear();
+    queuedKeys.clear();
+    idle.wait(lock, [this]() { return !busy; });
+    backend = &keyBackend;
+    results.clear();
+}
+
+void RegistryIoWorker::SelectKey(HKEY rootKey, const std::string& keyPath, bool load, bool sizes) {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        selectionGeneration++;
+        selectedRoot = rootKey;
+        selectedPath = keyPath;
+        selectionPending = load;
+        selectionSizes = sizes;
+        rowsPending = false;
+    }
+    if (load) wake.notify_one();
+}
+
+void RegistryIoWorker::LoadKey(RequestKind kind, HKEY rootKey, const std::string& keyPath) {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (!queuedKeys.insert(RegistryLocationKey(rootKey, keyPath) + (char)('0' + kind)).second) return;
+        keyRequests.push_back({ kind, rootKey, keyPath });
+    }
+    wake.notify_one();
+}
+
+void RegistryIoWorker::LoadRows(size_t first, size_t last) {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        rowsFirst = first;
+        rowsLast = last;
+        rowsPending = true;
+    }
+    wake.notify_one();
+}
+
+std::vector<RegistryIoWorker::Result> RegistryIoWorker::TakeResults() {
+    notifyPending = false;
+    std::lock_guard<std::mutex> lock(queueMutex);
+    std::vector<Result> taken;
+    taken.swap(results);
+    return taken;
+}
+
+void RegistryIoWorker::Run() {
+    for (;;) {
+        KeyRequest request;
+        size_t lastRow = 0;
+        Result result;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            wake.wait(lock, [this]() { return stopping || selectionPending || rowsPending || !keyRequests.empty(); });
+            if (stopping) return;
+
+            // The selection first, then rows of it, then tree items
+            if (selectionPending) {
+                request = { selectionSizes ? LoadSubtreeSizes : LoadSelection, selectedRoot, selectedPath };
+                selectionPending = false;
+            } else if (rowsPending) {
+                request = { LoadValueRows, selectedRoot, selectedPath };
+                result.firstRow = rowsFirst;
+                lastRow = rowsLast;
+                rowsPending = false;
+            } else {
+                request = std::move(keyRequests.front());
+                keyRequests.pop_front();
+                queuedKeys.erase(RegistryLocationKey(request.rootKey, request.keyPath) + (char)('0' + request.kind));
+            }
+            result.generation = selectionGeneration;
+            busy = true;
+        }
+
+        result.kind = request.kind;
+        result.rootKey = request.rootKey;
+        result.keyPath = std::move(request.keyPath);
+        if (result.kind == LoadValueRows) {
+            ReadRows(result, lastRow);
+        } else if (result.kind == LoadSubtreeSizes) {
+            // A long pass gives up as soon as another key is selected
+            uint64_t generation = result.generation;
+            result.sizesComputed = subtreeStats.ComputeChildren(*backend, result.rootKey, result.keyPath, result.subtreeTotal,
+                result.subtreeSizes, [this, generation]() { return generation != selectionGeneration; });
+        } else if (result.kind == IndexSearchRoot) {
+            DWORD startTime = GetTickCount();
+            result.indexedKeys = searchIndex.IndexRoot(*backend, result.rootKey);
+            result.indexTime = GetTickCount() - startTime;
+        } else if (result.kind == ReplaceScan) {
+            replaceJob.succeeded = replaceJob.replacer->Scan(result.rootKey, result.keyPath, replaceJob.error,
+                &replaceJob.scanProgress);
+        } else if (result.kind == ReplaceApply) {
+            RegistryBatch batch(*backend);
+            replaceJob.replacer->QueueChanges(batch);
+            replaceJob.succeeded = batch.Apply(replaceJob.error, nullptr, &replaceJob.applyProgress);
+            if (replaceJob.succeeded) {
+                replaceJob.touchedKeys = batch.TouchedKeys();
+                for (const auto& key : replaceJob.touchedKeys) {
+                    if (searchIndex.IsRootIndexed(key.first)) searchIndex.UpdateKey(*backend, key.first, key.second);
+                }
+            }
+        } else if (result.kind == SaveFile) {
+            fileJob.succeeded = fileJob.snapshot
+                ? WriteRegSnapshot(*backend, result.rootKey, result.keyPath, fileJob.fileName, fileJob.error,
+                                   &fileJob.exportStats, &fileJob.progress)
+                : ExportRegFile(*backend, result.rootKey, result.keyPath, fileJob.fileName, fileJob.error,
+                                &fileJob.exportStats, &fileJob.progress);
+        } else if (result.kind == ImportFile) {
+            fileJob.succeeded = ImportRegFile(*backend, fileJob.fileName, fileJob.error, &fileJob.importStats, false,
+                &fileJob.progress);
+        } else if (result.kind == DiffFile) {
+            // The file is opened as a private hive so both sides can be read the same way
+            std::unique_ptr<RegistryBackend> other = LoadHiveFile(fileJob.fileName, fileJob.error, nullptr, nullptr,
+                &fileJob.progress);
+            fileJob.succeeded = other && DiffRegistry({ backend, result.rootKey, result.keyPath },
+                { other.get(), result.rootKey, result.keyPath }, fileJob.patchFileName, fileJob.error, &fileJob.diffStats,
+                &fileJob.progress);
+        } else if (result.kind == LoadHive) {
+            fileJob.hive = LoadHiveFile(fileJob.fileName, fileJob.error, &fileJob.hiveKeys, &fileJob.hiveValues,
+                &fileJob.progress);
+            fileJob.succeeded = fileJob.hive != nullptr;
+        } else if (result.kind == EditLookup) {
+            HKEY hKey;
+            editJob.keyExists = backend->OpenKey(result.rootKey, result.keyPath, KEY_READ, &hKey) == ERROR_SUCCESS;
+            if (editJob.keyExists) backend->CloseKey(hKey);
+        } else if (result.kind == EditApply) {
+            RegistryBatch batch(*backend);
+            if (editJob.action == EditJob::CreateKey) {
+                batch.CreateKey(result.rootKey, result.keyPath);
+            } else if (editJob.action == EditJob::SetValue) {
+                batch.SetValue(result.rootKey, result.keyPath, editJob.valueName, REG_SZ,
+                    (const BYTE*)editJob.valueData.c_str(), (DWORD)editJob.valueData.length() + 1);
+            } else if (editJob.action == EditJob::DeleteValue) {
+                batch.DeleteValue(result.rootKey, result.keyPath, editJob.valueName);
+            }
+            editJob.stats = RegBatchStats();
+            editJob.succeeded = batch.Apply(editJob.error, &editJob.stats);
+            if (editJob.succeeded) searchIndex.UpdateKey(*backend, result.rootKey, result.keyPath);
+        } else if (result.kind == FindText) {
+            DWORD startTime = GetTickCount();
+            findJob.hits.clear();
+            findJob.succeeded = searchIndex.Search(*backend, findJob.pattern, findJob.isRegex, 10000, findJob.hits,
+                findJob.error);
+            findJob.searchTime = GetTickCount() - startTime;
+        } else {
+            result.key = viewCache.GetKey(*backend, result.rootKey, result.keyPath);
+        }
+
+        bool superseded;
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            busy = false;
+            superseded = (result.kind == LoadSelection || result.kind == LoadSubtreeSizes || result.kind == LoadValueRows) &&
+                result.generation != selectionGeneration;
+            if (!superseded) results.push_back(std::move(result));
+        }
+        idle.notify_all();
+        if (!superseded && !notifyPending.exchange(true)) {
+            PostMessage(notifyWindow, WM_REGISTRY_LOADED, 0, 0);
+        }
+    }
+}
+
+// Format a range of values by index, giving up as soon as another key is selected
+void RegistryIoWorker::ReadRows(Result& result, size_t last) {
+    HKEY hKey;
+    if (backend->OpenKey(result.rootKey, result.keyPath, KEY_READ, &hKey) != ERROR_SUCCESS) return;
+    std::string name;
+    DWORD type;
+    std::vector<BYTE> data;
+    for (size_t index = result.firstRow; index <= last && result.generation == selectionGeneration; index++) {
+        if (backend->EnumValue(hKey, (DWORD)index, name, type, data) != ERROR_SUCCESS) break;
+        result.rows.emplace_back();
+        ValueListModel::FormatValue(name, type, data, result.rows.back());
+    }
+    backend->CloseKey(hKey);
+}
+
+// Apply what the I/O worker has read (WM_REGISTRY_LOADED)
+void OnRegistryLoaded() {
+    for (RegistryIoWorker::Result& result : ioWorker.TakeResults()) {
+        switch (result.kind) {
+        case RegistryIoWorker::LoadSelection:
+            if (result.generation == ioWorker.SelectionGeneration()) {
+                ShowValuesList(result.rootKey, result.keyPath, result.key);
+            }
+            break;
+
+        case RegistryIoWorker::LoadSubtreeSizes:
+            if (result.generation != ioWorker.SelectionGeneration()) break;
+            if (!result.sizesComputed) {
+                ClearValuesList();
+                UpdateStatusBar("Cannot open registry key: " + result.keyPath);
+                break;
+            }
+            shownSubtreeSizes = std::move(result.subtreeSizes);
+            ShowSubtreeSizes();
+            UpdateStatusBar(std::string(GetRootKeyName(result.rootKey)) + (result.keyPath.empty() ? "" : "\\") + result.keyPath +
+                ": " + std::to_string(result.subtreeTotal.keys) + " keys, " + std::to_string(result.subtreeTotal.values) +
+                " values, " + FormatByteSize(result.subtreeTotal.valueBytes) + " of value data");
+            break;
+
+        case RegistryIoWorker::LoadValueRows:
+            if (result.generation == ioWorker.SelectionGeneration() && !result.rows.empty()) {
+                int first = (int)result.firstRow;
+                int last = first + (int)result.rows.size() - 1;
+                valueListModel.StoreRows(result.firstRow, std::move(result.rows));
+                ListView_RedrawItems(hListView, first, last);
+            }
+            break;
+
+        case RegistryIoWorker::LoadExpansion:
+        case RegistryIoWorker::LoadChildCount: {
+            // The item may have been collapsed, refreshed or deleted meanwhile
+            bool exact;
+            HTREEITEM hItem = FindLoadedTreeItem(result.rootKey, result.keyPath, &exact);
+            if (!hItem || !exact || TreeView_GetChild(hTreeView, hItem)) break;
+            if (!result.key || result.key->subKeys.empty()) {
+                SetTreeItemChildren(hItem, 0);
+            } else if (result.kind == RegistryIoWorker::LoadChildCount) {
+                SetTreeItemChildren(hItem, 1);
+            } else {
+                PopulateTreeChildren(hItem, result.key->subKeys);
+                TreeView_Expand(hTreeView, hItem, TVE_EXPAND);
+            }
+            break;
+        }
+
+        case RegistryIoWorker::LoadRefresh: {
+            // Only a branch that is still expanded is diffed; anything else resets without reads
+            bool exact;
+            HTREEITEM hItem = FindLoadedTreeItem(result.rootKey, result.keyPath, &exact);
+            if (!hItem || !exact) break;
+            if (TreeView_GetChild(hTreeView, hItem) && (TreeView_GetItemState(hTreeView, hItem, TVIS_EXPANDED) & TVIS_EXPANDED)) {
+                SyncTreeChildren(hItem, result.key ? result.key->subKeys : std::vector<std::string>());
+            } else {
+                RefreshTreeItem(hItem);
+            }
+            break;
+        }
+
+        case RegistryIoWorker::IndexSearchRoot:
+            OnSearchIndexBuilt(result.rootKey, result.indexedKeys, result.indexTime);
+            break;
+
+        case RegistryIoWorker::ReplaceScan:
+            OnReplaceScanned();
+            break;
+
+        case RegistryIoWorker::ReplaceApply:
+            OnReplaceApplied();
+            break;
+
+        case RegistryIoWorker::SaveFile:
+            OnRegistrySaved();
+            break;
+
+        case RegistryIoWorker::ImportFile:
+            OnRegistryImported();
+            break;
+
+        case RegistryIoWorker::DiffFile:
+            OnRegistryCompared();
+            break;
+
+        case RegistryIoWorker::LoadHive:
+            OnHiveLoaded();
+            break;
+
+        case RegistryIoWorker::EditLookup:
+            OnEditLookedUp();
+            break;
+
+        case RegistryIoWorker::EditApply:
+            OnEditApplied();
+            break;
+
+        case RegistryIoWorker::FindText:
+            OnRegistrySearched();
+            break;
+        }
+    }
+}
+
+// Create registry key: the I/O worker looks it up, and creates it once an existing key is confirmed
+void CreateRegistryKey() {
+    std::string keyPath = GetWindowText(hEditKeyPath);
+    if (keyPath.empty()) {
+        MessageBox(hMainWindow, "Please enter a key path!", "Error", MB_OK | MB_ICONERROR);
+        return;
+    }
+    if (editJob.busy) {
+        MessageBox(hMainWindow, "Please wait until the previous change has been written!", "Error", MB_OK | MB_ICONERROR);
+        return;
+    }
+    if (MustWaitForHive()) return;
+
+    editJob.action = EditJob::CreateKey;
+    editJob.rootKey = GetSelectedRootKey();
+    editJob.keyPath = keyPath;
+    StartEditStep(RegistryIoWorker::EditLookup);
+}
+
+// Queue a step of editJob on the I/O worker
+void StartEditStep(RegistryIoWorker::RequestKind kind) {
+    editJob.error.clear();
+    editJob.busy = true;
+    ioWorker.LoadKey(kind, editJob.rootKey, editJob.keyPath);
+}
+
+// The worker has looked the key up: report it, or write the edit if it can go ahead
+void OnEditLookedUp() {
+    editJob.busy = false;
+    const std::string& keyPath = editJob.keyPath;
+    if (editJob.action == EditJob::CheckKey) {
+        std::string message = "Key '" + keyPath + "' ";
+        message += editJob.keyExists ? "EXISTS" : "DOES NOT EXIST";
+
+        MessageBox(hMainWindow, message, "Key Check Result",
+            MB_OK | (editJob.keyExists ? MB_ICONINFORMATION : MB_ICONWARNING));
+
+        UpdateStatusBar(message);
+        return;
+    }
+
+    // Check if key already exists (Group 3 additional requirement)
+    if (editJob.action == EditJob::CreateKey && editJob.keyExists) {
+        int result = MessageBox(hMainWindow,
+            "Key already exists! Do you want to update it?",
+            "Key Exists", MB_YESNO | MB_ICONQUESTION);
+        if (result != IDYES) {
+            return;
+        }
+    }
+    if (editJob.action == EditJob::SetValue && !editJob.keyExists) {
+        UpdateStatusBar("Failed to open registry key for writing: " + keyPath);
+        MessageBox(hMainWindow, "Failed to open registry key!", "Error", MB_OK | MB_ICONERROR);
+        return;
+    }
+
+    StartEditStep(RegistryIoWorker::EditApply);
+}
+
+// The worker has written the edit, or rolled it back after an error
+void OnEditApplied() {
+    editJob.busy = false;
+    HKEY rootKey = editJob.rootKey;
+    const std::string& keyPath = editJob.keyPath;
+    const std::string& valueName = editJob.valueName;
+
+    if (!editJob.succeeded) {
+        if (editJob.action == EditJob::CreateKey) {
+            UpdateStatusBar("Failed to create registry key. " + editJob.error);
+            MessageBox(hMainWindow, "Failed to create registry key!", "Error", MB_OK | MB_ICONERROR);
+        } else if (editJob.action == EditJob::SetValue) {
+            UpdateStatusBar("Failed to set registry value. " + editJob.error);
+            MessageBox(hMainWindow, "Failed to set registry value!", "Error", MB_OK | MB_ICONERROR);
+        } else {
+            UpdateStatusBar("Failed to delete registry value. " + editJob.error);
+            MessageBox(hMainWindow, "Failed to delete registry value!", "Error", MB_OK | MB_ICONERROR);
+        }
+        return;
+    }
+    if (editJob.action == EditJob::DeleteValue && editJob.stats.valuesDeleted == 0) {
+        UpdateStatusBar("Registry value not found: " + valueName);
+        MessageBox(hMainWindow, "Registry value not found!", "Error", MB_OK | MB_ICONERROR);
+        return;
+    }
+
+    viewCache.InvalidateKey(rootKey, keyPath);
+    subtreeStats.InvalidateKey(rootKey, keyPath);
+    if (editJob.action == EditJob::CreateKey) {
+        if (editJob.stats.keysCreated) {
+            UpdateStatusBar("Registry key created successfully: " + keyPath);
+        } else {
+            UpdateStatusBar("Registry key opened for update: " + keyPath);
+        }
+        RefreshTreeBranch(rootKey, keyPath);
+    } else if (editJob.action == EditJob::SetValue) {
+        UpdateStatusBar("Registry value set successfully: " + valueName);
+        OnTreeSelectionChanged(); // Refresh values list
+    } else {
+        UpdateStatusBar("Registry value deleted successfully: " + valueName);
+        OnTreeSelectionChanged(); // Refresh values list
+    }
+}
+
+// Delete registry key
+void DeleteRegistryKey() {
+    std::string keyPath = GetWindowText(hEditKeyPath);
+    if (keyPath.empty()) {
+        MessageBox(hMainWindow, "Please enter a key path!", "Error", MB_OK | MB_ICONERROR);
+        return;
+    }
+
+    if (IsKeyDeleteRunning()) {
+        MessageBox(hMainWindow, "A key is already being deleted!", "Error", MB_OK | MB_ICONERROR);
+        return;
+    }
+    if (MustWaitForHive()) return;
+
+    int result = MessageBox(hMainWindow,
+        "Are you sure you want to delete the key and all of its subkeys: " + keyPath + "?",
+        "Confirm Delete", MB_YESNO | MB_ICONWARNING);
+
+    if (result != IDYES) return;
+
+    // The subtree is deleted on a background thread; the window keeps working and shows progress
+    keyDeleteJob.rootKey = GetSelectedRootKey();
+    keyDeleteJob.keyPath = keyPath;
+    keyDeleteJob.startTime = GetTickCount();
+    keyDeleteJob.progress.keysDeleted = 0;
+    keyDeleteJob.progress.keysFailed = 0;
+    keyDeleteJob.progress.cancel = false;
+
+    RegistryBackend* backend = registry;
+    keyDeleteJob.thread = std::thread([backend]() {
+        keyDeleteJob.result = DeleteKeyTreeParallel(*backend, keyDeleteJob.rootKey, keyDeleteJob.keyPath, keyDeleteJob.progress);
+        PostMessage(hMainWindow, WM_KEY_TREE_DELETED, 0, 0);
+    });
+
+    UpdateCancelButton();
+    SetTimer(hMainWindow, IDT_KEY_DELETE_PROGRESS, 200, nullptr);
+    UpdateStatusBar("Deleting registry key: " + keyPath + "...");
+}
+
+bool IsKeyDeleteRunning() {
+    return keyDeleteJob.thread.joinable();
+}
+
+// Cancel stops whichever background key deletion, replace or file operation is running
+void UpdateCancelButton() {
+    EnableWindow(hButtonCancel, IsKeyDeleteRunning() || replaceJob.busy || fileJob.busy);
+}
+
+// Show how far the background deletion has got
+void ShowKeyDeleteProgress() {
+    UpdateStatusBar("Deleting registry key: " + keyDeleteJob.keyPath + " (" +
+        std::to_string(keyDeleteJob.progress.keysDeleted) + " keys deleted)...");
+}
+
+// Background deletion finished, was cancelled or failed
+void OnKeyTreeDeleted() {
+    if (!IsKeyDeleteRunning()) return;
+    keyDeleteJob.thread.join();
+    KillTimer(hMainWindow, IDT_KEY_DELETE_PROGRESS);
+    UpdateCancelButton();
+
+    HKEY rootKey = keyDeleteJob.rootKey;
+    const std::string& keyPath = keyDeleteJob.keyPath;
+    LONG result = keyDeleteJob.result;
+    std::string counts = std::to_string(keyDeleteJob.progress.keysDeleted) + " keys deleted in " +
+        std::to_string(GetTickCount() - keyDeleteJob.startTime) + " ms";
+
+    // A partly deleted subtree leaves stale index entries; search re-checks hits against the backend
+    viewCache.InvalidateKey(rootKey, keyPath);
+    subtreeStats.RemoveSubtree(rootKey, keyPath);
+    if (result == ERROR_SUCCESS) searchIndex.RemoveSubtree(rootKey, keyPath);
+    RefreshTreeBranch(rootKey, keyPath);
+    ClearValuesList();
+
+    if (result == ERROR_SUCCESS) {
+        UpdateStatusBar("Registry key deleted successfully: " + keyPath + " (" + counts + ")");
+    } else if (result == ERROR_CANCELLED) {
+        UpdateStatusBar("Deletion of " + keyPath + " cancelled (" + counts + ")");
+    } else {
+        UpdateStatusBar("Failed to delete registry key. Error: " + std::to_string(result) + " (" + counts + ", " +
+            std::to_string(keyDeleteJob.progress.keysFailed) + " failed)");
+        MessageBox(hMainWindow, "Failed to delete registry key!", "Error", MB_OK | MB_ICONERROR);
+    }
+}
+
+// Set registry value of an existing key on the I/O worker
+void SetRegistryValue() {
+    std::string keyPath = GetWindowText(hEditKeyPath);
+    std::string valueName = GetWindowText(hEditValueName);
+    std::string valueData = GetWindowText(hEditValueData);
+
+    if (keyPath.empty() || valueName.empty()) {
+        MessageBox(hMainWindow, "Please enter key path and value name!", "Error", MB_OK | MB_ICONERROR);
+        return;
+    }
+    if (editJob.busy) {
+        MessageBox(hMainWindow, "Please wait until the previous change has been written!", "Error", MB_OK | MB_ICONERROR);
+        return;
+    }
+    if (MustWaitForHive()) return;
+
+    editJob.action = EditJob::SetValue;
+    editJob.rootKey = GetSelectedRootKey();
+    editJob.keyPath = keyPath;
+    editJob.valueName = valueName;
+    editJob.valueData = valueData;
+    StartEditStep(RegistryIoWorker::EditLookup);
+}
+
+// Delete registry value on the I/O worker
+void DeleteRegistryValue() {
+    std::string keyPath = GetWindowText(hEditKeyPath);
+    std::string valueName = GetWindowText(hEditValueName);
+
+    if (keyPath.empty() || valueName.empty()) {
+        MessageBox(hMainWindow, "Please enter key path and value name!", "Error", MB_OK | MB_ICONERROR);
+        return;
+    }
+
+    if (editJob.busy) {
+        MessageBox(hMainWindow, "Please wait until the previous change has been written!", "Error", MB_OK | MB_ICONERROR);
+        return;
+    }
+    if (MustWaitForHive()) return;
+
+    int result = MessageBox(hMainWindow,
+        "Are you sure you want to delete the value: " + valueName + "?",
+        "Confirm Delete", MB_YESNO | MB_ICONWARNING);
+
+    if (result != IDYES) return;
+
+    editJob.action = EditJob::DeleteValue;
+    editJob.rootKey = GetSelectedRootKey();
+    editJob.keyPath = keyPath;
+    editJob.valueName = valueName;
+    StartEditStep(RegistryIoWorker::EditApply);
+}
+
+// Save the selected key and its whole subtree to a .reg file or snapshot on the I/O worker
+void SaveRegistryToFile() {
+    if (fileJob.busy) {
+        MessageBox(hMainWindow, "Please wait until the current file operation has finished!", "Error", MB_OK | MB_ICONERROR);
+        return;
+    }
+
+    OPENFILENAMEW ofn;
+    WCHAR szFile[260] = {0};
+
+    ZeroMemory(&ofn, sizeof(ofn));
+    ofn.lStructSize = sizeof(ofn);
+    ofn.hwndOwner = hMainWindow;
+    ofn.lpstrFile = szFile;
+    ofn.nMaxFile = sizeof(szFile) / sizeof(WCHAR);
+    ofn.lpstrFilter = L"Registry Files\0*.reg\0Registry Snapshots\0*.regsnap\0Text Files\0*.txt\0All Files\0*.*\0";
+    ofn.nFilterIndex = 1;
+    ofn.lpstrFileTitle = nullptr;
+    ofn.nMaxFileTitle = 0;
+    ofn.lpstrInitialDir = nullptr;
+    ofn.lpstrDefExt = L"reg";
+    ofn.Flags = OFN_PATHMUSTEXIST | OFN_OVERWRITEPROMPT;
+
+    if (GetSaveFileNameW(&ofn)) {
+        std::string fileName = WideToUtf8(szFile, wcslen(szFile));
+        std::string keyPath = GetWindowText(hEditKeyPath);
+        if (keyPath.empty()) {
+            MessageBox(hMainWindow, "Please select a key to save!", "Error", MB_OK | MB_ICONERROR);
+            return;
+        }
+
+        fileJob.fileName = fileName;
+        fileJob.rootKey = GetSelectedRootKey();
+        fileJob.keyPath = keyPath;
+        // Snapshots are chosen by extension; everything else is written as .reg text
+        fileJob.snapshot = fileName.size() > 8 && _stricmp(fileName.c_str() + fileName.size() - 8, ".regsnap") == 0;
+        StartFileJob("Saving", RegistryIoWorker::SaveFile);
+    }
+}
+
+// Load registry from file (imports the .reg file into the current backend on the I/O worker)
+void LoadRegistryFromFile() {
+    if (fileJob.busy) {
+        MessageBox(hMainWindow, "Please wait until the current file operation has finished!", "Error", MB_OK | MB_ICONERROR);
+        return;
+    }
+
+    OPENFILENAMEW ofn;
+    WCHAR szFile[260] = {0};
+
+    ZeroMemory(&ofn, sizeof(ofn));
+    ofn.lStructSize = sizeof(ofn);
+    ofn.hwndOwner = hMainWindow;
+    ofn.lpstrFile = szFile;
+    ofn.nMaxFile = sizeof(szFile) / sizeof(WCHAR);
+    ofn.lpstrFilter = L"Registry Files\0*.reg\0Text Files\0*.txt\0All Files\0*.*\0";
+    ofn.nFilterIndex = 1;
+    ofn.lpstrFileTitle = nullptr;
+    ofn.nMaxFileTitle = 0;
+    ofn.lpstrInitialDir = nullptr;
+    ofn.Flags = OFN_PATHMUSTEXIST | OFN_FILEMUSTEXIST;
+
+    if (GetOpenFileNameW(&ofn)) {
+        std::string fileName = WideToUtf8(szFile, wcslen(szFile));
+        int confirm = MessageBox(hMainWindow,
+            "Import all keys and values from " + fileName + "?",
+            "Confirm Import", MB_YESNO | MB_ICONWARNING);
+        if (confirm != IDYES) return;
+
+        fileJob.fileName = fileName;
+        fileJob.rootKey = nullptr;
+        fileJob.keyPath.clear();
+        StartFileJob("Importing", RegistryIoWorker::ImportFile);
+    }
+}
+
+// Queue the step of fileJob on the I/O worker and show its progress until the result arrives
+void StartFileJob(const char* action, RegistryIoWorker::RequestKind kind) {
+    fileJob.action = action;
+    fileJob.opensHive = kind == RegistryIoWorker::LoadHive;
+    fileJob.startTime = GetTickCount();
+    fileJob.progress.keys = 0;
+    fileJob.progress.cancel = false;
+    fileJob.error.clear();
+    fileJob.busy = true;
+    ioWorker.LoadKey(kind, fileJob.rootKey, fileJob.keyPath);
+
+    UpdateCancelButton();
+    SetTimer(hMainWindow, IDT_FILE_PROGRESS, 200, nullptr);
+    ShowFileProgress();
+}
+
+// Show how many keys the file operation has got through
+void ShowFileProgress() {
+    if (!fileJob.busy) return;
+    UpdateStatusBar(std::string(fileJob.action) + " " + fileJob.fileName + ": " +
+        std::to_string(fileJob.progress.keys) + " keys...");
+}
+
+// The worker has finished the step
+void EndFileJob() {
+    fileJob.busy = false;
+    KillTimer(hMainWindow, IDT_FILE_PROGRESS);
+    UpdateCancelButton();
+}
+
+// The save finished, failed or was cancelled (a cancelled save leaves no file behind)
+void OnRegistrySaved() {
+    EndFileJob();
+    const RegExportStats& stats = fileJob.exportStats;
+    if (!fileJob.succeeded) {
+        if (fileJob.progress.cancel) {
+            UpdateStatusBar("Save cancelled after " + std::to_string(fileJob.progress.keys) + " keys");
+        } else {
+            MessageBox(hMainWindow, fileJob.error, "Error", MB_OK | MB_ICONERROR);
+        }
+        return;
+    }
+
+    std::string message = "Registry saved to file: " + fileJob.fileName + " (" +
+        std::to_string(stats.keys) + " keys, " + std::to_string(stats.values) + " values in " +
+        std::to_string(GetTickCount() - fileJob.startTime) + " ms)";
+    if (stats.skipped) message += ", " + std::to_string(stats.skipped) + " keys skipped (access denied)";
+    UpdateStatusBar(message);
+}
+
+// The import finished, failed or was cancelled
+void OnRegistryImported() {
+    EndFileJob();
+    viewCache.Clear(); // Even a failed or cancelled import may have written part of the file
+    subtreeStats.Clear();
+    // Imported keys can be anywhere, so indexed roots are crawled again
+    for (int i = 0; i < ROOT_KEYS_COUNT; i++) {
+        if (searchIndex.IsRootIndexed(rootKeys[i].hKey)) {
+            ioWorker.LoadKey(RegistryIoWorker::IndexSearchRoot, rootKeys[i].hKey, "");
+        }
+    }
+
+    const RegImportStats& stats = fileJob.importStats;
+    if (fileJob.succeeded) {
+        UpdateStatusBar("Registry file imported: " + std::to_string(stats.keys) + " keys, " +
+            std::to_string(stats.values) + " values, " + std::to_string(stats.deletions) + " deletions in " +
+            std::to_string(GetTickCount() - fileJob.startTime) + " ms");
+        RefreshTreeView();
+        OnTreeSelectionChanged();
+    } else {
+        UpdateStatusBar("Import failed: " + fileJob.error);
+        if (!fileJob.progress.cancel) MessageBox(hMainWindow, fileJob.error, "Error", MB_OK | MB_ICONERROR);
+        RefreshTreeView();
+    }
+}
+
+// Map a root key name from a .reg header to its predefined HKEY
+HKEY FindRootKeyByName(const std::string& name) {
+    for (int i = 0; i < ROOT_KEYS_COUNT; i++) {
+        if (_stricmp(name.c_str(), rootKeys[i].name) == 0) {
+            return rootKeys[i].hKey;
+        }
+    }
+    return nullptr;
+}
+
+// Full name of a predefined root key
+const char* GetRootKeyName(HKEY rootKey) {
+    for (int i = 0; i < ROOT_KEYS_COUNT; i++) {
+        if (rootKeys[i].hKey == rootKey) {
+            return rootKeys[i].name;
+        }
+    }
+    return "";
+}
+
+// Delete a key together with all of its subkeys
+LONG DeleteKeyTree(RegistryBackend& backend, HKEY rootKey, const std::string& keyPath) {
+    std::vector<std::string> subKeys;
+    HKEY hKey;
+    LONG result = backend.OpenKey(rootKey, keyPath, KEY_READ, &hKey);
+    if (result != ERROR_SUCCESS) return result;
+
+    std::string subKeyName;
+    DWORD index = 0;
+    while (backend.EnumKey(hKey, index++, subKeyName) == ERROR_SUCCESS) {
+        subKeys.push_back(subKeyName);
+    }
+    backend.CloseKey(hKey);
+
+    for (const std::string& subKey : subKeys) {
+        result = DeleteKeyTree(backend, rootKey, keyPath + "\\" + subKey);
+        if (result != ERROR_SUCCESS) return result;
+    }
+    return backend.DeleteKey(rootKey, keyPath);
+}
+
+// Delete a key bottom-up: all subkeys first, then the key itself. Siblings of a key that
+// failed are still deleted, but its ancestors are kept. keyPath is extended in place.
+LONG DeleteSubtree(RegistryBackend& backend, HKEY rootKey, std::string& keyPath, RegDeleteProgress& progress) {
+    if (progress.cancel) return ERROR_CANCELLED;
+
+    HKEY hKey;
+    LONG result = backend.OpenKey(rootKey, keyPath, KEY_READ, &hKey);
+    if (result == ERROR_FILE_NOT_FOUND) return ERROR_SUCCESS; // Already gone
+    if (result != ERROR_SUCCESS) {
+        progress.keysFailed++;
+        return result;
+    }
+    std::vector<std::string> subKeys;
+    std::string subKeyName;
+    for (DWORD index = 0; backend.EnumKey(hKey, index, subKeyName) == ERROR_SUCCESS; index++) {
+        subKeys.push_back(subKeyName);
+    }
+    backend.CloseKey(hKey);
+
+    LONG firstError = ERROR_SUCCESS;
+    size_t pathLength = keyPath.size();
+    for (const std::string& subKey : subKeys) {
+        keyPath += '\\';
+        keyPath += subKey;
+        result = DeleteSubtree(backend, rootKey, keyPath, progress);
+        keyPath.resize(pathLength);
+        if (result == ERROR_CANCELLED) return result;
+        if (result != ERROR_SUCCESS && firstError == ERROR_SUCCESS) firstError = result;
+    }
+    if (firstError != ERROR_SUCCESS) return firstError;
+
+    result = backend.DeleteKey(rootKey, keyPath);
+    if (result == ERROR_SUCCESS) {
+        progress.keysDeleted++;
+    } else {
+        progress.keysFailed++;
+    }
+    return result;
+}
+
+// Delete a key with all of its subkeys. The top of the subtree is split breadth-first into
+// independent sibling subtrees that worker threads delete in parallel; the keys above them
+// are deleted last, children before parents. Progress can be watched and cancelled.
+LONG DeleteKeyTreeParallel(RegistryBackend& backend, HKEY rootKey, const std::string& keyPath, RegDeleteProgress& progress) {
+    HKEY hKey;
+    LONG result = backend.OpenKey(rootKey, keyPath, KEY_READ, &hKey);
+    if (result != ERROR_SUCCESS) return result;
+    backend.CloseKey(hKey);
+
+    size_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+    std::vector<std::string> units = { keyPath };
+    std::vector<std::string> upperKeys; // Split keys, parents before children
+    std::string subKeyName;
+    for (int depth = 0; depth < 3 && units.size() < threadCount * 8; depth++) {
+        std::vector<std::string> split;
+        bool expanded = false;
+        for (std::string& unit : units) {
+            std::vector<std::string> subKeys;
+            if (backend.OpenKey(rootKey, unit, KEY_READ, &hKey) == ERROR_SUCCESS) {
+                for (DWORD index = 0; backend.EnumKey(hKey, index, subKeyName) == ERROR_SUCCESS; index++) {
+                    subKeys.push_back(subKeyName);
+                }
+                backend.CloseKey(hKey);
+            }
+            if (subKeys.empty()) {
+                split.push_back(std::move(unit));
+                continue;
+            }
+            for (const std::string& subKey : subKeys) split.push_back(unit + "\\" + subKey);
+            upperKeys.push_back(std::move(unit));
+            expanded = true;
+        }
+        units.swap(split);
+        if (!expanded) break;
+    }
+
+    std::atomic<size_t> nextUnit(0);
+    std::atomic<LONG> firstError(ERROR_SUCCESS);
+    std::vector<std::thread> workers;
+    for (size_t worker = 0; worker < std::min(threadCount, units.size()); worker++) {
+        workers.emplace_back([&]() {
+            for (size_t index = nextUnit++; index < units.size(); index = nextUnit++) {
+                std::string path = units[index];
+                LONG unitResult = DeleteSubtree(backend, rootKey, path, progress);
+                LONG expected = ERROR_SUCCESS;
+                if (unitResult != ERROR_SUCCESS) firstError.compare_exchange_strong(expected, unitResult);
+                if (unitResult == ERROR_CANCELLED) break;
+            }
+        });
+    }
+    for (std::thread& worker : workers) worker.join();
+
+    if (progress.cancel) return ERROR_CANCELLED;
+    if (firstError != ERROR_SUCCESS) return firstError;
+
+    for (size_t i = upperKeys.size(); i-- > 0;) {
+        if (progress.cancel) return ERROR_CANCELLED;
+        result = backend.DeleteKey(rootKey, upperKeys[i]);
+        if (result != ERROR_SUCCESS) {
+            progress.keysFailed++;
+            return result;
+        }
+        progress.keysDeleted++;
+    }
+    return ERROR_SUCCESS;
+}
+
+bool RegistryStatsCache::Lookup(const std::string& location, SubtreeStats& stats) const {
+    std::shared_lock<std::shared_mutex> lock(statsMutex);
+    auto found = entries.find(location);
+    if (found == entries.end()) return false;
+    stats = found->second;
+    return true;
+}
+
+// Count and size of a key's own values, and its subkey names
+bool RegistryStatsCache::ReadKey(RegistryBackend& backend, HKEY rootKey, const std::string& keyPath, SubtreeStats& own,
+                                 std::vector<std::string>* subKeys) const {
+    HKEY hKey;
+    if (backend.OpenKey(rootKey, keyPath, KEY_READ, &hKey) != ERROR_SUCCESS) return false;
+    std::string name;
+    DWORD type;
+    std::vector<BYTE> data;
+    own = SubtreeStats();
+    own.keys = 1;
+    for (DWORD index = 0; backend.EnumValue(hKey, index, name, type, data) == ERROR_SUCCESS; index++) {
+        own.values++;
+        own.valueBytes += data.size();
+    }
+    if (subKeys) {
+        for (DWORD index = 0; backend.EnumKey(hKey, index, name) == ERROR_SUCCESS; index++) subKeys->push_back(name);
+    }
+    backend.CloseKey(hKey);
+    return true;
+}
+
+// Depth-first walk of one unit; every completed key is added to found. Cached subtrees are not
+// entered again.
+bool RegistryStatsCache::WalkSubtree(RegistryBackend& backend, HKEY rootKey, std::string& keyPath, SubtreeStats& stats,
+                                     Found& found, const CancelCheck& cancelled) const {
+    std::string location = RegistryLocationKey(rootKey, keyPath);
+    if (Lookup(location, stats)) return true;
+    if (cancelled && cancelled()) return false;
+
+    std::vector<std::string> subKeys;
+    if (!ReadKey(backend, rootKey, keyPath, stats, &subKeys)) {
+        stats = SubtreeStats(); // Vanished or access denied: counts as empty
+        return true;
+    }
+
+    size_t pathLength = keyPath.size();
+    for (const std::string& subKey : subKeys) {
+        if (!keyPath.empty()) keyPath += '\\';
+        keyPath += subKey;
+        SubtreeStats child;
+        bool complete = WalkSubtree(backend, rootKey, keyPath, child, found, cancelled);
+        keyPath.resize(pathLength);
+        if (!complete) return false;
+        stats.keys += child.keys;
+        stats.values += child.values;
+        stats.valueBytes += child.valueBytes;
+    }
+    found.push_back({ std::move(location), stats });
+    return true;
+}
+
+bool RegistryStatsCache::Compute(RegistryBackend& backend, HKEY rootKey, const std::string& keyPath, SubtreeStats& stats,
+                                 const CancelCheck& cancelled) {
+    for (int pass = 1;; pass++) {
+        bool stale = false;
+        bool computed = ComputePass(backend, rootKey, keyPath, stats, cancelled, stale);
+        if (!stale || pass == kMaxPasses) return computed;
+        if (cancelled && cancelled()) return false;
+    }
+}
+
+// True if the two locations are the same key or one lies below the other
+bool RegistryStatsCache::Overlaps(const std::string& first, const std::string& second) {
+    const std::string& outer = first.size() <= second.size() ? first : second;
+    const std::string& inner = first.size() <= second.size() ? second : first;
+    if (inner.compare(0, outer.size(), outer) != 0) return false;
+    return inner.size() == outer.size() || outer.back() == '\\' || inner[outer.size()] == '\\';
+}
+
+// Keep what a pass found, except for keys that overlap a location invalidated since the pass
+// began; false if anything was left out
+bool RegistryStatsCache::Store(const Found& found, const PassChanges& changes) {
+    std::unique_lock<std::shared_mutex> lock(statsMutex);
+    bool storedAll = true;
+    for (const auto& entry : found) {
+        bool changed = changes.everything;
+        for (size_t i = 0; i < changes.locations.size() && !changed; i++) changed = Overlaps(entry.first, changes.locations[i]);
+        if (changed) {
+            storedAll = false;
+            continue;
+        }
+        entries[entry.first] = entry.second;
+    }
+    return storedAll;
+}
+
+// Tell the running passes about an invalidated location; statsMutex must be held
+void RegistryStatsCache::NoteChange(const std::string& location) {
+    for (PassChanges* pass : runningPasses) {
+        if (pass->everything ||
+            std::find(pass->locations.begin(), pass->locations.end(), location) != pass->locations.end()) {
+            continue;
+        }
+        if (pass->locations.size() == kMaxPassChanges) {
+            pass->everything = true;
+            pass->locations.clear();
+        } else {
+            pass->locations.push_back(location);
+        }
+    }
+}
+
+bool RegistryStatsCache::ComputePass(RegistryBackend& backend, HKEY rootKey, const std::string& keyPath, SubtreeStats& stats,
+                                     const CancelCheck& cancelled, bool& stale) {
+    if (Lookup(RegistryLocationKey(rootKey, keyPath), stats)) return true;
+
+    HKEY hKey;
+    if (backend.OpenKey(rootKey, keyPath, KEY_READ, &hKey) != ERROR_SUCCESS) return false;
+    backend.CloseKey(hKey);
+
+    // Collect the invalidations made from here on, until the pass returns
+    PassChanges changes;
+    struct RunningPass {
+        RegistryStatsCache& cache;
+        PassChanges& changes;
+        RunningPass(RegistryStatsCache& cache, PassChanges& changes) : cache(cache), changes(changes) {
+            std::unique_lock<std::shared_mutex> lock(cache.statsMutex);
+            cache.runningPasses.push_back(&changes);
+        }
+        ~RunningPass() {
+            std::unique_lock<std::shared_mutex> lock(cache.statsMutex);
+            cache.runningPasses.erase(std::find(cache.runningPasses.begin(), cache.runningPasses.end(), &changes));
+        }
+    } running(*this, changes);
+
+    // Split the top levels into independent units, as for parallel deletion
+    size_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::string> units = { keyPath };
+    std::vector<std::string> upperKeys; // Parents before children
+    for (int depth = 0; depth < 3 && units.size() < threadCount * 8; depth++) {
+        std::vector<std::string> split;
+        bool expanded = false;
+        for (std::string& unit : units) {
+            SubtreeStats own;
+            std::vector<std::string> subKeys;
+            if (Lookup(RegistryLocationKey(rootKey, unit), own) || !ReadKey(backend, rootKey, unit, own, &subKeys) ||
+                subKeys.empty()) {
+                split.push_back(std::move(unit));
+                continue;
+            }
+            for (const std::string& subKey : subKeys) split.push_back(unit.empty() ? subKey : unit + "\\" + subKey);
+            upperKeys.push_back(std::move(unit));
+            expanded = true;
+        }
+        units.swap(split);
+        if (!expanded) break;
+    }
+
+    // Each unit is stored as soon as it is walked, so a change elsewhere costs no other unit
+    std::atomic<size_t> nextUnit(0);
+    std::atomic<bool> complete(true);
+    std::atomic<bool> overlapped(false);
+    size_t workerCount = std::min(threadCount, units.size());
+    std::vector<Found> walkedByWorker(workerCount);
+    std::vector<std::thread> workers;
+    for (size_t worker = 0; worker < workerCount; worker++) {
+        workers.emplace_back([&, worker]() {
+            for (size_t index = nextUnit++; index < units.size() && complete; index = nextUnit++) {
+                std::string path = units[index];
+                SubtreeStats unitStats;
+                Found found;
+                if (!WalkSubtree(backend, rootKey, path, unitStats, found, cancelled)) complete = false;
+                if (!Store(found, changes)) overlapped = true;
+                Found& own = walkedByWorker[worker];
+                own.insert(own.end(), std::make_move_iterator(found.begin()), std::make_move_iterator(found.end()));
+            }
+        });
+    }
+    for (std::thread& worker : workers) worker.join();
+    stale = overlapped;
+    if (!complete) return false;
+
+    // What this pass walked, including the keys a change kept out of the cache
+    std::unordered_map<std::string, SubtreeStats> walked;
+    for (Found& found : walkedByWorker) {
+        for (auto& entry : found) walked[std::move(entry.first)] = entry.second;
+    }
+    auto lookup = [&](const std::string& location, SubtreeStats& result) {
+        auto it = walked.find(location);
+        if (it == walked.end()) return Lookup(location, result);
+        result = it->second;
+        return true;
+    };
+
+    // Keys above the units, children first; every child has been walked by now
+    for (size_t i = upperKeys.size(); i-- > 0;) {
+        SubtreeStats upper;
+        std::vector<std::string> subKeys;
+        if (!ReadKey(backend, rootKey, upperKeys[i], upper, &subKeys)) continue;
+        for (const std::string& subKey : subKeys) {
+            SubtreeStats child;
+            std::string childPath = upperKeys[i].empty() ? subKey : upperKeys[i] + "\\" + subKey;
+            if (!lookup(RegistryLocationKey(rootKey, childPath), child)) {
+                std::string path = childPath;
+                Found found;
+                if (!WalkSubtree(backend, rootKey, path, child, found, cancelled)) return false; // Created meanwhile
+                if (!Store(found, changes)) stale = true;
+                for (auto& entry : found) walked[std::move(entry.first)] = entry.second;
+            }
+            upper.keys += child.keys;
+            upper.values += child.values;
+            upper.valueBytes += child.valueBytes;
+        }
+        std::string location = RegistryLocationKey(rootKey, upperKeys[i]);
+        Found found = { { location, upper } };
+        if (!Store(found, changes)) stale = true;
+        walked[location] = upper;
+    }
+    return lookup(RegistryLocationKey(rootKey, keyPath), stats);
+}
+
+bool RegistryStatsCache::ComputeChildren(RegistryBackend& backend, HKEY rootKey, const std::string& keyPath, SubtreeStats& total,
+                                         std::vector<std::pair<std::string, SubtreeStats>>& children, const CancelCheck& cancelled) {
+    children.clear();
+    if (!Compute(backend, rootKey, keyPath, total, cancelled)) return false;
+
+    SubtreeStats own;
+    std::vector<std::string> subKeys;
+    if (!ReadKey(backend, rootKey, keyPath, own, &subKeys)) return false;
+    for (const std::string& subKey : subKeys) {
+        SubtreeStats child;
+        if (!Compute(backend, rootKey, keyPath.empty() ? subKey : keyPath + "\\" + subKey, child, cancelled)) {
+            if (cancelled && cancelled()) return false;
+            continue; // Deleted since
+        }
+        children.push_back({ subKey, child });
+    }
+    return true;
+}
+
+// "ROOT\A\B" -> "ROOT\A" -> "ROOT\"
+void RegistryStatsCache::DropWithAncestors(std::string location) {
+    size_t rootEnd = location.find('\\');
+    for (;;) {
+        entries.erase(location);
+        if (location.size() <= rootEnd + 1) break;
+        size_t separator = location.rfind('\\');
+        location.resize(separator == rootEnd ? rootEnd + 1 : separator);
+    }
+}
+
+void RegistryStatsCache::InvalidateKey(HKEY rootKey, const std::string& keyPath) {
+    std::string location = RegistryLocationKey(rootKey, keyPath);
+    std::unique_lock<std::shared_mutex> lock(statsMutex);
+    NoteChange(location);
+    DropWithAncestors(location);
+}
+
+void RegistryStatsCache::RemoveSubtree(HKEY rootKey, const std::string& keyPath) {
+    std::string location = RegistryLocationKey(rootKey, keyPath);
+    std::string childPrefix = location.back() == '\\' ? location : location + "\\";
+    std::unique_lock<std::shared_mutex> lock(statsMutex);
+    NoteChange(location);
+    for (auto it = entries.begin(); it != entries.end();) {
+        if (it->first.compare(0, childPrefix.size(), childPrefix) == 0) {
+            it = entries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    DropWithAncestors(location);
+}
+
+void RegistryStatsCache::Clear() {
+    std::unique_lock<std::shared_mutex> lock(statsMutex);
+    for (PassChanges* pass : runningPasses) pass->everything = true;
+    entries.clear();
+}
+
+size_t RegistryStatsCache::EntryCount() const {
+    std::shared_lock<std::shared_mutex> lock(statsMutex);
+    return entries.size();
+}
+
+// "1.5 MB"
+std::string FormatByteSize(uint64_t bytes) {
+    static const char* units[] = { "bytes", "KB", "MB", "GB", "TB" };
+    double size = (double)bytes;
+    int unit = 0;
+    while (size >= 1024 && unit < 4) {
+        size /= 1024;
+        unit++;
+    }
+    char text[32];
+    snprintf(text, sizeof(text), unit ? "%.1f %s" : "%.0f %s", size, units[unit]);
+    return text;
+}
+
+void RegistryBatch::CreateKey(HKEY rootKey, const std::string& keyPath) {
+    AddEdit(CreateEdit, FindKey(rootKey, keyPath), std::string(), REG_NONE, nullptr, 0);
+}
+
+void RegistryBatch::DeleteKey(HKEY rootKey, const std::string& keyPath) {
+    AddEdit(DeleteKeyEdit, FindKey(rootKey, keyPath), std::string(), REG_NONE, nullptr, 0);
+    phase++; // Later edits of any key must wait until the deletion is done
+    lastKey = UINT32_MAX;
+}
+
+void RegistryBatch::SetValue(HKEY rootKey, const std::string& keyPath, const std::string& name, DWORD type,
+                             const BYTE* data, DWORD size) {
+    AddEdit(SetValueEdit, FindKey(rootKey, keyPath), name, type, data, size);
+}
+
+void RegistryBatch::DeleteValue(HKEY rootKey, const std::string& keyPath, const std::string& name) {
+    AddEdit(DeleteValueEdit, FindKey(rootKey, keyPath), name, REG_NONE, nullptr, 0);
+}
+
+std::vector<std::pair<HKEY, std::string>> RegistryBatch::TouchedKeys() const {
+    std::vector<std::pair<HKEY, std::string>> touched;
+    touched.reserve(keys.size());
+    for (const BatchKey& key : keys) touched.push_back({ key.rootKey, key.keyPath });
+    return touched;
+}
+
+void RegistryBatch::Clear() {
+    keys.clear();
+    keyIndex.clear();
+    edits.clear();
+    editData.clear();
+    phase = 0;
+    lastKey = UINT32_MAX;
+}
+
+// Key of the current phase; consecutive edits of the same key skip the lookup
+uint32_t RegistryBatch::FindKey(HKEY rootKey, const std::string& keyPath) {
+    if (lastKey != UINT32_MAX && keys[lastKey].rootKey == rootKey && keys[lastKey].keyPath == keyPath) {
+        return lastKey;
+    }
+
+    std::string location = RegistryLocationKey(rootKey, keyPath);
+    location += '\0'; // Cannot occur in a key path
+    location += std::to_string(phase);
+    auto inserted = keyIndex.emplace(location, (uint32_t)keys.size());
+    if (inserted.second) keys.push_back({ rootKey, keyPath, phase });
+    lastKey = inserted.first->second;
+    return lastKey;
+}
+
+void RegistryBatch::AddEdit(EditKind kind, uint32_t keyIndex, const std::string& name, DWORD type,
+                            const BYTE* data, DWORD size) {
+    edits.push_back({ kind, keyIndex, name, type, editData.size(), size });
+    if (size) editData.insert(editData.end(), data, data + size);
+}
+
+bool RegistryBatch::Apply(std::string& error, RegBatchStats* stats, RegBatchProgress* progress) {
+    RegBatchStats counters;
+    journal.clear();
+    journalData.clear();
+    savedKeys.clear();
+    savedValues.clear();
+
+    // Edits of each key in queue order, and the key deletion (if any) that ends each phase
+    std::vector<std::vector<uint32_t>> keyEdits(keys.size());
+    std::vector<uint32_t> phaseDeletions(phase + 1, UINT32_MAX);
+    for (uint32_t i = 0; i < edits.size(); i++) {
+        if (edits[i].kind == DeleteKeyEdit) {
+            phaseDeletions[keys[edits[i].keyIndex].phase] = i;
+        } else {
+            keyEdits[edits[i].keyIndex].push_back(i);
+        }
+    }
+
+    counters.transacted = backend.BeginTransaction();
+    bool journaled = !counters.transacted;
+    LONG result = ERROR_SUCCESS;
+
+    auto applyDeletion = [&](uint32_t phaseIndex) {
+        if (phaseDeletions[phaseIndex] == UINT32_MAX) return;
+        const BatchKey& key = keys[edits[phaseDeletions[phaseIndex]].keyIndex];
+        if (journaled) JournalTree(key.rootKey, key.keyPath);
+        LONG deleted = DeleteKeyTree(backend, key.rootKey, key.keyPath);
+        if (deleted == ERROR_SUCCESS) {
+            counters.keysDeleted++;
+        } else if (deleted != ERROR_FILE_NOT_FOUND) {
+            result = deleted; // Deleting a key that is not there is not an error, like regedit
+        }
+    };
+
+    uint32_t currentPhase = 0;
+    for (uint32_t i = 0; i < keys.size() && result == ERROR_SUCCESS; i++) {
+        if (progress && progress->cancel) {
+            result = ERROR_CANCELLED;
+            break;
+        }
+        while (currentPhase < keys[i].phase && result == ERROR_SUCCESS) applyDeletion(currentPhase++);
+        if (result == ERROR_SUCCESS && !keyEdits[i].empty()) {
+            result = ApplyKeyEdits(i, keyEdits[i], journaled, counters);
+        }
+        if (progress) progress->keysApplied++;
+    }
+    while (currentPhase <= phase && result == ERROR_SUCCESS) applyDeletion(currentPhase++);
+
+    if (result == ERROR_SUCCESS && counters.transacted) {
+        result = backend.CommitTransaction();
+    } else if (result != ERROR_SUCCESS) {
+        if (counters.transacted) {
+            backend.RollbackTransaction();
+        } else {
+            RollBack();
+        }
+    }
+
+    journal.clear();
+    journalData.clear();
+    savedKeys.clear();
+    savedValues.clear();
+
+    if (stats) *stats = counters;
+    if (result == ERROR_CANCELLED) {
+        error = "Cancelled, no changes were made";
+        return false;
+    }
+    if (result != ERROR_SUCCESS) {
+        error = "Failed to write registry data, no changes were made. Error: " + std::to_string(result);
+        return false;
+    }
+    return true;
+}
+
+// Apply all edits of one key through a single open handle
+LONG RegistryBatch::ApplyKeyEdits(uint32_t keyIndex, const std::vector<uint32_t>& keyEdits, bool journaled,
+                                  RegBatchStats& counters) {
+    const BatchKey& key = keys[keyIndex];
+    bool create = false;
+    for (uint32_t editIndex : keyEdits) {
+        if (edits[editIndex].kind != DeleteValueEdit) create = true;
+    }
+
+    HKEY hKey;
+    bool created = false;
+    LONG result = OpenForEdit(key, create, journaled, &hKey, created);
+    if (result == ERROR_FILE_NOT_FOUND && !create) return ERROR_SUCCESS; // Nothing to delete from
+    if (result != ERROR_SUCCESS) return result;
+    counters.keysOpened++;
+    if (created) counters.keysCreated++;
+
+    for (uint32_t editIndex : keyEdits) {
+        const Edit& edit = edits[editIndex];
+        if (edit.kind == SetValueEdit) {
+            if (journaled && !created) JournalValue(hKey, key, edit.name);
+            result = backend.SetValue(hKey, edit.name, edit.type, editData.data() + edit.dataOffset, edit.dataSize);
+            if (result != ERROR_SUCCESS) break;
+            counters.valuesSet++;
+        } else if (edit.kind == DeleteValueEdit) {
+            if (journaled && !created) JournalValue(hKey, key, edit.name);
+            LONG deleted = backend.DeleteValue(hKey, edit.name);
+            if (deleted == ERROR_SUCCESS) {
+                counters.valuesDeleted++;
+            } else if (deleted != ERROR_FILE_NOT_FOUND) {
+                result = deleted;
+                break;
+            }
+        }
+    }
+
+    backend.CloseKey(hKey);
+    return result;
+}
+
+// Open a key, or create it together with any missing parents. When journaling, the
+// highest parent that did not exist is recorded so a rollback removes all of them.
+LONG RegistryBatch::OpenForEdit(const BatchKey& key, bool create, bool journaled, HKEY* phKey, bool& created) {
+    LONG result = backend.OpenKey(key.rootKey, key.keyPath, KEY_READ | KEY_WRITE, phKey);
+    if (result != ERROR_FILE_NOT_FOUND || !create) return result;
+
+    if (journaled) {
+        std::string missing = key.keyPath;
+        for (size_t separator = missing.rfind('\\'); separator != std::string::npos; separator = missing.rfind('\\')) {
+            HKEY hParent;
+            if (backend.OpenKey(key.rootKey, missing.substr(0, separator), KEY_READ, &hParent) == ERROR_SUCCESS) {
+                backend.CloseKey(hParent);
+                break;
+            }
+            missing.resize(separator);
+        }
+        journal.push_back({ UndoDeleteTree, key.rootKey, missing, std::string(), REG_NONE, 0, 0, 0, 0 });
+    }
+
+    result = backend.CreateKey(key.rootKey, key.keyPath, KEY_READ | KEY_WRITE, phKey, &created);
+    return result;
+}
+
+// Remember what a value looked like before the batch first touched it
+void RegistryBatch::JournalValue(HKEY hKey, const BatchKey& key, const std::string& name) {
+    DWORD type;
+    std::vector<BYTE> data;
+    if (backend.QueryValue(hKey, name, type, data) == ERROR_SUCCESS) {
+        journal.push_back({ UndoRestoreValue, key.rootKey, key.keyPath, name, type, journalData.size(), (DWORD)data.size(), 0, 0 });
+        journalData.insert(journalData.end(), data.begin(), data.end());
+    } else {
+        journal.push_back({ UndoDeleteValue, key.rootKey, key.keyPath, name, REG_NONE, 0, 0, 0, 0 });
+    }
+}
+
+// Save a whole subtree before it is deleted
+void RegistryBatch::JournalTree(HKEY rootKey, const std::string& keyPath) {
+    size_t firstSaved = savedKeys.size();
+    std::string path = keyPath;
+    SaveTree(rootKey, path);
+    if (savedKeys.size() > firstSaved) {
+        journal.push_back({ UndoRestoreTree, rootKey, keyPath, std::string(), REG_NONE, 0, 0,
+                            firstSaved, savedKeys.size() - firstSaved });
+    }
+}
+
+// Append a key and then its subkeys to savedKeys; keyPath is extended in place
+void RegistryBatch::SaveTree(HKEY rootKey, std::string& keyPath) {
+    HKEY hKey;
+    if (backend.OpenKey(rootKey, keyPath, KEY_READ, &hKey) != ERROR_SUCCESS) return;
+
+    savedKeys.push_back({ keyPath, savedValues.size(), 0 });
+    size_t savedIndex = savedKeys.size() - 1;
+    SavedValue value;
+    std::vector<BYTE> data;
+    for (DWORD index = 0; backend.EnumValue(hKey, index, value.name, value.type, data) == ERROR_SUCCESS; index++) {
+        value.dataOffset = journalData.size();
+        value.dataSize = (DWORD)data.size();
+        journalData.insert(journalData.end(), data.begin(), data.end());
+        savedValues.push_back(value);
+        savedKeys[savedIndex].valueCount++;
+    }
+
+    std::vector<std::string> subKeys;
+    std::string subKey;
+    for (DWORD index = 0; backend.EnumKey(hKey, index, subKey) == ERROR_SUCCESS; index++) {
+        subKeys.push_back(subKey);
+    }
+    backend.CloseKey(hKey);
+
+    size_t pathLength = keyPath.size();
+    for (const std::string& name : subKeys) {
+        keyPath += '\\';
+        keyPath += name;
+        SaveTree(rootKey, keyPath);
+        keyPath.resize(pathLength);
+    }
+}
+
+// Undo journaled edits newest first, restoring every key and value the batch touched
+void RegistryBatch::RollBack() {
+    HKEY hKey;
+    for (size_t i = journal.size(); i-- > 0;) {
+        const UndoEntry& entry = journal[i];
+        switch (entry.kind) {
+        case UndoDeleteTree:
+            DeleteKeyTree(backend, entry.rootKey, entry.keyPath);
+            break;
+        case UndoRestoreValue:
+            if (backend.CreateKey(entry.rootKey, entry.keyPath, KEY_WRITE, &hKey, nullptr) == ERROR_SUCCESS) {
+                backend.SetValue(hKey, entry.name, entry.type, journalData.data() + entry.dataOffset, entry.dataSize);
+                backend.CloseKey(hKey);
+            }
+            break;
+        case UndoDeleteValue:
+            if (backend.OpenKey(entry.rootKey, entry.keyPath, KEY_WRITE, &hKey) == ERROR_SUCCESS) {
+                backend.DeleteValue(hKey, entry.name);
+                backend.CloseKey(hKey);
+            }
+            break;
+        case UndoRestoreTree:
+            for (size_t k = entry.firstSaved; k < entry.firstSaved + entry.savedCount; k++) {
+                const SavedKey& saved = savedKeys[k];
+                if (backend.CreateKey(entry.rootKey, saved.keyPath, KEY_WRITE, &hKey, nullptr) != ERROR_SUCCESS) continue;
+                for (size_t v = saved.firstValue; v < saved.firstValue + saved.valueCount; v++) {
+                    const SavedValue& value = savedValues[v];
+                    backend.SetValue(hKey, value.name, value.type, journalData.data() + value.dataOffset, value.dataSize);
+                }
+                backend.CloseKey(hKey);
+            }
+            break;
+        }
+    }
+}
+
+// First occurrence of either byte in [p, end), or end (16 bytes per step with SSE2)
+const char* FindEitherByte(const char* p, const char* end, char a, char b) {
+#if REG_SCAN_SSE2
+    const __m128i va = _mm_set1_epi8(a);
+    const __m128i vb = _mm_set1_epi8(b);
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)p);
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, va), _mm_cmpeq_epi8(chunk, vb)));
+        if (mask) return p + CountTrailingZeros(mask);
+        p += 16;
+    }
+#endif
+    while (p < end && *p != a && *p != b) p++;
+    return p;
+}
+
+// First occurrence of a UTF-16 code unit in [p, end), or end (8 units per step with SSE2)
+const wchar_t* FindWideChar(const wchar_t* p, const wchar_t* end, wchar_t c) {
+#if REG_SCAN_SSE2
+    const __m128i vc = _mm_set1_epi16((short)c);
+    while (end - p >= 8) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)p);
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi16(chunk, vc));
+        if (mask) return p + CountTrailingZeros(mask) / 2;
+        p += 8;
+    }
+#endif
+    while (p < end && *p != c) p++;
+    return p;
+}
+
+// True if no byte in [p, end) has the high bit set
+bool IsAsciiText(const char* p, const char* end) {
+#if REG_SCAN_SSE2
+    while (end - p >= 16) {
+        if (_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)p))) return false;
+        p += 16;
+    }
+#endif
+    for (; p < end; p++) {
+        if ((BYTE)*p & 0x80) return false;
+    }
+    return true;
+}
+
+// Read-only view of a whole file mapped into memory (backed by the page cache, not the heap)
+class MappedFile {
+public:
+    ~MappedFile() {
+        if (view) UnmapViewOfFile(view);
+        if (hMapping) CloseHandle(hMapping);
+        if (hFile != INVALID_HANDLE_VALUE) CloseHandle(hFile);
+    }
+
+    // Files read front to back get the sequential-scan hint, files read at random do not
+    bool Open(const std::string& fileName, bool sequential = true) {
+        hFile = CreateFileW(Utf8ToWide(fileName).c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+            OPEN_EXISTING, sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS, nullptr);
+        if (hFile == INVALID_HANDLE_VALUE) return false;
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(hFile, &fileSize)) return false;
+        size = (size_t)fileSize.QuadPart;
+        if (size == 0) return true; // Empty files cannot be mapped
+
+        hMapping = CreateFileMapping(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!hMapping) return false;
+        view = (const char*)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+        return view != nullptr;
+    }
+
+    const char* Data() const { return view; }
+    size_t Size() const { return size; }
+
+private:
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+    HANDLE hMapping = nullptr;
+    const char* view = nullptr;
+    size_t size = 0;
+};
+
+// Streams logical lines out of a mapped .reg file as UTF-8. UTF-16LE lines and ANSI lines with
+// non-ASCII text are transcoded into a reused buffer, continuation lines are joined; UTF-8 and
+// plain ASCII lines are returned in place.
+class RegLineReader {
+public:
+    RegLineReader(const char* data, size_t size) : cursor(data), end(data + size) {
+        if (size >= 2 && (BYTE)data[0] == 0xFF && (BYTE)data[1] == 0xFE) {
+            encoding = ENCODING_UTF16LE;
+            cursor += 2;
+        } else if (size >= 3 && (BYTE)data[0] == 0xEF && (BYTE)data[1] == 0xBB && (BYTE)data[2] == 0xBF) {
+            encoding = ENCODING_UTF8;
+            cursor += 3;
+        } else if (size >= 2 && data[0] != 0 && data[1] == 0) {
+            encoding = ENCODING_UTF16LE; // UTF-16LE without a byte order mark
+        }
+    }
+
+    bool Next(const char*& line, size_t& length) {
+        const char* physical;
+        size_t physicalLength;
+        if (!NextPhysical(physical, physicalLength)) return false;
+
+        // Only value lines wrap (hex data ending in a backslash)
+        if (physicalLength == 0 || physical[physicalLength - 1] != '\\' || (physical[0] != '"' && physical[0] != '@')) {
+            line = physical;
+            length = physicalLength;
+            return true;
+        }
+
+        joined.assign(physical, physicalLength - 1);
+        while (NextPhysical(physical, physicalLength)) {
+            size_t skip = 0;
+            while (skip < physicalLength && (physical[skip] == ' ' || physical[skip] == '\t')) skip++;
+            bool continues = physicalLength > skip && physical[physicalLength - 1] == '\\';
+            joined.append(physical + skip, physicalLength - skip - (continues ? 1 : 0));
+            if (!continues) break;
+        }
+
+        line = joined.data();
+        length = joined.size();
+        return true;
+    }
+
+    int LineNumber() const { return lineNumber; }
+
+private:
+    enum Encoding { ENCODING_ANSI, ENCODING_UTF8, ENCODING_UTF16LE };
+
+    bool NextPhysical(const char*& line, size_t& length) {
+        if (cursor >= end) return false;
+        lineNumber++;
+
+        if (encoding == ENCODING_UTF16LE) {
+            const wchar_t* wideStart = (const wchar_t*)cursor;
+            const wchar_t* wideEnd = (const wchar_t*)(cursor + ((end - cursor) & ~(ptrdiff_t)1));
+            const wchar_t* newline = FindWideChar(wideStart, wideEnd, L'\n');
+            cursor = newline < wideEnd ? (const char*)(newline + 1) : end;
+            if (newline > wideStart && newline[-1] == L'\r') newline--;
+
+            AssignUtf8(decoded, wideStart, (size_t)(newline - wideStart));
+            line = decoded.data();
+            length = decoded.size();
+            return true;
+        }
+
+        const char* start = cursor;
+        const char* newline = FindEitherByte(start, end, '\n', '\n');
+        cursor = newline < end ? newline + 1 : end;
+        if (newline > start && newline[-1] == '\r') newline--;
+
+        // ANSI lines with non-ASCII text are in the system code page (REGEDIT4 files)
+        if (encoding == ENCODING_ANSI && !IsAsciiText(start, newline)) {
+            int byteLength = (int)(newline - start);
+            wide.resize(byteLength);
+            int wideLength = MultiByteToWideChar(CP_ACP, 0, start, byteLength, &wide[0], byteLength);
+            AssignUtf8(decoded, wide.data(), (size_t)wideLength);
+            line = decoded.data();
+            length = decoded.size();
+            return true;
+        }
+
+        line = start;
+        length = (size_t)(newline - start);
+        return true;
+    }
+
+    const char* cursor;
+    const char* end;
+    Encoding encoding = ENCODING_ANSI;
+    int lineNumber = 0;
+    std::string decoded;
+    std::string joined;
+    std::wstring wide;
+};
+
+// Parse a quoted .reg string starting at the opening quote, handling \\ and \" escapes
+bool ParseRegQuotedString(const char*& p, const char* end, std::string& result) {
+    result.clear();
+    p++;
+    while (p < end) {
+        const char* special = FindEitherByte(p, end, '"', '\\');
+        result.append(p, special);
+        if (special >= end) break;
+        if (*special == '"') {
+            p = special + 1;
+            return true;
+        }
+        if (special + 1 >= end) break;
+        result += special[1];
+        p = special + 2;
+    }
+    p = end;
+    return false;
+}
+
+// Convert string data in the system code page (hex(2)/hex(7) in REGEDIT4 files) to UTF-8 in place
+void WidenAnsiValueData(std::vector<BYTE>& data) {
+    if (IsAsciiText((const char*)data.data(), (const char*)data.data() + data.size())) return;
+    thread_local std::wstring wide;
+    wide.resize(data.size());
+    int wideLength = MultiByteToWideChar(CP_ACP, 0, (const char*)data.data(), (int)data.size(), &wide[0], (int)data.size());
+    std::string narrow;
+    AssignUtf8(narrow, wide.data(), (size_t)wideLength);
+    data.assign(narrow.begin(), narrow.end());
+}
+
+inline int HexDigitValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Parse one value line of a .reg file: "name"=data or @=data. Hex string data is UTF-16LE in
+// version 5.00 files and in the system code page in REGEDIT4 files, whatever the file's encoding.
+bool ParseRegValueLine(const char* p, const char* end, bool unicodeData,
+                       std::string& name, bool& deleteValue, DWORD& type, std::vector<BYTE>& data) {
+    deleteValue = false;
+    data.clear();
+
+    if (*p == '@') {
+        name.clear();
+        p++;
+    } else if (!ParseRegQuotedString(p, end, name)) {
+        return false;
+    }
+
+    while (p < end && *p == ' ') p++;
+    if (p >= end || *p != '=') return false;
+    p++;
+    while (p < end && *p == ' ') p++;
+
+    size_t remaining = end - p;
+    if (remaining == 1 && *p == '-') {
+        deleteValue = true;
+        return true;
+    }
+
+    if (remaining > 0 && *p == '"') {
+        std::string text;
+        if (!ParseRegQuotedString(p, end, text)) return false;
+        type = REG_SZ;
+        data.assign(text.begin(), text.end());
+        data.push_back(0);
+        return true;
+    }
+
+    if (remaining >= 6 && memcmp(p, "dword:", 6) == 0) {
+        DWORD dword = 0;
+        const char* digits = p + 6;
+        for (p = digits; p < end && HexDigitValue(*p) >= 0; p++) {
+            dword = (dword << 4) | (DWORD)HexDigitValue(*p);
+        }
+        if (p == digits || p - digits > 8 || p != end) return false; // 1 to 8 hex digits only
+        type = REG_DWORD;
+        data.assign((const BYTE*)&dword, (const BYTE*)&dword + sizeof(dword));
+        return true;
+    }
+
+    if (remaining >= 4 && memcmp(p, "hex:", 4) == 0) {
+        type = REG_BINARY;
+        p += 4;
+    } else if (remaining >= 4 && memcmp(p, "hex(", 4) == 0) {
+        type = 0;
+        for (p += 4; p < end && HexDigitValue(*p) >= 0; p++) {
+            type = (type << 4) | (DWORD)HexDigitValue(*p);
+        }
+        if (end - p < 2 || p[0] != ')' || p[1] != ':') return false;
+        p += 2;
+    } else {
+        return false;
+    }
+
+    // Comma-separated hex bytes
+    data.reserve((end - p) / 3 + 1);
+    while (p < end) {
+        if (*p == ',' || *p == ' ' || *p == '\t') {
+            p++;
+            continue;
+        }
+        int high = HexDigitValue(*p);
+        int low = p + 1 < end ? HexDigitValue(p[1]) : -1;
+        if (high < 0) return false;
+        if (low < 0) {
+            data.push_back((BYTE)high);
+            p++;
+        } else {
+            data.push_back((BYTE)(high << 4 | low));
+            p += 2;
+        }
+    }
+
+    if (IsStringValueType(type)) {
+        if (unicodeData) {
+            NarrowUtf16ValueData(data);
+        } else {
+            WidenAnsiValueData(data);
+        }
+    }
+    return true;
+}
+
+// Import a .reg file (REGEDIT4 or version 5.00; ANSI, UTF-8 or UTF-16LE) into a backend.
+// The file is memory-mapped and parsed in one pass into a RegistryBatch, which opens each
+// key once. By default the batch is applied in bounded slices, so memory does not grow with
+// file size and a failure keeps the slices already written. An atomic import applies the
+// whole file as one batch: a file that fails to parse or write leaves the registry as it was.
+// Progress counts the key sections read; a cancelled import stops at the next section.
+bool ImportRegFile(RegistryBackend& backend, const std::string& fileName, std::string& error, RegImportStats* stats,
+                   bool atomic, RegFileProgress* progress) {
+    MappedFile file;
+    if (!file.Open(fileName)) {
+        error = "Failed to open file!";
+        return false;
+    }
+
+    RegImportStats counters;
+    counters.bytes = file.Size();
+    RegLineReader reader(file.Data(), file.Size());
+    RegistryBatch batch(backend);
+    bool sliceApplied = false;
+
+    // Write the queued slice; later edits of the open section queue its key again
+    auto applySlice = [&]() {
+        if (!batch.Apply(error)) {
+            if (sliceApplied) error += " (earlier parts of the file were imported)";
+            return false;
+        }
+        batch.Clear();
+        sliceApplied = true;
+        return true;
+    };
+
+    HKEY sectionRoot = nullptr;
+    std::string sectionPath;
+    const char* line;
+    size_t length;
+    bool headerFound = false;
+    bool unicodeData = false; // Version 5.00 header
+    std::string valueName;
+    bool deleteValue;
+    DWORD valueType;
+    std::vector<BYTE> valueData;
+
+    while (reader.Next(line, length)) {
+        if (length == 0 || line[0] == ';') continue;
+
+        if (!headerFound) {
+            unicodeData = length >= 23 && memcmp(line, "Windows Registry Editor", 23) == 0;
+            headerFound = unicodeData || (length == 8 && memcmp(line, "REGEDIT4", 8) == 0);
+            if (!headerFound) {
+                error = "Invalid registry file format!";
+                return false;
+            }
+            continue;
+        }
+
+        if (line[0] == '[') {
+            if (progress && progress->cancel) {
+                error = "Cancelled";
+                if (sliceApplied) error += " (earlier parts of the file were imported)";
+                return false;
+            }
+            if (progress) progress->keys++;
+            bool deleteKey = length > 1 && line[1] == '-';
+            const char* nameStart = line + (deleteKey ? 2 : 1);
+            const char* nameEnd = line + length;
+            while (nameEnd > nameStart && nameEnd[-1] != ']') nameEnd--;
+            if (nameEnd > nameStart) nameEnd--;
+
+            const char* separator = FindEitherByte(nameStart, nameEnd, '\\', '\\');
+            HKEY rootKey = FindRootKeyByName(std::string(nameStart, separator));
+            std::string keyPath = separator < nameEnd ? std::string(separator + 1, nameEnd) : std::string();
+
+            if (!rootKey) {
+                error = "Unknown root key at line " + std::to_string(reader.LineNumber());
+                return false;
+            }
+
+            if (deleteKey) {
+                batch.DeleteKey(rootKey, keyPath);
+                sectionRoot = nullptr;
+                counters.deletions++;
+            } else {
+                sectionRoot = rootKey;
+                sectionPath.swap(keyPath);
+                batch.CreateKey(sectionRoot, sectionPath);
+                counters.keys++;
+            }
+            continue;
+        }
+
+        if (!sectionRoot) continue; // Values under a deleted key are ignored, like regedit
+
+        if (!ParseRegValueLine(line, line + length, unicodeData, valueName, deleteValue, valueType, valueData)) {
+            error = "Malformed value at line " + std::to_string(reader.LineNumber());
+            return false;
+        }
+
+        if (deleteValue) {
+            batch.DeleteValue(sectionRoot, sectionPath, valueName);
+            counters.deletions++;
+        } else {
+            batch.SetValue(sectionRoot, sectionPath, valueName, valueType, valueData.data(), (DWORD)valueData.size());
+            counters.values++;
+        }
+
+        if (!atomic && (batch.EditCount() >= 4096 || batch.DataSize() >= (4 << 20)) && !applySlice()) return false;
+    }
+
+    if (!headerFound) {
+        error = "Invalid registry file format!";
+        return false;
+    }
+    if (!applySlice()) return false;
+
+    if (stats) *stats = counters;
+    return true;
+}
+
+// Buffered .reg file writer. UTF-8 text is collected in a large reused buffer and written with
+// one WriteFile call per megabyte, converted to UTF-16LE with a BOM like regedit's own exports.
+class RegFileWriter {
+public:
+    static const size_t kBufferSize = 1 << 20;
+
+    ~RegFileWriter() {
+        if (hFile != INVALID_HANDLE_VALUE) CloseHandle(hFile);
+    }
+
+    bool Create(const std::string& fileName) {
+        hFile = CreateFileW(Utf8ToWide(fileName).c_str(), GENERIC_WRITE, 0, nullptr,
+            CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (hFile == INVALID_HANDLE_VALUE) return false;
+
+        pending.reserve(kBufferSize);
+        wide.resize(kBufferSize);
+        static const BYTE bom[] = { 0xFF, 0xFE };
+        return WriteRaw(bom, sizeof(bom));
+    }
+
+    bool Write(const char* text, size_t length) {
+        while (length > 0 && !failed) {
+            size_t room = kBufferSize - pending.size();
+            if (length <= room) {
+                pending.append(text, length);
+                break;
+            }
+
+            // Fill up to the last line break that fits, so multibyte characters are never split
+            size_t take = room;
+            while (take > 0 && text[take - 1] != '\n') take--;
+            if (take == 0 && pending.empty()) {
+                // A single line longer than the buffer: cut before a UTF-8 lead byte
+                take = room;
+                while (take > 1 && ((BYTE)text[take] & 0xC0) == 0x80) take--;
+            }
+
+            pending.append(text, take);
+            text += take;
+            length -= take;
+            Flush();
+        }
+        return !failed;
+    }
+
+    bool Write(const std::string& text) {
+        return Write(text.data(), text.size());
+    }
+
+    bool Flush() {
+        if (pending.empty() || failed) return !failed;
+        size_t wideLength = Utf8ToUtf16(pending.data(), pending.size(), wide.data());
+        pending.clear();
+        return WriteRaw(wide.data(), wideLength * sizeof(WCHAR));
+    }
+
+    bool Close() {
+        Flush();
+        if (hFile != INVALID_HANDLE_VALUE) {
+            CloseHandle(hFile);
+            hFile = INVALID_HANDLE_VALUE;
+        }
+        return !failed;
+    }
+
+    size_t BytesWritten() const { return bytesWritten; }
+    // Error of the first failed write, saved before Close can overwrite the last error
+    DWORD Error() const { return writeError; }
+
+private:
+    bool WriteRaw(const void* data, size_t size) {
+        DWORD written = 0;
+        if (!WriteFile(hFile, data, (DWORD)size, &written, nullptr)) {
+            writeError = GetLastError();
+        } else if (written != size) {
+            writeError = ERROR_DISK_FULL; // A short write to a file leaves no last error
+        }
+        if (writeError != ERROR_SUCCESS) {
+            failed = true;
+            return false;
+        }
+        bytesWritten += written;
+        return true;
+    }
+
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+    std::string pending;
+    std::vector<WCHAR> wide;
+    size_t bytesWritten = 0;
+    bool failed = false;
+    DWORD writeError = ERROR_SUCCESS;
+};
+
+// Append a name or string in .reg quoting, escaping backslashes and quotes
+void AppendRegQuoted(std::string& out, const char* text, size_t length) {
+    const char* end = text + length;
+    out += '"';
+    while (text < end) {
+        const char* special = FindEitherByte(text, end, '\\', '"');
+        out.append(text, special);
+        if (special == end) break;
+        out += '\\';
+        out += *special;
+        text = special + 1;
+    }
+    out += '"';
+}
+
+// Append bytes as comma-separated hex, wrapped like regedit: "\" continuation lines indented
+// by two spaces, 25 bytes per full line, nothing past column 80
+void AppendRegHex(std::string& out, size_t column, const BYTE* data, size_t size) {
+    static const char digits[] = "0123456789abcdef";
+    size_t start = out.size();
+    out.resize(start + size * 3 + (size / 25 + 1) * 5);
+    char* p = &out[start];
+
+    for (size_t i = 0; i < size; i++) {
+        *p++ = digits[data[i] >> 4];
+        *p++ = digits[data[i] & 15];
+        if (i + 1 == size) break;
+        *p++ = ',';
+        column += 3;
+        if (column >= 77) {
+            memcpy(p, "\\\r\n  ", 5);
+            p += 5;
+            column = 2;
+        }
+    }
+    out.resize(p - out.data());
+}
+
+// True if REG_SZ data can be written as a quoted string and read back unchanged:
+// exactly one terminating NUL and no line breaks
+bool IsPlainRegString(const std::vector<BYTE>& data) {
+    if (data.empty() || data.back() != 0) return false;
+    size_t length = data.size() - 1;
+    const char* text = (const char*)data.data();
+    return !memchr(text, 0, length) && !memchr(text, '\r', length) && !memchr(text, '\n', length);
+}
+
+// Serializes the keys of one backend into .reg text. Every export worker owns one instance,
+// so the name and data buffers are reused across all keys it visits. Keys are counted into the
+// progress if there is one, and a cancelled progress stops subtree walks.
+class RegTextSerializer {
+public:
+    RegTextSerializer(RegistryBackend& backend, HKEY rootKey, RegFileProgress* progress = nullptr)
+        : backend(backend), rootKey(rootKey), rootName(GetRootKeyName(rootKey)), progress(progress) {}
+
+    // Append the header and values of a key; its subkey names are returned in subKeys if given
+    bool AppendKey(const std::string& keyPath, std::string& out, std::vector<std::string>* subKeys) {
+        HKEY hKey;
+        if (backend.OpenKey(rootKey, keyPath, KEY_READ, &hKey) != ERROR_SUCCESS) {
+            stats.skipped++; // Typically access denied, regedit skips these too
+            return false;
+        }
+
+        out += '[';
+        AppendKeyName(keyPath, out);
+        out += "]\r\n";
+        stats.keys++;
+        if (progress) progress->keys++;
+
+        for (DWORD index = 0; backend.EnumValue(hKey, index, valueName, valueType, valueData) == ERROR_SUCCESS; index++) {
+            AppendValueLine(out, valueName, valueType, valueData);
+            stats.values++;
+        }
+        out += "\r\n";
+
+        if (subKeys) {
+            subKeys->clear();
+            for (DWORD index = 0; backend.EnumKey(hKey, index, valueName) == ERROR_SUCCESS; index++) {
+                subKeys->push_back(valueName);
+            }
+        }
+
+        backend.CloseKey(hKey);
+        return true;
+    }
+
+    // Append a key followed depth-first by all of its subkeys; keyPath is extended in place
+    void AppendSubtree(std::string& keyPath, std::string& out) {
+        if (progress && progress->cancel) return;
+        std::vector<std::string> subKeys;
+        if (!AppendKey(keyPath, out, &subKeys)) return;
+
+        size_t pathLength = keyPath.size();
+        for (const std::string& subKey : subKeys) {
+            if (pathLength > 0) keyPath += '\\';
+            keyPath += subKey;
+            AppendSubtree(keyPath, out);
+            keyPath.resize(pathLength);
+        }
+    }
+
+    // Subkey names of a key, used to split the export into parallel units
+    bool ListSubKeys(const std::string& keyPath, std::vector<std::string>& subKeys) {
+        HKEY hKey;
+        if (backend.OpenKey(rootKey, keyPath, KEY_READ, &hKey) != ERROR_SUCCESS) return false;
+        subKeys.clear();
+        for (DWORD index = 0; backend.EnumKey(hKey, index, valueName) == ERROR_SUCCESS; index++) {
+            subKeys.push_back(valueName);
+        }
+        backend.CloseKey(hKey);
+        return true;
+    }
+
+    // Write headers for keys below sourceBase as if they were below headerBase ("ROOT\\path"),
+    // so a subtree read from one place can be written as a patch for another
+    void MapHeaders(const std::string& sourceBase, const std::string& headerBase) {
+        mappedSource = sourceBase;
+        mappedHeader = headerBase;
+        headersMapped = true;
+    }
+
+    // Append the full name of a key as it appears between the brackets of a section header
+    void AppendKeyName(const std::string& keyPath, std::string& out) const {
+        if (headersMapped) {
+            out += mappedHeader;
+            if (keyPath.size() > mappedSource.size()) {
+                size_t rest = mappedSource.size();
+                if (keyPath[rest] == '\\') rest++;
+                out += '\\';
+                out.append(keyPath, rest, std::string::npos);
+            }
+            return;
+        }
+        out += rootName;
+        if (!keyPath.empty()) {
+            out += '\\';
+            out += keyPath;
+        }
+    }
+
+    // Append one value as a (possibly wrapped) line
+    void AppendValueLine(std::string& out, const std::string& valueName, DWORD valueType, const std::vector<BYTE>& valueData) {
+        size_t lineStart = out.size();
+        if (valueName.empty()) {
+            out += '@';
+        } else {
+            AppendRegQuoted(out, valueName.data(), valueName.size());
+        }
+        out += '=';
+
+        if (valueType == REG_SZ && IsPlainRegString(valueData)) {
+            AppendRegQuoted(out, (const char*)valueData.data(), valueData.size() - 1);
+        } else if (valueType == REG_DWORD && valueData.size() == sizeof(DWORD)) {
+            char text[16];
+            snprintf(text, sizeof(text), "dword:%08x", *(const DWORD*)valueData.data());
+            out += text;
+        } else {
+            const BYTE* data = valueData.data();
+            size_t size = valueData.size();
+            if (IsStringValueType(valueType)) {
+                // Version 5.00 files store string data as UTF-16LE
+                WidenUtf8ValueData(data, size, wideData);
+                data = wideData.data();
+                size = wideData.size();
+            }
+
+            if (valueType == REG_BINARY) {
+                out += "hex:";
+            } else {
+                char text[16];
+                snprintf(text, sizeof(text), "hex(%x):", (unsigned)valueType);
+                out += text;
+            }
+            AppendRegHex(out, out.size() - lineStart, data, size);
+        }
+        out += "\r\n";
+    }
+
+    RegExportStats stats;
+
+private:
+    RegistryBackend& backend;
+    HKEY rootKey;
+    const char* rootName;
+    RegFileProgress* progress;
+    bool headersMapped = false;
+    std::string mappedSource;
+    std::string mappedHeader;
+    std::string valueName;
+    DWORD valueType = REG_NONE;
+    std::vector<BYTE> valueData;
+    std::vector<BYTE> wideData;
+};
+
+// Produce numbered text chunks on worker threads and write them to the file in order.
+// Workers never run more than a few units ahead of the writer, which bounds the memory held.
+// A set cancel flag stops the writer at the next chunk and the workers at their next unit.
+bool WriteChunksInOrder(RegFileWriter& writer, size_t unitCount, size_t threadCount,
+                        const std::function<void(size_t worker, size_t unit, std::string& text)>& produce,
+                        const std::atomic<bool>* cancel = nullptr) {
+    const size_t maxAhead = threadCount * 4;
+    std::vector<std::string> chunks(unitCount);
+    std::vector<char> ready(unitCount, 0);
+    size_t nextToWrite = 0;
+    bool cancelled = false;
+    std::atomic<size_t> nextUnit(0);
+    std::mutex chunkMutex;
+    std::condition_variable chunkChanged;
+
+    std::vector<std::thread> workers;
+    for (size_t worker = 0; worker < threadCount; worker++) {
+        workers.emplace_back([&, worker]() {
+            for (;;) {
+                size_t index = nextUnit++;
+                if (index >= unitCount) break;
+                {
+                    std::unique_lock<std::mutex> lock(chunkMutex);
+                    chunkChanged.wait(lock, [&]() { return cancelled || index < nextToWrite + maxAhead; });
+                    if (cancelled) break;
+                }
+
+                std::string text;
+                produce(worker, index, text);
+
+                {
+                    std::lock_guard<std::mutex> lock(chunkMutex);
+                    chunks[index].swap(text);
+                    ready[index] = 1;
+                }
+                chunkChanged.notify_all();
+            }
+        });
+    }
+
+    bool writeOk = true;
+    bool stopped = false;
+    for (size_t index = 0; index < unitCount && writeOk && !stopped; index++) {
+        std::string text;
+        {
+            std::unique_lock<std::mutex> lock(chunkMutex);
+            chunkChanged.wait(lock, [&]() { return ready[index] != 0; });
+            text.swap(chunks[index]);
+            nextToWrite = index + 1;
+        }
+        chunkChanged.notify_all();
+        writeOk = writer.Write(text);
+        stopped = cancel && *cancel;
+    }
+
+    if (!writeOk || stopped) {
+        std::lock_guard<std::mutex> lock(chunkMutex);
+        cancelled = true;
+    }
+    chunkChanged.notify_all();
+    for (std::thread& worker : workers) worker.join();
+    return writeOk;
+}
+
+// A slice of an export: one key alone, or one key with its whole subtree
+struct RegExportUnit {
+    std::string keyPath;
+    bool subtree;
+};
+
+// Export a key and everything below it to a .reg file (version 5.00, regedit layout).
+// The subtree is cut into ordered units - a key alone followed by each child subtree -
+// which worker threads serialize in parallel and the calling thread writes in order.
+// A cancelled export deletes the part of the file already written.
+bool ExportRegFile(RegistryBackend& backend, HKEY rootKey, const std::string& keyPath,
+                   const std::string& fileName, std::string& error, RegExportStats* stats,
+                   RegFileProgress* progress) {
+    RegTextSerializer planner(backend, rootKey);
+    std::vector<std::string> subKeys;
+    if (!planner.ListSubKeys(keyPath, subKeys)) {
+        error = "Key not found!";
+        return false;
+    }
+
+    RegFileWriter writer;
+    if (!writer.Create(fileName)) {
+        error = "Failed to create file!";
+        return false;
+    }
+    writer.Write("Windows Registry Editor Version 5.00\r\n\r\n");
+
+    size_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+    // Split breadth-first until there is enough work to balance the threads
+    std::vector<RegExportUnit> units = { { keyPath, true } };
+    for (int depth = 0; depth < 3 && units.size() < threadCount * 8; depth++) {
+        std::vector<RegExportUnit> split;
+        bool expanded = false;
+        for (RegExportUnit& unit : units) {
+            if (!unit.subtree || !planner.ListSubKeys(unit.keyPath, subKeys) || subKeys.empty()) {
+                split.push_back(std::move(unit));
+                continue;
+            }
+            split.push_back({ unit.keyPath, false });
+            for (const std::string& subKey : subKeys) {
+                split.push_back({ unit.keyPath.empty() ? subKey : unit.keyPath + "\\" + subKey, true });
+            }
+            expanded = true;
+        }
+        units.swap(split);
+        if (!expanded) break;
+    }
+
+    threadCount = std::min(threadCount, units.size());
+    std::vector<std::unique_ptr<RegTextSerializer>> serializers;
+    for (size_t i = 0; i < threadCount; i++) {
+        serializers.emplace_back(new RegTextSerializer(backend, rootKey, progress));
+    }
+
+    bool writeOk = WriteChunksInOrder(writer, units.size(), threadCount,
+        [&](size_t worker, size_t unit, std::string& text) {
+            std::string path = units[unit].keyPath;
+            if (units[unit].subtree) {
+                serializers[worker]->AppendSubtree(path, text);
+            } else {
+                serializers[worker]->AppendKey(path, text, nullptr);
+            }
+        }, progress ? &progress->cancel : nullptr);
+
+    writeOk = writer.Close() && writeOk;
+
+    if (stats) {
+        *stats = RegExportStats();
+        for (const auto& serializer : serializers) {
+            stats->keys += serializer->stats.keys;
+            stats->values += serializer->stats.values;
+            stats->skipped += serializer->stats.skipped;
+        }
+        stats->bytes = writer.BytesWritten();
+    }
+
+    if (progress && progress->cancel) {
+        DeleteFileW(Utf8ToWide(fileName).c_str());
+        error = "Cancelled";
+        return false;
+    }
+    if (!writeOk) {
+        error = "Failed to write file! Error: " + std::to_string(writer.Error());
+        return false;
+    }
+    return true;
+}
+
+// A slice of a diff, addressed by its path relative to both sides
+struct RegDiffUnit {
+    enum Kind { KeyOnly, Subtree, Removed, Added };
+    std::string relativePath;
+    Kind kind;
+};
+
+// Join a base key path and a path relative to it
+std::string JoinKeyPath(const std::string& basePath, const std::string& relativePath) {
+    if (basePath.empty()) return relativePath;
+    if (relativePath.empty()) return basePath;
+    return basePath + "\\" + relativePath;
+}
+
+// Sorted-merge comparison of two subtrees. Subkeys and values of every key are read from
+// both sides, sorted case-insensitively and merged, and the differences are written as
+// .reg text that turns the "from" side into the "to" side. One differ per worker thread.
+class RegDiffer {
+public:
+    RegDiffer(const RegDiffSource& from, const RegDiffSource& to, RegFileProgress* progress = nullptr)
+        : from(from), to(to), toSerializer(*to.backend, to.rootKey, progress), progress(progress) {
+        fromHeader = GetRootKeyName(from.rootKey);
+        if (!from.keyPath.empty()) fromHeader += "\\" + from.keyPath;
+        toSerializer.MapHeaders(to.keyPath, fromHeader);
+    }
+
+    // Sorted subkey names of a key on one side
+    bool ListSubKeys(const RegDiffSource& side, const std::string& relativePath, std::vector<std::string>& subKeys) {
+        HKEY hKey;
+        if (side.backend->OpenKey(side.rootKey, JoinKeyPath(side.keyPath, relativePath), KEY_READ, &hKey) != ERROR_SUCCESS) {
+            return false;
+        }
+        subKeys.clear();
+        for (DWORD index = 0; side.backend->EnumKey(hKey, index, name) == ERROR_SUCCESS; index++) {
+            subKeys.push_back(name);
+        }
+        side.backend->CloseKey(hKey);
+        std::sort(subKeys.begin(), subKeys.end(), RegistryNameLess());
+        return true;
+    }
+
+    // Append the value differences of a key present on both sides; the sorted subkey
+    // names of both sides are returned if asked for
+    bool AppendKeyDiff(const std::string& relativePath, std::string& out,
+                       std::vector<std::string>* fromKeys = nullptr, std::vector<std::string>* toKeys = nullptr) {
+        stats.keysCompared++;
+        if (progress) progress->keys++;
+        size_t fromCount, toCount;
+        if (!ReadKey(from, relativePath, fromValues, fromCount, fromKeys) ||
+            !ReadKey(to, relativePath, toValues, toCount, toKeys)) {
+            stats.skipped++;
+            return false;
+        }
+
+        bool headerWritten = false;
+        auto writeHeader = [&]() {
+            if (headerWritten) return;
+            out += '[';
+            AppendHeader(relativePath, out);
+            out += "]\r\n";
+            headerWritten = true;
+        };
+
+        size_t i = 0, j = 0;
+        while (i < fromCount || j < toCount) {
+            int order = i == fromCount ? 1 : j == toCount ? -1 :
+                CompareRegistryNames(fromValues[i].name.data(), fromValues[i].name.size(),
+                                     toValues[j].name.data(), toValues[j].name.size());
+            if (order < 0) {
+                writeHeader();
+                if (fromValues[i].name.empty()) {
+                    out += '@';
+                } else {
+                    AppendRegQuoted(out, fromValues[i].name.data(), fromValues[i].name.size());
+                }
+                out += "=-\r\n";
+                stats.valuesRemoved++;
+                i++;
+            } else if (order > 0) {
+                writeHeader();
+                toSerializer.AppendValueLine(out, toValues[j].name, toValues[j].type, toValues[j].data);
+                stats.valuesAdded++;
+                j++;
+            } else {
+                if (fromValues[i].type != toValues[j].type || fromValues[i].data != toValues[j].data) {
+                    writeHeader();
+                    toSerializer.AppendValueLine(out, toValues[j].name, toValues[j].type, toValues[j].data);
+                    stats.valuesChanged++;
+                }
+                i++;
+                j++;
+            }
+        }
+        if (headerWritten) out += "\r\n";
+        return true;
+    }
+
+    // Append the differences of a key and, merged by name, of all of its subkeys
+    void AppendSubtreeDiff(std::string& relativePath, std::string& out) {
+        if (progress && progress->cancel) return;
+        std::vector<std::string> fromKeys, toKeys;
+        if (!AppendKeyDiff(relativePath, out, &fromKeys, &toKeys)) return;
+
+        size_t pathLength = relativePath.size();
+        size_t i = 0, j = 0;
+        while (i < fromKeys.size() || j < toKeys.size()) {
+            int order = i == fromKeys.size() ? 1 : j == toKeys.size() ? -1 :
+                CompareRegistryNames(fromKeys[i].data(), fromKeys[i].size(), toKeys[j].data(), toKeys[j].size());
+            if (pathLength > 0) relativePath += '\\';
+            if (order < 0) {
+                relativePath += fromKeys[i++];
+                AppendRemovedKey(relativePath, out);
+            } else if (order > 0) {
+                relativePath += toKeys[j++];
+                AppendAddedSubtree(relativePath, out);
+            } else {
+                relativePath += fromKeys[i];
+                AppendSubtreeDiff(relativePath, out);
+                i++;
+                j++;
+            }
+            relativePath.resize(pathLength);
+        }
+    }
+
+    // A key that exists only on the "from" side is deleted with everything below it
+    void AppendRemovedKey(const std::string& relativePath, std::string& out) {
+        out += "[-";
+        AppendHeader(relativePath, out);
+        out += "]\r\n\r\n";
+        stats.keysRemoved++;
+    }
+
+    // A key that exists only on the "to" side is written out whole
+    void AppendAddedSubtree(const std::string& relativePath, std::string& out) {
+        std::string path = JoinKeyPath(to.keyPath, relativePath);
+        size_t keysBefore = toSerializer.stats.keys;
+        size_t valuesBefore = toSerializer.stats.values;
+        toSerializer.AppendSubtree(path, out);
+        stats.keysAdded += toSerializer.stats.keys - keysBefore;
+        stats.valuesAdded += toSerializer.stats.values - valuesBefore;
+        stats.skipped += toSerializer.stats.skipped;
+        toSerializer.stats.skipped = 0;
+    }
+
+    RegDiffStats stats;
+
+private:
+    struct DiffValue {
+        std::string name;
+        DWORD type;
+        std::vector<BYTE> data;
+    };
+
+    // Read the values of a key into reused entries and sort the first count of them by name
+    bool ReadKey(const RegDiffSource& side, const std::string& relativePath, std::vector<DiffValue>& values, size_t& count,
+                 std::vector<std::string>* subKeys) {
+        HKEY hKey;
+        if (side.backend->OpenKey(side.rootKey, JoinKeyPath(side.keyPath, relativePath), KEY_READ, &hKey) != ERROR_SUCCESS) {
+            return false;
+        }
+        count = 0;
+        for (;;) {
+            if (count == values.size()) values.emplace_back();
+            DiffValue& value = values[count];
+            if (side.backend->EnumValue(hKey, (DWORD)count, value.name, value.type, value.data) != ERROR_SUCCESS) break;
+            count++;
+        }
+        if (subKeys) {
+            subKeys->clear();
+            for (DWORD index = 0; side.backend->EnumKey(hKey, index, name) == ERROR_SUCCESS; index++) {
+                subKeys->push_back(name);
+            }
+            std::sort(subKeys->begin(), subKeys->end(), RegistryNameLess());
+        }
+        side.backend->CloseKey(hKey);
+        std::sort(values.begin(), values.begin() + count, [](const DiffValue& a, const DiffValue& b) {
+            return RegistryNameLess()(a.name, b.name);
+        });
+        return true;
+    }
+
+    void AppendHeader(const std::string& relativePath, std::string& out) const {
+        out += fromHeader;
+        if (!relativePath.empty()) {
+            out += '\\';
+            out += relativePath;
+        }
+    }
+
+    RegDiffSource from;
+    RegDiffSource to;
+    RegTextSerializer toSerializer;
+    RegFileProgress* progress;
+    std::string fromHeader;
+    std::string name;
+    std::vector<DiffValue> fromValues;
+    std::vector<DiffValue> toValues;
+};
+
+// Write a .reg patch (version 5.00) that turns the "from" subtree into the "to" subtree.
+// Headers name the "from" location, so applying the patch there reproduces "to". The
+// comparison is split into ordered units like an export and diffed on worker threads.
+// A cancelled diff deletes the part of the patch already written.
+bool DiffRegistry(const RegDiffSource& from, const RegDiffSource& to, const std::string& patchFileName,
+                  std::string& error, RegDiffStats* stats, RegFileProgress* progress) {
+    RegDiffer planner(from, to);
+    std::vector<std::string> fromKeys, toKeys;
+    if (!planner.ListSubKeys(from, "", fromKeys)) {
+        error = "Key not found: " + JoinKeyPath(GetRootKeyName(from.rootKey), from.keyPath);
+        return false;
+    }
+    if (!planner.ListSubKeys(to, "", toKeys)) {
+        error = "Key not found: " + JoinKeyPath(GetRootKeyName(to.rootKey), to.keyPath);
+        return false;
+    }
+
+    RegFileWriter writer;
+    if (!writer.Create(patchFileName)) {
+        error = "Failed to create file!";
+        return false;
+    }
+    writer.Write("Windows Registry Editor Version 5.00\r\n\r\n");
+
+    size_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+    // Split breadth-first, merging the subkey lists of both sides at each level
+    std::vector<RegDiffUnit> units = { { "", RegDiffUnit::Subtree } };
+    for (int depth = 0; depth < 3 && units.size() < threadCount * 8; depth++) {
+        std::vector<RegDiffUnit> split;
+        bool expanded = false;
+        for (RegDiffUnit& unit : units) {
+            if (unit.kind != RegDiffUnit::Subtree ||
+                !planner.ListSubKeys(from, unit.relativePath, fromKeys) ||
+                !planner.ListSubKeys(to, unit.relativePath, toKeys) ||
+                (fromKeys.empty() && toKeys.empty())) {
+                split.push_back(std::move(unit));
+                continue;
+            }
+            split.push_back({ unit.relativePath, RegDiffUnit::KeyOnly });
+            size_t i = 0, j = 0;
+            while (i < fromKeys.size() || j < toKeys.size()) {
+                int order = i == fromKeys.size() ? 1 : j == toKeys.size() ? -1 :
+                    CompareRegistryNames(fromKeys[i].data(), fromKeys[i].size(), toKeys[j].data(), toKeys[j].size());
+                const std::string& subKey = order > 0 ? toKeys[j] : fromKeys[i];
+                RegDiffUnit::Kind kind = order < 0 ? RegDiffUnit::Removed : order > 0 ? RegDiffUnit::Added : RegDiffUnit::Subtree;
+                split.push_back({ JoinKeyPath(unit.relativePath, subKey), kind });
+                if (order <= 0) i++;
+                if (order >= 0) j++;
+            }
+            expanded = true;
+        }
+        units.swap(split);
+        if (!expanded) break;
+    }
+
+    threadCount = std::min(threadCount, units.size());
+    std::vector<std::unique_ptr<RegDiffer>> differs;
+    for (size_t i = 0; i < threadCount; i++) {
+        differs.emplace_back(new RegDiffer(from, to, progress));
+    }
+
+    bool writeOk = WriteChunksInOrder(writer, units.size(), threadCount,
+        [&](size_t worker, size_t unit, std::string& text) {
+            RegDiffer& differ = *differs[worker];
+            std::string path = units[unit].relativePath;
+            switch (units[unit].kind) {
+            case RegDiffUnit::KeyOnly: differ.AppendKeyDiff(path, text); break;
+            case RegDiffUnit::Subtree: differ.AppendSubtreeDiff(path, text); break;
+            case RegDiffUnit::Removed: differ.AppendRemovedKey(path, text); break;
+            case RegDiffUnit::Added: differ.AppendAddedSubtree(path, text); break;
+            }
+        }, progress ? &progress->cancel : nullptr);
+
+    writeOk = writer.Close() && writeOk;
+
+    if (stats) {
+        *stats = RegDiffStats();
+        for (const auto& differ : differs) {
+            stats->keysCompared += differ->stats.keysCompared;
+            stats->keysAdded += differ->stats.keysAdded;
+            stats->keysRemoved += differ->stats.keysRemoved;
+            stats->valuesAdded += differ->stats.valuesAdded;
+            stats->valuesRemoved += differ->stats.valuesRemoved;
+            stats->valuesChanged += differ->stats.valuesChanged;
+            stats->skipped += differ->stats.skipped;
+        }
+        stats->bytes = writer.BytesWritten();
+    }
+
+    if (progress && progress->cancel) {
+        DeleteFileW(Utf8ToWide(patchFileName).c_str());
+        error = "Cancelled";
+        return false;
+    }
+    if (!writeOk) {
+        error = "Failed to write file! Error: " + std::to_string(writer.Error());
+        return false;
+    }
+    return true;
+}
+
+// Binary registry snapshot (.regsnap), laid out to be memory-mapped and queried in place:
+// a header, the value data blobs, a string table of NUL-terminated names, the key table
+// and the value table. Keys are stored breadth-first, so the children of a key are one run
+// of the key table sorted case-insensitively, and the values of a key are one sorted run of
+// the value table; every lookup is a binary search over the mapped file.
+const char REG_SNAPSHOT_MAGIC[8] = { 'R', 'E', 'G', 'S', 'N', 'A', 'P', '\0' };
+const uint32_t REG_SNAPSHOT_VERSION = 2; // 2: names sorted by their Unicode uppercase form
+const uint32_t REG_SNAPSHOT_NONE = 0xFFFFFFFF;
+
+struct RegSnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t rootCount; // The first rootCount keys are the predefined roots
+    uint64_t keyCount;
+    uint64_t valueCount;
+    uint64_t blobsOffset;
+    uint64_t blobsSize;
+    uint64_t stringsOffset;
+    uint64_t stringsSize;
+    uint64_t keysOffset;
+    uint64_t valuesOffset;
+};
+
+struct RegSnapshotKey {
+    uint32_t parent;     // REG_SNAPSHOT_NONE for roots
+    uint32_t nameOffset; // In the string table
+    uint32_t nameLength;
+    uint32_t firstChild; // Children are keys [firstChild, firstChild + childCount)
+    uint32_t childCount;
+    uint32_t firstValue; // Values are [firstValue, firstValue + valueCount)
+    uint32_t valueCount;
+    uint32_t reserved;
+};
+
+struct RegSnapshotValue {
+    uint32_t nameOffset;
+    uint32_t nameLength;
+    uint32_t type;
+    uint32_t dataSize;
+    uint64_t dataOffset; // In the blob area
+};
+
+static_assert(sizeof(RegSnapshotHeader) == 80, "snapshot header layout");
+static_assert(sizeof(RegSnapshotKey) == 32, "snapshot key layout");
+static_assert(sizeof(RegSnapshotValue) == 24, "snapshot value layout");
+
+// Write a key and its subtree as a snapshot. The other roots are kept as empty keys and the
+// ancestors of the key as keys without values, so the snapshot opens as a hive with the
+// subtree at its usual place. Value data is streamed to the file while the key walk runs;
+// the tables follow, and the header is written last. A cancelled snapshot deletes the file.
+bool WriteRegSnapshot(RegistryBackend& backend, HKEY rootKey, const std::string& keyPath,
+                      const std::string& fileName, std::string& error, RegExportStats* stats,
+                      RegFileProgress* progress) {
+    HKEY hKey;
+    if (backend.OpenKey(rootKey, keyPath, KEY_READ, &hKey) != ERROR_SUCCESS) {
+        error = "Key not found!";
+        return false;
+    }
+    backend.CloseKey(hKey);
+
+    HANDLE hFile = CreateFileW(Utf8ToWide(fileName).c_str(), GENERIC_WRITE, 0, nullptr,
+        CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        error = "Failed to create file!";
+        return false;
+    }
+
+    std::vector<BYTE> buffer;
+    buffer.reserve(1 << 20);
+    uint64_t fileOffset = 0;
+    bool writeOk = true;
+    auto flush = [&]() {
+        DWORD written = 0;
+        if (!buffer.empty() && writeOk) {
+            writeOk = WriteFile(hFile, buffer.data(), (DWORD)buffer.size(), &written, nullptr) && written == buffer.size();
+        }
+        buffer.clear();
+    };
+    auto write = [&](const void* data, size_t size) {
+        if (buffer.size() + size > buffer.capacity()) flush();
+        if (size > buffer.capacity()) {
+            DWORD written = 0;
+            if (writeOk) writeOk = WriteFile(hFile, data, (DWORD)size, &written, nullptr) && written == size;
+        } else {
+            buffer.insert(buffer.end(), (const BYTE*)data, (const BYTE*)data + size);
+        }
+        fileOffset += size;
+    };
+    auto align = [&]() {
+        static const BYTE zeros[8] = {};
+        write(zeros, (size_t)((8 - fileOffset % 8) % 8));
+    };
+
+    RegSnapshotHeader header = {};
+    write(&header, sizeof(header)); // Placeholder, rewritten at the end
+    header.blobsOffset = fileOffset;
+
+    std::vector<char> strings;
+    std::unordered_map<std::string, uint32_t> stringIds;
+    auto intern = [&](const std::string& name) {
+        auto inserted = stringIds.emplace(name, (uint32_t)strings.size());
+        if (inserted.second) strings.insert(strings.end(), name.c_str(), name.c_str() + name.size() + 1);
+        return inserted.first->second;
+    };
+
+    // The walk queue holds keys whose children and values are still to be read
+    struct PendingKey {
+        uint32_t keyId;
+        HKEY rootKey;
+        std::string path;
+        bool onlyPath; // An ancestor of the saved key: keep only the next key on the way down
+    };
+    std::vector<RegSnapshotKey> keys;
+    std::vector<RegSnapshotValue> values;
+    std::deque<PendingKey> pending;
+    for (int i = 0; i < ROOT_KEYS_COUNT; i++) {
+        keys.push_back({ REG_SNAPSHOT_NONE, intern(rootKeys[i].name), (uint32_t)strlen(rootKeys[i].name), 0, 0, 0, 0, 0 });
+        if (rootKeys[i].hKey == rootKey) pending.push_back({ (uint32_t)i, rootKey, std::string(), !keyPath.empty() });
+    }
+
+    RegExportStats counters;
+    struct SortedValue {
+        std::string name;
+        DWORD type;
+        std::vector<BYTE> data;
+    };
+    std::vector<SortedValue> keyValues;
+    std::vector<std::string> subKeys;
+    std::string name;
+    while (!pending.empty() && writeOk) {
+        if (progress && progress->cancel) {
+            CloseHandle(hFile);
+            DeleteFileW(Utf8ToWide(fileName).c_str());
+            error = "Cancelled";
+            return false;
+        }
+        PendingKey current = std::move(pending.front());
+        pending.pop_front();
+        subKeys.clear();
+        size_t valueCount = 0;
+
+        if (current.onlyPath) {
+            size_t start = current.path.empty() ? 0 : current.path.size() + 1;
+            size_t end = keyPath.find('\\', start);
+            subKeys.push_back(keyPath.substr(start, end == std::string::npos ? std::string::npos : end - start));
+        } else if (backend.OpenKey(current.rootKey, current.path, KEY_READ, &hKey) == ERROR_SUCCESS) {
+            for (DWORD index = 0;; index++) {
+                if (valueCount == keyValues.size()) keyValues.emplace_back();
+                SortedValue& value = keyValues[valueCount];
+                if (backend.EnumValue(hKey, index, value.name, value.type, value.data) != ERROR_SUCCESS) break;
+                valueCount++;
+            }
+            for (DWORD index = 0; backend.EnumKey(hKey, index, name) == ERROR_SUCCESS; index++) {
+                subKeys.push_back(name);
+            }
+            backend.CloseKey(hKey);
+            counters.keys++;
+            if (progress) progress->keys++;
+        } else {
+            counters.skipped++;
+        }
+
+        std::sort(keyValues.begin(), keyValues.begin() + valueCount, [](const SortedValue& a, const SortedValue& b) {
+            return RegistryNameLess()(a.name, b.name);
+        });
+        keys[current.keyId].firstValue = (uint32_t)values.size();
+        keys[current.keyId].valueCount = (uint32_t)valueCount;
+        for (size_t i = 0; i < valueCount; i++) {
+            const SortedValue& value = keyValues[i];
+            values.push_back({ intern(value.name), (uint32_t)value.name.size(), value.type,
+                               (uint32_t)value.data.size(), fileOffset - header.blobsOffset });
+            write(value.data.data(), value.data.size());
+        }
+        counters.values += valueCount;
+
+        std::sort(subKeys.begin(), subKeys.end(), RegistryNameLess());
+        keys[current.keyId].firstChild = (uint32_t)keys.size();
+        keys[current.keyId].childCount = (uint32_t)subKeys.size();
+        for (const std::string& subKey : subKeys) {
+            std::string childPath = current.path.empty() ? subKey : current.path + "\\" + subKey;
+            bool childOnPath = current.onlyPath && childPath.size() < keyPath.size();
+            pending.push_back({ (uint32_t)keys.size(), current.rootKey, std::move(childPath), childOnPath });
+            keys.push_back({ current.keyId, intern(subKey), (uint32_t)subKey.size(), 0, 0, 0, 0, 0 });
+        }
+
+        if (keys.size() >= REG_SNAPSHOT_NONE || strings.size() >= REG_SNAPSHOT_NONE) {
+            error = "The subtree is too large for a snapshot!";
+            CloseHandle(hFile);
+            return false;
+        }
+    }
+
+    header.blobsSize = fileOffset - header.blobsOffset;
+    align();
+    header.stringsOffset = fileOffset;
+    header.stringsSize = strings.size();
+    write(strings.data(), strings.size());
+    align();
+    header.keysOffset = fileOffset;
+    header.keyCount = keys.size();
+    write(keys.data(), keys.size() * sizeof(RegSnapshotKey));
+    header.valuesOffset = fileOffset;
+    header.valueCount = values.size();
+    write(values.data(), values.size() * sizeof(RegSnapshotValue));
+    flush();
+
+    memcpy(header.magic, REG_SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = REG_SNAPSHOT_VERSION;
+    header.rootCount = ROOT_KEYS_COUNT;
+    LARGE_INTEGER start = {};
+    DWORD written = 0;
+    if (writeOk) {
+        writeOk = SetFilePointerEx(hFile, start, nullptr, FILE_BEGIN) &&
+            WriteFile(hFile, &header, sizeof(header), &written, nullptr) && written == sizeof(header);
+    }
+    if (!writeOk) error = "Failed to write file! Error: " + std::to_string(GetLastError());
+    CloseHandle(hFile);
+
+    counters.bytes = (size_t)fileOffset;
+    if (stats) *stats = counters;
+    return writeOk;
+}
+
+// Read-only backend over a mapped snapshot. Nothing is parsed or copied when the file is
+// opened; handles point straight at entries of the mapped key table.
+class SnapshotRegistryBackend : public RegistryBackend {
+public:
+    static bool IsSnapshotFile(const std::string& fileName) {
+        MappedFile file;
+        return file.Open(fileName, false) && file.Size() >= sizeof(REG_SNAPSHOT_MAGIC) &&
+            memcmp(file.Data(), REG_SNAPSHOT_MAGIC, sizeof(REG_SNAPSHOT_MAGIC)) == 0;
+    }
+
+    bool Open(const std::string& fileName, std::string& error) {
+        if (!file.Open(fileName, false)) {
+            error = "Failed to open file!";
+            return false;
+        }
+        const char* data = file.Data();
+        uint64_t size = file.Size();
+        header = (const RegSnapshotHeader*)data;
+        if (size < sizeof(RegSnapshotHeader) || memcmp(header->magic, REG_SNAPSHOT_MAGIC, sizeof(header->magic)) != 0) {
+            error = "Not a registry snapshot!";
+            return false;
+        }
+        if (header->version != REG_SNAPSHOT_VERSION) {
+            error = "Unsupported snapshot version " + std::to_string(header->version);
+            return false;
+        }
+        if (!FitsIn(header->blobsOffset, header->blobsSize, 1, size) ||
+            !FitsIn(header->stringsOffset, header->stringsSize, 1, size) ||
+            header->keyCount >= REG_SNAPSHOT_NONE || header->keyCount < header->rootCount ||
+            !FitsIn(header->keysOffset, header->keyCount, sizeof(RegSnapshotKey), size) ||
+            !FitsIn(header->valuesOffset, header->valueCount, sizeof(RegSnapshotValue), size) ||
+            header->stringsSize == 0 || data[header->stringsOffset + header->stringsSize - 1] != '\0') {
+            error = "Snapshot file is truncated or corrupt!";
+            return false;
+        }
+
+        blobs = (const BYTE*)data + header->blobsOffset;
+        strings = data + header->stringsOffset;
+        keyTable = (const RegSnapshotKey*)(data + header->keysOffset);
+        valueTable = (const RegSnapshotValue*)(data + header->valuesOffset);
+
+        // Roots are matched by name, so the file does not depend on the order of rootKeys
+        for (int i = 0; i < ROOT_KEYS_COUNT; i++) {
+            rootIds[i] = REG_SNAPSHOT_NONE;
+            for (uint32_t id = 0; id < header->rootCount; id++) {
+                if (_stricmp(Name(keyTable[id]), rootKeys[i].name) == 0) rootIds[i] = id;
+            }
+        }
+        return true;
+    }
+
+    LONG OpenKey(HKEY rootKey, const std::string& keyPath, REGSAM access, HKEY* phKey) override {
+        if (access & (KEY_SET_VALUE | KEY_CREATE_SUB_KEY)) return ERROR_ACCESS_DENIED;
+        uint32_t keyId = ResolveKey(rootKey, keyPath);
+        if (keyId == REG_SNAPSHOT_NONE) return ERROR_FILE_NOT_FOUND;
+        *phKey = ToHandle(keyId);
+        return ERROR_SUCCESS;
+    }
+
+    LONG CreateKey(HKEY rootKey, const std::string& keyPath, REGSAM access, HKEY* phKey, bool* created) override {
+        return ERROR_ACCESS_DENIED;
+    }
+
+    LONG CloseKey(HKEY hKey) override {
+        return ERROR_SUCCESS; // Handles point into the mapping, which lives as long as the backend
+    }
+
+    LONG DeleteKey(HKEY rootKey, const std::string& keyPath) override {
+        return ERROR_ACCESS_DENIED;
+    }
+
+    LONG EnumKey(HKEY hKey, DWORD index, std::string& name) override {
+        const RegSnapshotKey* key = FromHandle(hKey);
+        if (!key) return ERROR_INVALID_HANDLE;
+        if (index >= key->childCount) return ERROR_NO_MORE_ITEMS;
+        uint64_t childId = (uint64_t)key->firstChild + index;
+        if (childId >= header->keyCount) return ERROR_FILE_CORRUPT;
+        name.assign(Name(keyTable[childId]), keyTable[childId].nameLength);
+        return ERROR_SUCCESS;
+    }
+
+    LONG EnumValue(HKEY hKey, DWORD index, std::string& name, DWORD& type, std::vector<BYTE>& data) override {
+        const RegSnapshotKey* key = FromHandle(hKey);
+        if (!key) return ERROR_INVALID_HANDLE;
+        if (index >= key->valueCount) return ERROR_NO_MORE_ITEMS;
+        const RegSnapshotValue* value = GetValue((uint64_t)key->firstValue + index);
+        if (!value) return ERROR_FILE_CORRUPT;
+        name.assign(Name(*value), value->nameLength);
+        type = value->type;
+        data.assign(blobs + value->dataOffset, blobs + value->dataOffset + value->dataSize);
+        return ERROR_SUCCESS;
+    }
+
+    LONG QueryInfo(HKEY hKey, DWORD* subKeyCount, DWORD* valueCount) override {
+        const RegSnapshotKey* key = FromHandle(hKey);
+        if (!key) return ERROR_INVALID_HANDLE;
+        if (subKeyCount) *subKeyCount = key->childCount;
+        if (valueCount) *valueCount = key->valueCount;
+        return ERROR_SUCCESS;
+    }
+
+    LONG QueryValue(HKEY hKey, const std::string& name, DWORD& type, std::vector<BYTE>& data) override {
+        const RegSnapshotKey* key = FromHandle(hKey);
+        if (!key) return ERROR_INVALID_HANDLE;
+        uint32_t low = 0, high = key->valueCount;
+        while (low < high) {
+            uint32_t middle = low + (high - low) / 2;
+            const RegSnapshotValue* value = GetValue((uint64_t)key->firstValue + middle);
+            if (!value) return ERROR_FILE_CORRUPT;
+            int order = CompareName(Name(*value), name.c_str(), name.size());
+            if (order == 0) {
+                type = value->type;
+                data.assign(blobs + value->dataOffset, blobs + value->dataOffset + value->dataSize);
+                return ERROR_SUCCESS;
+            }
+            if (order < 0) low = middle + 1; else high = middle;
+        }
+        return ERROR_FILE_NOT_FOUND;
+    }
+
+    LONG SetValue(HKEY hKey, const std::string& name, DWORD type, const BYTE* data, DWORD size) override {
+        return ERROR_ACCESS_DENIED;
+    }
+
+    LONG DeleteValue(HKEY hKey, const std::string& name) override {
+        return ERROR_ACCESS_DENIED;
+    }
+
+    size_t KeyCount() const { return (size_t)header->keyCount; }
+    size_t ValueCount() const { return (size_t)header->valueCount; }
+
+private:
+    // True if count entries of entrySize bytes at offset lie within size bytes; checked without
+    // computing offset + count * entrySize, which a corrupt header could make wrap around
+    static bool FitsIn(uint64_t offset, uint64_t count, uint64_t entrySize, uint64_t size) {
+        return offset <= size && count <= (size - offset) / entrySize;
+    }
+
+    // Stored name against a name that is not NUL-terminated, in RegistryNameLess order
+    static int CompareName(const char* stored, const char* name, size_t length) {
+        return CompareRegistryNames(stored, strlen(stored), name, length);
+    }
+
+    template <typename Entry>
+    const char* Name(const Entry& entry) const {
+        uint64_t end = (uint64_t)entry.nameOffset + entry.nameLength;
+        return end < header->stringsSize ? strings + entry.nameOffset : "";
+    }
+
+    const RegSnapshotValue* GetValue(uint64_t valueId) const {
+        if (valueId >= header->valueCount) return nullptr;
+        const RegSnapshotValue* value = &valueTable[valueId];
+        return FitsIn(value->dataOffset, value->dataSize, 1, header->blobsSize) ? value : nullptr;
+    }
+
+    uint32_t ResolveHandle(HKEY hKey) const {
+        for (int i = 0; i < ROOT_KEYS_COUNT; i++) {
+            if (rootKeys[i].hKey == hKey) return rootIds[i];
+        }
+        const RegSnapshotKey* key = (const RegSnapshotKey*)hKey;
+        if (key < keyTable || key >= keyTable + header->keyCount) return REG_SNAPSHOT_NONE;
+        return (uint32_t)(key - keyTable);
+    }
+
+    // Walk the path one component at a time, binary searching each run of children
+    uint32_t ResolveKey(HKEY rootKey, const std::string& keyPath) const {
+        uint32_t keyId = ResolveHandle(rootKey);
+        size_t start = 0;
+        while (keyId != REG_SNAPSHOT_NONE && start <= keyPath.size()) {
+            size_t end = keyPath.find('\\', start);
+            if (end == std::string::npos) end = keyPath.size();
+            if (end > start) {
+                const RegSnapshotKey& key = keyTable[keyId];
+                uint64_t low = key.firstChild, high = (uint64_t)key.firstChild + key.childCount;
+                if (high > header->keyCount) return REG_SNAPSHOT_NONE;
+                keyId = REG_SNAPSHOT_NONE;
+                while (low < high) {
+                    uint64_t middle = low + (high - low) / 2;
+                    int order = CompareName(Name(keyTable[middle]), keyPath.c_str() + start, end - start);
+                    if (order == 0) {
+                        keyId = (uint32_t)middle;
+                        break;
+                    }
+                    if (order < 0) low = middle + 1; else high = middle;
+                }
+            }
+            start = end + 1;
+        }
+        return keyId;
+    }
+
+    // Root keys are addressed by their predefined HKEY, all other keys by table entry
+    HKEY ToHandle(uint32_t keyId) const {
+        for (int i = 0; i < ROOT_KEYS_COUNT; i++) {
+            if (rootIds[i] == keyId) return rootKeys[i].hKey;
+        }
+        return (HKEY)&keyTable[keyId];
+    }
+
+    const RegSnapshotKey* FromHandle(HKEY hKey) const {
+        uint32_t keyId = ResolveHandle(hKey);
+        return keyId == REG_SNAPSHOT_NONE ? nullptr : &keyTable[keyId];
+    }
+
+    MappedFile file;
+    const RegSnapshotHeader* header = nullptr;
+    const BYTE* blobs = nullptr;
+    const char* strings = nullptr;
+    const RegSnapshotKey* keyTable = nullptr;
+    const RegSnapshotValue* valueTable = nullptr;
+    uint32_t rootIds[ROOT_KEYS_COUNT];
+};
+
+// Load a hive file for offline use: snapshots are mapped, .reg files imported into memory
+// (the import reports progress and can be cancelled)
+std::unique_ptr<RegistryBackend> LoadHiveFile(const std::string& fileName, std::string& error,
+                                              size_t* keyCount, size_t* valueCount, RegFileProgress* progress) {
+    if (SnapshotRegistryBackend::IsSnapshotFile(fileName)) {
+        std::unique_ptr<SnapshotRegistryBackend> snapshot(new SnapshotRegistryBackend());
+        if (!snapshot->Open(fileName, error)) return nullptr;
+        if (keyCount) *keyCount = snapshot->KeyCount();
+        if (valueCount) *valueCount = snapshot->ValueCount();
+        return std::move(snapshot);
+    }
+
+    std::unique_ptr<MemoryRegistryBackend> hive(new MemoryRegistryBackend());
+    if (!ImportRegFile(*hive, fileName, error, nullptr, false, progress)) return nullptr;
+    if (keyCount) *keyCount = hive->KeyCount();
+    if (valueCount) *valueCount = hive->ValueCount();
+    return std::move(hive);
+}
+
+// ASCII case folding used for index trigrams and substring matching. Bytes of non-ASCII UTF-8
+// characters are left alone, so those letters match case-sensitively; regex icase, which folds
+// single bytes, behaves the same. Find reports this when a pattern contains such letters.
+inline BYTE FoldSearchByte(BYTE c) {
+    return (c >= 'A' && c <= 'Z') ? (BYTE)(c + ('a' - 'A')) : c;
+}
+
+// Append the folded trigrams of a text (NULs separate independent strings, as in REG_MULTI_SZ)
+void AppendTextTrigrams(const char* text, size_t length, std::vector<uint32_t>& trigrams) {
+    uint32_t window = 0;
+    size_t run = 0;
+    for (size_t i = 0; i < length; i++) {
+        BYTE c = FoldSearchByte((BYTE)text[i]);
+        if (c == 0) {
+            run = 0;
+            continue;
+        }
+        window = ((window << 8) | c) & 0xFFFFFF;
+        if (++run >= 3) trigrams.push_back(window);
+    }
+}
+
+// First occurrence of a non-empty needle in [p, end), or end. With foldCase the needle is already
+// folded and ASCII letters match either case. SSE2 tests 16 start positions per step against the
+// needle's first and last bytes and compares the whole needle only where both agree.
+const char* FindLiteral(const char* p, const char* end, const std::string& needle, bool foldCase) {
+    size_t n = needle.size();
+    if ((size_t)(end - p) < n) return end;
+    const char* last = end - n; // Last possible start
+    auto matchesAt = [&](const char* start) {
+        if (!foldCase) return memcmp(start, needle.data(), n) == 0;
+        for (size_t i = 0; i < n; i++) {
+            if (FoldSearchByte((BYTE)start[i]) != (BYTE)needle[i]) return false;
+        }
+        return true;
+    };
+#if REG_SCAN_SSE2
+    // Setting bit 5 lower-cases letters; other bytes it aliases are rejected by matchesAt
+    BYTE first = (BYTE)needle[0], lastByte = (BYTE)needle[n - 1];
+    const __m128i vFirst = _mm_set1_epi8((char)first);
+    const __m128i vLast = _mm_set1_epi8((char)lastByte);
+    const __m128i foldFirst = _mm_set1_epi8(foldCase && first >= 'a' && first <= 'z' ? 0x20 : 0);
+    const __m128i foldLast = _mm_set1_epi8(foldCase && lastByte >= 'a' && lastByte <= 'z' ? 0x20 : 0);
+    while (last - p >= 15) {
+        __m128i firstBytes = _mm_or_si128(_mm_loadu_si128((const __m128i*)p), foldFirst);
+        __m128i lastBytes = _mm_or_si128(_mm_loadu_si128((const __m128i*)(p + n - 1)), foldLast);
+        unsigned mask = (unsigned)_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(firstBytes, vFirst), _mm_cmpeq_epi8(lastBytes, vLast)));
+        for (; mask; mask &= mask - 1) {
+            const char* start = p + CountTrailingZeros(mask);
+            if (matchesAt(start)) return start;
+        }
+        p += 16;
+    }
+#endif
+    for (; p <= last; p++) {
+        if (matchesAt(p)) return p;
+    }
+    return end;
+}
+
+// Case-insensitive substring test against an already folded needle
+bool ContainsFolded(const char* text, size_t length, const std::string& foldedNeedle) {
+    if (foldedNeedle.empty()) return true;
+    return FindLiteral(text, text + length, foldedNeedle, true) != text + length;
+}
+
+// Literal runs that every match of a regex must contain; used only to pre-filter candidates.
+// Conservative: a pattern with alternation yields nothing, and group contents are ignored.
+std::vector<std::string> ExtractRegexLiterals(const std::string& pattern) {
+    std::vector<std::string> literals;
+    if (pattern.find('|') != std::string::npos) return literals;
+
+    std::string run;
+    auto endRun = [&]() {
+        if (run.size() >= 3) literals.push_back(run);
+        run.clear();
+    };
+
+    int depth = 0;
+    for (size_t i = 0; i < pattern.size(); i++) {
+        char c = pattern[i];
+        if (c == '\\' && i + 1 < pattern.size()) {
+            char escaped = pattern[++i];
+            if (isalnum((unsigned char)escaped)) {
+                endRun(); // \d, \w, \b, \x41 ... are classes, assertions or codes
+            } else if (depth == 0) {
+                run += (char)FoldSearchByte((BYTE)escaped);
+            }
+        } else if (c == '[') {
+            endRun();
+            size_t j = i + 1;
+            if (j < pattern.size() && pattern[j] == '^') j++;
+            if (j < pattern.size() && pattern[j] == ']') j++;
+            while (j < pattern.size() && pattern[j] != ']') j += pattern[j] == '\\' ? 2 : 1;
+            i = j;
+        } else if (c == '*' || c == '?' || c == '{') {
+            if (!run.empty()) run.pop_back(); // The quantified character is optional
+            endRun();
+            if (c == '{') {
+                while (i < pattern.size() && pattern[i] != '}') i++;
+            }
+        } else if (c == '(' || c == ')' || c == '.' || c == '^' || c == '$' || c == '+') {
+            if (c == '(') depth++;
+            if (c == ')' && depth > 0) depth--;
+            endRun();
+        } else if (depth == 0) {
+            run += (char)FoldSearchByte((BYTE)c);
+        }
+    }
+    endRun();
+    return literals;
+}
+
+void RegistrySearchIndex::AppendPosting(PostingList& list, uint32_t id) {
+    uint32_t delta = list.count ? id - list.lastId : id;
+    while (delta >= 0x80) {
+        list.bytes.push_back((BYTE)(delta | 0x80));
+        delta >>= 7;
+    }
+    list.bytes.push_back((BYTE)delta);
+    list.lastId = id;
+    list.count++;
+}
+
+void RegistrySearchIndex::DecodePostings(const PostingList& list, std::vector<uint32_t>& ids) {
+    ids.clear();
+    ids.reserve(list.count);
+    const BYTE* p = list.bytes.data();
+    const BYTE* end = p + list.bytes.size();
+    uint32_t id = 0;
+    while (p < end) {
+        uint32_t delta = 0;
+        int shift = 0;
+        while (*p & 0x80) {
+            delta |= (uint32_t)(*p++ & 0x7F) << shift;
+            shift += 7;
+        }
+        delta |= (uint32_t)*p++ << shift;
+        id = ids.empty() ? delta : id + delta;
+        ids.push_back(id);
+    }
+}
+
+// Keep only the candidates that also appear in a posting list (both sorted ascending)
+void RegistrySearchIndex::IntersectPostings(const PostingList& list, std::vector<uint32_t>& candidates) {
+    const BYTE* p = list.bytes.data();
+    const BYTE* end = p + list.bytes.size();
+    uint32_t id = 0;
+    bool first = true;
+    size_t kept = 0;
+    size_t next = 0;
+
+    while (p < end && next < candidates.size()) {
+        uint32_t delta = 0;
+        int shift = 0;
+        while (*p & 0x80) {
+            delta |= (uint32_t)(*p++ & 0x7F) << shift;
+            shift += 7;
+        }
+        delta |= (uint32_t)*p++ << shift;
+        id = first ? delta : id + delta;
+        first = false;
+
+        while (next < candidates.size() && candidates[next] < id) next++;
+        if (next < candidates.size() && candidates[next] == id) candidates[kept++] = candidates[next++];
+    }
+    candidates.resize(kept);
+}
+
+// Index one key into a shard; subkey names are returned for the crawler if requested
+bool RegistrySearchIndex::AddKey(RegistryBackend& backend, HKEY rootKey, const std::string& keyPath,
+                                 Shard& shard, CrawlScratch& scratch, std::vector<std::string>* subKeys) {
+    HKEY hKey;
+    if (backend.OpenKey(rootKey, keyPath, KEY_READ, &hKey) != ERROR_SUCCESS) return false;
+
+    scratch.trigrams.clear();
+    scratch.text = GetRootKeyName(rootKey);
+    scratch.text += '\\';
+    scratch.text += keyPath;
+    AppendTextTrigrams(scratch.text.data(), scratch.text.size(), scratch.trigrams);
+
+    DWORD valueType;
+    for (DWORD index = 0; backend.EnumValue(hKey, index, scratch.valueName, valueType, scratch.valueData) == ERROR_SUCCESS; index++) {
+        AppendTextTrigrams(scratch.valueName.data(), scratch.valueName.size(), scratch.trigrams);
+        if (valueType == REG_SZ || valueType == REG_EXPAND_SZ || valueType == REG_MULTI_SZ) {
+            AppendTextTrigrams((const char*)scratch.valueData.data(), scratch.valueData.size(), scratch.trigrams);
+        }
+    }
+
+    if (subKeys) {
+        subKeys->clear();
+        for (DWORD index = 0; backend.EnumKey(hKey, index, scratch.valueName) == ERROR_SUCCESS; index++) {
+            subKeys->push_back(scratch.valueName);
+        }
+    }
+    backend.CloseKey(hKey);
+
+    std::sort(scratch.trigrams.begin(), scratch.trigrams.end());
+    scratch.trigrams.erase(std::unique(scratch.trigrams.begin(), scratch.trigrams.end()), scratch.trigrams.end());
+
+    uint32_t id = (uint32_t)shard.keys.size();
+    shard.keys.push_back({ rootKey, keyPath, true });
+    for (uint32_t trigram : scratch.trigrams) {
+        AppendPosting(shard.postings[trigram], id);
+    }
+    return true;
+}
+
+void RegistrySearchIndex::CrawlSubtree(RegistryBackend& backend, HKEY rootKey, std::string& keyPath,
+                                       Shard& shard, CrawlScratch& scratch) {
+    std::vector<std::string> subKeys;
+    if (!AddKey(backend, rootKey, keyPath, shard, scratch, &subKeys)) return;
+
+    size_t pathLength = keyPath.size();
+    for (const std::string& subKey : subKeys) {
+        if (pathLength > 0) keyPath += '\\';
+        keyPath += subKey;
+        CrawlSubtree(backend, rootKey, keyPath, shard, scratch);
+        keyPath.resize(pathLength);
+    }
+}
+
+void RegistrySearchIndex::RegisterShardKeys(uint32_t shardIndex) {
+    const Shard& shard = *shards[shardIndex];
+    for (uint32_t i = 0; i < shard.keys.size(); i++) {
+        if (shard.keys[i].live) {
+            keyLocations[RegistryLocationKey(shard.keys[i].rootKey, shard.keys[i].keyPath)] = { shardIndex, i };
+        }
+    }
+}
+
+void RegistrySearchIndex::MarkDead(const std::string& location) {
+    auto it = keyLocations.find(location);
+    if (it == keyLocations.end()) return;
+    Shard& shard = *shards[it->second.first];
+    shard.keys[it->second.second].live = false;
+    shard.deadKeys++;
+    keyLocations.erase(it);
+}
+
+// Drop dead keys from a shard, renumbering the survivors and re-encoding its posting lists
+void RegistrySearchIndex::CompactShard(uint32_t shardIndex) {
+    Shard& shard = *shards[shardIndex];
+    std::vector<uint32_t> remap(shard.keys.size(), UINT32_MAX);
+    std::vector<IndexedKey> keys;
+    keys.reserve(shard.keys.size() - shard.deadKeys);
+    for (uint32_t i = 0; i < shard.keys.size(); i++) {
+        if (!shard.keys[i].live) continue;
+        remap[i] = (uint32_t)keys.size();
+        keys.push_back(std::move(shard.keys[i]));
+    }
+
+    std::vector<uint32_t> ids;
+    for (auto it = shard.postings.begin(); it != shard.postings.end();) {
+        DecodePostings(it->second, ids);
+        size_t kept = 0;
+        for (uint32_t id : ids) {
+            if (remap[id] != UINT32_MAX) ids[kept++] = remap[id];
+        }
+        ids.resize(kept);
+
+        if (ids.empty()) {
+            it = shard.postings.erase(it);
+            continue;
+        }
+        PostingList list;
+        for (uint32_t newId : ids) AppendPosting(list, newId);
+        it->second.bytes.swap(list.bytes);
+        it->second.bytes.shrink_to_fit();
+        it->second.lastId = list.lastId;
+        it->second.count = list.count;
+        ++it;
+    }
+
+    shard.keys.swap(keys);
+    shard.deadKeys = 0;
+    RegisterShardKeys(shardIndex);
+}
+
+size_t RegistrySearchIndex::IndexRoot(RegistryBackend& backend, HKEY rootKey) {
+    // Plan: the root key alone, then one unit per top-level subtree
+    std::vector<std::string> topKeys;
+    std::vector<std::unique_ptr<Shard>> crawled;
+    {
+        std::unique_lock<std::shared_mutex> lock(indexMutex);
+        crawlingRoots.push_back(rootKey);
+    }
+    {
+        CrawlScratch scratch;
+        std::unique_ptr<Shard> rootShard(new Shard());
+        rootShard->rootKey = rootKey;
+        if (!AddKey(backend, rootKey, "", *rootShard, scratch, &topKeys)) {
+            std::unique_lock<std::shared_mutex> lock(indexMutex);
+            crawlingRoots.erase(std::find(crawlingRoots.begin(), crawlingRoots.end(), rootKey));
+            return 0;
+        }
+        crawled.push_back(std::move(rootShard));
+    }
+    for (size_t i = 0; i < topKeys.size(); i++) {
+        crawled.emplace_back(new Shard());
+        crawled.back()->rootKey = rootKey;
+    }
+
+    std::atomic<size_t> nextUnit(0);
+    size_t threadCount = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), topKeys.size());
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threadCount; t++) {
+        workers.emplace_back([&]() {
+            CrawlScratch scratch;
+            std::string keyPath;
+            for (size_t unit; (unit = nextUnit++) < topKeys.size();) {
+                keyPath = topKeys[unit];
+                CrawlSubtree(backend, rootKey, keyPath, *crawled[unit + 1], scratch);
+            }
+        });
+    }
+    for (std::thread& worker : workers) worker.join();
+
+    std::unique_lock<std::shared_mutex> lock(indexMutex);
+
+    // Replace the previous crawl of this root
+    std::string rootPrefix = std::string(GetRootKeyName(rootKey)) + "\\";
+    for (auto it = keyLocations.begin(); it != keyLocations.end();) {
+        if (it->first.compare(0, rootPrefix.size(), rootPrefix) == 0) {
+            Shard& shard = *shards[it->second.first];
+            shard.keys[it->second.second].live = false;
+            shard.deadKeys++;
+            it = keyLocations.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    std::vector<std::unique_ptr<Shard>> kept;
+    for (std::unique_ptr<Shard>& shard : shards) {
+        if (shard->rootKey != rootKey) kept.push_back(std::move(shard));
+    }
+    shards.swap(kept);
+    if (shards.empty() || shards[0]->rootKey != nullptr) {
+        shards.insert(shards.begin(), std::unique_ptr<Shard>(new Shard())); // Update shard always comes first
+    }
+
+    keyLocations.clear();
+    size_t keyCount = 0;
+    for (std::unique_ptr<Shard>& shard : crawled) {
+        keyCount += shard->keys.size();
+        shards.push_back(std::move(shard));
+    }
+    for (uint32_t i = 0; i < shards.size(); i++) RegisterShardKeys(i);
+
+    if (std::find(indexedRoots.begin(), indexedRoots.end(), rootKey) == indexedRoots.end()) {
+        indexedRoots.push_back(rootKey);
+    }
+    if (shards[0]->deadKeys > 0) CompactShard(0);
+
+    // Edits made while crawling may have been missed; re-read them now that the root is indexed
+    crawlingRoots.erase(std::find(crawlingRoots.begin(), crawlingRoots.end(), rootKey));
+    std::vector<CrawlChange> changes;
+    for (auto it = crawlChanges.begin(); it != crawlChanges.end();) {
+        if (it->rootKey == rootKey) {
+            changes.push_back(std::move(*it));
+            it = crawlChanges.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    lock.unlock();
+    for (const CrawlChange& change : changes) {
+        if (change.removed) {
+            RemoveSubtree(change.rootKey, change.keyPath);
+        } else {
+            UpdateKey(backend, change.rootKey, change.keyPath);
+        }
+    }
+    return keyCount;
+}
+
+// Called with the index locked: remember an edit of a root that is being crawled
+void RegistrySearchIndex::RecordCrawlChange(HKEY rootKey, const std::string& keyPath, bool removed) {
+    if (std::find(crawlingRoots.begin(), crawlingRoots.end(), rootKey) != crawlingRoots.end()) {
+        crawlChanges.push_back({ rootKey, keyPath, removed });
+    }
+}
+
+void RegistrySearchIndex::UpdateKey(RegistryBackend& backend, HKEY rootKey, const std::string& keyPath) {
+    std::unique_lock<std::shared_mutex> lock(indexMutex);
+    RecordCrawlChange(rootKey, keyPath, false);
+    if (std::find(indexedRoots.begin(), indexedRoots.end(), rootKey) == indexedRoots.end()) return;
+
+    std::string location = RegistryLocationKey(rootKey, keyPath);
+    MarkDead(location);
+
+    Shard& updates = *shards[0];
+    CrawlScratch scratch;
+    if (AddKey(backend, rootKey, keyPath, updates, scratch, nullptr)) {
+        keyLocations[location] = { 0, (uint32_t)updates.keys.size() - 1 };
+    }
+    if (updates.deadKeys > 1024 && updates.deadKeys * 2 > updates.keys.size()) CompactShard(0);
+}
+
+void RegistrySearchIndex::RemoveSubtree(HKEY rootKey, const std::string& keyPath) {
+    std::unique_lock<std::shared_mutex> lock(indexMutex);
+    RecordCrawlChange(rootKey, keyPath, true);
+    std::string location = RegistryLocationKey(rootKey, keyPath);
+    std::string childPrefix = location + "\\";
+
+    std::vector<std::string> removed;
+    for (const auto& entry : keyLocations) {
+        if (entry.first == location || entry.first.compare(0, childPrefix.size(), childPrefix) == 0) {
+            removed.push_back(entry.first);
+        }
+    }
+    for (const std::string& key : removed) MarkDead(key);
+
+    for (uint32_t i = 0; i < shards.size(); i++) {
+        Shard& shard = *shards[i];
+        if (shard.deadKeys > 1024 && shard.deadKeys * 2 > shard.keys.size()) CompactShard(i);
+    }
+}
+
+bool RegistrySearchIndex::Search(RegistryBackend& backend, const std::string& pattern, bool isRegex, size_t maxHits,
+                                 std::vector<Hit>& hits, std::string& error, HKEY onlyRoot) const {
+    std::string folded;
+    for (char c : pattern) folded += (char)FoldSearchByte((BYTE)c);
+
+    std::vector<std::string> literals;
+    std::regex expression;
+    if (isRegex) {
+        try {
+            expression.assign(pattern, std::regex::ECMAScript | std::regex::icase | std::regex::optimize);
+        } catch (const std::regex_error& e) {
+            error = std::string("Invalid regular expression: ") + e.what();
+            return false;
+        }
+        literals = ExtractRegexLiterals(pattern);
+    } else {
+        literals.push_back(folded);
+    }
+
+    std::vector<uint32_t> trigrams;
+    for (const std::string& literal : literals) AppendTextTrigrams(literal.data(), literal.size(), trigrams);
+    std::sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+
+    auto matches = [&](const char* text, size_t length) {
+        if (isRegex) return std::regex_search(text, text + length, expression);
+        return ContainsFolded(text, length, folded);
+    };
+
+    std::shared_lock<std::shared_mutex> lock(indexMutex);
+
+    // Shards are filtered and verified in parallel; hits are concatenated in shard order
+    std::vector<std::vector<Hit>> shardHits(shards.size());
+    std::atomic<size_t> nextShard(0);
+    std::atomic<size_t> hitCount(0);
+    size_t threadCount = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), shards.size());
+    std::vector<std::thread> workers;
+
+    for (size_t t = 0; t < threadCount; t++) {
+        workers.emplace_back([&]() {
+            std::vector<uint32_t> candidates;
+            std::vector<const PostingList*> lists;
+            std::string text;
+            std::string valueName;
+            std::vector<BYTE> valueData;
+
+            for (size_t s; (s = nextShard++) < shards.size() && hitCount < maxHits;) {
+                const Shard& shard = *shards[s];
+                if (onlyRoot && shard.rootKey && shard.rootKey != onlyRoot) continue;
+
+                lists.clear();
+                bool possible = true;
+                for (uint32_t trigram : trigrams) {
+                    auto it = shard.postings.find(trigram);
+                    if (it == shard.postings.end()) {
+                        possible = false;
+                        break;
+                    }
+                    lists.push_back(&it->second);
+                }
+                if (!possible) continue;
+
+                // Start from the rarest trigram and narrow down
+                candidates.clear();
+                if (lists.empty()) {
+                    for (uint32_t id = 0; id < shard.keys.size(); id++) candidates.push_back(id);
+                } else {
+                    std::sort(lists.begin(), lists.end(),
+                        [](const PostingList* a, const PostingList* b) { return a->count < b->count; });
+                    DecodePostings(*lists[0], candidates);
+                    for (size_t i = 1; i < lists.size(); i++) {
+                        IntersectPostings(*lists[i], candidates);
+                        if (candidates.empty()) break;
+                    }
+                }
+
+                for (uint32_t id : candidates) {
+                    const IndexedKey& key = shard.keys[id];
+                    if (!key.live || (onlyRoot && key.rootKey != onlyRoot)) continue;
+
+                    HKEY hKey;
+                    if (backend.OpenKey(key.rootKey, key.keyPath, KEY_READ, &hKey) != ERROR_SUCCESS) continue;
+
+                    text = GetRootKeyName(key.rootKey);
+                    text += '\\';
+                    text += key.keyPath;
+                    if (matches(text.data(), text.size())) {
+                        shardHits[s].push_back({ key.rootKey, key.keyPath, "", REG_NONE, true });
+                        hitCount++;
+                    }
+
+                    DWORD valueType;
+                    for (DWORD index = 0; backend.EnumValue(hKey, index, valueName, valueType, valueData) == ERROR_SUCCESS; index++) {
+                        bool found = matches(valueName.data(), valueName.size());
+                        if (!found && (valueType == REG_SZ || valueType == REG_EXPAND_SZ || valueType == REG_MULTI_SZ)) {
+                            // Each string of a REG_MULTI_SZ is matched on its own
+                            const char* data = (const char*)valueData.data();
+                            const char* end = data + valueData.size();
+                            while (!found && data < end) {
+                                const char* stringEnd = std::find(data, end, '\0');
+                                found = stringEnd > data && matches(data, stringEnd - data);
+                                data = stringEnd + 1;
+                            }
+                        }
+                        if (found) {
+                            shardHits[s].push_back({ key.rootKey, key.keyPath, valueName, valueType, false });
+                            hitCount++;
+                        }
+                    }
+                    backend.CloseKey(hKey);
+                    if (hitCount >= maxHits) break;
+                }
+            }
+        });
+    }
+    for (std::thread& worker : workers) worker.join();
+
+    hits.clear();
+    for (std::vector<Hit>& found : shardHits) {
+        for (Hit& hit : found) {
+            if (hits.size() >= maxHits) break;
+            hits.push_back(std::move(hit));
+        }
+    }
+    return true;
+}
+
+bool RegistrySearchIndex::IsRootIndexed(HKEY rootKey) const {
+    std::shared_lock<std::shared_mutex> lock(indexMutex);
+    return std::find(indexedRoots.begin(), indexedRoots.end(), rootKey) != indexedRoots.end();
+}
+
+void RegistrySearchIndex::Clear() {
+    std::unique_lock<std::shared_mutex> lock(indexMutex);
+    shards.clear();
+    keyLocations.clear();
+    indexedRoots.clear();
+    crawlChanges.clear();
+}
+
+size_t RegistrySearchIndex::KeyCount() const {
+    std::shared_lock<std::shared_mutex> lock(indexMutex);
+    return keyLocations.size();
+}
+
+size_t RegistrySearchIndex::PostingBytes() const {
+    std::shared_lock<std::shared_mutex> lock(indexMutex);
+    size_t bytes = 0;
+    for (const auto& shard : shards) {
+        for (const auto& entry : shard->postings) bytes += entry.second.bytes.size();
+    }
+    return bytes;
+}
+
+// Crawl the selected root into the search index on the I/O worker
+void BuildSearchIndex() {
+    HKEY rootKey = GetSelectedRootKey();
+    ioWorker.LoadKey(RegistryIoWorker::IndexSearchRoot, rootKey, "");
+    UpdateStatusBar(std::string("Indexing ") + GetRootKeyName(rootKey) + "...");
+}
+
+// The I/O worker finished crawling a root; run the Find that was waiting for it
+void OnSearchIndexBuilt(HKEY rootKey, size_t keyCount, DWORD elapsed) {
+    bool findPending = findAfterIndexing == rootKey;
+    if (findPending) findAfterIndexing = nullptr;
+    if (!searchIndex.IsRootIndexed(rootKey)) {
+        UpdateStatusBar(std::string("Cannot index ") + GetRootKeyName(rootKey));
+        return;
+    }
+
+    UpdateStatusBar("Indexed " + std::to_string(keyCount) + " keys of " + GetRootKeyName(rootKey) + " in " +
+        std::to_string(elapsed) + " ms (" + std::to_string(searchIndex.PostingBytes() / 1024) + " KB of postings)");
+    if (findPending) FindInRegistry();
+}
+
+// Run the query in the Find box on the I/O worker; the hits are listed in the values list
+void FindInRegistry() {
+    std::string pattern = GetWindowText(hEditFind);
+    if (pattern.empty()) {
+        MessageBox(hMainWindow, "Please enter text to find!", "Error", MB_OK | MB_ICONERROR);
+        return;
+    }
+    if (findJob.busy) {
+        MessageBox(hMainWindow, "A search is already running!", "Error", MB_OK | MB_ICONERROR);
+        return;
+    }
+    if (MustWaitForHive()) return;
+
+    // The search runs once the worker has indexed the root
+    if (!searchIndex.IsRootIndexed(GetSelectedRootKey())) {
+        findAfterIndexing = GetSelectedRootKey();
+        BuildSearchIndex();
+        return;
+    }
+
+    findJob.pattern = pattern;
+    findJob.isRegex = SendMessage(hCheckRegex, BM_GETCHECK, 0, 0) == BST_CHECKED;
+    findJob.error.clear();
+    findJob.busy = true;
+    ioWorker.LoadKey(RegistryIoWorker::FindText, nullptr, "");
+    UpdateStatusBar("Searching for " + pattern + "...");
+}
+
+// The worker has searched: list the hits
+void OnRegistrySearched() {
+    findJob.busy = false;
+    if (!findJob.succeeded) {
+        UpdateStatusBar("Search failed");
+        MessageBox(hMainWindow, findJob.error, "Error", MB_OK | MB_ICONERROR);
+        return;
+    }
+
+    const std::vector<RegistrySearchIndex::Hit>& hits = findJob.hits;
+    const std::string& pattern = findJob.pattern;
+    std::vector<ValueListModel::Row> rows;
+    rows.reserve(hits.size());
+    for (const RegistrySearchIndex::Hit& hit : hits) {
+        ValueListModel::Row row;
+        row.name = hit.keyMatch ? "[Key]" : (hit.valueName.empty() ? "(Default)" : hit.valueName);
+        row.type = hit.keyMatch ? "Key" : GetValueTypeName(hit.valueType);
+        row.data = std::string(GetRootKeyName(hit.rootKey)) + "\\" + hit.keyPath;
+        rows.push_back(std::move(row));
+    }
+    SetValuesListColumns(false);
+    valueListModel.ShowRows(std::move(rows));
+    ListView_SetItemCountEx(hListView, (int)hits.size(), 0);
+    InvalidateRect(hListView, nullptr, TRUE);
+
+    std::string status = "Found " + std::to_string(hits.size()) + " matches in " + std::to_string(findJob.searchTime) + " ms";
+    if (!IsAsciiText(pattern.data(), pattern.data() + pattern.size())) {
+        status += " (case is ignored for ASCII letters only)";
+    }
+    UpdateStatusBar(status);
+}
+
+bool RegTextMatcher::Compile(const std::string& pattern, bool regex, bool matchCase, std::string& error) {
+    isRegex = regex;
+    foldCase = !matchCase;
+    if (isRegex) {
+        try {
+            expression.assign(pattern, matchCase ? std::regex::ECMAScript : std::regex::ECMAScript | std::regex::icase);
+        } catch (const std::regex_error& e) {
+            error = std::string("Invalid regular expression: ") + e.what();
+            return false;
+        }
+        return true;
+    }
+    if (pattern.empty()) {
+        error = "The text to find is empty";
+        return false;
+    }
+    needle.clear();
+    for (char c : pattern) needle += foldCase ? (char)FoldSearchByte((BYTE)c) : c;
+    return true;
+}
+
+bool RegTextMatcher::Matches(const char* text, size_t length) const {
+    if (isRegex) return std::regex_search(text, text + length, expression);
+    return FindLiteral(text, text + length, needle, foldCase) != text + length;
+}
+
+size_t RegTextMatcher::Replace(const char* text, size_t length, const std::string& replacement, std::string& out) const {
+    const char* end = text + length;
+    size_t count = 0;
+    if (isRegex) {
+        const char* copied = text;
+        for (std::cregex_iterator it(text, end, expression), last; it != last; ++it) {
+            out.append(copied, (*it)[0].first);
+            out += it->format(replacement);
+            copied = (*it)[0].second;
+            count++;
+        }
+        out.append(copied, end);
+        return count;
+    }
+    for (const char* p = text;;) {
+        const char* found = FindLiteral(p, end, needle, foldCase);
+        out.append(p, found);
+        if (found == end) break;
+        out += replacement;
+        p = found + needle.size();
+        count++;
+    }
+    return count;
+}
+
+bool RegistryReplacer::Prepare(const RegReplaceOptions& replaceOptions, std::string& error) {
+    options = replaceOptions;
+    changes.clear();
+    stats = RegReplaceStats();
+    for (DWORD type : options.types) {
+        if (type != REG_SZ && type != REG_EXPAND_SZ && type != REG_MULTI_SZ) {
+            error = std::string("Only string values can be replaced, not ") + GetValueTypeName(type);
+            return false;
+        }
+    }
+    if (!dataMatcher.Compile(options.pattern, options.isRegex, options.matchCase, error)) return false;
+    return options.namePattern.empty() ||
+        nameMatcher.Compile(options.namePattern, options.isRegex, options.matchCase, error);
+}
+
+bool RegistryReplacer::Scan(HKEY rootKey, const std::string& keyPath, std::string& error, RegReplaceProgress* scanProgress) {
+    HKEY hKey;
+    if (backend.OpenKey(rootKey, keyPath, KEY_READ, &hKey) != ERROR_SUCCESS) {
+        error = "Cannot open key: " + keyPath;
+        return false;
+    }
+    backend.CloseKey(hKey);
+    progress = scanProgress;
+    std::string path = keyPath;
+    ScanKey(rootKey, path);
+    progress = nullptr;
+    if (scanProgress && scanProgress->cancel) {
+        error = "Cancelled";
+        return false;
+    }
+    return true;
+}
+
+void RegistryReplacer::ScanKey(HKEY rootKey, std::string& keyPath) {
+    if (progress && progress->cancel) return;
+    HKEY hKey;
+    if (backend.OpenKey(rootKey, keyPath, KEY_READ, &hKey) != ERROR_SUCCESS) return;
+    stats.keysScanned++;
+    if (progress) progress->keysScanned++;
+
+    std::string name;
+    DWORD type;
+    std::vector<BYTE> data;
+    std::vector<BYTE> replaced;
+    for (DWORD index = 0; backend.EnumValue(hKey, index, name, type, data) == ERROR_SUCCESS; index++) {
+        stats.valuesScanned++;
+        if (std::find(options.types.begin(), options.types.end(), type) == options.types.end()) continue;
+        if (!options.namePattern.empty() && !nameMatcher.Matches(name.data(), name.size())) continue;
+        if (!ReplaceData(data, replaced)) continue;
+        changes.push_back({ rootKey, keyPath, name, type, data, replaced });
+        stats.valuesChanged++;
+    }
+
+    std::vector<std::string> subKeys;
+    for (DWORD index = 0; backend.EnumKey(hKey, index, name) == ERROR_SUCCESS; index++) subKeys.push_back(name);
+    backend.CloseKey(hKey);
+
+    // Recurse after closing, so only one handle per level of the walk is ever open
+    size_t length = keyPath.size();
+    for (const std::string& subKey : subKeys) {
+        if (length) keyPath += '\\';
+        keyPath += subKey;
+        ScanKey(rootKey, keyPath);
+        keyPath.resize(length);
+    }
+}
+
+// Replace within every NUL-separated string of the data; false if nothing matched
+bool RegistryReplacer::ReplaceData(const std::vector<BYTE>& data, std::vector<BYTE>& replaced) {
+    const char* p = (const char*)data.data();
+    const char* end = p + data.size();
+    // Cheap rejection of most values; a regex may be anchored to each string, so it has to look at them one by one
+    if (!options.isRegex && !dataMatcher.Matches(p, data.size())) return false;
+
+    text.clear();
+    size_t count = 0;
+    while (p < end) {
+        const char* stringEnd = std::find(p, end, '\0');
+        if (stringEnd > p) count += dataMatcher.Replace(p, stringEnd - p, options.replacement, text);
+        if (stringEnd == end) break;
+        text += '\0';
+        p = stringEnd + 1;
+    }
+    if (count == 0 || (text.size() == data.size() && memcmp(text.data(), data.data(), data.size()) == 0)) return false;
+    stats.replacements += count;
+    replaced.assign(text.begin(), text.end());
+    return true;
+}
+
+void RegistryReplacer::QueueChanges(RegistryBatch& batch) const {
+    for (const RegReplaceChange& change : changes) {
+        batch.SetValue(change.rootKey, change.keyPath, change.name, change.type,
+            change.newData.data(), (DWORD)change.newData.size());
+    }
+}
+
+// Replace the Find text with the Replace text in the string values under the selected key.
+// The changes are listed first, and written only once confirmed; a value name in the Value
+// Name box limits the replace to values whose name contains it. Both the scan and the writes
+// run on the I/O worker, with progress in the status bar and the Cancel button to stop them.
+void ReplaceInRegistry() {
+    if (replaceJob.running) {
+        MessageBox(hMainWindow, "A replace is already running!", "Error", MB_OK | MB_ICONERROR);
+        return;
+    }
+    if (MustWaitForHive()) return;
+
+    RegReplaceOptions options;
+    options.pattern = GetWindowText(hEditFind);
+    options.replacement = GetWindowText(hEditReplace);
+    options.namePattern = GetWindowText(hEditValueName);
+    options.isRegex = SendMessage(hCheckRegex, BM_GETCHECK, 0, 0) == BST_CHECKED;
+    if (options.pattern.empty()) {
+        MessageBox(hMainWindow, "Please enter text to find!", "Error", MB_OK | MB_ICONERROR);
+        return;
+    }
+    if (options.isRegex && !options.namePattern.empty()) {
+        // The name box holds a plain name, not a pattern
+        std::string escaped;
+        for (char c : options.namePattern) {
+            if (strchr("\\^$.|?*+()[]{}", c)) escaped += '\\';
+            escaped += c;
+        }
+        options.namePattern = escaped;
+    }
+
+    std::unique_ptr<RegistryReplacer> replacer(new RegistryReplacer(*registry));
+    std::string error;
+    if (!replacer->Prepare(options, error)) {
+        MessageBox(hMainWindow, error, "Error", MB_OK | MB_ICONERROR);
+        return;
+    }
+
+    replaceJob.replacer = std::move(replacer);
+    replaceJob.rootKey = GetSelectedRootKey();
+    replaceJob.keyPath = GetWindowText(hEditKeyPath);
+    replaceJob.startTime = GetTickCount();
+    replaceJob.scanProgress.keysScanned = 0;
+    replaceJob.scanProgress.cancel = false;
+    replaceJob.error.clear();
+    replaceJob.running = true;
+    replaceJob.busy = true;
+    ioWorker.LoadKey(RegistryIoWorker::ReplaceScan, replaceJob.rootKey, replaceJob.keyPath);
+
+    UpdateCancelButton();
+    SetTimer(hMainWindow, IDT_REPLACE_PROGRESS, 200, nullptr);
+    ShowReplaceProgress();
+}
+
+// Show how far the scan or the writes have got
+void ShowReplaceProgress() {
+    if (!replaceJob.busy) return;
+    if (replaceJob.summary.empty()) {
+        UpdateStatusBar("Scanning for replace: " + std::to_string(replaceJob.scanProgress.keysScanned) + " keys scanned...");
+    } else {
+        UpdateStatusBar("Replacing: " + std::to_string(replaceJob.applyProgress.keysApplied) + " keys written...");
+    }
+}
+
+// The worker has finished a step
+void EndReplaceStep() {
+    replaceJob.busy = false;
+    KillTimer(hMainWindow, IDT_REPLACE_PROGRESS);
+    UpdateCancelButton();
+}
+
+void EndReplaceJob() {
+    replaceJob.running = false;
+    replaceJob.replacer.reset();
+    replaceJob.summary.clear();
+    replaceJob.touchedKeys.clear();
+}
+
+// The scan finished: preview one row per value that would change, then write them if confirmed
+void OnReplaceScanned() {
+    EndReplaceStep();
+    DWORD elapsed = GetTickCount() - replaceJob.startTime;
+    if (!replaceJob.succeeded) {
+        if (replaceJob.scanProgress.cancel) {
+            UpdateStatusBar("Replace cancelled after " + std::to_string(replaceJob.scanProgress.keysScanned) + " keys");
+        } else {
+            MessageBox(hMainWindow, replaceJob.error, "Error", MB_OK | MB_ICONERROR);
+        }
+        EndReplaceJob();
+        return;
+    }
+
+    const RegistryReplacer& replacer = *replaceJob.replacer;
+    const RegReplaceStats& stats = replacer.Stats();
+    std::vector<ValueListModel::Row> rows;
+    rows.reserve(replacer.Changes().size());
+    for (const RegReplaceChange& change : replacer.Changes()) {
+        ValueListModel::Row row;
+        row.name = GetRootKeyName(change.rootKey);
+        if (!change.keyPath.empty()) row.name += "\\" + change.keyPath;
+        row.name += "\\" + (change.name.empty() ? std::string("(Default)") : change.name);
+        row.type = GetValueTypeName(change.type);
+        row.data = FormatCliValueData(change.type, change.oldData) + " -> " + FormatCliValueData(change.type, change.newData);
+        rows.push_back(std::move(row));
+    }
+    SetValuesListColumns(false);
+    valueListModel.ShowRows(std::move(rows));
+    ListView_SetItemCountEx(hListView, (int)replacer.Changes().size(), 0);
+    InvalidateRect(hListView, nullptr, TRUE);
+
+    replaceJob.summary = std::to_string(stats.replacements) + " matches in " + std::to_string(stats.valuesChanged) +
+        " values (" + std::to_string(stats.valuesScanned) + " values in " + std::to_string(stats.keysScanned) +
+        " keys scanned in " + std::to_string(elapsed) + " ms)";
+    if (replacer.Changes().empty() ||
+        MessageBox(hMainWindow, "Replace " + replaceJob.summary + "?", "Confirm Replace", MB_YESNO | MB_ICONWARNING) != IDYES) {
+        UpdateStatusBar("Dry run: " + replaceJob.summary);
+        EndReplaceJob();
+        return;
+    }
+
+    replaceJob.applyProgress.keysApplied = 0;
+    replaceJob.applyProgress.cancel = false;
+    replaceJob.busy = true;
+    ioWorker.LoadKey(RegistryIoWorker::ReplaceApply, replaceJob.rootKey, replaceJob.keyPath);
+    UpdateCancelButton();
+    SetTimer(hMainWindow, IDT_REPLACE_PROGRESS, 200, nullptr);
+    ShowReplaceProgress();
+}
+
+// The batch was written, or rolled back after an error or Cancel
+void OnReplaceApplied() {
+    EndReplaceStep();
+    if (!replaceJob.succeeded) {
+        UpdateStatusBar("Failed to replace. " + replaceJob.error);
+        if (!replaceJob.applyProgress.cancel) {
+            MessageBox(hMainWindow, "Failed to replace; no values were changed!", "Error", MB_OK | MB_ICONERROR);
+        }
+        EndReplaceJob();
+        return;
+    }
+    for (const auto& key : replaceJob.touchedKeys) {
+        viewCache.InvalidateKey(key.first, key.second);
+        subtreeStats.InvalidateKey(key.first, key.second);
+    }
+    UpdateStatusBar("Replaced " + replaceJob.summary);
+    EndReplaceJob();
+}
+
+// Current time as a FILETIME value
+uint64_t GetAuditTime() {
+    FILETIME fileTime;
+    GetSystemTimeAsFileTime(&fileTime);
+    return ((uint64_t)fileTime.dwHighDateTime << 32) | fileTime.dwLowDateTime;
+}
+
+// ISO 8601 UTC time with milliseconds
+std::string FormatAuditTime(uint64_t time) {
+    FILETIME fileTime = { (DWORD)time, (DWORD)(time >> 32) };
+    SYSTEMTIME st;
+    if (!FileTimeToSystemTime(&fileTime, &st)) return "?";
+    char text[32];
+    snprintf(text, sizeof(text), "%04u-%02u-%02uT%02u:%02u:%02u.%03uZ",
+        st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond, st.wMilliseconds);
+    return text;
+}
+
+// "now", a relative time such as -30m, -12h or -7d, or a UTC date with an optional time
+// (2024-05-01, 2024-05-01T13:45, 2024-05-01 13:45:10Z)
+bool ParseAuditTime(const std::string& text, uint64_t& time) {
+    const uint64_t second = 10000000; // FILETIME units
+    if (text == "now") {
+        time = GetAuditTime();
+        return true;
+    }
+    if (text.size() >= 3 && text[0] == '-') {
+        char* end;
+        unsigned long long count = strtoull(text.c_str() + 1, &end, 10);
+        uint64_t unit = *end == 's' ? second : *end == 'm' ? 60 * second : *end == 'h' ? 3600 * second :
+            *end == 'd' ? 86400 * second : 0;
+        if (!unit || end[1] || end == text.c_str() + 1) return false;
+        time = GetAuditTime() - std::min<uint64_t>(GetAuditTime(), count * unit);
+        return true;
+    }
+
+    unsigned year, month, day, hour = 0, minute = 0, secondOfMinute = 0;
+    char separator = 'T';
+    int consumed = 0;
+    if (sscanf(text.c_str(), "%4u-%2u-%2u%n", &year, &month, &day, &consumed) != 3) return false;
+    const char* rest = text.c_str() + consumed;
+    if (*rest && sscanf(rest, "%c%2u:%2u%n", &separator, &hour, &minute, &consumed) == 3 &&
+        (separator == 'T' || separator == ' ')) {
+        rest += consumed;
+        if (*rest == ':' && sscanf(rest, ":%2u%n", &secondOfMinute, &consumed) == 1) rest += consumed;
+    }
+    if (*rest == 'Z') rest++;
+    if (*rest) return false;
+
+    SYSTEMTIME st = {};
+    st.wYear = (WORD)year;
+    st.wMonth = (WORD)month;
+    st.wDay = (WORD)day;
+    st.wHour = (WORD)hour;
+    st.wMinute = (WORD)minute;
+    st.wSecond = (WORD)secondOfMinute;
+    FILETIME fileTime;
+    if (!SystemTimeToFileTime(&st, &fileTime)) return false;
+    time = ((uint64_t)fileTime.dwHighDateTime << 32) | fileTime.dwLowDateTime;
+    return true;
+}
+
+const char* GetAuditChangeName(const AuditRecord& record) {
+    if (record.kind == AuditKeyCreated) return "key created";
+    if (record.kind == AuditKeyDeleted) return "key deleted";
+    if (!record.oldHash) return "value added";
+    if (!record.newHash) return "value deleted";
+    return "value changed";
+}
+
+void RegistryAuditLog::AppendVarint(std::vector<BYTE>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back((BYTE)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((BYTE)value);
+}
+
+bool RegistryAuditLog::ReadVarint(const BYTE*& p, const BYTE* end, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        BYTE b = *p++;
+        value |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+// FNV-1a
+uint32_t RegistryAuditLog::Checksum(const BYTE* data, size_t size) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++) hash = (hash ^ data[i]) * 16777619u;
+    return hash;
+}
+
+bool RegistryAuditLog::Open(const std::string& fileName, bool openReadOnly, std::string& error) {
+    Close();
+    readOnly = openReadOnly;
+    // A reader may look at a log that a watcher is still appending to
+    hFile = CreateFileW(Utf8ToWide(fileName).c_str(), readOnly ? GENERIC_READ : GENERIC_READ | GENERIC_WRITE,
+        readOnly ? FILE_SHARE_READ | FILE_SHARE_WRITE : FILE_SHARE_READ, nullptr,
+        readOnly ? OPEN_EXISTING : OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        error = "Cannot open audit log: " + fileName;
+        return false;
+    }
+    if (!ReadIndex()) {
+        error = "Cannot read audit log: " + fileName;
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void RegistryAuditLog::Close() {
+    if (hFile != INVALID_HANDLE_VALUE) {
+        std::string error;
+        Flush(error);
+        CloseHandle(hFile);
+        hFile = INVALID_HANDLE_VALUE;
+    }
+    blocks.clear();
+    keys.clear();
+    keyIds.clear();
+    keyBlocks.clear();
+    buffered.clear();
+    writtenKeys = 0;
+    lastTime = 0;
+}
+
+// Read every block header and key list, skipping the payloads
+bool RegistryAuditLog::ReadIndex() {
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(hFile, &fileSize)) return false;
+    uint64_t size = (uint64_t)fileSize.QuadPart;
+    uint64_t offset = 0;
+    std::vector<BYTE> index;
+    std::vector<uint32_t> blockKeys;
+
+    while (offset + sizeof(BlockHeader) <= size) {
+        BlockHeader header;
+        DWORD read = 0;
+        LARGE_INTEGER position;
+        position.QuadPart = (LONGLONG)offset;
+        if (!SetFilePointerEx(hFile, position, nullptr, FILE_BEGIN) ||
+            !ReadFile(hFile, &header, sizeof(header), &read, nullptr) || read != sizeof(header)) {
+            return false;
+        }
+        uint64_t end = offset + sizeof(header) + header.indexSize + header.payloadSize;
+        if (memcmp(header.magic, "RAUD", 4) != 0 || end > size) break; // Torn or foreign tail
+
+        index.resize(header.indexSize);
+        if (!ReadFile(hFile, index.data(), header.indexSize, &read, nullptr) || read != header.indexSize) return false;
+
+        // Key ids of the block (ascending, as deltas), then the keys it introduces
+        const BYTE* p = index.data();
+        const BYTE* indexEnd = p + index.size();
+        bool valid = true;
+        uint64_t id = 0, number;
+        blockKeys.clear();
+        for (uint32_t i = 0; valid && i < header.keyCount; i++) {
+            valid = ReadVarint(p, indexEnd, number);
+            id += number;
+            blockKeys.push_back((uint32_t)id);
+        }
+        size_t firstNewKey = keys.size();
+        for (uint32_t i = 0; valid && i < header.newKeyCount; i++) {
+            uint64_t rootIndex, length;
+            valid = ReadVarint(p, indexEnd, rootIndex) && ReadVarint(p, indexEnd, length) &&
+                rootIndex < ROOT_KEYS_COUNT && length <= (uint64_t)(indexEnd - p);
+            if (valid) {
+                AddKey(rootKeys[rootIndex].hKey, std::string((const char*)p, (size_t)length));
+                p += length;
+            }
+        }
+        for (uint32_t keyId : blockKeys) valid = valid && keyId < keys.size();
+        if (!valid) {
+            // Keep the index consistent with the blocks that were accepted
+            for (size_t i = firstNewKey; i < keys.size(); i++) {
+                keyIds.erase(RegistryLocationKey(keys[i].rootKey, keys[i].keyPath));
+            }
+            keys.resize(firstNewKey);
+            break;
+        }
+
+        uint32_t blockIndex = (uint32_t)blocks.size();
+        for (uint32_t keyId : blockKeys) keyBlocks[keyId].push_back(blockIndex);
+        blocks.push_back({ offset + sizeof(header) + header.indexSize, header.payloadSize, header.recordCount,
+            header.checksum, header.firstTime, header.lastTime });
+        lastTime = std::max(lastTime, header.lastTime);
+        offset = end;
+    }
+    writtenKeys = (uint32_t)keys.size();
+
+    // Drop a block that was only partly written before the watcher stopped
+    if (offset < size && !readOnly) {
+        LARGE_INTEGER position;
+        position.QuadPart = (LONGLONG)offset;
+        if (!SetFilePointerEx(hFile, position, nullptr, FILE_BEGIN) || !SetEndOfFile(hFile)) return false;
+    }
+    return true;
+}
+
+uint32_t RegistryAuditLog::AddKey(HKEY rootKey, const std::string& keyPath) {
+    uint32_t id = (uint32_t)keys.size();
+    keys.push_back({ rootKey, keyPath });
+    keyIds.emplace(RegistryLocationKey(rootKey, keyPath), id);
+    return id;
+}
+
+uint32_t RegistryAuditLog::KeyId(HKEY rootKey, const std::string& keyPath) {
+    std::lock_guard<std::mutex> lock(logMutex);
+    auto it = keyIds.find(RegistryLocationKey(rootKey, keyPath));
+    if (it != keyIds.end()) return it->second;
+    return AddKey(rootKey, keyPath); // Written with the next block
+}
+
+void RegistryAuditLog::KeyLocation(uint32_t keyId, HKEY& rootKey, std::string& keyPath) const {
+    std::lock_guard<std::mutex> lock(logMutex);
+    rootKey = keys[keyId].rootKey;
+    keyPath = keys[keyId].keyPath;
+}
+
+bool RegistryAuditLog::Append(const AuditRecord& record) {
+    std::lock_guard<std::mutex> lock(logMutex);
+    buffered.push_back(record);
+    // The clock may step back; keep the log ordered so time deltas stay non-negative
+    lastTime = std::max(lastTime, record.time);
+    buffered.back().time = lastTime;
+    return buffered.size() >= kBlockRecords;
+}
+
+uint64_t RegistryAuditLog::OldestBuffered() const {
+    std::lock_guard<std::mutex> lock(logMutex);
+    return buffered.empty() ? 0 : buffered.front().time;
+}
+
+bool RegistryAuditLog::Flush(std::string& error) {
+    std::lock_guard<std::mutex> lock(logMutex);
+    if (buffered.empty()) return true;
+    if (readOnly || hFile == INVALID_HANDLE_VALUE) {
+        error = "The audit log is not open for writing";
+        return false;
+    }
+
+    std::vector<uint32_t> blockKeys;
+    for (const AuditRecord& record : buffered) blockKeys.push_back(record.keyId);
+    std::sort(blockKeys.begin(), blockKeys.end());
+    blockKeys.erase(std::unique(blockKeys.begin(), blockKeys.end()), blockKeys.end());
+
+    std::vector<BYTE> block(sizeof(BlockHeader));
+    uint32_t previousId = 0;
+    for (uint32_t keyId : blockKeys) {
+        AppendVarint(block, keyId - previousId);
+        previousId = keyId;
+    }
+    for (uint32_t keyId = writtenKeys; keyId < keys.size(); keyId++) {
+        int rootIndex = 0;
+        while (rootIndex < ROOT_KEYS_COUNT - 1 && rootKeys[rootIndex].hKey != keys[keyId].rootKey) rootIndex++;
+        AppendVarint(block, rootIndex);
+        AppendVarint(block, keys[keyId].keyPath.size());
+        block.insert(block.end(), keys[keyId].keyPath.begin(), keys[keyId].keyPath.end());
+    }
+    size_t indexSize = block.size() - sizeof(BlockHeader);
+
+    // Records: time delta, key id, kind with presence bits for the hashes, name, hashes
+    std::unordered_map<std::string, uint32_t> names;
+    uint64_t previousTime = buffered.front().time;
+    for (const AuditRecord& record : buffered) {
+        AppendVarint(block, record.time - previousTime);
+        previousTime = record.time;
+        AppendVarint(block, record.keyId);
+        block.push_back((BYTE)(record.kind | (record.oldHash ? 4 : 0) | (record.newHash ? 8 : 0)));
+        auto name = names.find(record.valueName);
+        if (name != names.end()) {
+            AppendVarint(block, name->second + 1);
+        } else {
+            AppendVarint(block, 0);
+            AppendVarint(block, record.valueName.size());
+            block.insert(block.end(), record.valueName.begin(), record.valueName.end());
+            names.emplace(record.valueName, (uint32_t)names.size());
+        }
+        if (record.oldHash) block.insert(block.end(), (const BYTE*)&record.oldHash, (const BYTE*)&record.oldHash + 8);
+        if (record.newHash) block.insert(block.end(), (const BYTE*)&record.newHash, (const BYTE*)&record.newHash + 8);
+    }
+
+    BlockHeader header = {};
+    memcpy(header.magic, "RAUD", 4);
+    header.indexSize = (uint32_t)indexSize;
+    header.payloadSize = (uint32_t)(block.size() - sizeof(BlockHeader) - indexSize);
+    header.recordCount = (uint32_t)buffered.size();
+    header.checksum = Checksum(block.data() + sizeof(BlockHeader) + indexSize, header.payloadSize);
+    header.keyCount = (uint32_t)blockKeys.size();
+    header.newKeyCount = (uint32_t)(keys.size() - writtenKeys);
+    header.firstTime = buffered.front().time;
+    header.lastTime = buffered.back().time;
+    memcpy(block.data(), &header, sizeof(header));
+
+    LARGE_INTEGER zero, end;
+    zero.QuadPart = 0;
+    DWORD written = 0;
+    if (!SetFilePointerEx(hFile, zero, &end, FILE_END) ||
+        !WriteFile(hFile, block.data(), (DWORD)block.size(), &written, nullptr) || written != block.size()) {
+        error = "Cannot write to the audit log";
+        return false;
+    }
+    FlushFileBuffers(hFile);
+
+    uint32_t blockIndex = (uint32_t)blocks.size();
+    for (uint32_t keyId : blockKeys) keyBlocks[keyId].push_back(blockIndex);
+    blocks.push_back({ (uint64_t)end.QuadPart + sizeof(BlockHeader) + indexSize, header.payloadSize, header.recordCount,
+        header.checksum, header.firstTime, header.lastTime });
+    writtenKeys = (uint32_t)keys.size();
+    buffered.clear();
+    return true;
+}
+
+bool RegistryAuditLog::DecodeBlock(const Block& block, const std::unordered_set<uint32_t>* wanted, uint64_t from, uint64_t to,
+                                   size_t maxRecords, std::vector<AuditRecord>& records, std::string& error) {
+    std::vector<BYTE> payload(block.payloadSize);
+    LARGE_INTEGER position;
+    position.QuadPart = (LONGLONG)block.payloadOffset;
+    DWORD read = 0;
+    if (!SetFilePointerEx(hFile, position, nullptr, FILE_BEGIN) ||
+        !ReadFile(hFile, payload.data(), block.payloadSize, &read, nullptr) || read != block.payloadSize ||
+        Checksum(payload.data(), payload.size()) != block.checksum) {
+        error = "The audit log is damaged at offset " + std::to_string(block.payloadOffset);
+        return false;
+    }
+    blocksRead++;
+
+    const BYTE* p = payload.data();
+    const BYTE* end = p + payload.size();
+    std::vector<std::string> names;
+    AuditRecord record;
+    record.time = block.firstTime;
+    for (uint32_t i = 0; i < block.recordCount; i++) {
+        uint64_t delta, keyId, nameCode, length;
+        bool valid = ReadVarint(p, end, delta) && ReadVarint(p, end, keyId) && p < end && keyId < keys.size();
+        BYTE flags = valid ? *p++ : 0;
+        valid = valid && ReadVarint(p, end, nameCode) && nameCode <= names.size();
+        if (valid && nameCode == 0) {
+            valid = ReadVarint(p, end, length) && length <= (uint64_t)(end - p);
+            if (valid) {
+                names.emplace_back((const char*)p, (size_t)length);
+                p += length;
+                nameCode = names.size();
+            }
+        }
+        size_t hashBytes = ((flags & 4) ? 8 : 0) + ((flags & 8) ? 8 : 0);
+        if (!valid || (size_t)(end - p) < hashBytes) {
+            error = "The audit log is damaged at offset " + std::to_string(block.payloadOffset);
+            return false;
+        }
+        record.time += delta;
+        record.keyId = (uint32_t)keyId;
+        record.kind = (AuditRecordKind)(flags & 3);
+        record.oldHash = record.newHash = 0;
+        if (flags & 4) {
+            memcpy(&record.oldHash, p, 8);
+            p += 8;
+        }
+        if (flags & 8) {
+            memcpy(&record.newHash, p, 8);
+            p += 8;
+        }
+        if (record.time > to) break;
+        if (record.time < from || (wanted && !wanted->count(record.keyId))) continue;
+        record.valueName = names[nameCode - 1];
+        records.push_back(record);
+        if (records.size() >= maxRecords) break;
+    }
+    return true;
+}
+
+bool RegistryAuditLog::Query(HKEY rootKey, const std::string* keyPath, uint64_t from, uint64_t to, size_t maxRecords,
+                             std::vector<AuditRecord>& records, std::string& error) {
+    std::lock_guard<std::mutex> lock(logMutex);
+    records.clear();
+    blocksRead = 0;
+
+    // Ids of the key and of everything below it, from the ordered key map
+    std::unordered_set<uint32_t> wanted;
+    std::vector<uint32_t> candidates;
+    if (keyPath) {
+        std::string location = RegistryLocationKey(rootKey, *keyPath);
+        std::string childPrefix = location.back() == '\\' ? location : location + "\\";
+        auto key = keyIds.find(location);
+        if (key != keyIds.end()) wanted.insert(key->second);
+        for (auto it = keyIds.lower_bound(childPrefix);
+             it != keyIds.end() && it->first.compare(0, childPrefix.size(), childPrefix) == 0; ++it) {
+            wanted.insert(it->second);
+        }
+        for (uint32_t keyId : wanted) {
+            auto found = keyBlocks.find(keyId);
+            if (found != keyBlocks.end()) candidates.insert(candidates.end(), found->second.begin(), found->second.end());
+        }
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+    } else {
+        for (uint32_t i = 0; i < blocks.size(); i++) candidates.push_back(i);
+    }
+
+    for (uint32_t blockIndex : candidates) {
+        const Block& block = blocks[blockIndex];
+        if (block.lastTime < from || block.firstTime > to) continue;
+        if (!DecodeBlock(block, keyPath ? &wanted : nullptr, from, to, maxRecords, records, error)) return false;
+        if (records.size() >= maxRecords) return true;
+    }
+    for (const AuditRecord& record : buffered) {
+        if (record.time < from || record.time > to || (keyPath && !wanted.count(record.keyId))) continue;
+        records.push_back(record);
+        if (records.size() >= maxRecords) break;
+    }
+    return true;
+}
+
+// FNV-1a over the type and data; never 0, which stands for a missing value
+uint64_t RegistryAuditWatcher::HashValue(DWORD type, const std::vector<BYTE>& data) {
+    uint64_t hash = 14695981039346656037ull;
+    for (int i = 0; i < 4; i++) hash = (hash ^ ((type >> (i * 8)) & 0xFF)) * 1099511628211ull;
+    for (BYTE b : data) hash = (hash ^ b) * 1099511628211ull;
+    return hash ? hash : 1;
+}
+
+bool RegistryAuditWatcher::Start(const std::vector<std::pair<HKEY, std::string>>& watched, std::string& error) {
+    subtrees = watched;
+    backend.SetChangeListener(this);
+
+    // Arm the watches before reading the baseline, so a change made in between is not lost
+    uint64_t now = GetAuditTime();
+    for (const auto& subtree : subtrees) {
+        if (!backend.WatchSubtree(subtree.first, subtree.second)) {
+            error = std::string("Cannot watch ") + GetRootKeyName(subtree.first) + "\\" + subtree.second;
+            backend.UnwatchAll();
+            backend.SetChangeListener(nullptr);
+            return false;
+        }
+        std::string keyPath = subtree.second;
+        ScanNew(subtree.first, keyPath, now, false);
+    }
+    stopping = false;
+    worker = std::thread(&RegistryAuditWatcher::Run, this);
+    return true;
+}
+
+void RegistryAuditWatcher::Stop() {
+    if (!worker.joinable()) return;
+    backend.SetChangeListener(nullptr);
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopping = true;
+    }
+    queueReady.notify_one();
+    recordsReady.notify_all();
+    worker.join(); // After logging whatever was still queued
+    backend.UnwatchAll(); // Including a watch the worker re-armed meanwhile
+}
+
+std::vector<AuditRecord> RegistryAuditWatcher::TakeRecords(DWORD timeoutMs) {
+    std::unique_lock<std::mutex> lock(queueMutex);
+    recordsReady.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this]() { return !newRecords.empty() || stopping; });
+    std::vector<AuditRecord> records;
+    records.swap(newRecords);
+    return records;
+}
+
+void RegistryAuditWatcher::OnKeyChanged(HKEY rootKey, const std::string& keyPath) {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (!queuedKeys.insert(RegistryLocationKey(rootKey, keyPath)).second) return; // Already queued
+        changedKeys.push_back({ rootKey, keyPath });
+    }
+    queueReady.notify_one();
+}
+
+void RegistryAuditWatcher::Run() {
+    const uint64_t flushDelay = 5 * 10000000ull; // A partial block is written once it is 5 seconds old
+    std::string error;
+    std::unique_lock<std::mutex> lock(queueMutex);
+    for (;;) {
+        if (changedKeys.empty()) {
+            if (stopping) break;
+            queueReady.wait_for(lock, std::chrono::seconds(1));
+            uint64_t oldest = log.OldestBuffered();
+            if (changedKeys.empty() && oldest && GetAuditTime() - oldest >= flushDelay) {
+                lock.unlock();
+                log.Flush(error);
+                lock.lock();
+            }
+            continue;
+        }
+        std::pair<HKEY, std::string> changed = changedKeys.front();
+        changedKeys.pop_front();
+        queuedKeys.erase(RegistryLocationKey(changed.first, changed.second));
+        lock.unlock();
+
+        HKEY rootKey = changed.first;
+        std::string keyPath = changed.second;
+        uint64_t now = GetAuditTime();
+        const std::pair<HKEY, std::string>* subtree = FindSubtree(rootKey, keyPath);
+        if (!backend.ReportsExactKeys()) {
+            // Only a watched root is ever named; re-arm before reading, then compare the whole subtree
+            if (subtree) {
+                backend.WatchSubtree(rootKey, keyPath);
+                Rescan(rootKey, keyPath, true, now);
+            }
+        } else if (subtree) {
+            // Start from the nearest key we know; a new key is found as a new subkey of it
+            while (keyPath.size() > subtree->second.size() && !states.count(RegistryLocationKey(rootKey, keyPath))) {
+                size_t separator = keyPath.rfind('\\');
+                keyPath.resize(separator == std::string::npos ? 0 : separator);
+            }
+            Rescan(rootKey, keyPath, false, now);
+        } else {
+            // A parent of watched roots changed: they may have been created or deleted
+            std::string childPrefix = RegistryLocationKey(rootKey, keyPath);
+            if (childPrefix.back() != '\\') childPrefix += '\\';
+            for (const auto& watched : subtrees) {
+                if (RegistryLocationKey(watched.first, watched.second).compare(0, childPrefix.size(), childPrefix) == 0) {
+                    std::string watchedPath = watched.second;
+                    Rescan(watched.first, watchedPath, false, now);
+                }
+            }
+        }
+        lock.lock();
+    }
+    lock.unlock();
+    log.Flush(error);
+}
+
+const std::pair<HKEY, std::string>* RegistryAuditWatcher::FindSubtree(HKEY rootKey, const std::string& keyPath) const {
+    std::string location = RegistryLocationKey(rootKey, keyPath);
+    for (const auto& subtree : subtrees) {
+        std::string watched = RegistryLocationKey(subtree.first, subtree.second);
+        if (location == watched) return &subtree;
+        std::string childPrefix = watched.back() == '\\' ? watched : watched + "\\";
+        if (location.compare(0, childPrefix.size(), childPrefix) == 0) return &subtree;
+    }
+    return nullptr;
+}
+
+bool RegistryAuditWatcher::ReadKey(HKEY rootKey, const std::string& keyPath, KeyState& state) {
+    HKEY hKey;
+    if (backend.OpenKey(rootKey, keyPath, KEY_READ, &hKey) != ERROR_SUCCESS) return false;
+    std::string name;
+    DWORD type;
+    std::vector<BYTE> data;
+    for (DWORD index = 0; backend.EnumValue(hKey, index, name, type, data) == ERROR_SUCCESS; index++) {
+        state.values[name] = HashValue(type, data);
+    }
+    for (DWORD index = 0; backend.EnumKey(hKey, index, name) == ERROR_SUCCESS; index++) {
+        state.subKeys.push_back(name);
+    }
+    backend.CloseKey(hKey);
+    return true;
+}
+
+// Compare a known key with what it holds now; deep also compares every subkey that still exists
+void RegistryAuditWatcher::Rescan(HKEY rootKey, std::string& keyPath, bool deep, uint64_t now) {
+    std::string location = RegistryLocationKey(rootKey, keyPath);
+    auto known = states.find(location);
+    KeyState current;
+    if (!ReadKey(rootKey, keyPath, current)) {
+        if (known != states.end()) ForgetKey(rootKey, keyPath, now);
+        return;
+    }
+    if (known == states.end()) {
+        ScanNew(rootKey, keyPath, now, true);
+        return;
+    }
+
+    KeyState& previous = known->second;
+    for (const auto& value : current.values) {
+        auto old = previous.values.find(value.first);
+        uint64_t oldHash = old == previous.values.end() ? 0 : old->second;
+        if (oldHash != value.second) Record(rootKey, keyPath, AuditValueChange, value.first, oldHash, value.second, now);
+    }
+    for (const auto& value : previous.values) {
+        if (!current.values.count(value.first)) Record(rootKey, keyPath, AuditValueChange, value.first, value.second, 0, now);
+    }
+
+    // Recursion below adds and removes states, so work on copies of the subkey lists
+    std::vector<std::string> oldSubKeys;
+    oldSubKeys.swap(previous.subKeys);
+    std::vector<std::string> subKeys = current.subKeys;
+    previous = std::move(current);
+
+    std::unordered_set<std::string> oldNames(oldSubKeys.begin(), oldSubKeys.end());
+    std::unordered_set<std::string> newNames(subKeys.begin(), subKeys.end());
+    size_t length = keyPath.size();
+    for (const std::string& subKey : subKeys) {
+        bool isNew = !oldNames.count(subKey);
+        if (!isNew && !deep) continue;
+        if (length) keyPath += '\\';
+        keyPath += subKey;
+        if (isNew) ScanNew(rootKey, keyPath, now, true);
+        else Rescan(rootKey, keyPath, true, now);
+        keyPath.resize(length);
+    }
+    for (const std::string& subKey : oldSubKeys) {
+        if (newNames.count(subKey)) continue;
+        if (length) keyPath += '\\';
+        keyPath += subKey;
+        ForgetKey(rootKey, keyPath, now);
+        keyPath.resize(length);
+    }
+}
+
+// Start tracking a key and its subtree; record logs it as created along with all of its values
+void RegistryAuditWatcher::ScanNew(HKEY rootKey, std::string& keyPath, uint64_t now, bool record) {
+    KeyState state;
+    if (!ReadKey(rootKey, keyPath, state)) return;
+    if (record) {
+        Record(rootKey, keyPath, AuditKeyCreated, "", 0, 0, now);
+        for (const auto& value : state.values) Record(rootKey, keyPath, AuditValueChange, value.first, 0, value.second, now);
+    }
+    std::vector<std::string> subKeys = state.subKeys;
+    states[RegistryLocationKey(rootKey, keyPath)] = std::move(state);
+
+    size_t length = keyPath.size();
+    for (const std::string& subKey : subKeys) {
+        if (length) keyPath += '\\';
+        keyPath += subKey;
+        ScanNew(rootKey, keyPath, now, record);
+        keyPath.resize(length);
+    }
+}
+
+// Log a vanished key, subkeys first, as the deletion itself went
+void RegistryAuditWatcher::ForgetKey(HKEY rootKey, std::string& keyPath, uint64_t now) {
+    auto known = states.find(RegistryLocationKey(rootKey, keyPath));
+    if (known == states.end()) return;
+    KeyState state = std::move(known->second);
+    states.erase(known);
+
+    size_t length = keyPath.size();
+    for (const std::string& subKey : state.subKeys) {
+        if (length) keyPath += '\\';
+        keyPath += subKey;
+        ForgetKey(rootKey, keyPath, now);
+        keyPath.resize(length);
+    }
+    for (const auto& value : state.values) Record(rootKey, keyPath, AuditValueChange, value.first, value.second, 0, now);
+    Record(rootKey, keyPath, AuditKeyDeleted, "", 0, 0, now);
+}
+
+void RegistryAuditWatcher::Record(HKEY rootKey, const std::string& keyPath, AuditRecordKind kind, const std::string& valueName,
+                                  uint64_t oldHash, uint64_t newHash, uint64_t now) {
+    AuditRecord record = { now, log.KeyId(rootKey, keyPath), kind, valueName, oldHash, newHash };
+    if (log.Append(record)) {
+        std::string error;
+        log.Flush(error);
+    }
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        newRecords.push_back(std::move(record));
+    }
+    recordsReady.notify_all();
+}
+
+// Compare the selected key with the same key in a .reg file or snapshot and save a patch that turns
+// the current contents into the file's contents. The file is loaded and compared on the I/O worker.
+void DiffWithRegFile() {
+    if (fileJob.busy) {
+        MessageBox(hMainWindow, "Please wait until the current file operation has finished!", "Error", MB_OK | MB_ICONERROR);
+        return;
+    }
+
+    std::string keyPath = GetWindowText(hEditKeyPath);
+    HKEY rootKey = GetSelectedRootKey();
+
+    OPENFILENAMEW ofn;
+    WCHAR szFile[260] = {0};
+
+    ZeroMemory(&ofn, sizeof(ofn));
+    ofn.lStructSize = sizeof(ofn);
+    ofn.hwndOwner = hMainWindow;
+    ofn.lpstrFile = szFile;
+    ofn.nMaxFile = sizeof(szFile) / sizeof(WCHAR);
+    ofn.lpstrFilter = L"Registry Files\0*.reg;*.regsnap\0All Files\0*.*\0";
+    ofn.nFilterIndex = 1;
+    ofn.lpstrTitle = L"Compare With";
+    ofn.Flags = OFN_PATHMUSTEXIST | OFN_FILEMUSTEXIST;
+
+    if (!GetOpenFileNameW(&ofn)) return;
+    std::string otherFile = WideToUtf8(szFile, wcslen(szFile));
+
+    szFile[0] = L'\0';
+    ofn.lpstrTitle = L"Save Patch As";
+    ofn.lpstrDefExt = L"reg";
+    ofn.Flags = OFN_PATHMUSTEXIST | OFN_OVERWRITEPROMPT;
+    if (!GetSaveFileNameW(&ofn)) return;
+    std::string patchFile = WideToUtf8(szFile, wcslen(szFile));
+
+    fileJob.fileName = otherFile;
+    fileJob.patchFileName = patchFile;
+    fileJob.rootKey = rootKey;
+    fileJob.keyPath = keyPath;
+    StartFileJob("Comparing with", RegistryIoWorker::DiffFile);
+}
+
+// The comparison finished, failed or was cancelled (a cancelled one leaves no patch behind)
+void OnRegistryCompared() {
+    EndFileJob();
+    const RegDiffStats& stats = fileJob.diffStats;
+    if (!fileJob.succeeded) {
+        if (fileJob.progress.cancel) {
+            UpdateStatusBar("Comparison cancelled after " + std::to_string(fileJob.progress.keys) + " keys");
+        } else {
+            MessageBox(hMainWindow, fileJob.error, "Error", MB_OK | MB_ICONERROR);
+        }
+        return;
+    }
+
+    UpdateStatusBar("Patch saved to " + fileJob.patchFileName + ": " + std::to_string(stats.keysCompared) + " keys compared, " +
+        std::to_string(stats.keysAdded) + " added, " + std::to_string(stats.keysRemoved) + " removed; values " +
+        std::to_string(stats.valuesAdded) + " added, " + std::to_string(stats.valuesRemoved) + " removed, " +
+        std::to_string(stats.valuesChanged) + " changed (" + std::to_string(GetTickCount() - fileJob.startTime) + " ms)");
+}
+
+// Open a .reg file as an offline in-memory hive and browse it instead of the live registry. The
+// file is loaded on the I/O worker; the window switches to it when it arrives.
+void OpenOfflineHive() {
+    OPENFILENAMEW ofn;
+    WCHAR szFile[260] = {0};
+
+    ZeroMemory(&ofn, sizeof(ofn));
+    ofn.lStructSize = sizeof(ofn);
+    ofn.hwndOwner = hMainWindow;
+    ofn.lpstrFile = szFile;
+    ofn.nMaxFile = sizeof(szFile) / sizeof(WCHAR);
+    ofn.lpstrFilter = L"Registry Files\0*.reg;*.regsnap\0All Files\0*.*\0";
+    ofn.nFilterIndex = 1;
+    ofn.Flags = OFN_PATHMUSTEXIST | OFN_FILEMUSTEXIST;
+
+    if (!GetOpenFileNameW(&ofn)) return;
+    if (IsKeyDeleteRunning()) {
+        MessageBox(hMainWindow, "Please wait until the key deletion has finished!", "Error", MB_OK | MB_ICONERROR);
+        return;
+    }
+    if (replaceJob.running) {
+        MessageBox(hMainWindow, "Please wait until the replace has finished!", "Error", MB_OK | MB_ICONERROR);
+        return;
+    }
+    if (fileJob.busy) {
+        MessageBox(hMainWindow, "Please wait until the current file operation has finished!", "Error", MB_OK | MB_ICONERROR);
+        return;
+    }
+    if (editJob.busy) {
+        MessageBox(hMainWindow, "Please wait until the change has been written!", "Error", MB_OK | MB_ICONERROR);
+        return;
+    }
+    if (findJob.busy) {
+        MessageBox(hMainWindow, "Please wait until the search has finished!", "Error", MB_OK | MB_ICONERROR);
+        return;
+    }
+
+    fileJob.fileName = WideToUtf8(szFile, wcslen(szFile));
+    fileJob.rootKey = nullptr;
+    fileJob.keyPath.clear();
+    StartFileJob("Opening", RegistryIoWorker::LoadHive);
+}
+
+// The hive was loaded: browse it from now on. Jobs that would run on the old backend were held
+// back while it loaded (see MustWaitForHive).
+void OnHiveLoaded() {
+    EndFileJob();
+    std::unique_ptr<RegistryBackend> hive = std::move(fileJob.hive);
+    if (!hive) {
+        if (fileJob.progress.cancel) {
+            UpdateStatusBar("Opening the hive cancelled after " + std::to_string(fileJob.progress.keys) + " keys");
+        } else {
+            MessageBox(hMainWindow, fileJob.error, "Error", MB_OK | MB_ICONERROR);
+        }
+        return;
+    }
+
+    hive->SetChangeListener(&viewCache);
+    ioWorker.SetBackend(*hive);
+    viewCache.Clear(); // While the backend its entries came from still exists
+    registry = hive.get();
+    offlineHive = std::move(hive);
+    subtreeStats.Clear();
+    searchIndex.Clear();
+    findAfterIndexing = nullptr;
+
+    PopulateTreeView();
+    ClearValuesList();
+    SetWindowText(hMainWindow, "Windows Registry Manager - Offline Hive: " + fileJob.fileName);
+    UpdateStatusBar("Offline hive loaded: " + std::to_string(fileJob.hiveKeys) + " keys, " +
+        std::to_string(fileJob.hiveValues) + " values in " + std::to_string(GetTickCount() - fileJob.startTime) + " ms");
+}
+
+// Jobs started while a hive loads would be dropped or cut short when the backend switches, so
+// they wait; true, after telling the user, if they must
+bool MustWaitForHive() {
+    if (!fileJob.busy || !fileJob.opensHive) return false;
+    MessageBox(hMainWindow, "Please wait until the hive has been opened!", "Error", MB_OK | MB_ICONERROR);
+    return true;
+}
+
+// Switch back from an offline hive to the live registry
+void UseLiveRegistry() {
+    if (IsKeyDeleteRunning()) {
+        MessageBox(hMainWindow, "Please wait until the key deletion has finished!", "Error", MB_OK | MB_ICONERROR);
+        return;
+    }
+    if (replaceJob.running) {
+        MessageBox(hMainWindow, "Please wait until the replace has finished!", "Error", MB_OK | MB_ICONERROR);
+        return;
+    }
+    if (fileJob.busy) {
+        MessageBox(hMainWindow, "Please wait until the current file operation has finished!", "Error", MB_OK | MB_ICONERROR);
+        return;
+    }
+    if (editJob.busy) {
+        MessageBox(hMainWindow, "Please wait until the change has been written!", "Error", MB_OK | MB_ICONERROR);
+        return;
+    }
+    if (findJob.busy) {
+        MessageBox(hMainWindow, "Please wait until the search has finished!", "Error", MB_OK | MB_ICONERROR);
+        return;
+    }
+    ioWorker.SetBackend(win32Registry);
+    viewCache.Clear(); // While the backend its entries came from still exists
+    registry = &win32Registry;
+    offlineHive.reset();
+    subtreeStats.Clear();
+    searchIndex.Clear();
+    findAfterIndexing = nullptr;
+
+    PopulateTreeView();
+    ClearValuesList();
+    SetWindowText(hMainWindow, "Windows Registry Manager - Lab 3 (Group 3)");
+    UpdateStatusBar("Using live registry");
+}
+
+// Check if key exists (Group 3 additional feature)
+void CheckKeyExists() {
     std::string keyPath = GetWindowText(hEditKeyPath);
     if (keyPath.empty()) {
         MessageBox(hMainWindow, "Please enter a key path!", "Error", MB_OK | MB_ICONERROR);
         return;
     }
 
-    HKEY rootKey = GetSelectedRootKey();
-    HKEY hKey;
-    DWORD disposition;
+    if (editJob.busy) {
+        MessageBox(hMainWindow, "Please wait until the previous change has been written!", "Error", MB_OK | MB_ICONERROR);
+        return;
+    }
+    if (MustWaitForHive()) return;
+
+    // The I/O worker looks the key up; the result is shown when it arrives
+    editJob.action = EditJob::CheckKey;
+    editJob.rootKey = GetSelectedRootKey();
+    editJob.keyPath = keyPath;
+    StartEditStep(RegistryIoWorker::EditLookup);
+}
+
+    // Update status bar
+    void UpdateStatusBar(const std::string& message) {
+    SetWindowText(hStatusBar, message);
+}
+
+    // Get selected root key from combo box
+    HKEY GetSelectedRootKey() {
+    int index = SendMessage(hComboRootKey, CB_GETCURSEL, 0, 0);
+    if (index >= 0 && index < ROOT_KEYS_COUNT) {
+        return rootKeys[index].hKey;
+    }
+    return HKEY_CURRENT_USER;
+}
+
+    // Get selected key path from edit control
+    std::string GetSelectedKeyPath() {
+    return GetWindowText(hEditKeyPath);
+}
+
+    // Helper function to get text from window (as UTF-8)
+    std::string GetWindowText(HWND hwnd) {
+    int length = ::GetWindowTextLengthW(hwnd);
+    if (length == 0) return "";
+
+    std::vector<WCHAR> buffer(length + 1);
+    length = ::GetWindowTextW(hwnd, buffer.data(), length + 1);
+    return WideToUtf8(buffer.data(), (size_t)length);
+}
+
+    // Helper function to set text to window (from UTF-8)
+    void SetWindowText(HWND hwnd, const std::string& text) {
+    ::SetWindowTextW(hwnd, Utf8ToWide(text).c_str());
+}
+
+    // Helper function to show a message box with UTF-8 text
+    int MessageBox(HWND hwnd, const std::string& text, const char* caption, UINT type) {
+    return ::MessageBoxW(hwnd, Utf8ToWide(text).c_str(), Utf8ToWide(caption).c_str(), type);
+}
+
+// Command line after the program name, as UTF-8 (lpCmdLine is in the ANSI code page)
+std::string GetCommandLineArguments() {
+    const WCHAR* p = GetCommandLineW();
+    if (*p == L'"') {
+        p++;
+        while (*p && *p != L'"') p++;
+        if (*p) p++;
+    } else {
+        while (*p && *p != L' ' && *p != L'\t') p++;
+    }
+    while (*p == L' ' || *p == L'\t') p++;
+    return WideToUtf8(p, wcslen(p));
+}
+
+// Split a command line into arguments: whitespace separates, double quotes group and \" is a
+// literal quote. Other backslashes are kept, so key paths need no escaping.
+std::vector<std::string> SplitCommandLine(const std::string& line) {
+    std::vector<std::string> arguments;
+    size_t i = 0;
+    while (i < line.size()) {
+        while (i < line.size() && isspace((unsigned char)line[i])) i++;
+        if (i == line.size()) break;
+
+        std::string argument;
+        bool quoted = false;
+        for (; i < line.size() && (quoted || !isspace((unsigned char)line[i])); i++) {
+            if (line[i] == '\\' && i + 1 < line.size() && line[i + 1] == '"') {
+                argument += '"';
+                i++;
+            } else if (line[i] == '"') {
+                quoted = !quoted;
+            } else {
+                argument += line[i];
+            }
+        }
+        arguments.push_back(std::move(argument));
+    }
+    return arguments;
+}
+
+bool IsCliCommand(const std::string& argument) {
+    static const char* commands[] = { "query", "set", "delete", "export", "import", "find", "replace", "watch", "audit", "diff", "stats", "batch", "--json", "--hive" };
+    for (const char* command : commands) {
+        if (_stricmp(argument.c_str(), command) == 0) return true;
+    }
+    return false;
+}
+
+// Command-line modes write to redirected handles as they are, and otherwise to the console
+// of the process that started us (this is a GUI program, so it has none of its own)
+void AttachCliConsole() {
+    if (GetFileType(GetStdHandle(STD_OUTPUT_HANDLE)) == FILE_TYPE_UNKNOWN) {
+        if (!AttachConsole(ATTACH_PARENT_PROCESS)) AllocConsole();
+        freopen("CONOUT$", "w", stdout);
+        freopen("CONOUT$", "w", stderr);
+        if (GetFileType(GetStdHandle(STD_INPUT_HANDLE)) == FILE_TYPE_UNKNOWN) freopen("CONIN$", "r", stdin);
+    }
+    // Names and data are printed (and batch commands read) as UTF-8
+    SetConsoleOutputCP(CP_UTF8);
+    SetConsoleCP(CP_UTF8);
+}
+
+// "HKEY_CURRENT_USER\Software\..." or "HKCU\Software\..." into root and path
+bool ParseRegistryPath(const std::string& fullPath, HKEY& rootKey, std::string& keyPath) {
+    size_t separator = fullPath.find('\\');
+    std::string rootName = fullPath.substr(0, separator);
+    rootKey = nullptr;
+    for (int i = 0; i < ROOT_KEYS_COUNT; i++) {
+        if (_stricmp(rootName.c_str(), rootKeys[i].name) == 0 || _stricmp(rootName.c_str(), rootKeys[i].shortName) == 0) {
+            rootKey = rootKeys[i].hKey;
+        }
+    }
+    keyPath = separator == std::string::npos ? std::string() : fullPath.substr(separator + 1);
+    while (!keyPath.empty() && keyPath.back() == '\\') keyPath.pop_back();
+    return rootKey != nullptr;
+}
+
+bool ParseValueType(const std::string& name, DWORD& type) {
+    static const DWORD types[] = { REG_SZ, REG_EXPAND_SZ, REG_MULTI_SZ, REG_DWORD, REG_BINARY };
+    for (DWORD candidate : types) {
+        if (_stricmp(name.c_str(), GetValueTypeName(candidate)) == 0) {
+            type = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Value data as given on the command line: text, a decimal or 0x number, hex bytes (commas and
+// spaces ignored), or strings separated by \0 for REG_MULTI_SZ
+bool ParseValueData(DWORD type, const std::string& text, std::vector<BYTE>& data) {
+    data.clear();
+    if (type == REG_DWORD) {
+        char* end;
+        errno = 0;
+        unsigned long long number = strtoull(text.c_str(), &end, 0);
+        if (text.empty() || *end || errno || number > 0xFFFFFFFFull) return false;
+        DWORD dword = (DWORD)number;
+        data.assign((const BYTE*)&dword, (const BYTE*)&dword + sizeof(dword));
+    } else if (type == REG_BINARY) {
+        int high = -1;
+        for (char c : text) {
+            if (c == ',' || c == ' ') continue;
+            int digit = HexDigitValue(c);
+            if (digit < 0) return false;
+            if (high < 0) {
+                high = digit;
+            } else {
+                data.push_back((BYTE)(high << 4 | digit));
+                high = -1;
+            }
+        }
+        if (high >= 0) return false;
+    } else if (type == REG_MULTI_SZ) {
+        for (size_t start = 0;;) {
+            size_t separator = text.find("\\0", start);
+            std::string item = text.substr(start, separator == std::string::npos ? std::string::npos : separator - start);
+            if (!item.empty()) data.insert(data.end(), item.c_str(), item.c_str() + item.size() + 1);
+            if (separator == std::string::npos) break;
+            start = separator + 2;
+        }
+        data.push_back(0);
+    } else {
+        data.assign(text.c_str(), text.c_str() + text.size() + 1);
+    }
+    return true;
+}
+
+// Value data as printed by the command mode; the inverse of ParseValueData
+std::string FormatCliValueData(DWORD type, const std::vector<BYTE>& data) {
+    if (type == REG_SZ || type == REG_EXPAND_SZ || type == REG_DWORD) return FormatValueData(type, data);
+    std::string text;
+    if (type == REG_MULTI_SZ) {
+        const char* p = (const char*)data.data();
+        const char* end = p + data.size();
+        while (p < end && *p) {
+            size_t length = strnlen(p, end - p);
+            if (!text.empty()) text += "\\0";
+            text.append(p, length);
+            p += length + 1;
+        }
+        return text;
+    }
+    static const char digits[] = "0123456789abcdef";
+    for (BYTE b : data) {
+        text += digits[b >> 4];
+        text += digits[b & 15];
+    }
+    return text;
+}
+
+void AppendJsonString(std::string& out, const std::string& text) {
+    static const char digits[] = "0123456789abcdef";
+    out += '"';
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if ((unsigned char)c < 0x20) {
+            out += "\\u00";
+            out += digits[(unsigned char)c >> 4];
+            out += digits[c & 15];
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+// Commands:
+//   query KEY [-v NAME] [-s]             values of a key (-s: and of all subkeys)
+//   set KEY NAME DATA [-t TYPE]          create or overwrite a value (and the key); TYPE defaults to REG_SZ
+//   delete KEY [-v NAME]                 a value, or the key with all of its subkeys
+//   export KEY FILE                      .reg text, or a snapshot if FILE ends in .regsnap
+//   import FILE [-atomic]                apply a .reg file in bounded slices (-atomic: as one batch)
+//   find ROOT PATTERN [-x] [-n MAX]      substring (-x: regex) search of keys, value names and data
+//   replace KEY FIND REPLACEMENT [-x] [-c] [-name PATTERN] [-t TYPE]... [-dry]
+//                                        replace text in the string values of KEY and its subkeys
+//                                        (-x: regex, -c: match case, -dry: only list the changes)
+// find and replace ignore the case of ASCII letters only; other letters always match case.
+//   watch LOG KEY [KEY...] [-for SECONDS] log every change under the keys until Ctrl+C (or SECONDS)
+//   audit LOG [KEY] [-since T] [-until T] [-n MAX]
+//                                        changes logged under KEY; T is a UTC date/time, -30m, -2h, -7d or now
+//   diff KEY FILE PATCH                  write a .reg patch that turns KEY into its contents in FILE
+//   stats KEY [-n TOP] [-sort S]         recursive keys, values and bytes of each subkey (S: bytes, keys, name)
+//   batch FILE|- [-atomic]               one command per line; -atomic applies all edits as one batch
+// Options before the command: --json (NDJSON output), --hive FILE (work on a .reg or snapshot
+// file in memory instead of the live registry)
+int RegistryCli::Run(const std::vector<std::string>& arguments) {
+    size_t first = 0;
+    for (; first < arguments.size() && arguments[first].compare(0, 2, "--") == 0; first++) {
+        if (arguments[first] == "--json") {
+            json = true;
+        } else if (arguments[first] == "--hive" && first + 1 < arguments.size()) {
+            std::unique_ptr<RegistryBackend> hive = LoadHiveFile(arguments[++first], error, nullptr, nullptr);
+            if (!hive) {
+                fprintf(stderr, "ERROR: %s\n", error.c_str());
+                return 1;
+            }
+            registry = hive.get();
+            offlineHive = std::move(hive);
+        } else {
+            first = arguments.size();
+        }
+    }
+    if (first == arguments.size()) {
+        fprintf(stderr, "Usage: [--json] [--hive FILE] query|set|delete|export|import|find|replace|watch|audit|diff|stats|batch ...\n");
+        return 2;
+    }
+
+    bool ok = RunCommand(Arguments(arguments.begin() + first, arguments.end()), 0);
+    Flush();
+    return ok ? 0 : 1;
+}
+
+// Run one command and report its outcome; line is the batch file line (0 outside batches)
+bool RegistryCli::RunCommand(const Arguments& arguments, size_t line) {
+    error.clear();
+    details.clear();
+    std::string command = arguments[0];
+    for (char& c : command) c = (char)tolower((unsigned char)c);
+
+    bool ok;
+    if (command == "query") ok = Query(arguments);
+    else if (command == "set") ok = Set(arguments);
+    else if (command == "delete") ok = Delete(arguments);
+    else if (command == "export") ok = Export(arguments);
+    else if (command == "import") ok = Import(arguments);
+    else if (command == "find") ok = Find(arguments);
+    else if (command == "replace") ok = Replace(arguments);
+    else if (command == "watch") ok = Watch(arguments);
+    else if (command == "audit") ok = Audit(arguments);
+    else if (command == "diff") ok = Diff(arguments);
+    else if (command == "stats") ok = Stats(arguments);
+    else if (command == "batch" && !inBatch) ok = Batch(arguments);
+    else {
+        error = "Unknown command: " + arguments[0];
+        ok = false;
+    }
+    WriteResult(command, ok, line);
+    return ok;
+}
+
+bool RegistryCli::Query(const Arguments& arguments) {
+    HKEY rootKey;
+    std::string keyPath;
+    std::string valueName;
+    bool hasValueName = false, recursive = false;
+    for (size_t i = 2; i < arguments.size(); i++) {
+        if (arguments[i] == "-s") {
+            recursive = true;
+        } else if (arguments[i] == "-v" && i + 1 < arguments.size()) {
+            valueName = arguments[++i];
+            hasValueName = true;
+        } else {
+            error = "Unknown option: " + arguments[i];
+            return false;
+        }
+    }
+    if (arguments.size() < 2 || !ParseRegistryPath(arguments[1], rootKey, keyPath)) {
+        error = "Usage: query ROOT\\KEY [-v NAME] [-s]";
+        return false;
+    }
+    return QueryKey(rootKey, keyPath, hasValueName ? &valueName : nullptr, recursive);
+}
+
+// Print a key and its values (or the one named value), then its subkeys if recursive
+bool RegistryCli::QueryKey(HKEY rootKey, std::string& keyPath, const std::string* valueName, bool recursive) {
+    HKEY hKey;
+    LONG result = registry->OpenKey(rootKey, keyPath, KEY_READ, &hKey);
+    if (result != ERROR_SUCCESS) {
+        error = "Cannot open " + std::string(GetRootKeyName(rootKey)) + "\\" + keyPath + ". Error: " + std::to_string(result);
+        return false;
+    }
+
+    std::string name;
+    DWORD type;
+    std::vector<BYTE> data;
+    bool found = false;
+    if (valueName) {
+        // Only keys that have the value are listed
+        found = registry->QueryValue(hKey, *valueName, type, data) == ERROR_SUCCESS;
+        if (found) {
+            WriteKey(rootKey, keyPath);
+            WriteValue(rootKey, keyPath, *valueName, type, data);
+            if (!json) output += '\n';
+        }
+    } else {
+        WriteKey(rootKey, keyPath);
+        for (DWORD index = 0; registry->EnumValue(hKey, index, name, type, data) == ERROR_SUCCESS; index++) {
+            WriteValue(rootKey, keyPath, name, type, data);
+        }
+        if (!json) output += '\n';
+    }
+
+    std::vector<std::string> subKeys;
+    if (recursive) {
+        for (DWORD index = 0; registry->EnumKey(hKey, index, name) == ERROR_SUCCESS; index++) {
+            subKeys.push_back(name);
+        }
+    }
+    registry->CloseKey(hKey);
+    if (output.size() >= 65536) Flush();
+
+    size_t pathLength = keyPath.size();
+    for (const std::string& subKey : subKeys) {
+        if (!keyPath.empty()) keyPath += '\\';
+        keyPath += subKey;
+        if (QueryKey(rootKey, keyPath, valueName, true)) found = true; // Subkeys that vanish are skipped
+        keyPath.resize(pathLength);
+    }
+
+    if (valueName && !found) {
+        error = "Value not found: " + *valueName;
+        return false;
+    }
+    error.clear();
+    return true;
+}
+
+bool RegistryCli::Set(const Arguments& arguments) {
+    HKEY rootKey;
+    std::string keyPath;
+    DWORD type = REG_SZ;
+    for (size_t i = 4; i < arguments.size(); i++) {
+        if (arguments[i] == "-t" && i + 1 < arguments.size() && ParseValueType(arguments[i + 1], type)) {
+            i++;
+        } else {
+            error = "Unknown option or type: " + arguments[i];
+            return false;
+        }
+    }
+    if (arguments.size() < 4 || !ParseRegistryPath(arguments[1], rootKey, keyPath) || keyPath.empty()) {
+        error = "Usage: set ROOT\\KEY NAME DATA [-t REG_SZ|REG_EXPAND_SZ|REG_MULTI_SZ|REG_DWORD|REG_BINARY]";
+        return false;
+    }
+    std::string valueName = arguments[2] == "(Default)" ? std::string() : arguments[2];
+    std::vector<BYTE> data;
+    if (!ParseValueData(type, arguments[3], data)) {
+        error = std::string("Invalid ") + GetValueTypeName(type) + " data: " + arguments[3];
+        return false;
+    }
+
+    if (atomicBatch) {
+        atomicBatch->SetValue(rootKey, keyPath, valueName, type, data.data(), (DWORD)data.size());
+        return true;
+    }
+    RegistryBatch batch(*registry);
+    batch.SetValue(rootKey, keyPath, valueName, type, data.data(), (DWORD)data.size());
+    return ApplyEdits(batch);
+}
+
+bool RegistryCli::Delete(const Arguments& arguments) {
+    HKEY rootKey;
+    std::string keyPath;
+    if (arguments.size() != 2 && (arguments.size() != 4 || arguments[2] != "-v")) {
+        error = "Usage: delete ROOT\\KEY [-v NAME]";
+        return false;
+    }
+    if (!ParseRegistryPath(arguments[1], rootKey, keyPath) || keyPath.empty()) {
+        error = "Not a registry key below a root: " + arguments[1];
+        return false;
+    }
+
+    RegistryBatch batch(*registry);
+    RegistryBatch& target = atomicBatch ? *atomicBatch : batch;
+    if (arguments.size() == 4) {
+        std::string valueName = arguments[3] == "(Default)" ? std::string() : arguments[3];
+        target.DeleteValue(rootKey, keyPath, valueName);
+        if (atomicBatch) return true;
+
+        RegBatchStats stats;
+        if (!batch.Apply(error, &stats)) return false;
+        searchIndex.UpdateKey(*registry, rootKey, keyPath);
+        if (stats.valuesDeleted == 0) {
+            error = "Value not found: " + arguments[3];
+            return false;
+        }
+        return true;
+    }
+
+    if (atomicBatch) {
+        atomicBatch->DeleteKey(rootKey, keyPath);
+        return true;
+    }
+    // Whole subtrees are deleted in parallel, as from the window
+    RegDeleteProgress progress;
+    LONG result = DeleteKeyTreeParallel(*registry, rootKey, keyPath, progress);
+    if (progress.keysDeleted) searchIndex.RemoveSubtree(rootKey, keyPath);
+    subtreeStats.RemoveSubtree(rootKey, keyPath);
+    details = ",\"keysDeleted\":" + std::to_string(progress.keysDeleted);
+    if (result != ERROR_SUCCESS) {
+        error = "Failed to delete registry key. Error: " + std::to_string(result);
+        return false;
+    }
+    return true;
+}
+
+// Apply queued edits and re-read the touched keys in the search index (if it covers them)
+bool RegistryCli::ApplyEdits(RegistryBatch& batch) {
+    RegBatchStats stats;
+    if (!batch.Apply(error, &stats)) return false;
+    for (const auto& key : batch.TouchedKeys()) {
+        if (searchIndex.IsRootIndexed(key.first)) searchIndex.UpdateKey(*registry, key.first, key.second);
+        if (stats.keysDeleted) subtreeStats.RemoveSubtree(key.first, key.second);
+        else subtreeStats.InvalidateKey(key.first, key.second);
+    }
+    details = ",\"keysCreated\":" + std::to_string(stats.keysCreated) + ",\"keysDeleted\":" + std::to_string(stats.keysDeleted) +
+        ",\"valuesSet\":" + std::to_string(stats.valuesSet) + ",\"valuesDeleted\":" + std::to_string(stats.valuesDeleted);
+    return true;
+}
+
+bool RegistryCli::Export(const Arguments& arguments) {
+    HKEY rootKey;
+    std::string keyPath;
+    if (arguments.size() != 3 || !ParseRegistryPath(arguments[1], rootKey, keyPath)) {
+        error = "Usage: export ROOT\\KEY FILE";
+        return false;
+    }
+    const std::string& fileName = arguments[2];
+    bool snapshot = fileName.size() > 8 && _stricmp(fileName.c_str() + fileName.size() - 8, ".regsnap") == 0;
+    RegExportStats stats;
+    bool exported = snapshot
+        ? WriteRegSnapshot(*registry, rootKey, keyPath, fileName, error, &stats)
+        : ExportRegFile(*registry, rootKey, keyPath, fileName, error, &stats);
+    if (!exported) return false;
+
+    details = ",\"keys\":" + std::to_string(stats.keys) + ",\"values\":" + std::to_string(stats.values) +
+        ",\"skipped\":" + std::to_string(stats.skipped);
+    if (!json) {
+        output += "Exported " + std::to_string(stats.keys) + " keys, " + std::to_string(stats.values) + " values to " + fileName + "\n";
+    }
+    return true;
+}
+
+bool RegistryCli::Import(const Arguments& arguments) {
+    bool atomic = arguments.size() == 3 && arguments[2] == "-atomic";
+    if (arguments.size() != 2 && !atomic) {
+        error = "Usage: import FILE [-atomic]";
+        return false;
+    }
+    RegImportStats stats;
+    bool imported = ImportRegFile(*registry, arguments[1], error, &stats, atomic);
+    subtreeStats.Clear();
 
-    // Check if key already exists (Group 3 additional requirement)
-    if (KeyExists(rootKey, keyPath)) {
-        int result = MessageBox(hMainWindow,
-            "Key already exists! Do you want to update it?",
-            "Key Exists", MB_YESNO | MB_ICONQUESTION);
-        if (result != IDYES) {
-            return;
+    // Imported keys can be anywhere, so indexed roots are crawled again (also after a failure,
+    // which may have written part of the file)
+    for (int i = 0; i < ROOT_KEYS_COUNT; i++) {
+        if (searchIndex.IsRootIndexed(rootKeys[i].hKey)) searchIndex.IndexRoot(*registry, rootKeys[i].hKey);
+    }
+    if (!imported) return false;
+    details = ",\"keys\":" + std::to_string(stats.keys) + ",\"values\":" + std::to_string(stats.values) +
+        ",\"deletions\":" + std::to_string(stats.deletions);
+    if (!json) {
+        output += "Imported " + std::to_string(stats.keys) + " keys, " + std::to_string(stats.values) + " values, " +
+            std::to_string(stats.deletions) + " deletions\n";
+    }
+    return true;
+}
+
+bool RegistryCli::Find(const Arguments& arguments) {
+    HKEY rootKey;
+    std::string keyPath;
+    bool isRegex = false;
+    size_t maxHits = 10000;
+    for (size_t i = 3; i < arguments.size(); i++) {
+        if (arguments[i] == "-x") {
+            isRegex = true;
+        } else if (arguments[i] == "-n" && i + 1 < arguments.size()) {
+            maxHits = strtoul(arguments[++i].c_str(), nullptr, 10);
+        } else {
+            error = "Unknown option: " + arguments[i];
+            return false;
         }
     }
+    if (arguments.size() < 3 || !ParseRegistryPath(arguments[1], rootKey, keyPath) || !keyPath.empty()) {
+        error = "Usage: find ROOT PATTERN [-x] [-n MAX] (ignores the case of ASCII letters only)";
+        return false;
+    }
 
-    LONG result = RegCreateKeyEx(rootKey, keyPath.c_str(), 0, nullptr,
-        REG_OPTION_NON_VOLATILE, KEY_WRITE, nullptr, &hKey, &disposition);
+    // The index is built once per process, so later finds in a batch are cheap
+    if (!searchIndex.IsRootIndexed(rootKey)) searchIndex.IndexRoot(*registry, rootKey);
+    std::vector<RegistrySearchIndex::Hit> hits;
+    if (!searchIndex.Search(*registry, arguments[2], isRegex, maxHits, hits, error, rootKey)) return false;
 
-    if (result == ERROR_SUCCESS) {
-        RegCloseKey(hKey);
-        if (disposition == REG_CREATED_NEW_KEY) {
-            UpdateStatusBar("Registry key created successfully: " + keyPath);
+    for (const RegistrySearchIndex::Hit& hit : hits) {
+        std::string fullPath = std::string(GetRootKeyName(hit.rootKey)) + "\\" + hit.keyPath;
+        if (json) {
+            output += "{\"key\":";
+            AppendJsonString(output, fullPath);
+            if (!hit.keyMatch) {
+                output += ",\"name\":";
+                AppendJsonString(output, hit.valueName);
+                output += ",\"type\":\"";
+                output += GetValueTypeName(hit.valueType);
+                output += '"';
+            }
+            output += "}\n";
+        } else if (hit.keyMatch) {
+            output += fullPath + "\n";
         } else {
-            UpdateStatusBar("Registry key opened for update: " + keyPath);
+            output += fullPath + "    " + (hit.valueName.empty() ? "(Default)" : hit.valueName) + "    " +
+                GetValueTypeName(hit.valueType) + "\n";
         }
-        PopulateTreeView();
-    } else {
-        UpdateStatusBar("Failed to create registry key. Error: " + std::to_string(result));
-        MessageBox(hMainWindow, "Failed to create registry key!", "Error", MB_OK | MB_ICONERROR);
+        if (output.size() >= 65536) Flush();
     }
+    details = ",\"hits\":" + std::to_string(hits.size());
+    return true;
 }
 
-// Delete registry key
-void DeleteRegistryKey() {
-    std::string keyPath = GetWindowText(hEditKeyPath);
-    if (keyPath.empty()) {
-        MessageBox(hMainWindow, "Please enter a key path!", "Error", MB_OK | MB_ICONERROR);
-        return;
+bool RegistryCli::Replace(const Arguments& arguments) {
+    HKEY rootKey;
+    std::string keyPath;
+    RegReplaceOptions options;
+    bool dryRun = false;
+    bool typesGiven = false;
+    for (size_t i = 4; i < arguments.size(); i++) {
+        DWORD type;
+        if (arguments[i] == "-x") {
+            options.isRegex = true;
+        } else if (arguments[i] == "-c") {
+            options.matchCase = true;
+        } else if (arguments[i] == "-dry") {
+            dryRun = true;
+        } else if (arguments[i] == "-name" && i + 1 < arguments.size()) {
+            options.namePattern = arguments[++i];
+        } else if (arguments[i] == "-t" && i + 1 < arguments.size() && ParseValueType(arguments[i + 1], type)) {
+            if (!typesGiven) options.types.clear();
+            typesGiven = true;
+            options.types.push_back(type);
+            i++;
+        } else {
+            error = "Unknown option or type: " + arguments[i];
+            return false;
+        }
     }
+    if (arguments.size() < 4 || !ParseRegistryPath(arguments[1], rootKey, keyPath)) {
+        error = "Usage: replace KEY FIND REPLACEMENT [-x] [-c] [-name PATTERN] [-t TYPE]... [-dry] "
+            "(without -c ignores the case of ASCII letters only)";
+        return false;
+    }
+    options.pattern = arguments[2];
+    options.replacement = arguments[3];
 
-    int result = MessageBox(hMainWindow,
-        ("Are you sure you want to delete the key: " + keyPath + "?").c_str(),
-        "Confirm Delete", MB_YESNO | MB_ICONWARNING);
-
-    if (result != IDYES) return;
+    RegistryReplacer replacer(*registry);
+    if (!replacer.Prepare(options, error) || !replacer.Scan(rootKey, keyPath, error)) return false;
 
-    HKEY rootKey = GetSelectedRootKey();
-    LONG regResult = RegDeleteKey(rootKey, keyPath.c_str());
+    for (const RegReplaceChange& change : replacer.Changes()) {
+        std::string fullPath = GetRootKeyName(change.rootKey);
+        if (!change.keyPath.empty()) fullPath += "\\" + change.keyPath;
+        std::string oldText = FormatCliValueData(change.type, change.oldData);
+        std::string newText = FormatCliValueData(change.type, change.newData);
+        if (json) {
+            output += "{\"key\":";
+            AppendJsonString(output, fullPath);
+            output += ",\"name\":";
+            AppendJsonString(output, change.name);
+            output += ",\"type\":\"";
+            output += GetValueTypeName(change.type);
+            output += "\",\"old\":";
+            AppendJsonString(output, oldText);
+            output += ",\"new\":";
+            AppendJsonString(output, newText);
+            output += "}\n";
+        } else {
+            output += fullPath + "    " + (change.name.empty() ? "(Default)" : change.name) + "    " +
+                GetValueTypeName(change.type) + "    " + oldText + " -> " + newText + "\n";
+        }
+        if (output.size() >= 65536) Flush();
+    }
 
-    if (regResult == ERROR_SUCCESS) {
-        UpdateStatusBar("Registry key deleted successfully: " + keyPath);
-        PopulateTreeView();
-        ListView_DeleteAllItems(hListView);
-    } else {
-        UpdateStatusBar("Failed to delete registry key. Error: " + std::to_string(regResult));
-        MessageBox(hMainWindow, "Failed to delete registry key!", "Error", MB_OK | MB_ICONERROR);
+    if (!dryRun && !replacer.Changes().empty()) {
+        if (atomicBatch) {
+            replacer.QueueChanges(*atomicBatch);
+        } else {
+            RegistryBatch batch(*registry);
+            replacer.QueueChanges(batch);
+            if (!ApplyEdits(batch)) return false;
+        }
     }
+    const RegReplaceStats& stats = replacer.Stats();
+    details += ",\"keysScanned\":" + std::to_string(stats.keysScanned) + ",\"valuesScanned\":" + std::to_string(stats.valuesScanned) +
+        ",\"valuesChanged\":" + std::to_string(stats.valuesChanged) + ",\"replacements\":" + std::to_string(stats.replacements) +
+        ",\"dryRun\":" + (dryRun ? "true" : "false");
+    if (!json) {
+        output += std::string(dryRun ? "Would replace " : atomicBatch ? "Queued " : "Replaced ") + std::to_string(stats.replacements) + " matches in " +
+            std::to_string(stats.valuesChanged) + " values (" + std::to_string(stats.valuesScanned) + " values in " +
+            std::to_string(stats.keysScanned) + " keys scanned)\n";
+    }
+    return true;
 }
 
-// Set registry value
-void SetRegistryValue() {
-    std::string keyPath = GetWindowText(hEditKeyPath);
-    std::string valueName = GetWindowText(hEditValueName);
-    std::string valueData = GetWindowText(hEditValueData);
+std::atomic<bool> cliInterrupted{ false };
 
-    if (keyPath.empty() || valueName.empty()) {
-        MessageBox(hMainWindow, "Please enter key path and value name!", "Error", MB_OK | MB_ICONERROR);
-        return;
+BOOL WINAPI OnCliInterrupt(DWORD ctrlType) {
+    if (ctrlType != CTRL_C_EVENT && ctrlType != CTRL_BREAK_EVENT) return FALSE;
+    cliInterrupted = true;
+    return TRUE;
+}
+
+bool RegistryCli::Watch(const Arguments& arguments) {
+    std::vector<std::pair<HKEY, std::string>> subtrees;
+    DWORD seconds = 0;
+    for (size_t i = 2; i < arguments.size(); i++) {
+        HKEY rootKey;
+        std::string keyPath;
+        if (arguments[i] == "-for" && i + 1 < arguments.size()) {
+            seconds = strtoul(arguments[++i].c_str(), nullptr, 10);
+        } else if (ParseRegistryPath(arguments[i], rootKey, keyPath)) {
+            subtrees.push_back({ rootKey, keyPath });
+        } else {
+            error = "Unknown option or key: " + arguments[i];
+            return false;
+        }
+    }
+    if (subtrees.empty()) {
+        error = "Usage: watch LOG KEY [KEY...] [-for SECONDS]";
+        return false;
     }
 
-    HKEY rootKey = GetSelectedRootKey();
-    HKEY hKey;
+    RegistryAuditLog log;
+    if (!log.Open(arguments[1], false, error)) return false;
+    RegistryAuditWatcher watcher(*registry, log);
+    if (!watcher.Start(subtrees, error)) return false;
 
-    LONG result = RegOpenKeyEx(rootKey, keyPath.c_str(), 0, KEY_WRITE, &hKey);
-    if (result != ERROR_SUCCESS) {
-        UpdateStatusBar("Failed to open registry key for writing. Error: " + std::to_string(result));
-        MessageBox(hMainWindow, "Failed to open registry key!", "Error", MB_OK | MB_ICONERROR);
-        return;
+    cliInterrupted = false;
+    SetConsoleCtrlHandler(OnCliInterrupt, TRUE);
+    if (!json) {
+        output += "Watching " + std::to_string(subtrees.size()) + (subtrees.size() == 1 ? " key" : " keys") +
+            "; press Ctrl+C to stop\n";
+        Flush();
     }
 
-    result = RegSetValueEx(hKey, valueName.c_str(), 0, REG_SZ,
-        (const BYTE*)valueData.c_str(), valueData.length() + 1);
+    size_t recorded = 0;
+    DWORD startTime = GetTickCount();
+    while (!cliInterrupted && (!seconds || GetTickCount() - startTime < seconds * 1000)) {
+        for (const AuditRecord& record : watcher.TakeRecords(500)) {
+            WriteAuditRecord(log, record);
+            recorded++;
+        }
+        Flush();
+    }
+    watcher.Stop();
+    for (const AuditRecord& record : watcher.TakeRecords(0)) {
+        WriteAuditRecord(log, record);
+        recorded++;
+    }
+    SetConsoleCtrlHandler(OnCliInterrupt, FALSE);
 
-    RegCloseKey(hKey);
+    if (!log.Flush(error)) return false;
+    details = ",\"recorded\":" + std::to_string(recorded) + ",\"blocks\":" + std::to_string(log.BlockCount());
+    return true;
+}
 
-    if (result == ERROR_SUCCESS) {
-        UpdateStatusBar("Registry value set successfully: " + valueName);
-        OnTreeSelectionChanged(); // Refresh values list
-    } else {
-        UpdateStatusBar("Failed to set registry value. Error: " + std::to_string(result));
-        MessageBox(hMainWindow, "Failed to set registry value!", "Error", MB_OK | MB_ICONERROR);
+bool RegistryCli::Audit(const Arguments& arguments) {
+    HKEY rootKey = nullptr;
+    std::string keyPath;
+    bool filtered = false;
+    uint64_t from = 0, to = UINT64_MAX;
+    size_t maxRecords = SIZE_MAX;
+    for (size_t i = 2; i < arguments.size(); i++) {
+        if (arguments[i] == "-since" && i + 1 < arguments.size()) {
+            if (!ParseAuditTime(arguments[++i], from)) {
+                error = "Invalid time: " + arguments[i];
+                return false;
+            }
+        } else if (arguments[i] == "-until" && i + 1 < arguments.size()) {
+            if (!ParseAuditTime(arguments[++i], to)) {
+                error = "Invalid time: " + arguments[i];
+                return false;
+            }
+        } else if (arguments[i] == "-n" && i + 1 < arguments.size()) {
+            maxRecords = strtoul(arguments[++i].c_str(), nullptr, 10);
+        } else if (!filtered && ParseRegistryPath(arguments[i], rootKey, keyPath)) {
+            filtered = true;
+        } else {
+            error = "Unknown option or key: " + arguments[i];
+            return false;
+        }
+    }
+    if (arguments.size() < 2) {
+        error = "Usage: audit LOG [KEY] [-since T] [-until T] [-n MAX]";
+        return false;
     }
-}
 
-// Delete registry value
-void DeleteRegistryValue() {
-    std::string keyPath = GetWindowText(hEditKeyPath);
-    std::string valueName = GetWindowText(hEditValueName);
+    RegistryAuditLog log;
+    if (!log.Open(arguments[1], true, error)) return false;
+    std::vector<AuditRecord> records;
+    if (!log.Query(rootKey, filtered ? &keyPath : nullptr, from, to, maxRecords, records, error)) return false;
 
-    if (keyPath.empty() || valueName.empty()) {
-        MessageBox(hMainWindow, "Please enter key path and value name!", "Error", MB_OK | MB_ICONERROR);
-        return;
+    for (const AuditRecord& record : records) WriteAuditRecord(log, record);
+    details = ",\"records\":" + std::to_string(records.size()) + ",\"blocksRead\":" + std::to_string(log.BlocksRead()) +
+        ",\"blocks\":" + std::to_string(log.BlockCount());
+    if (!json) {
+        output += std::to_string(records.size()) + " changes (read " + std::to_string(log.BlocksRead()) + " of " +
+            std::to_string(log.BlockCount()) + " blocks)\n";
     }
+    return true;
+}
 
-    int result = MessageBox(hMainWindow,
-        ("Are you sure you want to delete the value: " + valueName + "?").c_str(),
-        "Confirm Delete", MB_YESNO | MB_ICONWARNING);
+bool RegistryCli::Diff(const Arguments& arguments) {
+    HKEY rootKey;
+    std::string keyPath;
+    if (arguments.size() != 4 || !ParseRegistryPath(arguments[1], rootKey, keyPath)) {
+        error = "Usage: diff ROOT\\KEY FILE PATCH";
+        return false;
+    }
+    RegDiffStats stats;
+    std::unique_ptr<RegistryBackend> other = LoadHiveFile(arguments[2], error, nullptr, nullptr);
+    if (!other || !DiffRegistry({ registry, rootKey, keyPath }, { other.get(), rootKey, keyPath }, arguments[3], error, &stats)) {
+        return false;
+    }
 
-    if (result != IDYES) return;
+    details = ",\"keysCompared\":" + std::to_string(stats.keysCompared) + ",\"keysAdded\":" + std::to_string(stats.keysAdded) +
+        ",\"keysRemoved\":" + std::to_string(stats.keysRemoved) + ",\"valuesAdded\":" + std::to_string(stats.valuesAdded) +
+        ",\"valuesRemoved\":" + std::to_string(stats.valuesRemoved) + ",\"valuesChanged\":" + std::to_string(stats.valuesChanged);
+    if (!json) {
+        output += "Patch saved to " + arguments[3] + ": " + std::to_string(stats.keysAdded) + " keys added, " +
+            std::to_string(stats.keysRemoved) + " removed; values " + std::to_string(stats.valuesAdded) + " added, " +
+            std::to_string(stats.valuesRemoved) + " removed, " + std::to_string(stats.valuesChanged) + " changed\n";
+    }
+    return true;
+}
 
-    HKEY rootKey = GetSelectedRootKey();
-    HKEY hKey;
+bool RegistryCli::Stats(const Arguments& arguments) {
+    HKEY rootKey;
+    std::string keyPath;
+    size_t top = SIZE_MAX;
+    int sortColumn = 2;
+    for (size_t i = 2; i < arguments.size(); i++) {
+        if (arguments[i] == "-n" && i + 1 < arguments.size()) {
+            top = strtoul(arguments[++i].c_str(), nullptr, 10);
+        } else if (arguments[i] == "-sort" && i + 1 < arguments.size()) {
+            const std::string& column = arguments[++i];
+            sortColumn = column == "name" ? 0 : column == "keys" ? 1 : 2;
+        } else {
+            error = "Unknown option: " + arguments[i];
+            return false;
+        }
+    }
+    if (arguments.size() < 2 || !ParseRegistryPath(arguments[1], rootKey, keyPath)) {
+        error = "Usage: stats ROOT\\KEY [-n TOP] [-sort bytes|keys|name]";
+        return false;
+    }
 
-    LONG regResult = RegOpenKeyEx(rootKey, keyPath.c_str(), 0, KEY_WRITE, &hKey);
-    if (regResult == ERROR_SUCCESS) {
-        regResult = RegDeleteValue(hKey, valueName.c_str());
-        RegCloseKey(hKey);
+    SubtreeStats total;
+    std::vector<std::pair<std::string, SubtreeStats>> children;
+    if (!subtreeStats.ComputeChildren(*registry, rootKey, keyPath, total, children, nullptr)) {
+        error = "Cannot open " + arguments[1];
+        return false;
+    }
+    std::sort(children.begin(), children.end(),
+        [sortColumn](const std::pair<std::string, SubtreeStats>& a, const std::pair<std::string, SubtreeStats>& b) {
+            if (sortColumn == 0) return RegistryNameLess()(a.first, b.first);
+            if (sortColumn == 1 && a.second.keys != b.second.keys) return a.second.keys > b.second.keys;
+            return a.second.valueBytes > b.second.valueBytes;
+        });
+    if (children.size() > top) children.resize(top);
 
-        if (regResult == ERROR_SUCCESS) {
-            UpdateStatusBar("Registry value deleted successfully: " + valueName);
-            OnTreeSelectionChanged(); // Refresh values list
+    std::string fullPath = std::string(GetRootKeyName(rootKey)) + (keyPath.empty() ? "" : "\\") + keyPath;
+    for (const auto& child : children) {
+        if (json) {
+            output += "{\"key\":";
+            AppendJsonString(output, fullPath + "\\" + child.first);
+            output += ",\"keys\":" + std::to_string(child.second.keys) + ",\"values\":" + std::to_string(child.second.values) +
+                ",\"bytes\":" + std::to_string(child.second.valueBytes) + "}\n";
         } else {
-            UpdateStatusBar("Failed to delete registry value. Error: " + std::to_string(regResult));
-            MessageBox(hMainWindow, "Failed to delete registry value!", "Error", MB_OK | MB_ICONERROR);
+            char line[64];
+            snprintf(line, sizeof(line), "%12llu %12llu %12s    ", (unsigned long long)child.second.keys,
+                (unsigned long long)child.second.values, FormatByteSize(child.second.valueBytes).c_str());
+            output += line + child.first + "\n";
         }
-    } else {
-        UpdateStatusBar("Failed to open registry key. Error: " + std::to_string(regResult));
-        MessageBox(hMainWindow, "Failed to open registry key!", "Error", MB_OK | MB_ICONERROR);
     }
+    details = ",\"keys\":" + std::to_string(total.keys) + ",\"values\":" + std::to_string(total.values) +
+        ",\"bytes\":" + std::to_string(total.valueBytes);
+    if (!json) {
+        output += fullPath + ": " + std::to_string(total.keys) + " keys, " + std::to_string(total.values) + " values, " +
+            FormatByteSize(total.valueBytes) + "\n";
+    }
+    return true;
 }
 
-// Save registry to file
-void SaveRegistryToFile() {
-    OPENFILENAME ofn;
-    char szFile[260] = {0};
-
-    ZeroMemory(&ofn, sizeof(ofn));
-    ofn.lStructSize = sizeof(ofn);
-    ofn.hwndOwner = hMainWindow;
-    ofn.lpstrFile = szFile;
-    ofn.nMaxFile = sizeof(szFile);
-    ofn.lpstrFilter = "Registry Files\\0*.reg\\0Text Files\\0*.txt\\0All Files\\0*.*\\0";
-    ofn.nFilterIndex = 1;
-    ofn.lpstrFileTitle = nullptr;
-    ofn.nMaxFileTitle = 0;
-    ofn.lpstrInitialDir = nullptr;
-    ofn.Flags = OFN_PATHMUSTEXIST | OFN_FILEMUSTEXIST | OFN_OVERWRITEPROMPT;
+// Run a file of commands (or standard input) in this process. Blank lines and lines starting
+// with # are skipped. With -atomic every set and delete is queued into one RegistryBatch that
+// is applied after the last line, so either all of them take effect or none; queries in the
+// file then see the registry as it was before the batch.
+bool RegistryCli::Batch(const Arguments& arguments) {
+    bool atomic = arguments.size() == 3 && arguments[2] == "-atomic";
+    if (arguments.size() != 2 && !atomic) {
+        error = "Usage: batch FILE|- [-atomic]";
+        return false;
+    }
 
-    if (GetSaveFileName(&ofn)) {
-        std::string keyPath = GetWindowText(hEditKeyPath);
-        if (keyPath.empty()) {
-            MessageBox(hMainWindow, "Please select a key to save!", "Error", MB_OK | MB_ICONERROR);
-            return;
+    // File names are UTF-8, so the file is read through the wide API rather than an ifstream
+    MappedFile mapped;
+    std::istringstream file;
+    if (arguments[1] != "-") {
+        if (!mapped.Open(arguments[1])) {
+            error = "Cannot open batch file: " + arguments[1];
+            return false;
         }
+        size_t bom = mapped.Size() >= 3 && memcmp(mapped.Data(), "\xEF\xBB\xBF", 3) == 0 ? 3 : 0;
+        if (mapped.Size()) file.str(std::string(mapped.Data() + bom, mapped.Size() - bom));
+    }
+    std::istream& input = arguments[1] == "-" ? std::cin : file;
 
-        std::ofstream file(szFile);
-        if (file.is_open()) {
-            file << "Windows Registry Editor Version 5.00\
-\
-";
+    RegistryBatch batch(*registry);
+    if (atomic) atomicBatch = &batch;
+    inBatch = true;
 
-            HKEY rootKey = GetSelectedRootKey();
-            std::string rootKeyName;
-            for (int i = 0; i < ROOT_KEYS_COUNT; i++) {
-                if (rootKeys[i].hKey == rootKey) {
-                    rootKeyName = rootKeys[i].name;
-                    break;
-                }
-            }
+    size_t lineNumber = 0, commands = 0, failed = 0;
+    std::string line;
+    while (std::getline(input, line)) {
+        lineNumber++;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        Arguments lineArguments = SplitCommandLine(line);
+        if (lineArguments.empty() || lineArguments[0][0] == '#') continue;
+        commands++;
+        if (!RunCommand(lineArguments, lineNumber)) failed++;
+    }
+    inBatch = false;
+    atomicBatch = nullptr;
 
-            file << "[" << rootKeyName << "\\\\" << keyPath << "]";
+    error.clear();
+    details.clear();
+    if (atomic) {
+        if (failed) {
+            error = std::to_string(failed) + " of " + std::to_string(commands) + " commands failed; no edits were applied";
+            return false;
+        }
+        if (!ApplyEdits(batch)) return false;
+    }
+    details += ",\"commands\":" + std::to_string(commands) + ",\"failed\":" + std::to_string(failed);
+    if (failed) error = std::to_string(failed) + " of " + std::to_string(commands) + " commands failed";
+    return failed == 0;
+}
 
-            // Save values
-            HKEY hKey;
-            if (RegOpenKeyEx(rootKey, keyPath.c_str(), 0, KEY_READ, &hKey) == ERROR_SUCCESS) {
-                char valueName[256];
-                DWORD valueNameSize = sizeof(valueName);
-                DWORD valueType;
-                BYTE valueData[1024];
-                DWORD valueDataSize = sizeof(valueData);
-                DWORD index = 0;
-
-                while (RegEnumValue(hKey, index++, valueName, &valueNameSize, nullptr, &valueType, valueData, &valueDataSize) == ERROR_SUCCESS) {
-                    file << "\"" << valueName << "\"=";
-
-                    if (valueType == REG_SZ) {
-                        file << "\"" << (char*)valueData << "\"";
-                    } else if (valueType == REG_DWORD) {
-                        file << "dword:" << std::hex << *(DWORD*)valueData << "";
-                    }
+void RegistryCli::WriteKey(HKEY rootKey, const std::string& keyPath) {
+    std::string fullPath = GetRootKeyName(rootKey);
+    if (!keyPath.empty()) fullPath += "\\" + keyPath;
+    if (json) {
+        output += "{\"key\":";
+        AppendJsonString(output, fullPath);
+        output += "}\n";
+    } else {
+        output += fullPath + "\n";
+    }
+}
 
-                    valueNameSize = sizeof(valueName);
-                    valueDataSize = sizeof(valueData);
-                }
+void RegistryCli::WriteValue(HKEY rootKey, const std::string& keyPath, const std::string& name, DWORD type,
+                             const std::vector<BYTE>& data) {
+    if (json) {
+        std::string fullPath = GetRootKeyName(rootKey);
+        if (!keyPath.empty()) fullPath += "\\" + keyPath;
+        output += "{\"key\":";
+        AppendJsonString(output, fullPath);
+        output += ",\"name\":";
+        AppendJsonString(output, name);
+        output += ",\"type\":\"";
+        output += GetValueTypeName(type);
+        output += "\",\"data\":";
+        AppendJsonString(output, FormatCliValueData(type, data));
+        output += "}\n";
+    } else {
+        output += "    " + (name.empty() ? std::string("(Default)") : name) + "    " + GetValueTypeName(type) + "    " +
+            FormatCliValueData(type, data) + "\n";
+    }
+}
 
-                RegCloseKey(hKey);
-            }
+// One audit record per line: time, key, change and value hashes
+void RegistryCli::WriteAuditRecord(const RegistryAuditLog& log, const AuditRecord& record) {
+    HKEY rootKey;
+    std::string keyPath;
+    log.KeyLocation(record.keyId, rootKey, keyPath);
+    std::string fullPath = GetRootKeyName(rootKey);
+    if (!keyPath.empty()) fullPath += "\\" + keyPath;
+    char hashes[48];
+    snprintf(hashes, sizeof(hashes), "%016llx -> %016llx", (unsigned long long)record.oldHash, (unsigned long long)record.newHash);
 
-            file.close();
-            UpdateStatusBar("Registry saved to file: " + std::string(szFile));
+    if (json) {
+        output += "{\"time\":\"" + FormatAuditTime(record.time) + "\",\"key\":";
+        AppendJsonString(output, fullPath);
+        if (record.kind == AuditValueChange) {
+            output += ",\"name\":";
+            AppendJsonString(output, record.valueName);
+        }
+        output += ",\"change\":\"";
+        output += GetAuditChangeName(record);
+        output += '"';
+        if (record.kind == AuditValueChange) {
+            output += ",\"old\":\"" + std::string(hashes, 16) + "\",\"new\":\"" + std::string(hashes + 20, 16) + '"';
+        }
+        output += "}\n";
+    } else {
+        output += FormatAuditTime(record.time) + "    " + fullPath + "    ";
+        if (record.kind == AuditValueChange) {
+            output += (record.valueName.empty() ? "(Default)" : record.valueName) + "    " + GetAuditChangeName(record) +
+                "    " + hashes + "\n";
         } else {
-            MessageBox(hMainWindow, "Failed to create file!", "Error", MB_OK | MB_ICONERROR);
+            output += std::string(GetAuditChangeName(record)) + "\n";
         }
     }
+    if (output.size() >= 65536) Flush();
 }
 
-// Load registry from file
-void LoadRegistryFromFile() {
-    OPENFILENAME ofn;
-    char szFile[260] = {0};
+// NDJSON: a result object after every command. Text: only errors, on stderr.
+void RegistryCli::WriteResult(const std::string& command, bool ok, size_t line) {
+    if (json) {
+        output += "{\"command\":";
+        AppendJsonString(output, command);
+        if (line) output += ",\"line\":" + std::to_string(line);
+        output += ok ? ",\"ok\":true" : ",\"ok\":false,\"error\":";
+        if (!ok) AppendJsonString(output, error);
+        output += details;
+        output += "}\n";
+    } else if (!ok) {
+        Flush();
+        if (line) fprintf(stderr, "ERROR (line %zu): %s\n", line, error.c_str());
+        else fprintf(stderr, "ERROR: %s\n", error.c_str());
+    }
+    if (output.size() >= 65536) Flush();
+}
 
-    ZeroMemory(&ofn, sizeof(ofn));
-    ofn.lStructSize = sizeof(ofn);
-    ofn.hwndOwner = hMainWindow;
-    ofn.lpstrFile = szFile;
-    ofn.nMaxFile = sizeof(szFile);
-    ofn.lpstrFilter = "Registry Files\\0*.reg\\0Text Files\\0*.txt\\0All Files\\0*.*\\0";
-    ofn.nFilterIndex = 1;
-    ofn.lpstrFileTitle = nullptr;
-    ofn.nMaxFileTitle = 0;
-    ofn.lpstrInitialDir = nullptr;
-    ofn.Flags = OFN_PATHMUSTEXIST | OFN_FILEMUSTEXIST;
+void RegistryCli::Flush() {
+    fwrite(output.data(), 1, output.size(), stdout);
+    fflush(stdout);
+    output.clear();
+}
+
+// Allocation counters for the benchmarks. Every operator new in the program goes through
+// here, but only counts once --bench has switched counting on. Each thread counts into its own
+// slot with plain stores, so allocation never does an atomic read-modify-write; a benchmark
+// phase sums the slots of live threads and what exited threads left behind.
+struct AllocationCounter {
+    AllocationCounter();
+    ~AllocationCounter();
+
+    std::atomic<size_t> count{ 0 };
+    std::atomic<size_t> bytes{ 0 };
+    AllocationCounter* next = nullptr;
+};
+
+std::atomic<bool> countAllocations{ false };
+std::mutex allocationCountersMutex;
+AllocationCounter* allocationCounters = nullptr; // Live threads that have allocated while counting
+size_t exitedAllocationCount = 0;
+size_t exitedAllocationBytes = 0;
+thread_local AllocationCounter threadAllocations;
+thread_local bool threadAllocationsGone = false; // Thread exit has already folded the slot in
+
+AllocationCounter::AllocationCounter() {
+    std::lock_guard<std::mutex> lock(allocationCountersMutex);
+    next = allocationCounters;
+    allocationCounters = this;
+}
+
+AllocationCounter::~AllocationCounter() {
+    std::lock_guard<std::mutex> lock(allocationCountersMutex);
+    AllocationCounter** link = &allocationCounters;
+    while (*link != this) link = &(*link)->next;
+    *link = next;
+    exitedAllocationCount += count;
+    exitedAllocationBytes += bytes;
+    threadAllocationsGone = true;
+}
 
-    if (GetOpenFileName(&ofn)) {
-        std::ifstream file(szFile);
-        if (file.is_open()) {
-            std::string line;
-            bool success = false;
+void ReadAllocationCounters(size_t& count, size_t& bytes) {
+    std::lock_guard<std::mutex> lock(allocationCountersMutex);
+    count = exitedAllocationCount;
+    bytes = exitedAllocationBytes;
+    for (AllocationCounter* counter = allocationCounters; counter; counter = counter->next) {
+        count += counter->count.load(std::memory_order_relaxed);
+        bytes += counter->bytes.load(std::memory_order_relaxed);
+    }
+}
+
+void* operator new(size_t size) {
+    if (countAllocations.load(std::memory_order_relaxed) && !threadAllocationsGone) {
+        AllocationCounter& counter = threadAllocations;
+        counter.count.store(counter.count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        counter.bytes.store(counter.bytes.load(std::memory_order_relaxed) + size, std::memory_order_relaxed);
+    }
+    if (void* block = malloc(size ? size : 1)) return block;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* block) noexcept { free(block); }
+void operator delete[](void* block) noexcept { free(block); }
+void operator delete(void* block, size_t) noexcept { free(block); }
+void operator delete[](void* block, size_t) noexcept { free(block); }
+
+// Shape of a synthetic hive. With a depth the fan-out is derived from the key count.
+struct BenchConfig {
+    size_t keys = 0;
+    unsigned depth = 0;
+    unsigned fanout = 10;
+    unsigned values = 4;
+    unsigned valueSize = 32;
+};
+
+// Time, allocations and peak memory of one benchmark phase
+class BenchPhase {
+public:
+    BenchPhase(const char* name, size_t items) : name(name), items(items) {
+        ReadAllocationCounters(startCount, startBytes);
+        start = std::chrono::steady_clock::now();
+    }
+
+    void Report(size_t itemCount) { items = itemCount; }
+
+    ~BenchPhase() {
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        size_t endCount, endBytes;
+        ReadAllocationCounters(endCount, endBytes);
+        PROCESS_MEMORY_COUNTERS memory = {};
+        memory.cb = sizeof(memory);
+        GetProcessMemoryInfo(GetCurrentProcess(), &memory, sizeof(memory));
+        printf("  %-14s %10.1f ms %14.0f items/s %12zu allocs %10.1f MB allocated %8.1f MB peak\n",
+            name, ms, ms > 0 ? items * 1000.0 / ms : 0.0, endCount - startCount,
+            (endBytes - startBytes) / 1048576.0, memory.PeakWorkingSetSize / 1048576.0);
+        fflush(stdout);
+    }
+
+private:
+    const char* name;
+    size_t items;
+    size_t startCount;
+    size_t startBytes;
+    std::chrono::steady_clock::time_point start;
+};
+
+// Build a synthetic hive breadth-first below HKEY_CURRENT_USER\Bench through the backend interface.
+// Values cycle through the common types; string and binary data are valueSize bytes long.
+size_t GenerateBenchHive(RegistryBackend& backend, const BenchConfig& config, size_t& valueCount) {
+    unsigned fanout = config.fanout;
+    if (config.depth > 0) {
+        fanout = std::max(2u, (unsigned)ceil(pow((double)config.keys, 1.0 / config.depth)));
+    }
 
-            while (std::getline(file, line)) {
-                if (line.find("Windows Registry Editor") != std::string::npos) {
-                    success = true;
+    std::string text(config.valueSize ? config.valueSize - 1 : 0, 'x');
+    std::vector<BYTE> binary(config.valueSize);
+    for (size_t i = 0; i < binary.size(); i++) binary[i] = (BYTE)i;
+
+    std::deque<std::string> parents = { "Bench" };
+    size_t keyCount = 0;
+    valueCount = 0;
+    HKEY hKey;
+    while (!parents.empty() && keyCount < config.keys) {
+        std::string parent = std::move(parents.front());
+        parents.pop_front();
+        for (unsigned child = 0; child < fanout && keyCount < config.keys; child++) {
+            std::string keyPath = parent + "\\Key" + std::to_string(keyCount);
+            if (backend.CreateKey(HKEY_CURRENT_USER, keyPath, KEY_WRITE, &hKey, nullptr) != ERROR_SUCCESS) continue;
+            for (unsigned value = 0; value < config.values; value++) {
+                std::string name = "Value" + std::to_string(value);
+                DWORD number = (DWORD)(keyCount * 31 + value);
+                switch (value % 4) {
+                case 0:
+                    backend.SetValue(hKey, name, REG_SZ, (const BYTE*)text.c_str(), (DWORD)text.size() + 1);
+                    break;
+                case 1:
+                    backend.SetValue(hKey, name, REG_DWORD, (const BYTE*)&number, sizeof(number));
+                    break;
+                case 2:
+                    backend.SetValue(hKey, name, REG_BINARY, binary.data(), (DWORD)binary.size());
+                    break;
+                default:
+                    backend.SetValue(hKey, name, REG_EXPAND_SZ, (const BYTE*)"%SystemRoot%\\system32", 22);
                     break;
                 }
+                valueCount++;
             }
+            backend.CloseKey(hKey);
+            parents.push_back(std::move(keyPath));
+            keyCount++;
+        }
+    }
+    return keyCount;
+}
 
-            file.close();
+// Walk the subtree the way the tree view and values list do: subkeys and values of every key,
+// tree nodes and their full paths, and formatted value rows. Counts keys and rows.
+void WalkBenchKey(RegistryBackend& backend, TreeNodeTable& nodes, uint32_t nodeId, ValueListModel* rows,
+                  std::string& keyPath, size_t& keyCount, size_t& rowCount) {
+    HKEY hKey;
+    if (backend.OpenKey(HKEY_CURRENT_USER, keyPath, KEY_READ, &hKey) != ERROR_SUCCESS) return;
+    keyCount++;
 
-            if (success) {
-                UpdateStatusBar("Registry file loaded: " + std::string(szFile));
-                MessageBox(hMainWindow, "Registry file loaded successfully!\
-Note: This is a simplified implementation.", "Success", MB_OK | MB_ICONINFORMATION);
-                PopulateTreeView();
-            } else {
-                MessageBox(hMainWindow, "Invalid registry file format!", "Error", MB_OK | MB_ICONERROR);
-            }
+    std::vector<std::string> subKeys;
+    std::string name;
+    for (DWORD index = 0; backend.EnumKey(hKey, index, name) == ERROR_SUCCESS; index++) {
+        subKeys.push_back(name);
+    }
+    if (!rows) {
+        DWORD type;
+        std::vector<BYTE> data;
+        for (DWORD index = 0; backend.EnumValue(hKey, index, name, type, data) == ERROR_SUCCESS; index++) rowCount++;
+    }
+    backend.CloseKey(hKey);
+
+    if (rows && rows->Open(backend, HKEY_CURRENT_USER, keyPath, nullptr)) {
+        for (size_t row = 0; row < rows->RowCount(); row++) {
+            if (rows->GetRow(row)) rowCount++;
+        }
+        rows->Reset();
+    }
+
+    size_t pathLength = keyPath.size();
+    for (const std::string& subKey : subKeys) {
+        uint32_t childId = nodeId;
+        if (nodeId != TreeNodeTable::NO_NODE) {
+            childId = nodes.AddChild(nodeId, subKey);
+            nodes.BuildPath(childId, keyPath); // Path built from the node table, as for tree items
         } else {
-            MessageBox(hMainWindow, "Failed to open file!", "Error", MB_OK | MB_ICONERROR);
+            keyPath += '\\';
+            keyPath += subKey;
         }
+        WalkBenchKey(backend, nodes, childId, rows, keyPath, keyCount, rowCount);
+        keyPath.resize(pathLength);
     }
 }
 
-// Check if key exists (Group 3 additional feature)
-void CheckKeyExists() {
-    std::string keyPath = GetWindowText(hEditKeyPath);
-    if (keyPath.empty()) {
-        MessageBox(hMainWindow, "Please enter a key path!", "Error", MB_OK | MB_ICONERROR);
-        return;
-    }
+// Run every phase over one synthetic hive
+void RunBenchmarkHive(const BenchConfig& config) {
+    printf("\n%zu keys, %u values of %u bytes per key, %s %u\n", config.keys, config.values, config.valueSize,
+        config.depth ? "depth" : "fan-out", config.depth ? config.depth : config.fanout);
 
-    HKEY rootKey = GetSelectedRootKey();
-    bool exists = KeyExists(rootKey, keyPath);
+    WCHAR tempPath[MAX_PATH];
+    DWORD tempLength = GetTempPathW(MAX_PATH, tempPath);
+    std::string exportFile = WideToUtf8(tempPath, tempLength) + "regbench.reg";
 
-    std::string message = "Key '" + keyPath + "' ";
-    message += exists ? "EXISTS" : "DOES NOT EXIST";
+    std::unique_ptr<MemoryRegistryBackend> hive(new MemoryRegistryBackend());
+    size_t keyCount = 0, valueCount = 0;
+    {
+        BenchPhase phase("generate", config.keys);
+        keyCount = GenerateBenchHive(*hive, config, valueCount);
+        phase.Report(keyCount);
+    }
+    {
+        BenchPhase phase("enumerate", keyCount);
+        TreeNodeTable nodes;
+        std::string keyPath = "Bench";
+        size_t keys = 0, rows = 0;
+        WalkBenchKey(*hive, nodes, TreeNodeTable::NO_NODE, nullptr, keyPath, keys, rows);
+    }
+    {
+        BenchPhase phase("build paths", keyCount);
+        TreeNodeTable nodes;
+        uint32_t rootNode = nodes.AddRoot(HKEY_CURRENT_USER);
+        std::string keyPath = "Bench";
+        size_t keys = 0, rows = 0;
+        WalkBenchKey(*hive, nodes, nodes.AddChild(rootNode, "Bench"), nullptr, keyPath, keys, rows);
+    }
+    {
+        BenchPhase phase("format values", valueCount);
+        TreeNodeTable nodes;
+        ValueListModel rowModel;
+        std::string keyPath = "Bench";
+        size_t keys = 0, rows = 0;
+        WalkBenchKey(*hive, nodes, TreeNodeTable::NO_NODE, &rowModel, keyPath, keys, rows);
+        phase.Report(rows);
+    }
 
-    MessageBox(hMainWindow, message.c_str(), "Key Check Result",
-        MB_OK | (exists ? MB_ICONINFORMATION : MB_ICONWARNING));
+    std::string error;
+    RegExportStats exportStats;
+    {
+        BenchPhase phase("export", keyCount);
+        if (!ExportRegFile(*hive, HKEY_CURRENT_USER, "Bench", exportFile, error, &exportStats)) {
+            printf("  export failed: %s\n", error.c_str());
+        }
+    }
+    {
+        std::unique_ptr<MemoryRegistryBackend> imported(new MemoryRegistryBackend());
+        BenchPhase phase("import", keyCount);
+        if (!ImportRegFile(*imported, exportFile, error)) printf("  import failed: %s\n", error.c_str());
+    }
+    DeleteFileW(Utf8ToWide(exportFile).c_str());
 
-    UpdateStatusBar(message);
+    RegistrySearchIndex index;
+    {
+        BenchPhase phase("index", keyCount);
+        index.IndexRoot(*hive, HKEY_CURRENT_USER);
+    }
+    {
+        const size_t queryCount = 100;
+        BenchPhase phase("search", queryCount);
+        std::vector<RegistrySearchIndex::Hit> hits;
+        for (size_t query = 0; query < queryCount; query++) {
+            std::string pattern = "Key" + std::to_string((query * 7919) % std::max<size_t>(keyCount, 1)) + "\\";
+            index.Search(*hive, pattern, false, 1000, hits, error);
+        }
+    }
+    printf("  (%zu values, %.1f MB exported, %.1f MB hive arena)\n", valueCount,
+        exportStats.bytes / 1048576.0, hive->ArenaBytes() / 1048576.0);
 }
 
-    // Check if registry key exists
-    bool KeyExists(HKEY rootKey, const std::string& keyPath) {
-    HKEY hKey;
-    LONG result = RegOpenKeyEx(rootKey, keyPath.c_str(), 0, KEY_READ, &hKey);
-    if (result == ERROR_SUCCESS) {
-        RegCloseKey(hKey);
-        return true;
+// Check the UTF-16/UTF-8 transcoder on known encodings, malformed UTF-8 and random round trips,
+// then measure its throughput on ASCII, mostly-Latin and CJK text. False if a conversion is wrong.
+bool RunTranscodeBenchmark() {
+    printf("\nUTF-16/UTF-8 transcoding\n");
+
+    struct Sample {
+        std::wstring wide;
+        std::string utf8;
+    };
+    const Sample samples[] = {
+        { L"HKEY_CURRENT_USER\\Software", "HKEY_CURRENT_USER\\Software" },
+        { std::wstring(1, (wchar_t)0xE9), "\xC3\xA9" },
+        { std::wstring(1, (wchar_t)0x20AC), "\xE2\x82\xAC" },
+        { std::wstring({ (wchar_t)0xD83D, (wchar_t)0xDE00 }), "\xF0\x9F\x98\x80" },
+        { std::wstring(1, (wchar_t)0xD800), "\xED\xA0\x80" }, // Unpaired surrogate
+        { std::wstring({ L'a', (wchar_t)0xDC00, L'b' }), "a\xED\xB0\x80" "b" },
+    };
+    bool ok = true;
+    for (const Sample& sample : samples) {
+        if (WideToUtf8(sample.wide.data(), sample.wide.size()) != sample.utf8 || Utf8ToWide(sample.utf8) != sample.wide) {
+            printf("  wrong conversion of \"%s\"\n", sample.utf8.c_str());
+            ok = false;
+        }
     }
-    return false;
-}
 
-    // Update status bar
-    void UpdateStatusBar(const std::string& message) {
-    SetWindowText(hStatusBar, message.c_str());
-}
+    // Every byte that does not start a valid sequence becomes one U+FFFD
+    const Sample malformed[] = {
+        { std::wstring({ L'a', (wchar_t)0xFFFD, L'b' }), "a\x80" "b" },
+        { std::wstring(2, (wchar_t)0xFFFD), "\xC0\xAF" },         // Overlong '/'
+        { std::wstring(3, (wchar_t)0xFFFD), "\xE0\x80\x80" },     // Overlong NUL
+        { std::wstring(2, (wchar_t)0xFFFD), "\xE2\x82" },         // Truncated
+        { std::wstring(4, (wchar_t)0xFFFD), "\xF4\x90\x80\x80" }, // Above U+10FFFF
+    };
+    for (const Sample& sample : malformed) {
+        if (Utf8ToWide(sample.utf8) != sample.wide) {
+            printf("  wrong decoding of malformed UTF-8\n");
+            ok = false;
+        }
+    }
 
-    // Get selected root key from combo box
-    HKEY GetSelectedRootKey() {
-    int index = SendMessage(hComboRootKey, CB_GETCURSEL, 0, 0);
-    if (index >= 0 && index < ROOT_KEYS_COUNT) {
-        return rootKeys[index].hKey;
+    // Random text mixing ASCII runs (which take the vector path) with every other kind of unit
+    uint32_t seed = 0x9E3779B9;
+    auto random = [&seed]() {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return seed;
+    };
+    std::wstring text;
+    for (int round = 0; round < 20000 && ok; round++) {
+        text.resize(random() % 100);
+        uint32_t kinds = round % 2 ? 8 : 64; // Every other text is mostly ASCII
+        for (size_t i = 0; i < text.size(); i++) {
+            uint32_t kind = random() % kinds;
+            if (kind == 6 && i + 1 < text.size()) { // Surrogate pair
+                text[i] = (wchar_t)(0xD800 + random() % 0x400);
+                text[++i] = (wchar_t)(0xDC00 + random() % 0x400);
+                continue;
+            }
+            text[i] = (wchar_t)(kind < 4 || kind > 7 ? 0x20 + random() % 0x5F : kind == 4 ? 0x80 + random() % 0x780 :
+                kind == 5 ? 0xD800 + random() % 0x800 : 0x800 + random() % 0xF800);
+        }
+        std::string utf8 = WideToUtf8(text.data(), text.size());
+        if (Utf8ToWide(utf8) != text) {
+            printf("  round trip failed for random text %d\n", round);
+            ok = false;
+        }
     }
-    return HKEY_CURRENT_USER;
-}
+    if (!ok) return false;
+    printf("  %zu known encodings, %zu malformed inputs and 20000 random round trips correct\n",
+        sizeof(samples) / sizeof(samples[0]), sizeof(malformed) / sizeof(malformed[0]));
 
-    // Get selected key path from edit control
-    std::string GetSelectedKeyPath() {
-    return GetWindowText(hEditKeyPath);
-}
+    struct Corpus {
+        const char* name;
+        std::wstring text;
+    };
+    const size_t units = 16 << 20;
+    Corpus corpora[] = { { "ascii", std::wstring() }, { "latin", std::wstring() }, { "cjk", std::wstring() } };
+    for (size_t i = 0; i < units; i++) {
+        wchar_t ascii = (wchar_t)(i % 64 == 63 ? L'\\' : L'a' + (i * 7) % 26);
+        corpora[0].text += ascii;
+        corpora[1].text += i % 12 == 5 ? (wchar_t)(0xE0 + i % 16) : ascii;
+        corpora[2].text += (wchar_t)(0x4E00 + (i * 131) % 0x5000);
+    }
 
-    // Helper function to get text from window
-    std::string GetWindowText(HWND hwnd) {
-    int length = ::GetWindowTextLength(hwnd);
-    if (length == 0) return "";
+    // Converted into buffers allocated up front, as the .reg writer does
+    std::string utf8(units * 3, '\0');
+    std::wstring wide(units * 3, L'\0');
+    for (Corpus& corpus : corpora) {
+        const int repeats = 8;
+        auto start = std::chrono::steady_clock::now();
+        size_t utf8Length = 0;
+        for (int repeat = 0; repeat < repeats; repeat++) utf8Length = Utf16ToUtf8(corpus.text.data(), corpus.text.size(), &utf8[0]);
+        double narrowMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        start = std::chrono::steady_clock::now();
+        size_t wideLength = 0;
+        for (int repeat = 0; repeat < repeats; repeat++) wideLength = Utf8ToUtf16(utf8.data(), utf8Length, &wide[0]);
+        double widenMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (wideLength != corpus.text.size() || wide.compare(0, wideLength, corpus.text) != 0) {
+            printf("  round trip failed for %s text\n", corpus.name);
+            return false;
+        }
 
-    std::vector<char> buffer(length + 1);
-    ::GetWindowText(hwnd, buffer.data(), length + 1);
-    return std::string(buffer.data());
+        double inputMB = repeats * corpus.text.size() * sizeof(wchar_t) / 1048576.0;
+        double utf8MB = repeats * utf8Length / 1048576.0;
+        printf("  %-6s utf16->utf8 %10.1f ms %8.0f MB/s    utf8->utf16 %10.1f ms %8.0f MB/s\n", corpus.name,
+            narrowMs, narrowMs > 0 ? inputMB * 1000.0 / narrowMs : 0.0, widenMs, widenMs > 0 ? utf8MB * 1000.0 / widenMs : 0.0);
+    }
+    fflush(stdout);
+    return true;
 }
 
-    // Helper function to set text to window
-    void SetWindowText(HWND hwnd, const std::string& text) {
-    ::SetWindowText(hwnd, text.c_str());
-}
\ No newline at end of file
+// --bench [keys=N[,N...]] [depth=D] [fanout=F] [values=V] [valuesize=S]
+int RunBenchmarks(const std::string& arguments) {
+    BenchConfig config;
+    std::vector<size_t> sizes;
+    std::istringstream tokens(arguments);
+    std::string token;
+    while (tokens >> token) {
+        size_t equals = token.find('=');
+        std::string name = token.substr(0, equals);
+        std::string value = equals == std::string::npos ? std::string() : token.substr(equals + 1);
+        if (name == "keys") {
+            std::istringstream list(value);
+            std::string size;
+            while (std::getline(list, size, ',')) sizes.push_back(strtoull(size.c_str(), nullptr, 10));
+        } else if (name == "depth") {
+            config.depth = (unsigned)atoi(value.c_str());
+        } else if (name == "fanout") {
+            config.fanout = std::max(1, atoi(value.c_str()));
+        } else if (name == "values") {
+            config.values = (unsigned)atoi(value.c_str());
+        } else if (name == "valuesize") {
+            config.valueSize = (unsigned)atoi(value.c_str());
+        } else {
+            printf("Unknown benchmark option: %s\n", token.c_str());
+            printf("Usage: --bench [keys=N[,N...]] [depth=D] [fanout=F] [values=V] [valuesize=S]\n");
+            return 1;
+        }
+    }
+    if (sizes.empty()) sizes = { 10000, 1000000 }; // 10M keys needs several GB: pass keys=10000000
+
+    printf("Registry benchmarks over synthetic in-memory hives (%u threads)\n", std::max(1u, std::thread::hardware_concurrency()));
+    countAllocations = true;
+    if (!RunTranscodeBenchmark()) return 1;
+    for (size_t keys : sizes) {
+        config.keys = keys;
+        RunBenchmarkHive(config);
+    }
+    return 0;
+}